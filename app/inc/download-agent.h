@@ -0,0 +1,20 @@
+#ifndef INC_DOWNLOAD_AGENT_H
+#define INC_DOWNLOAD_AGENT_H
+
+#include "common-defines.h"
+
+/*
+ * Receives the next firmware.img into the staging slot while the application
+ * keeps running. Speaks the bootloader's protocol on USART2, so the same host
+ * tools drive it, but answers STAGED instead of SUCCESS; the bootloader
+ * installs the staged image at the next reset. AA BB CC BE instead of the
+ * sync sequence resets straight into the bootloader's update session.
+ */
+
+void download_agent_setup(void);
+void download_agent_update(void);
+
+/* Work left that does not wait on the host: a staging erase or background flash writes */
+bool download_agent_busy(void);
+
+#endif // INC_DOWNLOAD_AGENT_H
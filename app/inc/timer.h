@@ -1,7 +1,22 @@
 #ifndef INC_TIMER_H
 #define INC_TIMER_H
 
+#include "common-defines.h"
+
+/* Duty cycle in 0.01 % steps, integer math only (the M3 has no FPU) */
+#define TIMER_PWM_DUTY_MAX  (10000U)
+
 void timer_setup(void);
-void timer_set_pwm_duty_cycle(float duty_cycle);
+void timer_set_pwm_duty(uint16_t duty);
+uint16_t timer_pwm_duty_to_ccr(uint16_t duty);
+
+/*
+ * Waveform mode: DMA copies the next compare value from `ccr_values` into
+ * TIM2_CCR2 at every update event (1 kHz) and wraps at the end, so the CPU is
+ * not involved per period. Build the table with timer_pwm_duty_to_ccr(); it
+ * must stay valid until timer_pwm_waveform_stop().
+ */
+void timer_pwm_waveform_start(const uint16_t* ccr_values, uint16_t length);
+void timer_pwm_waveform_stop(void);
 
-#endif // INC_TIMER_H
\ No newline at end of file
+#endif // INC_TIMER_H
@@ -0,0 +1,325 @@
+#include "download-agent.h"
+#include "comms.h"
+#include "bl-flash.h"
+#include "bl-staging.h"
+#include "core/uart.h"
+#include "core/crc32.h"
+#include "core/image.h"
+#include "core/memory-map.h"
+#include "core/simple-timer.h"
+#include "core/handoff.h"
+
+#define DEVICE_ID    (0x52)
+
+#define SYNC_SEQ_B0  (0xAA)
+#define SYNC_SEQ_B1  (0xBB)
+#define SYNC_SEQ_B2  (0xCC)
+#define SYNC_SEQ_B3  (0xDD)
+#define ENTER_SYNC_SEQ_B3 (0xBE)   // AA BB CC BE: reset into the bootloader and update from there
+
+#define DEFAULT_TIMEOUT (5000)
+
+#define STAGE_CRC_CHUNK (64U)
+
+typedef enum {
+    DA_State_Sync,
+    DA_State_WaitForUpdateRes,
+    DA_State_DeviceIDRes,
+    DA_State_FwLengthRes,
+    DA_State_EraseStaging,
+    DA_State_RecieveImageHeader,
+    DA_State_RecieveFirmware,
+} da_state_t;
+
+static da_state_t da_state = DA_State_Sync;
+static bool staging_available = false;
+static uint8_t sync_bytes[4] = {0U};
+static uint32_t fw_length = 0;
+static uint32_t bytes_staged = 0;       /* firmware.img received in order so far */
+static uint8_t header_raw[IMAGE_HEADER_MAX_SIZE];
+static image_header_t header;
+static image_segment_t segments[IMAGE_MAX_SEGMENTS];
+static comms_packet_t packet;
+static simple_timer_t simple_timer;
+
+
+static void send_single_byte_packet(uint8_t byte) {
+    comms_create_single_byte_packet(&packet, byte);
+    comms_write(&packet);
+    simple_timer_reset(&simple_timer, 0);
+}
+
+static void send_device_id_req(void) {
+    const uint32_t boot_us = handoff_boot_us();
+
+    comms_create_single_byte_packet(&packet, BL_PACKET_DEVICE_ID_REQ_DATA0);
+    packet.length = BL_DEVICE_ID_REQ_APP_LEN;
+    device_id_encode(&packet.data[1], bl_flash_size(), bl_flash_page_size(), bl_flash_app_size());
+    packet.data[BL_DEVICE_ID_REQ_LEN] = (boot_us >> 24) & 0xFF;
+    packet.data[BL_DEVICE_ID_REQ_LEN + 1] = (boot_us >> 16) & 0xFF;
+    packet.data[BL_DEVICE_ID_REQ_LEN + 2] = (boot_us >> 8) & 0xFF;
+    packet.data[BL_DEVICE_ID_REQ_LEN + 3] = boot_us & 0xFF;
+    packet.crc = comms_packet_crc(&packet);
+    comms_write(&packet);
+    simple_timer_reset(&simple_timer, 0);
+}
+
+static void session_ended(uint8_t result) {
+    send_single_byte_packet(result);
+    da_state = DA_State_Sync;
+}
+
+/* Program firmware.img bytes at their own offset in the slot; replays find their data already there */
+static bool stage_write(uint32_t offset, const uint8_t* data, uint32_t length) {
+    uint8_t staged[COMMS_PACKET_PAYLOAD_MAX_LEN];
+    bool duplicate = true;
+    bool erased = true;
+
+    if (((offset % IMAGE_ALIGN) != 0U) || (length > sizeof(staged)) || (offset + length > fw_length)) {
+        return false;
+    }
+
+    bl_staging_read(offset, staged, length);
+    for (uint32_t i = 0; i < length; i++) {
+        duplicate = duplicate && (staged[i] == data[i]);
+        erased = erased && (staged[i] == 0xFFU);
+    }
+    if (!duplicate && !erased) {
+        return false;
+    }
+    if (!duplicate) {
+        bl_staging_write(offset, data, length);
+    }
+    return true;
+}
+
+static bool image_is_installed(void) {
+    image_header_t installed;
+    image_segment_t installed_segments[IMAGE_MAX_SEGMENTS];
+
+    if (image_parse((const uint8_t *) BL_IMAGE_INFO_ADDRESS, IMAGE_HEADER_MAX_SIZE, &installed, installed_segments) != Image_Status_Ok) {
+        return false;
+    }
+    return (installed.fw_version == header.fw_version) && (installed.build_id == header.build_id);
+}
+
+static void header_received(void) {
+    const uint16_t header_size = (bytes_staged >= IMAGE_ALIGN) ? image_peek_header_size(header_raw) : IMAGE_HEADER_MAX_SIZE;
+
+    if ((header_size < IMAGE_HEADER_LEN) || (header_size > IMAGE_HEADER_MAX_SIZE)) {
+        session_ended(BL_PACKET_FW_UPDATE_FAILED_DATA0);
+    }
+    else if (bytes_staged < header_size) {
+        send_single_byte_packet(BL_PACKET_READY_FOR_DATA_DATA0);
+    }
+    else if ((image_parse(header_raw, header_size, &header, segments) != Image_Status_Ok) ||
+             !(header.flags & IMAGE_FLAG_SIGNED) ||
+             (header.header_size + header.image_size != fw_length))
+    {
+        session_ended(BL_PACKET_FW_UPDATE_FAILED_DATA0);
+    }
+    else if (image_is_installed()) {
+        session_ended(BL_PACKET_FW_UP_TO_DATE_DATA0);
+    }
+    else {
+        da_state = DA_State_RecieveFirmware;
+        send_single_byte_packet(BL_PACKET_READY_FOR_DATA_DATA0);
+    }
+}
+
+static uint32_t staged_payload_crc(void) {
+    uint8_t chunk[STAGE_CRC_CHUNK];
+    uint32_t crc = CRC32_INITIAL_VALUE;
+
+    for (uint32_t offset = 0; offset < header.image_size; offset += STAGE_CRC_CHUNK) {
+        const uint32_t length = (header.image_size - offset < STAGE_CRC_CHUNK) ? (header.image_size - offset) : STAGE_CRC_CHUNK;
+        bl_staging_read(header.header_size + offset, chunk, length);
+        crc = crc32_update(crc, chunk, length);
+    }
+    return crc;
+}
+
+static void image_staged(void) {
+    // Encrypted payloads are checked by the bootloader, which holds the key, before it installs them
+    if (!(header.flags & IMAGE_FLAG_ENCRYPTED) && (staged_payload_crc() != header.image_crc)) {
+        session_ended(BL_PACKET_FW_UPDATE_FAILED_DATA0);
+        return;
+    }
+
+    image_staged_t trailer = {
+        .state = IMAGE_STAGED_READY,
+        .length = fw_length,
+        .header_crc = header.header_crc,
+        .reserved = 0xFFFFFFFFU,
+    };
+    bl_staging_write_trailer(&trailer);
+    session_ended(BL_PACKET_FW_STAGED_DATA0);
+}
+
+static void firmware_received(void) {
+    const uint32_t payload_len = comms_packet_payload_len(&packet);
+
+    if (packet.addressed) {
+        // Addressed frames may skip erased regions, arrive out of order or be replayed
+        if ((packet.offset + payload_len > header.image_size) ||
+            !stage_write(header.header_size + packet.offset, packet.data, payload_len))
+        {
+            session_ended(BL_PACKET_FW_UPDATE_FAILED_DATA0);
+        }
+        else {
+            send_single_byte_packet(BL_PACKET_READY_FOR_DATA_DATA0);
+        }
+    }
+    else if (comms_is_single_byte_packet(&packet, BL_PACKET_FW_WRITE_DONE_DATA0)) {
+        image_staged();
+    }
+    else {
+        const uint32_t length = (fw_length - bytes_staged < payload_len) ? (fw_length - bytes_staged) : payload_len;
+        if (!stage_write(bytes_staged, packet.data, length)) {
+            session_ended(BL_PACKET_FW_UPDATE_FAILED_DATA0);
+            return;
+        }
+
+        bytes_staged += length;
+        if (bytes_staged >= fw_length) {
+            image_staged();
+        }
+        else {
+            // Returns a credit to a streaming host
+            send_single_byte_packet(BL_PACKET_READY_FOR_DATA_DATA0);
+        }
+    }
+}
+
+static void packet_received(void) {
+    switch (da_state) {
+    case DA_State_WaitForUpdateRes: {
+        if (comms_is_single_byte_packet(&packet, BL_PACKET_FW_UPDATE_RES_DATA0)) {
+            send_device_id_req();
+            da_state = DA_State_DeviceIDRes;
+        }
+    } break;
+
+    case DA_State_DeviceIDRes: {
+        if ((packet.length == 2) &&
+            (packet.data[0] == BL_PACKET_DEVICE_ID_RES_DATA0) &&
+            (packet.data[1] == DEVICE_ID) &&
+            (packet.crc == comms_packet_crc(&packet)))
+        {
+            send_single_byte_packet(BL_PACKET_FW_LENGTH_REQ_DATA0);
+            da_state = DA_State_FwLengthRes;
+        }
+    } break;
+
+    case DA_State_FwLengthRes: {
+        if ((packet.length == 5) && (packet.data[0] == BL_PACKET_FW_LENGTH_RES_DATA0)) {
+            fw_length = (packet.data[1] << 24) | (packet.data[2] << 16) | (packet.data[3] << 8) | (packet.data[4]);
+            if (!staging_available || (fw_length > bl_staging_capacity())) {
+                session_ended(BL_PACKET_FW_UPDATE_FAILED_DATA0);
+                break;
+            }
+
+            // Erased one page or sector per update; nothing is in flight until READY
+            bl_staging_erase_begin(fw_length);
+            bytes_staged = 0;
+            da_state = DA_State_EraseStaging;
+        }
+    } break;
+
+    case DA_State_RecieveImageHeader: {
+        if ((bytes_staged >= IMAGE_HEADER_MAX_SIZE) || !stage_write(bytes_staged, packet.data, COMMS_PACKET_PAYLOAD_LEN)) {
+            session_ended(BL_PACKET_FW_UPDATE_FAILED_DATA0);
+            break;
+        }
+        for (uint8_t i = 0; i < COMMS_PACKET_PAYLOAD_LEN; i++) {
+            header_raw[bytes_staged + i] = packet.data[i];
+        }
+        bytes_staged += COMMS_PACKET_PAYLOAD_LEN;
+        header_received();
+    } break;
+
+    case DA_State_RecieveFirmware: {
+        firmware_received();
+    } break;
+
+    default: {
+        da_state = DA_State_Sync;
+    } break;
+    }
+}
+
+
+void download_agent_setup(void) {
+    staging_available = bl_staging_setup();
+    comms_setup();
+    simple_timer_setup(&simple_timer, DEFAULT_TIMEOUT, false);
+}
+
+
+void download_agent_update(void) {
+    // Staging writes to bank 2 of XL-density parts complete in the background
+    bl_flash_update();
+
+    if (da_state == DA_State_Sync) {
+        while (uart_data_available()) {
+            sync_bytes[0] = sync_bytes[1];
+            sync_bytes[1] = sync_bytes[2];
+            sync_bytes[2] = sync_bytes[3];
+            sync_bytes[3] = uart_read_byte();
+
+            if ((sync_bytes[0] == SYNC_SEQ_B0) &&
+                (sync_bytes[1] == SYNC_SEQ_B1) &&
+                (sync_bytes[2] == SYNC_SEQ_B2) &&
+                (sync_bytes[3] == SYNC_SEQ_B3))
+            {
+                // Everything after the sync sequence belongs to comms; drop what an aborted session left queued
+                sync_bytes[3] = 0U;
+                while (comms_packets_available()) {
+                    comms_read(&packet);
+                }
+                send_single_byte_packet(BL_PACKET_SEQ_OBSERVED_DATA0);
+                send_single_byte_packet(BL_PACKET_FW_UPDATE_REQ_DATA0);
+                da_state = DA_State_WaitForUpdateRes;
+                break;
+            }
+            else if ((sync_bytes[0] == SYNC_SEQ_B0) &&
+                     (sync_bytes[1] == SYNC_SEQ_B1) &&
+                     (sync_bytes[2] == SYNC_SEQ_B2) &&
+                     (sync_bytes[3] == ENTER_SYNC_SEQ_B3))
+            {
+                // The bootloader answers this host as soon as it is out of reset
+                bl_flash_flush();
+                handoff_enter_bootloader();
+            }
+        }
+        return;
+    }
+
+    if (simple_timer_has_elapsed(&simple_timer)) {
+        session_ended(BL_PACKET_FW_UPDATE_FAILED_DATA0);
+        return;
+    }
+
+    if (da_state == DA_State_EraseStaging) {
+        if (bl_staging_erase_continue()) {
+            da_state = DA_State_RecieveImageHeader;
+            send_single_byte_packet(BL_PACKET_READY_FOR_DATA_DATA0);
+        }
+        return;
+    }
+
+    while (uart_data_available()) {
+        comms_update();
+    }
+
+    // The host streams ahead on ACK credits, so handle every queued packet
+    while ((da_state != DA_State_Sync) && comms_packets_available()) {
+        comms_read(&packet);
+        packet_received();
+    }
+}
+
+
+bool download_agent_busy(void) {
+    return (da_state == DA_State_EraseStaging) || bl_flash_busy();
+}
@@ -1,15 +1,17 @@
 #include "common-defines.h"
 #include "core/system.h"
 #include "core/uart.h"
+#include "core/memory-map.h"
+#include "core/handoff.h"
+#include "core/scheduler.h"
 #include "timer.h"
+#include "download-agent.h"
 
 
 #include <libopencm3/stm32/gpio.h>
 #include <libopencm3/stm32/rcc.h>
 #include <libopencm3/cm3/scb.h>
 
-#define BOOTLOADER_SIZE (0x6000)
-
 #define LED_PORT (GPIOC) 
 #define LED_PIN  (GPIO13) 
 
@@ -20,48 +22,101 @@
 #define USART_TX_PIN (GPIO_USART2_TX)
 #define USART_RX_PIN (GPIO_USART2_RX)
 
+#define LED_PERIOD_MS    (1000U)
+#define LED_TICK_MS      (100U)
+#define LED_UPDATED_BLINKS (10U)    // Fast toggles after the bootloader installed this image
+#define PWM_RAMP_LENGTH  (1000U)    // Compare values, one per 1 ms PWM period: 0 to 100 % and back each second
+#define UPDATE_PERIOD_MS (10U)      // Session timeouts; received bytes post the task right away
+
+/* What the bootloader left us (clock, reset cause, update result); NULL after a cold start without one */
+static const handoff_t* boot_handoff = NULL;
+static scheduler_task_id_t update_task_id = SCHEDULER_NO_TASK;
+static uint32_t led_blinks = 0;
+static uint32_t led_ticks = 0;
+static uint16_t pwm_ramp[PWM_RAMP_LENGTH];
+
 static void vector_setup(void) {
     SCB_VTOR = BOOTLOADER_SIZE;
 }
 
 static void gpio_setup(void) {
-    rcc_periph_clock_enable(RCC_GPIOC);   // For GPIO
-    rcc_periph_clock_enable(RCC_GPIOA);   // For UART, PWM
-    rcc_periph_clock_enable(RCC_AFIO);    // For UART
-    
-    gpio_set_mode(LED_PORT, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_PUSHPULL, LED_PIN);               // PC13 -> GPIO
+    // The bootloader leaves the port clocks on and the LED and USART2 pins set up
+    if (!boot_handoff) {
+        rcc_periph_clock_enable(RCC_GPIOC);   // For GPIO
+        rcc_periph_clock_enable(RCC_GPIOA);   // For UART, PWM
+        rcc_periph_clock_enable(RCC_AFIO);    // For UART
+
+        gpio_set_mode(LED_PORT, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_PUSHPULL, LED_PIN);               // PC13 -> GPIO
+        gpio_set_mode(USART_PORT, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_ALTFN_PUSHPULL, USART_TX_PIN);  // PA2 -> Tx
+        gpio_set_mode(USART_PORT, GPIO_MODE_INPUT, GPIO_CNF_INPUT_FLOAT, USART_RX_PIN);                    // PA3 -> Rx
+    }
     gpio_set_mode(PWM_OUT_PORT, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_ALTFN_PUSHPULL, PWM_OUT_PIN); // PA1 -> PWM
-    gpio_set_mode(USART_PORT, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_ALTFN_PUSHPULL, USART_TX_PIN);  // PA2 -> Tx
-    gpio_set_mode(USART_PORT, GPIO_MODE_INPUT, GPIO_CNF_INPUT_FLOAT, USART_RX_PIN);                    // PA3 -> Rx
+}
+
+/* The profile the bootloader left running, so system_setup() keeps the PLL as it is */
+static system_clock_t boot_clock(void) {
+    const system_clock_t clock = boot_handoff ? system_clock_at(boot_handoff->ahb_hz) : System_Clock_Count;
+    return (clock < System_Clock_Count) ? clock : SYSTEM_CLOCK_APP;
+}
+
+
+/* Steady 1 s toggle, after a burst of fast ones when this image was just installed */
+static void led_task(void) {
+    if (led_blinks > 0U) {
+        led_blinks--;
+        gpio_toggle(LED_PORT, LED_PIN);
+    }
+    else if (++led_ticks == (LED_PERIOD_MS / LED_TICK_MS)) {
+        led_ticks = 0;
+        gpio_toggle(LED_PORT, LED_PIN);
+    }
+}
+
+/* Triangle ramp for the waveform mode, played by DMA without a task */
+static void pwm_ramp_setup(void) {
+    const uint32_t half = PWM_RAMP_LENGTH / 2U;
+
+    for (uint32_t i = 0; i < PWM_RAMP_LENGTH; i++) {
+        const uint32_t step = (i < half) ? i : (PWM_RAMP_LENGTH - i);
+        pwm_ramp[i] = timer_pwm_duty_to_ccr((uint16_t) ((step * TIMER_PWM_DUTY_MAX) / half));
+    }
+}
+
+/* Owns the UART: receives the next firmware into the staging slot */
+static void update_task(void) {
+    download_agent_update();
+    if (download_agent_busy()) {
+        scheduler_post(update_task_id);
+    }
+}
+
+static void uart_received(void) {
+    scheduler_post(update_task_id);
 }
 
 
 int main(void) {
+    // First, so handoff_boot_us() spans only the jump and our startup code
+    boot_handoff = handoff_take();
     vector_setup();
-    system_setup();
+    system_setup(boot_clock());
     gpio_setup();
     timer_setup();
-    uart_setup();
-
-    float duty_cycle = 0.0;
-    timer_set_pwm_duty_cycle(duty_cycle);
-
-    while (1) {
-        /* GPIO Task */
-        gpio_toggle(LED_PORT, LED_PIN);
+    uart_setup(false, boot_handoff ? boot_handoff->baud_rate : UART_DEFAULT_BAUD_RATE);   // No RTS/CTS, PA1 is the PWM output
+    download_agent_setup();
 
-        /* PWM Task */
-        duty_cycle = (duty_cycle < 100.0) ?(duty_cycle + 10.0) :0;
-        timer_set_pwm_duty_cycle(duty_cycle);
+    if (boot_handoff && ((boot_handoff->update_result == Handoff_Update_Installed) ||
+                         (boot_handoff->update_result == Handoff_Update_StagedInstalled))) {
+        led_blinks = LED_UPDATED_BLINKS;
+    }
 
-        /* UART Task */
-        while (uart_data_available()) {
-            uart_write_byte(uart_read_byte());
-        }
+    pwm_ramp_setup();
+    timer_pwm_waveform_start(pwm_ramp, PWM_RAMP_LENGTH);
 
-        /* Delay */
-        system_delay_ms(1000);
-    }
+    // The update task goes first, the UART ring is what must not overflow
+    update_task_id = scheduler_add(update_task, UPDATE_PERIOD_MS);
+    scheduler_add(led_task, LED_TICK_MS);
+    uart_set_rx_callback(uart_received);
 
-    return 0;
+    scheduler_run();
 }
\ No newline at end of file
@@ -1,13 +1,31 @@
 #include "timer.h"
 #include <libopencm3/stm32/timer.h>
 #include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/dma.h>
+#include "core/system.h"
 
-//   24_000_000  Hz
-//   final_freq = (system_freq / prescaler)  / arr
+//   final_freq = (timer_clock / prescaler) / arr = 1 kHz; the prescaler follows the clock profile
 
-#define PRESCALER     (24)
+#define TICK_FREQ     (1000000U)
 #define ARR_VALUE     (1000)
 
+// ccr = duty * ARR_VALUE / TIMER_PWM_DUTY_MAX, as a rounded Q16 factor so no division is left at runtime
+#define DUTY_TO_CCR_Q16 ((((uint32_t) ARR_VALUE << 16) + (TIMER_PWM_DUTY_MAX / 2U)) / TIMER_PWM_DUTY_MAX)
+
+// TIM2_CH2's DMA request (RM0008 table 78); shared with USART2_TX, which the application sends without DMA
+#define WAVEFORM_DMA_CHANNEL (DMA_CHANNEL7)
+
+
+static void set_prescaler(void) {
+    timer_set_prescaler(TIM2, (rcc_get_timer_clk_freq(TIM2) / TICK_FREQ) - 1U);
+}
+
+/* PSC is preloaded, so the new tick rate starts with the next PWM period */
+static void clock_changed(system_clock_event_t event) {
+    if (event == System_Clock_Changed) {
+        set_prescaler();
+    }
+}
 
 void timer_setup(void) {
     rcc_periph_clock_enable(RCC_TIM2);
@@ -15,22 +33,53 @@ void timer_setup(void) {
     // High level timer configuration
     timer_set_mode(TIM2, TIM_CR1_CKD_CK_INT, TIM_CR1_CMS_EDGE, TIM_CR1_DIR_UP);
 
-    // Set timer PWM mode
+    // Set timer PWM mode; preloaded, so a new compare value starts with the next period
     timer_set_oc_mode(TIM2, TIM_OC2, TIM_OCM_PWM1);
+    timer_enable_oc_preload(TIM2, TIM_OC2);
 
     // Enable PWM
     timer_enable_counter(TIM2);
     timer_enable_oc_output(TIM2, TIM_OC2);
 
 
-    timer_set_prescaler(TIM2, (PRESCALER-1));
+    set_prescaler();
     timer_set_period(TIM2, (ARR_VALUE-1));
+    system_on_clock_change(clock_changed);
 }
 
-void timer_set_pwm_duty_cycle(float duty_cycle) {
-    // duty_cycle = (ccr/arr) * 100
-    // ccr = (duty_cycle/100) * arr
+uint16_t timer_pwm_duty_to_ccr(uint16_t duty) {
+    if (duty > TIMER_PWM_DUTY_MAX) {
+        duty = TIMER_PWM_DUTY_MAX;
+    }
+    return (uint16_t) ((duty * DUTY_TO_CCR_Q16) >> 16);
+}
+
+void timer_set_pwm_duty(uint16_t duty) {
+    timer_set_oc_value(TIM2, TIM_OC2, timer_pwm_duty_to_ccr(duty));
+}
+
+void timer_pwm_waveform_start(const uint16_t* ccr_values, uint16_t length) {
+    timer_pwm_waveform_stop();
+    rcc_periph_clock_enable(RCC_DMA1);
+
+    dma_channel_reset(DMA1, WAVEFORM_DMA_CHANNEL);
+    dma_set_peripheral_address(DMA1, WAVEFORM_DMA_CHANNEL, (uint32_t) &TIM_CCR2(TIM2));
+    dma_set_memory_address(DMA1, WAVEFORM_DMA_CHANNEL, (uint32_t) ccr_values);
+    dma_set_number_of_data(DMA1, WAVEFORM_DMA_CHANNEL, length);
+    dma_set_read_from_memory(DMA1, WAVEFORM_DMA_CHANNEL);
+    dma_enable_memory_increment_mode(DMA1, WAVEFORM_DMA_CHANNEL);
+    dma_set_peripheral_size(DMA1, WAVEFORM_DMA_CHANNEL, DMA_CCR_PSIZE_16BIT);
+    dma_set_memory_size(DMA1, WAVEFORM_DMA_CHANNEL, DMA_CCR_MSIZE_16BIT);
+    dma_set_priority(DMA1, WAVEFORM_DMA_CHANNEL, DMA_CCR_PL_LOW);
+    dma_enable_circular_mode(DMA1, WAVEFORM_DMA_CHANNEL);
+    dma_enable_channel(DMA1, WAVEFORM_DMA_CHANNEL);
+
+    // The CC2 DMA request on the update event instead of the compare match: one value per period
+    timer_set_dma_on_update_event(TIM2);
+    timer_enable_irq(TIM2, TIM_DIER_CC2DE);
+}
 
-    const float raw_value = (float)ARR_VALUE * (duty_cycle/100);
-    timer_set_oc_value(TIM2, TIM_OC2, (uint32_t) raw_value);
+void timer_pwm_waveform_stop(void) {
+    timer_disable_irq(TIM2, TIM_DIER_CC2DE);
+    dma_disable_channel(DMA1, WAVEFORM_DMA_CHANNEL);
 }
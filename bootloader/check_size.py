@@ -0,0 +1,24 @@
+import re
+import subprocess
+import sys
+
+MEMORY_MAP_HEADER   = "../shared/inc/core/memory-map.h"
+BOOTLOADER_ELF_FILE = "bootloader.elf"
+SIZE                = sys.argv[1] if len(sys.argv) > 1 else "arm-none-eabi-size"
+
+with open(MEMORY_MAP_HEADER, "r") as f:
+    memory_map = f.read()
+BOOTLOADER_SIZE = int(re.search(r"#define\s+BOOTLOADER_SIZE\s+\((0x[0-9A-Fa-f]+)\)", memory_map).group(1), 16)
+BL_METADATA_SIZE = int(re.search(r"#define\s+BL_METADATA_SIZE\s+\((0x[0-9A-Fa-f]+)\)", memory_map).group(1), 16)
+
+# The code region ends where the metadata pages start (bootloader_rom in memory-map.ld.S)
+ROM_SIZE = BOOTLOADER_SIZE - BL_METADATA_SIZE
+
+# "   text    data     bss     dec     hex filename": text and the initial values of data are in flash
+output = subprocess.run([SIZE, BOOTLOADER_ELF_FILE], check=True, capture_output=True, text=True).stdout
+text, data = (int(field) for field in output.splitlines()[1].split()[:2])
+used = text + data
+
+print(f"{BOOTLOADER_ELF_FILE}: {used} of {ROM_SIZE} bytes ({100 * used / ROM_SIZE:.1f}%), text {text}, data {data}")
+if used > ROM_SIZE:
+    sys.exit(f"{BOOTLOADER_ELF_FILE} is {used - ROM_SIZE} bytes over the {ROM_SIZE} byte bootloader region")
@@ -0,0 +1,31 @@
+#ifndef INC_BL_BENCH_H
+#define INC_BL_BENCH_H
+
+#include "common-defines.h"
+
+/*
+ * What AES-CTR decryption costs per 16 byte frame, in DWT cycles, against the
+ * time that frame takes on the wire: 10 bits a byte at BL_BENCH_BAUD_RATE,
+ * 173.6 us at 921600 baud, of which decryption may take
+ * BL_BENCH_BUDGET_PERCENT. Bootloaders built with BENCH_AES=1 send the report
+ * over USART2 at startup; 'make -C host bench' runs the same code on the host.
+ */
+
+#define BL_BENCH_BAUD_RATE      (921600U)
+#define BL_BENCH_BUDGET_PERCENT (10U)
+#define BL_BENCH_REPORT_LEN     (160U)
+
+typedef struct {
+    uint32_t cycles;            /* per frame, averaged */
+    uint32_t ahb_hz;
+    uint32_t frame_ns;          /* those cycles at ahb_hz */
+    uint32_t wire_ns;
+    uint32_t budget_ns;
+} bl_bench_aes_t;
+
+void bl_bench_aes(bl_bench_aes_t* result);
+
+/* One CRLF terminated line into `line` (BL_BENCH_REPORT_LEN bytes), returns its length */
+uint32_t bl_bench_format(const bl_bench_aes_t* result, char* line);
+
+#endif /* INC_BL_BENCH_H */
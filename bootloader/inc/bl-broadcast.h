@@ -0,0 +1,28 @@
+#ifndef INC_BL_BROADCAST_H
+#define INC_BL_BROADCAST_H
+
+#include "common-defines.h"
+#include "comms.h"
+
+/* Frames in a NACK reply bitmap: [NACK][addr hi][addr lo][status][first hi][first lo][10 bitmap bytes] */
+#define BL_BROADCAST_NACK_BITMAP_LEN    (10U)
+#define BL_BROADCAST_NACK_FRAMES        (BL_BROADCAST_NACK_BITMAP_LEN * 8U)
+#define BL_BROADCAST_NONE_MISSING       (0xFFFFU)
+
+typedef enum {
+    BL_Broadcast_Status_NotTarget,
+    BL_Broadcast_Status_NoHeader,
+    BL_Broadcast_Status_Receiving,
+    BL_Broadcast_Status_UpToDate,
+    BL_Broadcast_Status_Success,
+    BL_Broadcast_Status_Failed,
+} bl_broadcast_status_t;
+
+void bl_broadcast_reset(void);
+void bl_broadcast_begin(bool device_class_matches, uint32_t fw_length);
+void bl_broadcast_frame(comms_packet_t* frame);
+void bl_broadcast_end(void);
+bl_broadcast_status_t bl_broadcast_status(void);
+void bl_broadcast_create_nack(comms_packet_t* packet, uint16_t from_seq);
+
+#endif /* INC_BL_BROADCAST_H */
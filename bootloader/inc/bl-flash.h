@@ -3,7 +3,20 @@
 
 #include "common-defines.h"
 
-void bl_flash_erase_main_application(void);
+#define FLASH_PAGE_SIZE (1024U)    // Smallest page in the family; bl_flash_page_size() is this part's
+
+/* Geometry of the part we run on, from the flash size register and the device ID */
+uint32_t bl_flash_size(void);
+uint32_t bl_flash_page_size(void);
+uint32_t bl_flash_app_size(void);       // Application region this part has room for, at most APP_MAX_SIZE
+
+void bl_flash_erase_region(uint32_t address, uint32_t length);
 void bl_flash_write(uint32_t address, uint8_t* data, uint32_t length);
 
+/* Bank 2 of XL-density parts is erased and programmed in the background;
+ * call bl_flash_update() from the main loop and flush before reading it back */
+void bl_flash_update(void);
+bool bl_flash_busy(void);
+void bl_flash_flush(void);
+
 #endif /* INC_BL_FLASH_H */
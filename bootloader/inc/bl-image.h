@@ -0,0 +1,39 @@
+#ifndef INC_BL_IMAGE_H
+#define INC_BL_IMAGE_H
+
+#include "common-defines.h"
+#include "core/image.h"
+
+typedef enum {
+    BL_Image_Header_Incomplete,
+    BL_Image_Header_Complete,
+    BL_Image_Header_Invalid,
+} bl_image_header_state_t;
+
+typedef enum {
+    BL_Image_Write_Ok,
+    BL_Image_Write_Duplicate,   // Same data already programmed there, nothing written
+    BL_Image_Write_Rejected,    // Outside the payload, unaligned, or over different programmed data
+} bl_image_write_status_t;
+
+void bl_image_reset(void);
+bl_image_header_state_t bl_image_header_append(const uint8_t* data, uint32_t length);
+const image_header_t* bl_image_header(void);
+
+bool bl_image_is_installed(void);
+void bl_image_erase_application(void);
+void bl_image_begin_install(void);
+uint32_t bl_image_resume_offset(void);
+void bl_image_resume_install(uint32_t offset);
+void bl_image_discard_progress(void);
+bl_image_write_status_t bl_image_write(uint32_t offset, uint8_t* data, uint32_t length);
+bool bl_image_verify(void);
+void bl_image_commit(void);
+
+bool bl_image_app_is_bootable(void);
+
+/* A/B updates: image downloaded into the staging slot by the application */
+bool bl_image_staged_pending(void);
+bool bl_image_install_staged(void);
+
+#endif /* INC_BL_IMAGE_H */
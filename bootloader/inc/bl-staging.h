@@ -0,0 +1,30 @@
+#ifndef INC_BL_STAGING_H
+#define INC_BL_STAGING_H
+
+#include "common-defines.h"
+#include "core/image.h"
+
+/*
+ * Staging slot for A/B updates, addressed by firmware.img offset. Internal
+ * flash above the application by default, external SPI NOR in SPI_STAGING=1
+ * builds. Linked by the application's download agent (writes) and the
+ * bootloader (installs).
+ */
+
+bool bl_staging_setup(void);
+uint32_t bl_staging_capacity(void);     // Largest firmware.img the slot takes
+bool bl_staging_is_busy(void);
+
+/* Erase in steps so the application keeps running; call _continue until it returns true */
+void bl_staging_erase_begin(uint32_t length);
+bool bl_staging_erase_continue(void);
+
+void bl_staging_write(uint32_t offset, const uint8_t* data, uint32_t length);
+void bl_staging_read(uint32_t offset, uint8_t* data, uint32_t length);
+void bl_staging_read_start(uint32_t offset, uint8_t* data, uint32_t length);  // Done once !bl_staging_is_busy()
+
+bool bl_staging_read_trailer(image_staged_t* trailer);     // True for a READY image that fits
+void bl_staging_write_trailer(const image_staged_t* trailer);
+void bl_staging_mark_done(void);
+
+#endif /* INC_BL_STAGING_H */
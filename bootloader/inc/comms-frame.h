@@ -0,0 +1,113 @@
+#ifndef INC_COMMS_FRAME_H
+#define INC_COMMS_FRAME_H
+
+#include "common-defines.h"
+#include "core/reed-solomon.h"
+
+/*
+ * Wire format of comms packets and frames. comms.c and the host library
+ * (host/src/bl-host.c) both encode and parse through this file, so the two
+ * ends cannot drift apart.
+ */
+
+#define COMMS_PACKET_DATALEN_LEN (1U)
+#define COMMS_PACKET_PAYLOAD_LEN (16U)
+#define COMMS_PACKET_CRC_LEN     (1U)
+#define COMMS_PACKET_FULL_LEN    (COMMS_PACKET_DATALEN_LEN + COMMS_PACKET_PAYLOAD_LEN + COMMS_PACKET_CRC_LEN)
+
+/* Large data frames: a length byte of 32 or 64 means a full payload of that many bytes.
+ * Control packets keep the 16 byte payload. */
+#define COMMS_PACKET_PAYLOAD_MAX_LEN (64U)
+
+/* FEC frames set this bit in the length byte and append Reed-Solomon parity over everything
+ * before it: [len | 0x80][payload][crc8][4 parity bytes]. Up to two corrupted bytes are fixed
+ * in place, the CRC still decides whether the frame is accepted. */
+#define COMMS_FEC_FLAG           (0x80U)
+
+#define COMMS_RETX_PACKET_DATA0 (0x15U)
+#define COMMS_ACK_PACKET_DATA0  (0x19U)
+
+/* ACK: [3][0x19][credits][max payload] -- free receive slots after queueing the acknowledged
+ * packet, and the largest data frame the receiver currently wants given its CRC failure rate */
+#define COMMS_ACK_PACKET_LEN      (3U)
+#define COMMS_ACK_CREDITS_INDEX   (1U)
+#define COMMS_ACK_MAX_PAYLOAD_INDEX (2U)
+
+/* Broadcast data frames replace the length byte with this tag:
+ * [tag][seq hi][seq lo][16 byte payload][crc8 over the preceding 19 bytes].
+ * They are never acknowledged. */
+#define COMMS_BCAST_FRAME_TAG   (0xB5U)
+#define COMMS_BCAST_SEQ_LEN     (2U)
+
+/* Addressed data frames carry their own payload offset, so they may arrive in any order,
+ * skip regions or be replayed: [tag][size 16/32/64][offset, 24 bit big endian][payload]
+ * [crc8 over everything before it]. The FEC flag applies to the tag as to a length byte. */
+#define COMMS_ADDR_FRAME_TAG    (0x5AU)
+#define COMMS_ADDR_HEADER_LEN   (5U)
+
+/* Longest frame on the wire: an addressed 64 byte frame with FEC parity */
+#define COMMS_FRAME_MAX_LEN     (COMMS_ADDR_HEADER_LEN + COMMS_PACKET_PAYLOAD_MAX_LEN + COMMS_PACKET_CRC_LEN + RS_PARITY_LEN)
+
+/* Frame size adaption: shrink after this many CRC failures (retransmits, on the host) in the last
+ * window of packets, grow after a whole window without one */
+#define COMMS_LINK_WINDOW             (32U)
+#define COMMS_LINK_SHRINK_FAILURES    (4U)
+
+typedef struct {
+    uint8_t length;
+    uint8_t data[COMMS_PACKET_PAYLOAD_MAX_LEN];
+    uint8_t crc;
+    uint16_t seq;       /* Broadcast frames only, not part of the wire packet */
+    bool addressed;     /* Addressed frames only: length is the payload size, offset its target */
+    uint32_t offset;
+} comms_packet_t;
+
+typedef enum {
+    CommsFrame_State_DataLen_En,
+    CommsFrame_State_Header_En,
+    CommsFrame_State_Payload_En,
+    CommsFrame_State_CRC_En,
+    CommsFrame_State_Parity_En,
+} comms_frame_state_t;
+
+/* Byte-at-a-time parser; packet holds the frame once comms_frame_parse() returns true */
+typedef struct {
+    comms_frame_state_t state;
+    comms_packet_t packet;
+    uint8_t header[COMMS_ADDR_HEADER_LEN - COMMS_PACKET_DATALEN_LEN];
+    uint8_t header_bytes_read;
+    uint8_t header_bytes_len;
+    uint8_t data_bytes_read;
+    bool fec;
+    uint8_t parity[RS_PARITY_LEN];
+    uint8_t parity_bytes_read;
+} comms_frame_parser_t;
+
+/* CRC failure history that picks the data frame size, see COMMS_LINK_WINDOW */
+typedef struct {
+    uint32_t history;
+    uint8_t samples;
+    uint8_t max_payload;
+} comms_link_t;
+
+/* Encoding; rs_setup() must have run before comms_frame_add_fec() */
+uint8_t comms_frame_header(const comms_packet_t* packet, uint8_t* header);
+uint8_t comms_packet_crc(const comms_packet_t* packet);
+uint32_t comms_frame_encode(const comms_packet_t* packet, uint8_t* frame);
+uint32_t comms_frame_add_fec(uint8_t* frame, uint32_t length);
+
+/* Parsing; FEC frames are corrected before they are returned, the CRC is left to the caller */
+void comms_frame_parser_reset(comms_frame_parser_t* parser);
+bool comms_frame_parse(comms_frame_parser_t* parser, uint8_t byte);
+
+void comms_link_reset(comms_link_t* link);
+bool comms_link_record(comms_link_t* link, bool failed);
+
+/* Comms Utils */
+uint8_t comms_packet_payload_len(const comms_packet_t* packet);
+void comms_packet_copy(const comms_packet_t* source, comms_packet_t* dest);
+bool comms_is_single_byte_packet(const comms_packet_t* packet, uint8_t byte);
+void comms_create_single_byte_packet(comms_packet_t* packet, uint8_t byte);
+
+
+#endif /* INC_COMMS_FRAME_H */
@@ -2,15 +2,16 @@
 #define INC_COMMS_H
 
 #include "common-defines.h"
+#include "core/uart.h"
+#include "comms-frame.h"
+#include "core/device-id.h"
 
 
-#define COMMS_PACKET_DATALEN_LEN (1U)
-#define COMMS_PACKET_PAYLOAD_LEN (16U)
-#define COMMS_PACKET_CRC_LEN     (1U)
-#define COMMS_PACKET_FULL_LEN    (COMMS_PACKET_DATALEN_LEN + COMMS_PACKET_PAYLOAD_LEN + COMMS_PACKET_CRC_LEN)
-
-#define COMMS_RETX_PACKET_DATA0 (0x15U)
-#define COMMS_ACK_PACKET_DATA0  (0x19U)
+/* DEVICE_ID_REQ: [0x31][core/device-id.h fields], so the host can check the image fits before it starts */
+#define BL_DEVICE_ID_REQ_LEN    (1U + DEVICE_ID_FIELDS_LEN)
+/* The application's download agent appends how long it took from the bootloader's jump to its main(), in
+ * microseconds, 32 bit big endian, 0 when it started without a handoff */
+#define BL_DEVICE_ID_REQ_APP_LEN (BL_DEVICE_ID_REQ_LEN + 4U)
 
 #define BL_PACKET_SEQ_OBSERVED_DATA0            (0x23U)
 #define BL_PACKET_FW_UPDATE_REQ_DATA0           (0x25U)
@@ -22,12 +23,14 @@
 #define BL_PACKET_READY_FOR_DATA_DATA0          (0x39U)
 #define BL_PACKET_FW_UPDATE_SUCCESS_DATA0       (0x41U)
 #define BL_PACKET_FW_UPDATE_FAILED_DATA0        (0x42U)
-
-typedef struct {
-    uint8_t length;
-    uint8_t data[COMMS_PACKET_PAYLOAD_LEN];
-    uint8_t crc;
-} comms_packet_t;
+#define BL_PACKET_FW_UP_TO_DATE_DATA0           (0x43U)
+#define BL_PACKET_FW_RESUME_DATA0               (0x44U)
+#define BL_PACKET_BCAST_BEGIN_DATA0             (0x45U)
+#define BL_PACKET_BCAST_POLL_DATA0              (0x46U)
+#define BL_PACKET_BCAST_NACK_DATA0              (0x47U)
+#define BL_PACKET_BCAST_END_DATA0               (0x48U)
+#define BL_PACKET_FW_WRITE_DONE_DATA0           (0x49U)
+#define BL_PACKET_FW_STAGED_DATA0               (0x4AU)   // Application's answer instead of SUCCESS: installs at next reset
 
 
 void comms_setup(void);
@@ -36,11 +39,8 @@ void comms_update(void);
 bool comms_packets_available(void);
 void comms_write(comms_packet_t* packet);
 void comms_read(comms_packet_t* packet);
-
-/* Comms Utils */
-void comms_packet_copy(const comms_packet_t* source, comms_packet_t* dest);
-bool comms_is_single_byte_packet(const comms_packet_t* packet, uint8_t byte);
-void comms_create_single_byte_packet(comms_packet_t* packet, uint8_t byte);
+void comms_set_silent(bool silent);
+void comms_forward(uart_t* next_hop, const comms_packet_t* packet);
 
 
 #endif /* INC_COMMS_H */
@@ -1,6 +1,11 @@
-BOOTLOADER_SIZE     = (0x6000)
+import re
+
+MEMORY_MAP_HEADER   = "../shared/inc/core/memory-map.h"
 BOOTLOADER_BIN_FILE = "bootloader.bin"
 
+with open(MEMORY_MAP_HEADER, "r") as f:
+    BOOTLOADER_SIZE = int(re.search(r"#define\s+BOOTLOADER_SIZE\s+\((0x[0-9A-Fa-f]+)\)", f.read()).group(1), 16)
+
 with open(BOOTLOADER_BIN_FILE, "rb") as f:
     raw_file = f.read()
 
@@ -8,4 +13,4 @@ numbytes_to_pad = (BOOTLOADER_SIZE - len(raw_file))
 padding = bytes([0xff] * numbytes_to_pad)
 
 with open(BOOTLOADER_BIN_FILE, "wb") as f:
-    f.write(raw_file + padding)
\ No newline at end of file
+    f.write(raw_file + padding)
@@ -0,0 +1,87 @@
+#include "bl-bench.h"
+#include "comms-frame.h"
+#include "core/aes128.h"
+
+#include <libopencm3/cm3/dwt.h>
+#include <libopencm3/stm32/rcc.h>
+
+#define BENCH_FRAMES        (1024U)
+#define BENCH_BITS_PER_BYTE (10U)       // start, 8 data, stop
+#define NS_PER_S            (1000000000ULL)
+
+
+void bl_bench_aes(bl_bench_aes_t* result) {
+    static const uint8_t key[AES128_KEY_LEN] = {0};
+    static const uint8_t nonce[AES128_BLOCK_LEN] = {0};
+    uint8_t frame[COMMS_PACKET_PAYLOAD_LEN] = {0};
+    aes128_t cipher;
+
+    aes128_setup(&cipher, key);
+    dwt_enable_cycle_counter();
+
+    // The way bl-image.c decrypts a frame: in place, at its own block index
+    const uint32_t start = dwt_read_cycle_counter();
+    for (uint32_t i = 0; i < BENCH_FRAMES; i++) {
+        aes128_ctr_crypt(&cipher, nonce, i * (COMMS_PACKET_PAYLOAD_LEN / AES128_BLOCK_LEN), frame, sizeof(frame));
+    }
+    const uint32_t cycles = dwt_read_cycle_counter() - start;
+
+    result->cycles = cycles / BENCH_FRAMES;
+    result->ahb_hz = rcc_ahb_frequency;
+    result->frame_ns = (uint32_t) (((uint64_t) cycles * NS_PER_S) / ((uint64_t) rcc_ahb_frequency * BENCH_FRAMES));
+    result->wire_ns = (uint32_t) ((COMMS_PACKET_PAYLOAD_LEN * BENCH_BITS_PER_BYTE * NS_PER_S) / BL_BENCH_BAUD_RATE);
+    result->budget_ns = (result->wire_ns * BL_BENCH_BUDGET_PERCENT) / 100U;
+}
+
+
+static char* put_text(char* out, const char* text) {
+    while (*text != '\0') {
+        *out++ = *text++;
+    }
+    return out;
+}
+
+static char* put_u32(char* out, uint32_t value) {
+    char digits[10];
+    uint32_t count = 0;
+
+    do {
+        digits[count++] = (char) ('0' + (value % 10U));
+        value /= 10U;
+    } while (value > 0U);
+    while (count > 0U) {
+        *out++ = digits[--count];
+    }
+    return out;
+}
+
+/* Microseconds with one decimal */
+static char* put_us(char* out, uint32_t ns) {
+    out = put_u32(out, ns / 1000U);
+    *out++ = '.';
+    out = put_u32(out, (ns / 100U) % 10U);
+    return put_text(out, " us");
+}
+
+
+uint32_t bl_bench_format(const bl_bench_aes_t* result, char* line) {
+    char* out = line;
+
+    out = put_text(out, "aes-ctr 16 B frame: ");
+    out = put_u32(out, result->cycles);
+    out = put_text(out, " cycles, ");
+    out = put_us(out, result->frame_ns);
+    out = put_text(out, " at ");
+    out = put_u32(out, result->ahb_hz / 1000000U);
+    out = put_text(out, " MHz; budget ");
+    out = put_us(out, result->budget_ns);
+    out = put_text(out, " (");
+    out = put_u32(out, BL_BENCH_BUDGET_PERCENT);
+    out = put_text(out, "% of ");
+    out = put_us(out, result->wire_ns);
+    out = put_text(out, " at ");
+    out = put_u32(out, BL_BENCH_BAUD_RATE);
+    out = put_text(out, " baud): ");
+    out = put_text(out, (result->frame_ns <= result->budget_ns) ? "ok\r\n" : "over\r\n");
+    return (uint32_t) (out - line);
+}
@@ -0,0 +1,172 @@
+#include "bl-broadcast.h"
+#include "bl-image.h"
+#include "core/memory-map.h"
+
+/* One bit per 16-byte payload frame of the largest application, as far as 16 bit sequence numbers reach */
+#define BL_BROADCAST_SEQ_FRAMES  (0xFFFFU - (IMAGE_HEADER_MAX_SIZE / COMMS_PACKET_PAYLOAD_LEN))
+#define BL_BROADCAST_MAX_FRAMES  (((APP_MAX_SIZE / COMMS_PACKET_PAYLOAD_LEN) < BL_BROADCAST_SEQ_FRAMES) ? \
+                                  (APP_MAX_SIZE / COMMS_PACKET_PAYLOAD_LEN) : BL_BROADCAST_SEQ_FRAMES)
+
+static bl_broadcast_status_t status = BL_Broadcast_Status_NotTarget;
+static uint32_t fw_length = 0;
+static uint32_t header_bytes = 0;
+static uint16_t header_frames = 0;
+static uint16_t payload_frames = 0;
+static uint16_t frames_missing = 0;
+static uint8_t received[(BL_BROADCAST_MAX_FRAMES + 7U) / 8U];
+
+
+void bl_broadcast_reset(void) {
+    status = BL_Broadcast_Status_NotTarget;
+}
+
+
+void bl_broadcast_begin(bool device_class_matches, uint32_t length) {
+    if (status != BL_Broadcast_Status_NotTarget) {
+        /* BEGIN is repeated by the host, only the first one counts */
+        return;
+    }
+    if (!device_class_matches) {
+        return;
+    }
+
+    fw_length = length;
+    header_bytes = 0;
+    bl_image_reset();
+    status = BL_Broadcast_Status_NoHeader;
+}
+
+
+static void header_frame(uint16_t seq, uint8_t* data) {
+    /* Header frames are repeated by the host, take them strictly in order */
+    if (((uint32_t) seq * COMMS_PACKET_PAYLOAD_LEN) != header_bytes) {
+        return;
+    }
+    header_bytes += COMMS_PACKET_PAYLOAD_LEN;
+
+    bl_image_header_state_t header_state = bl_image_header_append(data, COMMS_PACKET_PAYLOAD_LEN);
+    if (header_state == BL_Image_Header_Incomplete) {
+        return;
+    }
+
+    const image_header_t* header = bl_image_header();
+    if ((header_state == BL_Image_Header_Invalid) ||
+        (header->header_size + header->image_size != fw_length) ||
+        (header->image_size > (BL_BROADCAST_MAX_FRAMES * COMMS_PACKET_PAYLOAD_LEN)))
+    {
+        status = BL_Broadcast_Status_Failed;
+        return;
+    }
+    if (bl_image_is_installed()) {
+        status = BL_Broadcast_Status_UpToDate;
+        return;
+    }
+
+    header_frames = header->header_size / COMMS_PACKET_PAYLOAD_LEN;
+    payload_frames = header->image_size / COMMS_PACKET_PAYLOAD_LEN;
+    frames_missing = payload_frames;
+    for (uint32_t i = 0; i < sizeof(received); i++) {
+        received[i] = 0U;
+    }
+
+    /* The host pauses after the header frames for this erase */
+    bl_image_begin_install();
+    bl_image_erase_application();
+    status = BL_Broadcast_Status_Receiving;
+}
+
+
+void bl_broadcast_frame(comms_packet_t* frame) {
+    if (status == BL_Broadcast_Status_NoHeader) {
+        header_frame(frame->seq, frame->data);
+        return;
+    }
+    if ((status != BL_Broadcast_Status_Receiving) || (frame->seq < header_frames)) {
+        return;
+    }
+
+    const uint16_t index = frame->seq - header_frames;
+    if ((index >= payload_frames) || (received[index / 8U] & (1U << (index % 8U)))) {
+        return;
+    }
+
+    /* Frames arrive out of order after a repair round; bl_image_verify() hashes the gaps from flash */
+    if (bl_image_write((uint32_t) index * COMMS_PACKET_PAYLOAD_LEN, frame->data, COMMS_PACKET_PAYLOAD_LEN) == BL_Image_Write_Rejected) {
+        /* Left missing, the node reports it in its NACKs and the update fails if it never fits */
+        return;
+    }
+    received[index / 8U] |= (uint8_t) (1U << (index % 8U));
+    frames_missing--;
+}
+
+
+void bl_broadcast_end(void) {
+    if ((status != BL_Broadcast_Status_Receiving) && (status != BL_Broadcast_Status_NoHeader)) {
+        return;
+    }
+    if ((status == BL_Broadcast_Status_NoHeader) || (frames_missing > 0U)) {
+        /* Host gave up on this node; what was programmed is kept for a resumed unicast update */
+        status = BL_Broadcast_Status_Failed;
+        return;
+    }
+
+    if (bl_image_verify()) {
+        bl_image_commit();
+        status = BL_Broadcast_Status_Success;
+    }
+    else {
+        bl_image_discard_progress();
+        status = BL_Broadcast_Status_Failed;
+    }
+}
+
+
+bl_broadcast_status_t bl_broadcast_status(void) {
+    return status;
+}
+
+
+static bool seq_missing(uint32_t seq) {
+    if (status == BL_Broadcast_Status_NoHeader) {
+        return (seq * COMMS_PACKET_PAYLOAD_LEN) >= header_bytes;
+    }
+    if ((status != BL_Broadcast_Status_Receiving) || (seq < header_frames)) {
+        return false;
+    }
+
+    const uint32_t index = seq - header_frames;
+    return (index < payload_frames) && !(received[index / 8U] & (1U << (index % 8U)));
+}
+
+
+void bl_broadcast_create_nack(comms_packet_t* packet, uint16_t from_seq) {
+    const uint16_t address = device_id_node_address();
+    const uint32_t last_seq = (status == BL_Broadcast_Status_NoHeader) ?
+        (fw_length / COMMS_PACKET_PAYLOAD_LEN) : ((uint32_t) header_frames + payload_frames);
+    uint32_t first = from_seq;
+
+    while ((first < last_seq) && !seq_missing(first)) {
+        first++;
+    }
+    if (first >= last_seq) {
+        first = BL_BROADCAST_NONE_MISSING;
+    }
+
+    comms_create_single_byte_packet(packet, BL_PACKET_BCAST_NACK_DATA0);
+    packet->length = COMMS_PACKET_PAYLOAD_LEN;
+    packet->data[1] = (uint8_t) (address >> 8);
+    packet->data[2] = (uint8_t) (address & 0xFF);
+    packet->data[3] = (uint8_t) status;
+    packet->data[4] = (uint8_t) (first >> 8);
+    packet->data[5] = (uint8_t) (first & 0xFF);
+    for (uint8_t i = 0; i < BL_BROADCAST_NACK_BITMAP_LEN; i++) {
+        uint8_t bits = 0U;
+        for (uint8_t bit = 0; (bit < 8U) && (first != BL_BROADCAST_NONE_MISSING); bit++) {
+            if (seq_missing(first + (i * 8U) + bit)) {
+                bits |= (uint8_t) (1U << bit);
+            }
+        }
+        packet->data[6 + i] = bits;
+    }
+    packet->crc = comms_packet_crc(packet);
+}
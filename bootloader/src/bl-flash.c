@@ -1,16 +1,177 @@
 #include <libopencm3/stm32/flash.h>
+#include <libopencm3/stm32/desig.h>
+#include <libopencm3/stm32/dbgmcu.h>
 #include "bl-flash.h"
+#include "core/memory-map.h"
 
+/*
+ * XL-density parts (over 512 KiB) have a second bank with its own controller
+ * (FLASH_CR2/SR2/AR2). The CPU keeps fetching from bank 1 while bank 2 erases
+ * or programs, so bank 2 operations are queued here and run from
+ * bl_flash_update() instead of stalling the caller. libopencm3's helpers wait
+ * on both banks' BSY flags, so dual bank parts drive the registers directly.
+ */
 
-#define MAIN_APPLICATION_START_PAGE 24
-#define MAIN_APPLICATION_END_PAGE 63
+#define BL_FLASH_BANK2_ADDRESS  (FLASH_ORIGIN + FLASH_BANK_SIZE)
+#define BL_FLASH_QUEUE_LEN      (64U)       // Half-words, two large frames
+
+/* DBGMCU_IDCODE device IDs of the 1 KiB page lines; high density, XL and connectivity line use 2 KiB */
+#define BL_FLASH_DEV_ID_LOW_DENSITY     (0x412U)
+#define BL_FLASH_DEV_ID_MEDIUM_DENSITY  (0x410U)
+#define BL_FLASH_DEV_ID_VALUE_LINE      (0x420U)
+#define BL_FLASH_LARGE_PAGE_SIZE        (2048U)
+#define BL_FLASH_SMALL_PAGES_MAX_KIB    (128U)
+
+typedef struct {
+    uint32_t address;
+    uint16_t half_word;
+} bl_flash_program_t;
+
+static bl_flash_program_t program_queue[BL_FLASH_QUEUE_LEN];
+static uint32_t queue_head = 0;
+static uint32_t queue_count = 0;
+
+/* Bank 2 pages still to erase, [erase_next, erase_end); they go before any queued program */
+static uint32_t erase_next = 0;
+static uint32_t erase_end = 0;
+static bool bank2_active = false;       /* An erase or program was started and not finished */
+
+
+static bool is_dual_bank(void) {
+    return desig_get_flash_size() > (FLASH_BANK_SIZE / 1024U);
+}
+
+
+static bool in_bank2(uint32_t address) {
+    return (address >= BL_FLASH_BANK2_ADDRESS) && is_dual_bank();
+}
+
+
+uint32_t bl_flash_size(void) {
+    return (uint32_t) desig_get_flash_size() * 1024U;
+}
+
+
+uint32_t bl_flash_page_size(void) {
+    const uint32_t dev_id = DBGMCU_IDCODE & DBGMCU_IDCODE_DEV_ID_MASK;
+
+    if ((dev_id == BL_FLASH_DEV_ID_LOW_DENSITY) || (dev_id == BL_FLASH_DEV_ID_MEDIUM_DENSITY) ||
+        (dev_id == BL_FLASH_DEV_ID_VALUE_LINE)) {
+        return FLASH_PAGE_SIZE;
+    }
+    if (dev_id != 0U) {
+        return BL_FLASH_LARGE_PAGE_SIZE;
+    }
+
+    // Early F103 revisions read IDCODE as 0 without a debugger attached; only parts over 128 KiB have 2 KiB pages
+    return (desig_get_flash_size() > BL_FLASH_SMALL_PAGES_MAX_KIB) ? BL_FLASH_LARGE_PAGE_SIZE : FLASH_PAGE_SIZE;
+}
+
+
+uint32_t bl_flash_app_size(void) {
+    const uint32_t flash_end = FLASH_ORIGIN + bl_flash_size();
+
+    if (flash_end <= APP_START_ADDRESS) {
+        return 0;
+    }
+    return ((flash_end - APP_START_ADDRESS) < APP_MAX_SIZE) ? (flash_end - APP_START_ADDRESS) : APP_MAX_SIZE;
+}
+
+
+/* Bank 1, unlocked by the caller. On dual bank parts the same sequence as libopencm3 but waiting on this bank only */
+static void erase_page(uint32_t address) {
+    if (!is_dual_bank()) {
+        flash_erase_page(address);
+        return;
+    }
+    FLASH_CR |= FLASH_CR_PER;
+    FLASH_AR = address;
+    FLASH_CR |= FLASH_CR_STRT;
+    while (FLASH_SR & FLASH_SR_BSY) {}
+    FLASH_CR &= ~FLASH_CR_PER;
+}
+
+
+static void program(uint32_t address, uint16_t half_word) {
+    if (!is_dual_bank()) {
+        flash_program_half_word(address, half_word);
+        return;
+    }
+    FLASH_CR |= FLASH_CR_PG;
+    MMIO16(address) = half_word;
+    while (FLASH_SR & FLASH_SR_BSY) {}
+    FLASH_CR &= ~FLASH_CR_PG;
+}
+
+
+static bool bank2_pending(void) {
+    return (erase_next < erase_end) || (queue_count > 0U);
+}
+
+
+void bl_flash_update(void) {
+    if (bank2_active) {
+        if (FLASH_SR2 & FLASH_SR_BSY) {
+            return;
+        }
+        FLASH_CR2 &= ~(FLASH_CR_PER | FLASH_CR_PG);
+        bank2_active = false;
+        if (!bank2_pending()) {
+            flash_lock_upper();
+        }
+    }
+
+    if (erase_next < erase_end) {
+        flash_unlock_upper();
+        FLASH_CR2 |= FLASH_CR_PER;
+        FLASH_AR2 = erase_next;
+        FLASH_CR2 |= FLASH_CR_STRT;
+        erase_next += bl_flash_page_size();
+        bank2_active = true;
+    }
+    else if (queue_count > 0U) {
+        const bl_flash_program_t* next = &program_queue[queue_head];
+        flash_unlock_upper();
+        FLASH_CR2 |= FLASH_CR_PG;
+        MMIO16(next->address) = next->half_word;
+        queue_head = (queue_head + 1U) % BL_FLASH_QUEUE_LEN;
+        queue_count--;
+        bank2_active = true;
+    }
+}
+
+
+bool bl_flash_busy(void) {
+    bl_flash_update();
+    return bank2_active || bank2_pending();
+}
+
+
+void bl_flash_flush(void) {
+    while (bl_flash_busy()) {}
+}
+
+
+/* Whole pages of this part; `address` is page aligned */
+void bl_flash_erase_region(uint32_t address, uint32_t length) {
+    const uint32_t page_size = bl_flash_page_size();
+    uint32_t offset = 0;
 
-void bl_flash_erase_main_application(void) {
     flash_unlock();
-    for(uint8_t page = MAIN_APPLICATION_START_PAGE; page <= MAIN_APPLICATION_END_PAGE; page++) {
-        flash_erase_page(FLASH_BASE + (page*1024));
+    for (; (offset < length) && !in_bank2(address + offset); offset += page_size) {
+        erase_page(address + offset);
     }
     flash_lock();
+
+    if (offset < length) {
+        // The rest lies in bank 2: queue it in one go, after whatever bank 2 still has to do
+        if (bank2_pending()) {
+            bl_flash_flush();
+        }
+        erase_next = address + offset;
+        erase_end = address + length;
+        bl_flash_update();
+    }
 }
 
 
@@ -24,15 +185,26 @@ void bl_flash_write(uint32_t address, uint8_t* data, uint32_t length) {
     while (i < length) {
         half_word = data[i];         // MSB - Little Endian
         if (i + 1 < length) {        // LSB - Little Endian
-            half_word |= (data[i + 1] << 8);  
+            half_word |= (data[i + 1] << 8);
         }
         else {
             half_word |= (0xFF << 8);
         }
-        flash_program_half_word(cur_address, half_word);
+
+        if (in_bank2(cur_address)) {
+            while (queue_count == BL_FLASH_QUEUE_LEN) {
+                bl_flash_update();
+            }
+            program_queue[(queue_head + queue_count) % BL_FLASH_QUEUE_LEN] = (bl_flash_program_t) {cur_address, half_word};
+            queue_count++;
+        }
+        else {
+            program(cur_address, half_word);
+        }
         i += 2;
         cur_address += 2;
     }
-    
+
     flash_lock();
-}
\ No newline at end of file
+    bl_flash_update();
+}
@@ -0,0 +1,424 @@
+#include "bl-image.h"
+#include "bl-flash.h"
+#include "bl-staging.h"
+#include "core/crc32.h"
+#include "core/sha256.h"
+#include "core/ed25519.h"
+#include "core/aes128.h"
+#include "core/memory-map.h"
+#include "generated.signing-key.h"
+#include "generated.encryption-key.h"
+
+#define BL_IMAGE_INFO_PENDING (0x00000000U)
+#define BL_IMAGE_INFO_ERASED  (0xFFFFFFFFU)
+
+/* Progress slot: [header_crc of the image being installed][checkpoint 0][checkpoint 1]...
+ * A checkpoint is the payload offset below which the image is programmed. It is
+ * only appended when the next byte starts a flash page, so a resumed install can
+ * erase from there on without touching data that is already committed. */
+#define BL_PROGRESS_MAX_ENTRIES ((BL_SLOT_SIZE / sizeof(uint32_t)) - 1U)
+
+/* Staged installs stream the payload through two of these, one read while the other is programmed */
+#define BL_INSTALL_CHUNK_SIZE (FLASH_PAGE_SIZE)
+
+static uint8_t header_buffer[IMAGE_HEADER_MAX_SIZE] = {0U};
+static uint32_t header_bytes_received = 0;
+static image_header_t header;
+static image_segment_t segments[IMAGE_MAX_SEGMENTS];
+static sha256_t image_digest;
+static aes128_t image_cipher;
+static uint32_t progress_entries = 0;
+static uint32_t stream_offset = 0;      /* Payload below this is programmed and hashed */
+static const volatile uint32_t* const progress = (const volatile uint32_t *) BL_PROGRESS_ADDRESS;
+static image_staged_t staged;
+static uint8_t install_buffer[2][BL_INSTALL_CHUNK_SIZE];
+
+/* Running checks of bl_image_install_staged()'s dry run */
+static struct {
+    sha256_t digest;
+    uint32_t image_crc;
+    uint32_t segment_crc;
+    uint32_t segment_end;
+    uint16_t segment;
+    bool segments_ok;
+} staged_check;
+
+
+/* Bytes from the application start to the end of the last segment (segments are in address order) */
+static uint32_t image_span(void) {
+    const image_segment_t* last_segment = &segments[header.segment_count - 1U];
+    return (last_segment->address + last_segment->length) - APP_START_ADDRESS;
+}
+
+
+void bl_image_reset(void) {
+    header_bytes_received = 0;
+}
+
+
+bl_image_header_state_t bl_image_header_append(const uint8_t* data, uint32_t length) {
+    for (uint32_t i = 0; (i < length) && (header_bytes_received < IMAGE_HEADER_MAX_SIZE); i++) {
+        header_buffer[header_bytes_received++] = data[i];
+    }
+
+    if (header_bytes_received < IMAGE_ALIGN) {
+        return BL_Image_Header_Incomplete;
+    }
+
+    const uint16_t header_size = image_peek_header_size(header_buffer);
+    if ((header_size < IMAGE_HEADER_LEN) || (header_size > IMAGE_HEADER_MAX_SIZE)) {
+        return BL_Image_Header_Invalid;
+    }
+    if (header_bytes_received < header_size) {
+        return BL_Image_Header_Incomplete;
+    }
+
+    if (image_parse(header_buffer, header_bytes_received, &header, segments) != Image_Status_Ok) {
+        return BL_Image_Header_Invalid;
+    }
+    if (!(header.flags & IMAGE_FLAG_SIGNED)) {
+        return BL_Image_Header_Invalid;
+    }
+    if (image_span() > bl_flash_app_size()) {
+        /* Linked for a part with more flash than this one */
+        return BL_Image_Header_Invalid;
+    }
+
+    if (header.flags & IMAGE_FLAG_ENCRYPTED) {
+        aes128_setup(&image_cipher, encryption_key);
+    }
+
+    /* Digest is accumulated while the data streams in, see bl_image_write() */
+    stream_offset = 0;
+    sha256_init(&image_digest);
+    sha256_update(&image_digest, &header_buffer[IMAGE_HEADER_CRC_OFFSET], image_signed_header_end(&header) - IMAGE_HEADER_CRC_OFFSET);
+    return BL_Image_Header_Complete;
+}
+
+
+const image_header_t* bl_image_header(void) {
+    return &header;
+}
+
+
+static bool read_installed_record(image_header_t* installed) {
+    image_segment_t installed_segments[IMAGE_MAX_SEGMENTS];
+    const uint8_t* record = (const uint8_t*) BL_IMAGE_INFO_ADDRESS;
+    return (image_parse(record, IMAGE_HEADER_MAX_SIZE, installed, installed_segments) == Image_Status_Ok);
+}
+
+
+bool bl_image_is_installed(void) {
+    image_header_t installed;
+    if (!read_installed_record(&installed)) {
+        return false;
+    }
+
+    return (installed.fw_version == header.fw_version) && (installed.build_id == header.build_id);
+}
+
+
+/* Flash address of a payload offset; frames never straddle segments (both are 16-byte aligned) */
+static uint32_t payload_address(uint32_t offset) {
+    uint32_t segment_start = 0;
+    for (uint16_t i = 0; i < header.segment_count; i++) {
+        if (offset < segment_start + segments[i].length) {
+            return segments[i].address + (offset - segment_start);
+        }
+        segment_start += segments[i].length;
+    }
+    return 0;
+}
+
+
+/* Feed the programmed (plaintext) payload in [from, to) into the digest */
+static void digest_from_flash(uint32_t from, uint32_t to) {
+    uint32_t segment_start = 0;
+    bl_flash_flush();
+    for (uint16_t i = 0; (i < header.segment_count) && (from < to); i++) {
+        const uint32_t segment_end = segment_start + segments[i].length;
+        if (from < segment_end) {
+            const uint32_t end = (to < segment_end) ? to : segment_end;
+            sha256_update(&image_digest, (const uint8_t *) (segments[i].address + (from - segment_start)), end - from);
+            from = end;
+        }
+        segment_start = segment_end;
+    }
+}
+
+
+static void record_progress(uint32_t offset) {
+    if (progress_entries < BL_PROGRESS_MAX_ENTRIES) {
+        // The checkpoint promises everything before it is programmed
+        bl_flash_flush();
+        progress_entries++;
+        bl_flash_write(BL_PROGRESS_ADDRESS + (progress_entries * sizeof(uint32_t)), (uint8_t *) &offset, sizeof(offset));
+    }
+}
+
+
+/* Pages up to the end of the new image, not the whole region; on 1 MiB parts erasing dominates an install */
+void bl_image_erase_application(void) {
+    bl_flash_erase_region(APP_START_ADDRESS, image_span());
+}
+
+
+void bl_image_begin_install(void) {
+    /* Mark the application as incomplete until bl_image_commit() */
+    uint32_t pending = BL_IMAGE_INFO_PENDING;
+    uint32_t identity = header.header_crc;
+    bl_flash_erase_region(BL_IMAGE_INFO_ADDRESS, BL_SLOT_SIZE);
+    bl_flash_write(BL_IMAGE_INFO_ADDRESS, (uint8_t *) &pending, sizeof(pending));
+
+    bl_flash_erase_region(BL_PROGRESS_ADDRESS, BL_SLOT_SIZE);
+    bl_flash_write(BL_PROGRESS_ADDRESS, (uint8_t *) &identity, sizeof(identity));
+    progress_entries = 0;
+}
+
+
+uint32_t bl_image_resume_offset(void) {
+    const uint32_t info_word = *((volatile uint32_t *) BL_IMAGE_INFO_ADDRESS);
+    uint32_t resume_offset = 0;
+
+    /* header_crc covers the nonce and signature, so it identifies one packed image */
+    if ((info_word != BL_IMAGE_INFO_PENDING) || (progress[0] != header.header_crc)) {
+        return 0;
+    }
+
+    for (uint32_t i = 1; (i <= BL_PROGRESS_MAX_ENTRIES) && (progress[i] != BL_IMAGE_INFO_ERASED); i++) {
+        /* A checkpoint torn by a power cut reads back as 0xFFFFxxxx */
+        if (progress[i] < header.image_size) {
+            resume_offset = progress[i];
+        }
+    }
+    return resume_offset;
+}
+
+
+void bl_image_resume_install(uint32_t offset) {
+    const image_segment_t* last_segment = &segments[header.segment_count - 1U];
+    const uint32_t resume_address = payload_address(offset);
+
+    /* Frames after the checkpoint may be partially programmed, erase them again */
+    bl_flash_erase_region(resume_address, (last_segment->address + last_segment->length) - resume_address);
+
+    /* Bring the digest up to the checkpoint from what is already in flash */
+    digest_from_flash(0, offset);
+    stream_offset = offset;
+
+    for (progress_entries = 0; progress_entries < BL_PROGRESS_MAX_ENTRIES; progress_entries++) {
+        if (progress[progress_entries + 1U] == BL_IMAGE_INFO_ERASED) {
+            break;
+        }
+    }
+}
+
+
+void bl_image_discard_progress(void) {
+    bl_flash_erase_region(BL_PROGRESS_ADDRESS, BL_SLOT_SIZE);
+    progress_entries = 0;
+}
+
+
+bl_image_write_status_t bl_image_write(uint32_t offset, uint8_t* data, uint32_t length) {
+    const uint32_t next_offset = offset + length;
+    const uint32_t address = payload_address(offset);
+    const uint8_t* programmed = (const uint8_t *) address;
+    bool duplicate = true;
+    bool erased = true;
+
+    /* Offsets come from the host: block aligned, inside the payload and within one segment */
+    if ((length == 0U) || ((offset % AES128_BLOCK_LEN) != 0U) || (next_offset > header.image_size) ||
+        (address == 0U) || (payload_address(next_offset - 1U) != (address + length - 1U))) {
+        return BL_Image_Write_Rejected;
+    }
+
+    /* Decrypt in place in the receive buffer; the counter follows the stream offset */
+    if (header.flags & IMAGE_FLAG_ENCRYPTED) {
+        aes128_ctr_crypt(&image_cipher, &header_buffer[image_nonce_offset(&header)], offset / AES128_BLOCK_LEN, data, length);
+    }
+
+    /* A replayed frame finds its own data in flash; anything else needs erased flash */
+    bl_flash_flush();
+    for (uint32_t i = 0; i < length; i++) {
+        duplicate = duplicate && (programmed[i] == data[i]);
+        erased = erased && (programmed[i] == 0xFFU);
+    }
+    if (!duplicate && !erased) {
+        return BL_Image_Write_Rejected;
+    }
+    if (!duplicate) {
+        bl_flash_write(address, data, length);
+    }
+
+    /* Out of order writes (broadcast repairs, addressed frames) are hashed from flash by bl_image_verify() */
+    if (offset != stream_offset) {
+        return duplicate ? BL_Image_Write_Duplicate : BL_Image_Write_Ok;
+    }
+    sha256_update(&image_digest, data, length);
+    stream_offset = next_offset;
+
+    if ((next_offset < header.image_size) && ((payload_address(next_offset) % bl_flash_page_size()) == 0U)) {
+        record_progress(next_offset);
+    }
+    return duplicate ? BL_Image_Write_Duplicate : BL_Image_Write_Ok;
+}
+
+
+bool bl_image_verify(void) {
+    uint32_t image_crc = CRC32_INITIAL_VALUE;
+    uint8_t digest[SHA256_DIGEST_LEN];
+
+    bl_flash_flush();
+    for (uint16_t i = 0; i < header.segment_count; i++) {
+        const uint8_t* segment_data = (const uint8_t*) segments[i].address;
+        if (crc32(segment_data, segments[i].length) != segments[i].crc) {
+            return false;
+        }
+        image_crc = crc32_update(image_crc, segment_data, segments[i].length);
+    }
+
+    if (image_crc != header.image_crc) {
+        return false;
+    }
+
+    digest_from_flash(stream_offset, header.image_size);
+    sha256_final(&image_digest, digest);
+    return ed25519_verify(&header_buffer[image_signed_header_end(&header)], digest, SHA256_DIGEST_LEN, signing_public_key);
+}
+
+
+void bl_image_commit(void) {
+    bl_flash_erase_region(BL_IMAGE_INFO_ADDRESS, BL_SLOT_SIZE);
+    bl_flash_write(BL_IMAGE_INFO_ADDRESS, header_buffer, header.header_size);
+    bl_image_discard_progress();
+}
+
+
+bool bl_image_app_is_bootable(void) {
+    const uint32_t info_word = *((volatile uint32_t *) BL_IMAGE_INFO_ADDRESS);
+    const uint32_t app_stack_pointer = *((volatile uint32_t *) APP_START_ADDRESS);
+    image_header_t installed;
+
+    if (info_word == BL_IMAGE_INFO_PENDING) {
+        /* Update was interrupted */
+        return false;
+    }
+    if ((info_word != BL_IMAGE_INFO_ERASED) && !read_installed_record(&installed)) {
+        return false;
+    }
+
+    /* No record means the application was installed by other means (e.g. SWD) */
+    return (app_stack_pointer >= RAM_ORIGIN) && (app_stack_pointer <= (RAM_ORIGIN + RAM_SIZE));
+}
+
+
+
+
+bool bl_image_staged_pending(void) {
+    return bl_staging_read_trailer(&staged);
+}
+
+
+/* Feeds the staged payload to `consume` in IMAGE_ALIGN pieces. The next chunk is read (by DMA
+ * from SPI flash) while the current one is consumed, so an install runs at internal flash speed. */
+static void stream_staged_payload(void (*consume)(uint32_t offset, uint8_t* piece)) {
+    uint8_t current = 0;
+
+    bl_staging_read_start(header.header_size, install_buffer[0], (header.image_size < BL_INSTALL_CHUNK_SIZE) ? header.image_size : BL_INSTALL_CHUNK_SIZE);
+    for (uint32_t offset = 0; offset < header.image_size; offset += BL_INSTALL_CHUNK_SIZE) {
+        const uint32_t next = offset + BL_INSTALL_CHUNK_SIZE;
+        while (bl_staging_is_busy()) {}
+
+        if (next < header.image_size) {
+            const uint32_t next_length = header.image_size - next;
+            bl_staging_read_start(header.header_size + next, install_buffer[current ^ 1U],
+                                  (next_length < BL_INSTALL_CHUNK_SIZE) ? next_length : BL_INSTALL_CHUNK_SIZE);
+        }
+        for (uint32_t i = 0; (i < BL_INSTALL_CHUNK_SIZE) && (offset + i < header.image_size); i += IMAGE_ALIGN) {
+            consume(offset + i, &install_buffer[current][i]);
+        }
+        current ^= 1U;
+    }
+}
+
+
+static void verify_staged_piece(uint32_t offset, uint8_t* piece) {
+    if (header.flags & IMAGE_FLAG_ENCRYPTED) {
+        aes128_ctr_crypt(&image_cipher, &header_buffer[image_nonce_offset(&header)], offset / AES128_BLOCK_LEN, piece, IMAGE_ALIGN);
+    }
+    staged_check.segment_crc = crc32_update(staged_check.segment_crc, piece, IMAGE_ALIGN);
+    staged_check.image_crc = crc32_update(staged_check.image_crc, piece, IMAGE_ALIGN);
+    sha256_update(&staged_check.digest, piece, IMAGE_ALIGN);
+
+    if (offset + IMAGE_ALIGN == staged_check.segment_end) {
+        staged_check.segments_ok = staged_check.segments_ok && (staged_check.segment_crc == segments[staged_check.segment].crc);
+        staged_check.segment_crc = CRC32_INITIAL_VALUE;
+        if (++staged_check.segment < header.segment_count) {
+            staged_check.segment_end += segments[staged_check.segment].length;
+        }
+    }
+}
+
+
+/* Dry run of the install: decrypt, CRC and hash the staged payload without touching the application */
+static bool staged_payload_is_valid(void) {
+    uint8_t digest[SHA256_DIGEST_LEN];
+
+    staged_check.digest = image_digest;
+    staged_check.image_crc = CRC32_INITIAL_VALUE;
+    staged_check.segment_crc = CRC32_INITIAL_VALUE;
+    staged_check.segment = 0;
+    staged_check.segment_end = segments[0].length;
+    staged_check.segments_ok = true;
+    stream_staged_payload(verify_staged_piece);
+
+    if (!staged_check.segments_ok || (staged_check.image_crc != header.image_crc)) {
+        return false;
+    }
+    sha256_final(&staged_check.digest, digest);
+    return ed25519_verify(&header_buffer[image_signed_header_end(&header)], digest, SHA256_DIGEST_LEN, signing_public_key);
+}
+
+
+static void install_staged_piece(uint32_t offset, uint8_t* piece) {
+    bl_image_write(offset, piece, IMAGE_ALIGN);
+}
+
+
+bool bl_image_install_staged(void) {
+    bl_image_reset();
+    bl_staging_read(0, install_buffer[0], IMAGE_HEADER_MAX_SIZE);
+    if ((bl_image_header_append(install_buffer[0], IMAGE_HEADER_MAX_SIZE) != BL_Image_Header_Complete) ||
+        (header.header_size + header.image_size != staged.length) || (header.header_crc != staged.header_crc)) {
+        bl_staging_mark_done();
+        return false;
+    }
+
+    /* Power was cut between the commit and clearing the trailer last time */
+    if (bl_image_is_installed()) {
+        bl_staging_mark_done();
+        return true;
+    }
+
+    /* Never erase a working application for an image that would not verify */
+    if (!staged_payload_is_valid()) {
+        bl_staging_mark_done();
+        return false;
+    }
+
+    /* Same path as a download, at flash speed. The staged copy stays READY until the
+     * commit, so an install cut short by a reset starts over from it. */
+    bl_image_begin_install();
+    bl_image_erase_application();
+    stream_staged_payload(install_staged_piece);
+
+    if (!bl_image_verify()) {
+        bl_image_discard_progress();
+        bl_staging_mark_done();
+        return false;
+    }
+    bl_image_commit();
+    bl_staging_mark_done();
+    return true;
+}
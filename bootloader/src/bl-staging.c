@@ -0,0 +1,142 @@
+#include "bl-staging.h"
+#include "bl-flash.h"
+#include "core/memory-map.h"
+#include "core/spi-bus.h"
+#include "core/spi-flash.h"
+
+// SPI_STAGING=1 builds stage into an external SPI NOR on SPI1 instead of internal flash
+#ifndef STAGING_SPI_FLASH
+#define STAGING_SPI_FLASH (0)
+#endif
+
+#if STAGING_SPI_FLASH && defined(BL_GATEWAY) && BL_GATEWAY
+#error "SPI_STAGING=1 and GATEWAY=1 both need DMA1 channels 2 and 3"
+#endif
+
+#if STAGING_SPI_FLASH
+#define BL_STAGING_BASE         (SPI_STAGING_ADDRESS)
+#define BL_STAGING_SIZE         (SPI_STAGING_SIZE)
+#define BL_STAGING_ERASE_UNIT   (SPI_FLASH_SECTOR_SIZE)
+#else
+#define BL_STAGING_BASE         (STAGING_ADDRESS)
+#define BL_STAGING_SIZE         (STAGING_SIZE)
+#define BL_STAGING_ERASE_UNIT   (bl_flash_page_size())
+#endif
+
+#define BL_STAGING_TRAILER_OFFSET (BL_STAGING_SIZE - IMAGE_STAGED_TRAILER_LEN)
+#define BL_STAGING_TRAILER_UNIT   (BL_STAGING_SIZE - BL_STAGING_ERASE_UNIT)
+
+static uint32_t erase_offset = 0;
+static uint32_t erase_end = 0;
+static bool erase_trailer = false;
+
+
+bool bl_staging_setup(void) {
+#if STAGING_SPI_FLASH
+    spi_bus_setup();
+    return spi_flash_setup() && (spi_flash_size() >= (BL_STAGING_BASE + BL_STAGING_SIZE));
+#else
+    // A build for a bigger part puts the slot past the end of this one's flash
+    return (BL_STAGING_SIZE > 0) && ((BL_STAGING_BASE + BL_STAGING_SIZE) <= (FLASH_ORIGIN + bl_flash_size()));
+#endif
+}
+
+
+uint32_t bl_staging_capacity(void) {
+    return BL_STAGING_TRAILER_OFFSET;
+}
+
+
+bool bl_staging_is_busy(void) {
+#if STAGING_SPI_FLASH
+    return spi_flash_is_busy();
+#else
+    return bl_flash_busy();
+#endif
+}
+
+
+static void erase_unit(uint32_t offset) {
+#if STAGING_SPI_FLASH
+    spi_flash_erase_sector(BL_STAGING_BASE + offset);
+#else
+    bl_flash_erase_region(BL_STAGING_BASE + offset, BL_STAGING_ERASE_UNIT);
+#endif
+}
+
+
+void bl_staging_erase_begin(uint32_t length) {
+    erase_offset = 0;
+    erase_end = ((length + BL_STAGING_ERASE_UNIT - 1U) / BL_STAGING_ERASE_UNIT) * BL_STAGING_ERASE_UNIT;
+
+    // Only what the image needs, plus the trailer unless the image reaches into its unit
+    erase_trailer = (erase_end <= BL_STAGING_TRAILER_UNIT);
+}
+
+
+bool bl_staging_erase_continue(void) {
+    if (bl_staging_is_busy()) {
+        return false;
+    }
+    if (erase_offset < erase_end) {
+        erase_unit(erase_offset);
+        erase_offset += BL_STAGING_ERASE_UNIT;
+        return false;
+    }
+    if (erase_trailer) {
+        erase_unit(BL_STAGING_TRAILER_UNIT);
+        erase_trailer = false;
+        return false;
+    }
+    return true;
+}
+
+
+void bl_staging_write(uint32_t offset, const uint8_t* data, uint32_t length) {
+#if STAGING_SPI_FLASH
+    spi_flash_program(BL_STAGING_BASE + offset, data, length);
+#else
+    bl_flash_write(BL_STAGING_BASE + offset, (uint8_t *) data, length);
+#endif
+}
+
+
+void bl_staging_read(uint32_t offset, uint8_t* data, uint32_t length) {
+#if STAGING_SPI_FLASH
+    spi_flash_read(BL_STAGING_BASE + offset, data, length);
+#else
+    const uint8_t* staged = (const uint8_t *) (BL_STAGING_BASE + offset);
+    bl_flash_flush();
+    for (uint32_t i = 0; i < length; i++) {
+        data[i] = staged[i];
+    }
+#endif
+}
+
+
+void bl_staging_read_start(uint32_t offset, uint8_t* data, uint32_t length) {
+#if STAGING_SPI_FLASH
+    spi_flash_read_start(BL_STAGING_BASE + offset, data, length);
+#else
+    bl_staging_read(offset, data, length);
+#endif
+}
+
+
+bool bl_staging_read_trailer(image_staged_t* trailer) {
+    bl_staging_read(BL_STAGING_TRAILER_OFFSET, (uint8_t *) trailer, sizeof(*trailer));
+    return (trailer->state == IMAGE_STAGED_READY) && (trailer->length <= bl_staging_capacity());
+}
+
+
+void bl_staging_write_trailer(const image_staged_t* trailer) {
+    bl_staging_write(BL_STAGING_TRAILER_OFFSET, (const uint8_t *) trailer, sizeof(*trailer));
+    while (bl_staging_is_busy()) {}
+}
+
+
+void bl_staging_mark_done(void) {
+    const uint32_t done = IMAGE_STAGED_DONE;
+    bl_staging_write(BL_STAGING_TRAILER_OFFSET, (const uint8_t *) &done, sizeof(done));
+    while (bl_staging_is_busy()) {}
+}
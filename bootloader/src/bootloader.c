@@ -2,16 +2,22 @@
 #include <libopencm3/stm32/rcc.h>
 #include <libopencm3/stm32/gpio.h>
 #include <libopencm3/stm32/memorymap.h>
+#include <libopencm3/stm32/usart.h>
+#include <libopencm3/stm32/dma.h>
+#include <libopencm3/cm3/nvic.h>
+#include <libopencm3/cm3/systick.h>
 
 #include "core/system.h"
 #include "core/simple-timer.h"
 #include "core/uart.h"
-#include "core/crc8.h"
+#include "core/memory-map.h"
+#include "core/handoff.h"
 #include "comms.h"
 #include "bl-flash.h"
-
-#define BOOTLOADER_SIZE   (0x6000)
-#define APP_START_ADDRESS (FLASH_BASE + BOOTLOADER_SIZE)
+#include "bl-image.h"
+#include "bl-staging.h"
+#include "bl-broadcast.h"
+#include "bl-bench.h"
 
 #define LED_PORT (GPIOC) 
 #define LED_PIN  (GPIO13) 
@@ -22,10 +28,36 @@
 
 #define DEVICE_ID    (0x52)
 
+// Gateway builds (make GATEWAY=1) forward broadcast sessions to the next hop on USART3, and relay
+// unicast sessions addressed to a node further down
+#ifndef BL_GATEWAY
+#define BL_GATEWAY (0)
+#endif
+
+// FLOW_CONTROL=1 builds use RTS/CTS on the host link; the application keeps PA0/PA1 for itself
+#ifndef BL_FLOW_CONTROL
+#define BL_FLOW_CONTROL (0)
+#endif
+
+// BENCH_AES=1 builds report the AES-CTR cost per frame over the host link at startup, see bl-bench.h
+#ifndef BL_BENCH_AES
+#define BL_BENCH_AES (0)
+#endif
+
+#define DOWNSTREAM_USART     (USART3)
+#define DOWNSTREAM_BAUD_RATE (115200U)
+#define DOWNSTREAM_PORT      (GPIOB)
+#define DOWNSTREAM_TX_PIN    (GPIO_USART3_TX)
+#define DOWNSTREAM_RX_PIN    (GPIO_USART3_RX)
+#define DOWNSTREAM_RING_SIZE (256U)
+
 #define SYNC_SEQ_B0  (0xAA)
 #define SYNC_SEQ_B1  (0xBB)
 #define SYNC_SEQ_B2  (0xCC)
 #define SYNC_SEQ_B3  (0xDD)
+#define BCAST_SYNC_SEQ_B3 (0xEE)   // AA BB CC EE: join a silent broadcast session
+#define ENTER_SYNC_SEQ_B3 (0xBE)   // AA BB CC BE: makes a running application reset into us, a plain sync here
+#define ADDR_SYNC_SEQ_B3  (0xEF)   // AA BB CC EF <node hi> <node lo>: unicast session with that node only
 
 #define DEFAULT_TIMEOUT (5000)
 
@@ -37,19 +69,32 @@ typedef enum {
     BL_State_DeviceIDRes,
     BL_State_FwLengthReq,
     BL_State_FwLengthRes,
+    BL_State_RecieveImageHeader,
     BL_State_EraseApplication,
+    BL_State_WaitForErase,
     BL_State_RecieveFirmware,
+    BL_State_VerifyImage,
     BL_State_UpdateSuccess,
+    BL_State_BroadcastReceive,
+    BL_State_SyncAddress,
+    BL_State_Relay,
 } bl_state_t;
 
 static volatile bl_state_t bl_state = BL_State_Sync;
 static volatile uint32_t fw_length = 0x00;
-static volatile uint32_t cur_address = APP_START_ADDRESS;
 static volatile uint32_t bytes_written = 0x00;
 static volatile uint8_t sync_bytes[4] = {0U};
+static uint8_t sync_address[2] = {0U};
+static uint8_t sync_address_read = 0U;
+static uint32_t reset_flags = 0;
 
 comms_packet_t packet;
 simple_timer_t simple_timer;
+#if BL_GATEWAY
+static uart_t* downstream = 0;
+static uint8_t downstream_rx_data[DOWNSTREAM_RING_SIZE] = {0U};
+static uint8_t downstream_tx_data[DOWNSTREAM_RING_SIZE] = {0U};
+#endif
 
 
 static void gpio_setup(void) {
@@ -61,35 +106,205 @@ static void gpio_setup(void) {
 
     gpio_set_mode(USART_PORT, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_ALTFN_PUSHPULL, USART_TX_PIN);  // PA2 -> Tx
     gpio_set_mode(USART_PORT, GPIO_MODE_INPUT, GPIO_CNF_INPUT_FLOAT, USART_RX_PIN);                    // PA3 -> Rx
+
+#if BL_GATEWAY
+    rcc_periph_clock_enable(RCC_GPIOB);
+    gpio_set_mode(DOWNSTREAM_PORT, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_ALTFN_PUSHPULL, DOWNSTREAM_TX_PIN);  // PB10 -> Tx
+    gpio_set_mode(DOWNSTREAM_PORT, GPIO_MODE_INPUT, GPIO_CNF_INPUT_FLOAT, DOWNSTREAM_RX_PIN);                    // PB11 -> Rx
+#endif
+}
+
+
+/* The application's reset handler expects a core fresh out of reset: no interrupt sources, no DMA still writing into our RAM */
+static void release_peripherals(void) {
+    systick_interrupt_disable();
+    systick_counter_disable();
+
+    for (uint32_t i = 0; i < ((NVIC_IRQ_COUNT + 31U) / 32U); i++) {
+        NVIC_ICER(i) = 0xFFFFFFFFU;
+        NVIC_ICPR(i) = 0xFFFFFFFFU;
+    }
+    for (uint8_t channel = DMA_CHANNEL1; channel <= DMA_CHANNEL7; channel++) {
+        dma_disable_channel(DMA1, channel);
+    }
+}
+
+static void jump_to_app(handoff_update_t update_result) {
+    if (!bl_image_app_is_bootable()) {
+        return;
+    }
+
+    // Nothing may still be programming in the background once the application runs
+    bl_flash_flush();
+
+    // The application's profile, so its system_setup() finds the PLL locked and keeps it; GPIO and USART2 stay as they are
+    system_set_clock(SYSTEM_CLOCK_APP);
+    handoff_t handoff = {
+        .ahb_hz = rcc_ahb_frequency,
+        .baud_rate = UART_DEFAULT_BAUD_RATE,
+        .reset_flags = reset_flags,
+        .update_result = update_result,
+    };
+    release_peripherals();
+    handoff_publish(&handoff);
+
+    system_jump(APP_START_ADDRESS);
+}
+
+static void send_ready_for_data(void) {
+    comms_create_single_byte_packet(&packet, BL_PACKET_READY_FOR_DATA_DATA0);
+    comms_write(&packet);
+    simple_timer_reset(&simple_timer, 0);
 }
 
+static void send_resume_offset(uint32_t offset) {
+    comms_create_single_byte_packet(&packet, BL_PACKET_FW_RESUME_DATA0);
+    packet.length = 5;
+    packet.data[1] = (offset >> 24) & 0xFF;
+    packet.data[2] = (offset >> 16) & 0xFF;
+    packet.data[3] = (offset >> 8) & 0xFF;
+    packet.data[4] = offset & 0xFF;
+    packet.crc = comms_packet_crc(&packet);
+    comms_write(&packet);
+    simple_timer_reset(&simple_timer, 0);
+}
 
-static void jump_to_app(void) {
-    typedef void (*void_fn)(void);
+static void send_device_id_req(void) {
+    // Node address rides along so the host can poll this node in a broadcast session later
+    comms_create_single_byte_packet(&packet, BL_PACKET_DEVICE_ID_REQ_DATA0);
+    packet.length = BL_DEVICE_ID_REQ_LEN;
+    device_id_encode(&packet.data[1], bl_flash_size(), bl_flash_page_size(), bl_flash_app_size());
+    packet.crc = comms_packet_crc(&packet);
+    comms_write(&packet);
+}
 
-    uint32_t *reset_vector_entry = (uint32_t *)(APP_START_ADDRESS + 4U);
-    uint32_t *reset_vector =  (uint32_t *)(*reset_vector_entry);
+static void forward_downstream(const uint8_t* sync_sequence, const comms_packet_t* forwarded_packet) {
+#if BL_GATEWAY
+    // Forward first, so the next hop receives while this one programs
+    if (sync_sequence) {
+        uart_send(downstream, sync_sequence, 4);
+    }
+    if (forwarded_packet) {
+        comms_forward(downstream, forwarded_packet);
+        if (bl_broadcast_status() == BL_Broadcast_Status_NoHeader) {
+            // This frame may start our erase; let the next hop have its header first so both erase together
+            uart_flush(downstream);
+        }
+    }
+#else
+    (void) sync_sequence;
+    (void) forwarded_packet;
+#endif
+}
 
-    void_fn jump_func = (void_fn) reset_vector;
-    jump_func();
+static void relay_upstream(void) {
+#if BL_GATEWAY
+    // Only the polled node answers, so replies from further down never collide with ours
+    while (uart_available(downstream)) {
+        uart_write_byte(uart_recv_byte(downstream));
+    }
+#endif
+}
+
+/* Byte for byte both ways while another node's session runs; returns true while there is traffic */
+static bool relay_bytes(void) {
+    bool traffic = false;
+
+    while (uart_data_available()) {
+        const uint8_t byte = uart_read_byte();
+#if BL_GATEWAY
+        uart_send(downstream, &byte, 1);
+#else
+        (void) byte;
+#endif
+        traffic = true;
+    }
+#if BL_GATEWAY
+    traffic = traffic || uart_available(downstream);
+    relay_upstream();
+#endif
+    return traffic;
+}
+
+static handoff_update_t broadcast_update_result(void) {
+    switch (bl_broadcast_status()) {
+    case BL_Broadcast_Status_Success: return Handoff_Update_Installed;
+    case BL_Broadcast_Status_Failed: return Handoff_Update_Failed;
+    default: return Handoff_Update_None;
+    }
+}
+
+static void broadcast_session_ended(void) {
+    // Bus went quiet: boot what is installed, otherwise wait for the next session
+    comms_set_silent(false);
+    jump_to_app(broadcast_update_result());
+    bl_state = BL_State_Sync;
+    simple_timer_reset(&simple_timer, 0);
 }
 
 static void bootloading_process_failed(void) {
     comms_create_single_byte_packet(&packet, BL_PACKET_FW_UPDATE_FAILED_DATA0);
     comms_write(&packet);
-    jump_to_app();
+    // Timing out in Sync is the normal boot without an update session
+    jump_to_app((bl_state == BL_State_Sync) ? Handoff_Update_None : Handoff_Update_Failed);
+
+    /* No bootable application, wait for another update session */
+    bl_state = BL_State_Sync;
+    simple_timer_reset(&simple_timer, 0);
 }
 
 
 int main(void) {
-    system_setup();
+    // Latched until cleared, so the application would otherwise see every earlier reset's cause too
+    reset_flags = RCC_CSR & RCC_CSR_RESET_FLAGS;
+    RCC_CSR |= RCC_CSR_RMVF;
+    // Only a software reset can carry the request; anything else may have left noise in RAM
+    const bool session_requested = handoff_bootloader_requested() && (reset_flags & RCC_CSR_SFTRSTF);
+
+    // Full speed for CRC, signature and decryption work during a transfer; jump_to_app() drops to the application's profile
+    system_setup(System_Clock_72MHz);
     gpio_setup();
-    uart_setup();
+    uart_setup(BL_FLOW_CONTROL, UART_DEFAULT_BAUD_RATE);
+#if BL_BENCH_AES
+    // At the transfer clock, before the sync window opens
+    bl_bench_aes_t bench;
+    char bench_report[BL_BENCH_REPORT_LEN];
+    bl_bench_aes(&bench);
+    uart_write((uint8_t *) bench_report, bl_bench_format(&bench, bench_report));
+#endif
+#if BL_GATEWAY
+    /* DMA keeps forwarding while the CPU is stalled on a flash page erase */
+    const uart_config_t downstream_config = {
+        .usart = DOWNSTREAM_USART,
+        .baud_rate = DOWNSTREAM_BAUD_RATE,
+        .rx_mode = UART_RX_DMA,
+        .tx_mode = UART_TX_DMA,
+        .rx_data = downstream_rx_data,
+        .rx_size = DOWNSTREAM_RING_SIZE,
+        .tx_data = downstream_tx_data,
+        .tx_size = DOWNSTREAM_RING_SIZE,
+    };
+    downstream = uart_open(&downstream_config);
+#endif
     comms_setup();
     simple_timer_setup(&simple_timer, 10000, false);
 
+    // The application downloaded an update into the staging slot, install it and boot straight into it
+    if (bl_staging_setup() && bl_image_staged_pending() && bl_image_install_staged()) {
+        jump_to_app(Handoff_Update_StagedInstalled);
+    }
+
+    // The application reset into us on the host's request (AA BB CC BE), so the host is already waiting: skip the sync window
+    if (session_requested) {
+        comms_create_single_byte_packet(&packet, BL_PACKET_SEQ_OBSERVED_DATA0);
+        comms_write(&packet);
+        bl_state = BL_State_SendUpdateReq;
+    }
+
     simple_timer_reset(&simple_timer, 0);
     while (true) {
+        bl_flash_update();
+
         switch (bl_state) {
         case BL_State_Sync: {
             if (simple_timer_has_elapsed(&simple_timer)) {
@@ -104,15 +319,77 @@ int main(void) {
                 if ((sync_bytes[0] == SYNC_SEQ_B0) && 
                     (sync_bytes[1] == SYNC_SEQ_B1) &&
                     (sync_bytes[2] == SYNC_SEQ_B2) &&
-                    (sync_bytes[3] == SYNC_SEQ_B3)) 
+                    ((sync_bytes[3] == SYNC_SEQ_B3) || (sync_bytes[3] == ENTER_SYNC_SEQ_B3))) 
                 {
                     comms_create_single_byte_packet(&packet, BL_PACKET_SEQ_OBSERVED_DATA0);
                     comms_write(&packet);
                     bl_state = BL_State_SendUpdateReq;
                 }
+                else if ((sync_bytes[0] == SYNC_SEQ_B0) && 
+                         (sync_bytes[1] == SYNC_SEQ_B1) &&
+                         (sync_bytes[2] == SYNC_SEQ_B2) &&
+                         (sync_bytes[3] == ADDR_SYNC_SEQ_B3)) 
+                {
+                    sync_address_read = 0U;
+                    bl_state = BL_State_SyncAddress;
+                }
+                else if ((sync_bytes[0] == SYNC_SEQ_B0) && 
+                         (sync_bytes[1] == SYNC_SEQ_B1) &&
+                         (sync_bytes[2] == SYNC_SEQ_B2) &&
+                         (sync_bytes[3] == BCAST_SYNC_SEQ_B3)) 
+                {
+                    // Many nodes share the bus, so listen without answering
+                    forward_downstream((const uint8_t *) sync_bytes, 0);
+                    comms_set_silent(true);
+                    bl_broadcast_reset();
+                    bl_state = BL_State_BroadcastReceive;
+                    simple_timer_reset(&simple_timer, 0);
+                }
             }
         } break;
         
+        case BL_State_SyncAddress: {
+            if (simple_timer_has_elapsed(&simple_timer)) {
+                bootloading_process_failed();
+            }
+            else if (uart_data_available()) {
+                sync_address[sync_address_read++] = uart_read_byte();
+                if (sync_address_read < sizeof(sync_address)) {
+                    break;
+                }
+
+                if (((sync_address[0] << 8) | sync_address[1]) == device_id_node_address()) {
+                    // For us: an ordinary unicast session from here on
+                    comms_create_single_byte_packet(&packet, BL_PACKET_SEQ_OBSERVED_DATA0);
+                    comms_write(&packet);
+                    bl_state = BL_State_SendUpdateReq;
+                }
+                else {
+#if BL_GATEWAY
+                    // For a node further down: pass the session through untouched until the line goes quiet
+                    const uint8_t address_sync[6] = {
+                        SYNC_SEQ_B0, SYNC_SEQ_B1, SYNC_SEQ_B2, ADDR_SYNC_SEQ_B3, sync_address[0], sync_address[1],
+                    };
+                    uart_send(downstream, address_sync, sizeof(address_sync));
+#endif
+                    bl_state = BL_State_Relay;
+                    simple_timer_reset(&simple_timer, 0);
+                }
+            }
+        } break;
+
+        case BL_State_Relay: {
+            if (relay_bytes()) {
+                simple_timer_reset(&simple_timer, 0);
+            }
+            else if (simple_timer_has_elapsed(&simple_timer)) {
+                // Same as the end of a broadcast session: this node had no update, boot what it has
+                jump_to_app(Handoff_Update_None);
+                bl_state = BL_State_Sync;
+                simple_timer_reset(&simple_timer, 0);
+            }
+        } break;
+
         case BL_State_SendUpdateReq: {
             comms_create_single_byte_packet(&packet, BL_PACKET_FW_UPDATE_REQ_DATA0);
             comms_write(&packet);
@@ -136,8 +413,7 @@ int main(void) {
         } break;
 
         case BL_State_DeviceIDReq: {
-            comms_create_single_byte_packet(&packet, BL_PACKET_DEVICE_ID_REQ_DATA0);
-            comms_write(&packet);
+            send_device_id_req();
             bl_state = BL_State_DeviceIDRes;
             simple_timer_reset(&simple_timer, 0);
         } break;
@@ -153,7 +429,7 @@ int main(void) {
                     if ((packet.length == 2) && 
                         (packet.data[0] == BL_PACKET_DEVICE_ID_RES_DATA0) && 
                         (packet.data[1] == DEVICE_ID) &&
-                        (packet.crc == crc8((uint8_t *) &packet, COMMS_PACKET_FULL_LEN-COMMS_PACKET_CRC_LEN))
+                        (packet.crc == comms_packet_crc(&packet))
                     ) {
                         bl_state = BL_State_FwLengthReq;
                     }
@@ -178,6 +454,41 @@ int main(void) {
                     comms_read(&packet);
                     if ((packet.length == 5) && (packet.data[0] == BL_PACKET_FW_LENGTH_RES_DATA0)) {
                         fw_length = (packet.data[1] << 24) | (packet.data[2] << 16) | (packet.data[3] << 8) | (packet.data[4]);
+                        bl_image_reset();
+                        bl_state = BL_State_RecieveImageHeader;
+
+                        // Ready for Image Header
+                        send_ready_for_data();
+                    }
+                }
+            }
+        } break;
+
+        case BL_State_RecieveImageHeader: {
+            if (simple_timer_has_elapsed(&simple_timer)) {
+                bootloading_process_failed();
+            }
+            else if (uart_data_available()) {
+                comms_update();
+                if (comms_packets_available()) {
+                    comms_read(&packet);
+
+                    bl_image_header_state_t header_state = bl_image_header_append(packet.data, COMMS_PACKET_PAYLOAD_LEN);
+                    if (header_state == BL_Image_Header_Incomplete) {
+                        send_ready_for_data();
+                    }
+                    else if ((header_state == BL_Image_Header_Invalid) ||
+                             (bl_image_header()->header_size + bl_image_header()->image_size != fw_length)) 
+                    {
+                        bootloading_process_failed();
+                    }
+                    else if (bl_image_is_installed()) {
+                        comms_create_single_byte_packet(&packet, BL_PACKET_FW_UP_TO_DATE_DATA0);
+                        comms_write(&packet);
+                        jump_to_app(Handoff_Update_None);
+                        bootloading_process_failed();
+                    }
+                    else {
                         bl_state = BL_State_EraseApplication;
                     }
                 }
@@ -185,52 +496,137 @@ int main(void) {
         } break;
 
         case BL_State_EraseApplication: {
-            bl_flash_erase_main_application();
+            bytes_written = bl_image_resume_offset();
             bl_state = BL_State_RecieveFirmware;
 
-            // Ready for Packets
-            comms_create_single_byte_packet(&packet, BL_PACKET_READY_FOR_DATA_DATA0);
-            comms_write(&packet);
-            simple_timer_reset(&simple_timer, 0);
+            if (bytes_written > 0) {
+                // Same image was interrupted, continue from the last committed page
+                bl_image_resume_install(bytes_written);
+                send_resume_offset(bytes_written);
+            }
+            else {
+                bl_image_begin_install();
+                bl_image_erase_application();
+                bl_state = BL_State_WaitForErase;
+            }
+        } break;
+
+        case BL_State_WaitForErase: {
+            // Bank 2 of XL-density parts erases in the background while this loop keeps running
+            if (!bl_flash_busy()) {
+                bl_state = BL_State_RecieveFirmware;
+
+                // Ready for Packets
+                send_ready_for_data();
+            }
         } break;
 
         case BL_State_RecieveFirmware:  {
             if (simple_timer_has_elapsed(&simple_timer)) {
                 bootloading_process_failed();
             }
-            else if (uart_data_available()) {
-                comms_update();
+            else {
+                if (uart_data_available()) {
+                    comms_update();
+                }
+
+                // The host streams ahead on ACK credits, so drain the queue even when the line is idle
                 if (comms_packets_available()) {
                     // Read Packet
                     comms_read(&packet);
 
-                    // Write Packet Data
-                    bl_flash_write(cur_address, packet.data, COMMS_PACKET_PAYLOAD_LEN);
-                    cur_address += COMMS_PACKET_PAYLOAD_LEN;
-                    bytes_written += COMMS_PACKET_PAYLOAD_LEN;
+                    if (packet.addressed) {
+                        // Addressed frames may skip regions, arrive out of order or be replayed
+                        bl_image_write_status_t write_status = BL_Image_Write_Ok;
+                        for (uint8_t i = 0; (i < comms_packet_payload_len(&packet)) && (write_status != BL_Image_Write_Rejected); i += COMMS_PACKET_PAYLOAD_LEN) {
+                            write_status = bl_image_write(packet.offset + i, &packet.data[i], COMMS_PACKET_PAYLOAD_LEN);
+                        }
+
+                        if (write_status == BL_Image_Write_Rejected) {
+                            bootloading_process_failed();
+                        }
+                        else {
+                            send_ready_for_data();
+                        }
+                    }
+                    else if (comms_is_single_byte_packet(&packet, BL_PACKET_FW_WRITE_DONE_DATA0)) {
+                        // Host has sent every region it wants programmed
+                        bl_state = BL_State_VerifyImage;
+                    }
+                    else {
+                        // Sequential frames (large frames in 16-byte pieces, which never straddle a segment)
+                        bl_image_write_status_t write_status = BL_Image_Write_Ok;
+                        for (uint8_t i = 0; (i < comms_packet_payload_len(&packet)) && (bytes_written < bl_image_header()->image_size) && (write_status != BL_Image_Write_Rejected); i += COMMS_PACKET_PAYLOAD_LEN) {
+                            write_status = bl_image_write(bytes_written, &packet.data[i], COMMS_PACKET_PAYLOAD_LEN);
+                            bytes_written += COMMS_PACKET_PAYLOAD_LEN;
+                        }
+
+                        if (write_status == BL_Image_Write_Rejected) {
+                            bootloading_process_failed();
+                        }
+                        else if (bytes_written >= bl_image_header()->image_size)  {
+                            bl_state = BL_State_VerifyImage;
+                        }
+                        else {
+                            // Ready for Next Packet (returns a credit to a streaming host)
+                            send_ready_for_data();
+                        }
+                    }
                 }
             }
-            if (bytes_written >= fw_length)  {
+        } break;
+
+        case BL_State_VerifyImage: {
+            if (bl_image_verify()) {
+                bl_image_commit();
                 bl_state = BL_State_UpdateSuccess;
             }
             else {
-                // Ready for Next Packet
-                comms_create_single_byte_packet(&packet, BL_PACKET_READY_FOR_DATA_DATA0);
-                comms_write(&packet);
-                simple_timer_reset(&simple_timer, 0);
+                // Start over next time instead of resuming into the same bad data
+                bl_image_discard_progress();
+                bootloading_process_failed();
             }
         } break;
 
         case BL_State_UpdateSuccess: {
             comms_create_single_byte_packet(&packet, BL_PACKET_FW_UPDATE_SUCCESS_DATA0);
             comms_write(&packet);
+            jump_to_app(Handoff_Update_Installed);
+        } break;
 
-            for (uint8_t i = 0; i < 10; i++)  {
-                gpio_toggle(LED_PORT, LED_PIN);
-                system_delay_ms(500);
+        case BL_State_BroadcastReceive: {
+            relay_upstream();
+
+            if (simple_timer_has_elapsed(&simple_timer)) {
+                broadcast_session_ended();
             }
+            else if (uart_data_available()) {
+                comms_update();
+                if (comms_packets_available()) {
+                    comms_read(&packet);
+                    simple_timer_reset(&simple_timer, 0);
+                    forward_downstream(0, &packet);
 
-            jump_to_app();
+                    if (packet.length == COMMS_BCAST_FRAME_TAG) {
+                        bl_broadcast_frame(&packet);
+                    }
+                    else if ((packet.length == 6) && (packet.data[0] == BL_PACKET_BCAST_BEGIN_DATA0)) {
+                        fw_length = (packet.data[2] << 24) | (packet.data[3] << 16) | (packet.data[4] << 8) | (packet.data[5]);
+                        bl_broadcast_begin(packet.data[1] == DEVICE_ID, fw_length);
+                    }
+                    else if ((packet.length == 5) && 
+                             (packet.data[0] == BL_PACKET_BCAST_POLL_DATA0) &&
+                             (((packet.data[1] << 8) | packet.data[2]) == device_id_node_address()) &&
+                             (bl_broadcast_status() != BL_Broadcast_Status_NotTarget))
+                    {
+                        bl_broadcast_create_nack(&packet, (packet.data[3] << 8) | packet.data[4]);
+                        comms_write(&packet);
+                    }
+                    else if (comms_is_single_byte_packet(&packet, BL_PACKET_BCAST_END_DATA0)) {
+                        bl_broadcast_end();
+                    }
+                }
+            }
         } break;
 
         default: {
@@ -240,7 +636,7 @@ int main(void) {
         } 
     }
 
-    jump_to_app();
+    jump_to_app(Handoff_Update_None);
 
     return 0;
 }
\ No newline at end of file
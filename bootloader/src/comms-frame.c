@@ -0,0 +1,299 @@
+#include "comms-frame.h"
+#include "core/crc8.h"
+#include "core/reed-solomon.h"
+
+
+/* Wire bytes in front of the payload: the length byte, or a frame tag and what follows it */
+uint8_t comms_frame_header(const comms_packet_t* packet, uint8_t* header) {
+    if (packet->addressed) {
+        header[0] = COMMS_ADDR_FRAME_TAG;
+        header[1] = packet->length;
+        header[2] = (uint8_t) (packet->offset >> 16);
+        header[3] = (uint8_t) (packet->offset >> 8);
+        header[4] = (uint8_t) (packet->offset & 0xFF);
+        return COMMS_ADDR_HEADER_LEN;
+    }
+
+    header[0] = packet->length;
+    if (packet->length == COMMS_BCAST_FRAME_TAG) {
+        header[1] = (uint8_t) (packet->seq >> 8);
+        header[2] = (uint8_t) (packet->seq & 0xFF);
+        return COMMS_PACKET_DATALEN_LEN + COMMS_BCAST_SEQ_LEN;
+    }
+    return COMMS_PACKET_DATALEN_LEN;
+}
+
+
+uint8_t comms_packet_crc(const comms_packet_t* packet) {
+    uint8_t frame[COMMS_ADDR_HEADER_LEN + COMMS_PACKET_PAYLOAD_MAX_LEN];
+    uint8_t frame_len = comms_frame_header(packet, frame);
+
+    for (uint8_t i = 0; i < comms_packet_payload_len(packet); i++) {
+        frame[frame_len++] = packet->data[i];
+    }
+    return crc8(frame, frame_len);
+}
+
+
+/* The packet as it goes on the wire, with the CRC it carries; returns the frame length */
+uint32_t comms_frame_encode(const comms_packet_t* packet, uint8_t* frame) {
+    uint32_t frame_len = comms_frame_header(packet, frame);
+
+    for (uint8_t i = 0; i < comms_packet_payload_len(packet); i++) {
+        frame[frame_len++] = packet->data[i];
+    }
+    frame[frame_len++] = packet->crc;
+    return frame_len;
+}
+
+
+/* Turns an encoded frame into its FEC form in place, returns the new length */
+uint32_t comms_frame_add_fec(uint8_t* frame, uint32_t length) {
+    frame[0] |= COMMS_FEC_FLAG;
+    rs_encode(frame, length, &frame[length]);
+    return length + RS_PARITY_LEN;
+}
+
+
+static bool comms_valid_length(uint8_t length) {
+    return ((length > 0U) && (length <= COMMS_PACKET_PAYLOAD_LEN)) ||
+           (length == (2U * COMMS_PACKET_PAYLOAD_LEN)) ||
+           (length == COMMS_PACKET_PAYLOAD_MAX_LEN);
+}
+
+
+static bool comms_valid_addressed_size(uint8_t size) {
+    return (size == COMMS_PACKET_PAYLOAD_LEN) || (size == (2U * COMMS_PACKET_PAYLOAD_LEN)) ||
+           (size == COMMS_PACKET_PAYLOAD_MAX_LEN);
+}
+
+
+/* Rebuild the codeword as it was on the wire and let Reed-Solomon fix what the line corrupted */
+static void comms_fec_correct(comms_frame_parser_t* parser) {
+    comms_packet_t* packet = &parser->packet;
+    uint8_t codeword[COMMS_FRAME_MAX_LEN];
+    const uint8_t payload_len = comms_packet_payload_len(packet);
+    const uint8_t header_len = comms_frame_header(packet, codeword);
+    uint32_t codeword_len = header_len;
+
+    codeword[0] |= COMMS_FEC_FLAG;
+    for (uint8_t i = 0; i < payload_len; i++) {
+        codeword[codeword_len++] = packet->data[i];
+    }
+    codeword[codeword_len++] = packet->crc;
+    for (uint8_t i = 0; i < RS_PARITY_LEN; i++) {
+        codeword[codeword_len++] = parser->parity[i];
+    }
+
+    if (rs_decode(codeword, codeword_len) <= 0) {
+        /* Clean, or beyond repair and left for the CRC check to reject */
+        return;
+    }
+
+    /* A corrected header must still describe the frame we just parsed */
+    comms_packet_t corrected = {.length = (uint8_t) (codeword[0] & ~COMMS_FEC_FLAG), .addressed = packet->addressed};
+    if (!(codeword[0] & COMMS_FEC_FLAG)) {
+        return;
+    }
+    if (corrected.addressed) {
+        if ((corrected.length != COMMS_ADDR_FRAME_TAG) || !comms_valid_addressed_size(codeword[1])) {
+            return;
+        }
+        corrected.length = codeword[1];
+        corrected.offset = ((uint32_t) codeword[2] << 16) | ((uint32_t) codeword[3] << 8) | codeword[4];
+    }
+    if (comms_packet_payload_len(&corrected) != payload_len) {
+        return;
+    }
+    packet->length = corrected.length;
+    packet->offset = corrected.offset;
+    for (uint8_t i = 0; i < payload_len; i++) {
+        packet->data[i] = codeword[header_len + i];
+    }
+    packet->crc = codeword[header_len + payload_len];
+}
+
+
+void comms_frame_parser_reset(comms_frame_parser_t* parser) {
+    parser->state = CommsFrame_State_DataLen_En;
+    parser->header_bytes_read = 0;
+    parser->data_bytes_read = 0;
+    parser->parity_bytes_read = 0;
+}
+
+
+bool comms_frame_parse(comms_frame_parser_t* parser, uint8_t byte) {
+    comms_packet_t* packet = &parser->packet;
+
+    switch (parser->state) {
+        case CommsFrame_State_DataLen_En: {
+            packet->length = byte;
+            packet->seq = 0U;
+            packet->addressed = false;
+            packet->offset = 0U;
+            parser->fec = false;
+            if (packet->length == COMMS_BCAST_FRAME_TAG) {
+                parser->header_bytes_len = COMMS_BCAST_SEQ_LEN;
+                parser->state = CommsFrame_State_Header_En;
+            }
+            else if ((packet->length & ~COMMS_FEC_FLAG) == COMMS_ADDR_FRAME_TAG) {
+                packet->addressed = true;
+                parser->fec = ((packet->length & COMMS_FEC_FLAG) != 0U);
+                parser->header_bytes_len = COMMS_ADDR_HEADER_LEN - COMMS_PACKET_DATALEN_LEN;
+                parser->state = CommsFrame_State_Header_En;
+            }
+            else if (comms_valid_length(packet->length)) {
+                parser->state = CommsFrame_State_Payload_En;
+            }
+            else if ((packet->length & COMMS_FEC_FLAG) && comms_valid_length(packet->length & ~COMMS_FEC_FLAG)) {
+                packet->length &= ~COMMS_FEC_FLAG;
+                parser->fec = true;
+                parser->state = CommsFrame_State_Payload_En;
+            }
+            /* Anything else cannot start a packet (e.g. trailing sync bytes), skip it to resynchronise */
+        } break;
+
+        case CommsFrame_State_Header_En: {
+            parser->header[parser->header_bytes_read] = byte;
+            parser->header_bytes_read++;
+            if (parser->header_bytes_read < parser->header_bytes_len) {
+                break;
+            }
+            parser->header_bytes_read = 0;
+
+            if (!packet->addressed) {
+                packet->seq = (uint16_t) ((parser->header[0] << 8) | parser->header[1]);
+                parser->state = CommsFrame_State_Payload_En;
+            }
+            else if (comms_valid_addressed_size(parser->header[0])) {
+                packet->length = parser->header[0];
+                packet->offset = ((uint32_t) parser->header[1] << 16) | ((uint32_t) parser->header[2] << 8) | parser->header[3];
+                parser->state = CommsFrame_State_Payload_En;
+            }
+            else {
+                /* Not a frame after all, resynchronise on the next byte */
+                parser->state = CommsFrame_State_DataLen_En;
+            }
+        } break;
+
+        case CommsFrame_State_Payload_En: {
+            packet->data[parser->data_bytes_read] = byte;
+            parser->data_bytes_read++;
+            if (parser->data_bytes_read == comms_packet_payload_len(packet)) {
+                parser->state = CommsFrame_State_CRC_En;
+            }
+        } break;
+
+        case CommsFrame_State_CRC_En: {
+            packet->crc = byte;
+            if (parser->fec) {
+                parser->state = CommsFrame_State_Parity_En;
+                break;
+            }
+
+            comms_frame_parser_reset(parser);
+            return true;
+        }
+
+        case CommsFrame_State_Parity_En: {
+            parser->parity[parser->parity_bytes_read] = byte;
+            parser->parity_bytes_read++;
+            if (parser->parity_bytes_read < RS_PARITY_LEN) {
+                break;
+            }
+
+            comms_fec_correct(parser);
+            comms_frame_parser_reset(parser);
+            return true;
+        }
+
+        default:  {
+            comms_frame_parser_reset(parser);
+        } break;
+    }
+    return false;
+}
+
+
+void comms_link_reset(comms_link_t* link) {
+    link->history = 0U;
+    link->samples = 0U;
+    link->max_payload = COMMS_PACKET_PAYLOAD_LEN;
+}
+
+
+/* Returns true when max_payload changed */
+bool comms_link_record(comms_link_t* link, bool failed) {
+    uint8_t failures = 0U;
+
+    link->history = (link->history << 1) | (failed ? 1U : 0U);
+    if (link->samples < COMMS_LINK_WINDOW) {
+        link->samples++;
+    }
+    for (uint32_t history = link->history; history != 0U; history &= (history - 1U)) {
+        failures++;
+    }
+
+    if ((failures >= COMMS_LINK_SHRINK_FAILURES) && (link->max_payload > COMMS_PACKET_PAYLOAD_LEN)) {
+        link->max_payload /= 2U;
+    }
+    else if ((link->samples == COMMS_LINK_WINDOW) && (failures == 0U) && (link->max_payload < COMMS_PACKET_PAYLOAD_MAX_LEN)) {
+        link->max_payload *= 2U;
+    }
+    else {
+        return false;
+    }
+
+    /* Judge the new size on its own packets */
+    link->history = 0U;
+    link->samples = 0U;
+    return true;
+}
+
+
+/* Comms Utils */
+uint8_t comms_packet_payload_len(const comms_packet_t* packet) {
+    if ((packet->length > COMMS_PACKET_PAYLOAD_LEN) && (packet->length <= COMMS_PACKET_PAYLOAD_MAX_LEN)) {
+        return packet->length;
+    }
+    return COMMS_PACKET_PAYLOAD_LEN;
+}
+
+void comms_packet_copy(const comms_packet_t* source, comms_packet_t* dest) {
+    dest->length = source->length;
+    for (uint8_t i = 0; i < comms_packet_payload_len(source); i++) {
+        dest->data[i] = source->data[i];
+    }
+    dest->crc = source->crc;
+    dest->seq = source->seq;
+    dest->addressed = source->addressed;
+    dest->offset = source->offset;
+}
+
+bool comms_is_single_byte_packet(const comms_packet_t* packet, uint8_t byte)  {
+    if (packet->length != 1U) {
+        return false;
+    }
+    if (packet->data[0] != byte) {
+        return false;
+    }
+    for (uint8_t i = 1; i < COMMS_PACKET_PAYLOAD_LEN; i++) {
+        if (packet->data[i] != 0xFF) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Callers reuse the packet they last received into, so the frame kind is reset along with the payload */
+void comms_create_single_byte_packet(comms_packet_t* packet, uint8_t byte) {
+    packet->length = 0x01;
+    packet->data[0] = byte;
+    for (uint8_t i = 1; i < COMMS_PACKET_PAYLOAD_LEN; i++) {
+        packet->data[i] = 0xFF;
+    }
+    packet->seq = 0U;
+    packet->addressed = false;
+    packet->offset = 0U;
+    packet->crc = comms_packet_crc(packet);
+}
@@ -1,18 +1,13 @@
 #include "comms.h"
 #include "core/uart.h"
-#include "core/crc8.h"
+#include "core/reed-solomon.h"
 
 #define COMMS_RECV_PACKET_BUFFER_SIZE (16U)
 
-typedef enum {
-    CommsPacket_State_DataLen_En,
-    CommsPacket_State_Payload_En,
-    CommsPacket_State_CRC_En,
-} comms_state_t;
+static comms_frame_parser_t parser;
 
-static comms_state_t cur_state = CommsPacket_State_DataLen_En;
-static comms_packet_t cur_packet = {.length=0U, .data={0U}, .crc=0U};
-static uint8_t data_bytes_read = 0;
+/* On a shared bus only the polled node may talk, so nothing is ACKed or RETX'd */
+static bool silent = false;
 
 static comms_packet_t last_trasmit_packet = {.length=0U, .data={0U}, .crc=0U};
 static comms_packet_t recv_packet_buffer[COMMS_RECV_PACKET_BUFFER_SIZE] = {{0U}, {0U}, {0U}, {0U}};
@@ -22,68 +17,96 @@ static uint8_t packet_buffer_write_index = 0U;
 static comms_packet_t retx_packet = {.length=0U, .data={0U}, .crc=0U};
 static comms_packet_t ack_packet = {.length=0U, .data={0U}, .crc=0U};
 
+/* CRC failures pick the data frame size the ACKs ask the host for */
+static comms_link_t link_quality;
+
+
+static uint8_t comms_free_slots(void) {
+    const uint8_t queued = (uint8_t) ((packet_buffer_write_index + COMMS_RECV_PACKET_BUFFER_SIZE - packet_buffer_read_index) % COMMS_RECV_PACKET_BUFFER_SIZE);
+    return (uint8_t) (COMMS_RECV_PACKET_BUFFER_SIZE - 1U - queued);
+}
+
+
+static void comms_queue_packet(const comms_packet_t* packet) {
+    uint8_t next_packet_buffer_write_index = (packet_buffer_write_index + 1) % COMMS_RECV_PACKET_BUFFER_SIZE;
+    if (next_packet_buffer_write_index == packet_buffer_read_index)  {
+        packet_buffer_read_index = (packet_buffer_read_index + 1) % COMMS_RECV_PACKET_BUFFER_SIZE;
+    }
+
+    comms_packet_copy(packet, &recv_packet_buffer[packet_buffer_write_index]);
+    packet_buffer_write_index = next_packet_buffer_write_index;
+}
+
+
+static void comms_send(const comms_packet_t* packet) {
+    uint8_t frame[COMMS_FRAME_MAX_LEN];
+    uart_write(frame, comms_frame_encode(packet, frame));
+}
+
+
+/* The ACK tells the host how many more packets it may send before waiting for this end to catch up,
+ * and how large they should be */
+static void comms_send_ack(void) {
+    ack_packet.data[COMMS_ACK_CREDITS_INDEX] = comms_free_slots();
+    ack_packet.data[COMMS_ACK_MAX_PAYLOAD_INDEX] = link_quality.max_payload;
+    ack_packet.crc = comms_packet_crc(&ack_packet);
+    comms_send(&ack_packet);
+}
 
 
 void comms_setup(void) {
+    rs_setup();
+    comms_frame_parser_reset(&parser);
+    comms_link_reset(&link_quality);
     comms_create_single_byte_packet(&retx_packet, COMMS_RETX_PACKET_DATA0);
     comms_create_single_byte_packet(&ack_packet, COMMS_ACK_PACKET_DATA0);
+    ack_packet.length = COMMS_ACK_PACKET_LEN;
     comms_create_single_byte_packet(&last_trasmit_packet, COMMS_ACK_PACKET_DATA0);
 }
 
 
+static void comms_packet_received(const comms_packet_t* cur_packet) {
+    const uint8_t computed_crc = comms_packet_crc(cur_packet);
+    if (!silent && (cur_packet->length != COMMS_BCAST_FRAME_TAG)) {
+        (void) comms_link_record(&link_quality, cur_packet->crc != computed_crc);
+    }
+
+    if (cur_packet->crc != computed_crc) {
+        /* Request Retransmit (broadcast frames are recovered through NACKs instead) */
+        if (!silent && (cur_packet->length != COMMS_BCAST_FRAME_TAG)) {
+            comms_write(&retx_packet);
+        }
+    }
+    else if (silent) {
+        comms_queue_packet(cur_packet);
+    }
+    else if (cur_packet->length == COMMS_BCAST_FRAME_TAG) {
+        /* Stray broadcast frame outside a broadcast session, never image data for a unicast transfer */
+    }
+    else if (comms_is_single_byte_packet(cur_packet, COMMS_RETX_PACKET_DATA0)) {
+        /* Got Retx Request Packet */ 
+        comms_write(&last_trasmit_packet);
+    }
+    else if (comms_is_single_byte_packet(cur_packet, COMMS_ACK_PACKET_DATA0)) {
+        /* Got Acknowledgement Packet */ 
+    }
+    else if (comms_free_slots() == 0U) {
+        /* Host ignored the credits, have it send this one again instead of dropping a queued packet */
+        comms_write(&retx_packet);
+    }
+    else {
+        /* Normal Packet Recieved */
+        comms_queue_packet(cur_packet);
+
+        /* Give Acknowledgement */
+        comms_send_ack();
+    }
+}
+
+
 void comms_update(void) {
-    switch (cur_state) {
-        case CommsPacket_State_DataLen_En: {
-            cur_packet.length = uart_read_byte();
-            cur_state = CommsPacket_State_Payload_En;
-        } break;
-
-        case CommsPacket_State_Payload_En: {
-            cur_packet.data[data_bytes_read] = uart_read_byte();
-            data_bytes_read++;
-            if (data_bytes_read == COMMS_PACKET_PAYLOAD_LEN) {
-                cur_state = CommsPacket_State_CRC_En;
-            }
-        } break;
-
-        case CommsPacket_State_CRC_En: {
-            uint8_t computed_crc;
-            cur_packet.crc = uart_read_byte();
-            computed_crc = crc8((uint8_t *) &cur_packet, COMMS_PACKET_FULL_LEN-COMMS_PACKET_CRC_LEN);
-            if (cur_packet.crc != computed_crc) {
-                /* Request Retransmit */
-                comms_write(&retx_packet);
-            }
-            else if (comms_is_single_byte_packet(&cur_packet, COMMS_RETX_PACKET_DATA0)) {
-                /* Got Retx Request Packet */ 
-                comms_write(&last_trasmit_packet);
-            }
-            else if (comms_is_single_byte_packet(&cur_packet, COMMS_ACK_PACKET_DATA0)) {
-                /* Got Acknowledgement Packet */ 
-            }
-            else {
-                /* Normal Packet Recieved */
-                uint8_t next_packet_buffer_write_index = (packet_buffer_write_index + 1) % COMMS_RECV_PACKET_BUFFER_SIZE;
-                if (next_packet_buffer_write_index == packet_buffer_read_index)  {
-                    packet_buffer_read_index = (packet_buffer_read_index + 1) % COMMS_RECV_PACKET_BUFFER_SIZE;
-                }
-
-                comms_packet_copy(&cur_packet, &recv_packet_buffer[packet_buffer_write_index]);
-                packet_buffer_write_index = next_packet_buffer_write_index;
-
-                /* Give Acknowledgement */
-                comms_write(&ack_packet);
-            }
-
-            /* Reset Data Bytes, State */
-            data_bytes_read = 0;
-            cur_state = CommsPacket_State_DataLen_En;
-
-        } break;
-
-        default:  {
-            cur_state = CommsPacket_State_DataLen_En;
-        } break;
+    if (comms_frame_parse(&parser, uart_read_byte())) {
+        comms_packet_received(&parser.packet);
     }
 }
 
@@ -94,7 +117,7 @@ bool comms_packets_available(void) {
 
 
 void comms_write(comms_packet_t* packet) {
-    uart_write((uint8_t *) packet, COMMS_PACKET_FULL_LEN);
+    comms_send(packet);
     if (comms_is_single_byte_packet(packet, COMMS_RETX_PACKET_DATA0) || comms_is_single_byte_packet(packet, COMMS_ACK_PACKET_DATA0)) {
         return;
     }
@@ -102,6 +125,18 @@ void comms_write(comms_packet_t* packet) {
 }
 
 
+/* Re-send a received packet unchanged on another link (gateway towards the next hop) */
+void comms_forward(uart_t* next_hop, const comms_packet_t* packet) {
+    uint8_t frame[COMMS_FRAME_MAX_LEN];
+    uart_send(next_hop, frame, comms_frame_encode(packet, frame));
+}
+
+
+void comms_set_silent(bool silent_mode) {
+    silent = silent_mode;
+}
+
+
 void comms_read(comms_packet_t* packet) {
     if (packet_buffer_read_index == packet_buffer_write_index) {
         return;
@@ -110,37 +145,3 @@ void comms_read(comms_packet_t* packet) {
     comms_packet_copy(&recv_packet_buffer[packet_buffer_read_index], packet);
     packet_buffer_read_index = (packet_buffer_read_index+1) % COMMS_RECV_PACKET_BUFFER_SIZE;
 }
-
-
-/* Comms Utils */
-void comms_packet_copy(const comms_packet_t* source, comms_packet_t* dest) {
-    dest->length = source->length;
-    for (uint8_t i = 0; i < COMMS_PACKET_PAYLOAD_LEN; i++) {
-        dest->data[i] = source->data[i];
-    }
-    dest->crc = source->crc;
-}
-
-bool comms_is_single_byte_packet(const comms_packet_t* packet, uint8_t byte)  {
-    if (packet->length != 1U) {
-        return false;
-    }
-    if (packet->data[0] != byte) {
-        return false;
-    }
-    for (uint8_t i = 1; i < COMMS_PACKET_PAYLOAD_LEN; i++) {
-        if (packet->data[i] != 0xFF) {
-            return false;
-        }
-    }
-    return true;
-}
-
-void comms_create_single_byte_packet(comms_packet_t* packet, uint8_t byte) {
-    packet->length = 0x01;
-    packet->data[0] = byte;
-    for (uint8_t i = 1; i < 16; i++) {
-        packet->data[i] = 0xFF;
-    }
-    packet->crc = crc8((uint8_t *) packet, COMMS_PACKET_FULL_LEN - COMMS_PACKET_CRC_LEN);
-}
\ No newline at end of file
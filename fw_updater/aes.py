@@ -0,0 +1,73 @@
+"""Minimal AES-128 encryption and CTR mode, used to encrypt firmware images on the build host.
+
+CTR counter blocks match shared/src/core/aes128.c: the 16-byte nonce with its
+last four bytes treated as a big-endian block counter.
+"""
+
+SBOX = [0] * 256
+
+
+def _init_sbox():
+    # Multiplicative inverse in GF(2^8) followed by the affine transform
+    p = q = 1
+    while True:
+        p = p ^ ((p << 1) & 0xFF) ^ (0x1B if p & 0x80 else 0)
+        q ^= q << 1
+        q ^= q << 2
+        q ^= q << 4
+        q &= 0xFF
+        if q & 0x80:
+            q ^= 0x09
+        x = q ^ ((q << 1) | (q >> 7)) ^ ((q << 2) | (q >> 6)) ^ ((q << 3) | (q >> 5)) ^ ((q << 4) | (q >> 4))
+        SBOX[p] = (x ^ 0x63) & 0xFF
+        if p == 1:
+            break
+    SBOX[0] = 0x63
+
+
+_init_sbox()
+
+
+def _xtime(b: int) -> int:
+    return ((b << 1) ^ 0x1B) & 0xFF if b & 0x80 else b << 1
+
+
+def expand_key(key: bytes) -> list[list[int]]:
+    if len(key) != 16:
+        raise ValueError("AES-128 needs a 16-byte key")
+    words = [list(key[4 * i:4 * i + 4]) for i in range(4)]
+    rcon = 1
+    for i in range(4, 44):
+        t = list(words[i - 1])
+        if i % 4 == 0:
+            t = [SBOX[t[1]] ^ rcon, SBOX[t[2]], SBOX[t[3]], SBOX[t[0]]]
+            rcon = _xtime(rcon)
+        words.append([words[i - 4][j] ^ t[j] for j in range(4)])
+    return [sum(words[4 * r:4 * r + 4], []) for r in range(11)]
+
+
+def encrypt_block(round_keys: list[list[int]], block: bytes) -> bytes:
+    s = [b ^ k for b, k in zip(block, round_keys[0])]
+    for rnd in range(1, 11):
+        s = [SBOX[b] for b in s]
+        s = [s[(i + 4 * (i % 4)) % 16] for i in range(16)]       # ShiftRows (column-major state)
+        if rnd != 10:
+            mixed = []
+            for c in range(4):
+                a = s[4 * c:4 * c + 4]
+                t = a[0] ^ a[1] ^ a[2] ^ a[3]
+                mixed += [a[i] ^ t ^ _xtime(a[i] ^ a[(i + 1) % 4]) for i in range(4)]
+            s = mixed
+        s = [b ^ k for b, k in zip(s, round_keys[rnd])]
+    return bytes(s)
+
+
+def ctr_crypt(key: bytes, nonce: bytes, data: bytes, block_index: int = 0) -> bytes:
+    round_keys = expand_key(key)
+    counter = int.from_bytes(nonce[12:16], "big")
+    out = bytearray()
+    for offset in range(0, len(data), 16):
+        block = nonce[:12] + ((counter + block_index + offset // 16) & 0xFFFFFFFF).to_bytes(4, "big")
+        keystream = encrypt_block(round_keys, block)
+        out += bytes(d ^ k for d, k in zip(data[offset:offset + 16], keystream))
+    return bytes(out)
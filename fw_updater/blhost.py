@@ -0,0 +1,214 @@
+"""ctypes bindings for host/libblhost.so, the protocol built from the firmware's own sources.
+
+Build it with 'make -C host'; BLHOST_LIB overrides where it is looked for. There is no Python
+fallback: the frame codec and both session state machines exist once, in C, so this tool and
+the bootloader cannot drift apart.
+"""
+import ctypes
+import os
+
+LIB_PATH = os.environ.get("BLHOST_LIB", os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "host", "libblhost.so"))
+
+BLH_OPTION_FEC      = 1 << 0
+BLH_OPTION_DENSE    = 1 << 1
+BLH_OPTION_ENTER    = 1 << 2
+BLH_RESULT_PENDING  = -1
+BLH_NODE_ADDRESS_UNKNOWN = -1
+BLH_TIME_UNKNOWN    = 0xFFFFFFFF
+PAYLOAD_LEN         = 16        # of control packets and broadcast frames; the wire format, not a buffer size
+
+
+class Status(ctypes.Structure):
+    _fields_ = [
+        ("result", ctypes.c_int32),
+        ("offset", ctypes.c_uint32),
+        ("bytes_sent", ctypes.c_uint32),
+        ("rtt_count", ctypes.c_uint32),
+        ("rtt_total_ms", ctypes.c_uint32),
+        ("rtt_max_ms", ctypes.c_uint32),
+        ("node_address", ctypes.c_int32),
+        ("boot_us", ctypes.c_uint32),
+        ("transfer_ms", ctypes.c_uint32),
+        ("verify_ms", ctypes.c_uint32),
+        ("state", ctypes.c_char_p),
+        ("message", ctypes.c_char_p),
+    ]
+
+
+class BroadcastStatus(ctypes.Structure):
+    _fields_ = [
+        ("result", ctypes.c_int32),
+        ("frames_sent", ctypes.c_uint32),
+        ("total_frames", ctypes.c_uint32),
+        ("message", ctypes.c_char_p),
+    ]
+
+
+class BroadcastNode(ctypes.Structure):
+    _fields_ = [
+        ("address", ctypes.c_uint16),
+        ("status", ctypes.c_int32),
+        ("missing", ctypes.c_uint32),
+        ("result", ctypes.c_int32),
+    ]
+
+
+def _load():
+    try:
+        lib = ctypes.CDLL(LIB_PATH)
+    except OSError:
+        return None
+    u8p = ctypes.POINTER(ctypes.c_uint8)
+    lib.blh_frame_max_len.restype = ctypes.c_uint32
+    lib.blh_tx_buffer_size.restype = ctypes.c_uint32
+    lib.blh_crc8.argtypes = [ctypes.c_char_p, ctypes.c_uint32]
+    lib.blh_crc8.restype = ctypes.c_uint8
+    lib.blh_encode_packet.argtypes = [ctypes.c_char_p, ctypes.c_uint8, u8p]
+    lib.blh_encode_packet.restype = ctypes.c_uint32
+    lib.blh_encode_addressed.argtypes = [ctypes.c_uint32, ctypes.c_char_p, ctypes.c_uint8, u8p]
+    lib.blh_encode_addressed.restype = ctypes.c_uint32
+    lib.blh_encode_broadcast.argtypes = [ctypes.c_uint16, ctypes.c_char_p, u8p]
+    lib.blh_encode_broadcast.restype = ctypes.c_uint32
+    lib.blh_add_fec.argtypes = [u8p, ctypes.c_uint32]
+    lib.blh_add_fec.restype = ctypes.c_uint32
+    lib.blh_decode_frame.argtypes = [ctypes.c_char_p, ctypes.c_uint32, u8p, u8p]
+    lib.blh_decode_frame.restype = ctypes.c_uint32
+    lib.blh_image_storage_size.argtypes = [ctypes.c_uint32]
+    lib.blh_image_storage_size.restype = ctypes.c_uint32
+    lib.blh_image_size.restype = ctypes.c_uint32
+    lib.blh_image_init.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_uint32, ctypes.c_uint32, ctypes.c_void_p]
+    lib.blh_image_init.restype = ctypes.c_bool
+    lib.blh_session_size.restype = ctypes.c_uint32
+    lib.blh_session_init.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_uint32, ctypes.c_uint32]
+    lib.blh_session_init.restype = ctypes.c_bool
+    lib.blh_session_update.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_uint32, ctypes.c_uint32, u8p, ctypes.c_uint32]
+    lib.blh_session_update.restype = ctypes.c_uint32
+    lib.blh_session_status.argtypes = [ctypes.c_void_p, ctypes.POINTER(Status)]
+    lib.blh_session_set_target.argtypes = [ctypes.c_void_p, ctypes.c_uint16]
+    lib.blh_bcast_size.restype = ctypes.c_uint32
+    lib.blh_bcast_init.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_uint32, ctypes.POINTER(ctypes.c_uint16),
+                                   ctypes.c_uint32, ctypes.c_uint32, ctypes.c_uint32]
+    lib.blh_bcast_init.restype = ctypes.c_bool
+    lib.blh_bcast_update.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_uint32, ctypes.c_uint32, u8p, ctypes.c_uint32]
+    lib.blh_bcast_update.restype = ctypes.c_uint32
+    lib.blh_bcast_status.argtypes = [ctypes.c_void_p, ctypes.POINTER(BroadcastStatus)]
+    lib.blh_bcast_node.argtypes = [ctypes.c_void_p, ctypes.c_uint32, ctypes.POINTER(BroadcastNode)]
+    lib.blh_bcast_node.restype = ctypes.c_bool
+    lib.blh_bcast_status_name.argtypes = [ctypes.c_int32]
+    lib.blh_bcast_status_name.restype = ctypes.c_char_p
+    return lib
+
+
+lib = _load()
+
+# Buffer sizes come from the library, which takes them from the firmware's comms-frame.h
+FRAME_MAX_LEN = lib.blh_frame_max_len() if lib else 0
+TX_BUFFER_SIZE = lib.blh_tx_buffer_size() if lib else 0
+
+
+def crc8(buffer) -> int:
+    data = bytes(buffer)
+    return lib.blh_crc8(data, len(data))
+
+
+def _frame_bytes(encode, *args) -> bytes:
+    frame = (ctypes.c_uint8 * FRAME_MAX_LEN)()
+    return bytes(frame[:encode(*args, frame)])
+
+
+def encode_packet(payload) -> bytes:
+    data = bytes(payload)
+    return _frame_bytes(lib.blh_encode_packet, data, len(data))
+
+
+def encode_addressed(offset: int, chunk: bytes) -> bytes:
+    return _frame_bytes(lib.blh_encode_addressed, offset, bytes(chunk), len(chunk))
+
+
+def encode_broadcast(seq: int, chunk: bytes) -> bytes:
+    return _frame_bytes(lib.blh_encode_broadcast, seq, bytes(chunk).ljust(PAYLOAD_LEN, b"\xff"))
+
+
+def add_fec(frame: bytes) -> bytes:
+    buffer = (ctypes.c_uint8 * FRAME_MAX_LEN).from_buffer_copy(frame.ljust(FRAME_MAX_LEN, b"\x00"))
+    return bytes(buffer[:lib.blh_add_fec(buffer, len(frame))])
+
+
+def decode_frame(data: bytes) -> tuple[int, bytes, int] | None:
+    """(length byte, payload, bytes consumed) of the first frame in `data` with a good CRC."""
+    payload = (ctypes.c_uint8 * FRAME_MAX_LEN)()
+    length = ctypes.c_uint8()
+    consumed = lib.blh_decode_frame(bytes(data), len(data), payload, ctypes.byref(length))
+    if not consumed:
+        return None
+    # Large data frames carry as many bytes as their length byte says, everything else 16
+    size = length.value if PAYLOAD_LEN < length.value <= FRAME_MAX_LEN else PAYLOAD_LEN
+    return length.value, bytes(payload[:size]), consumed
+
+
+class Image:
+    """An image with its frames encoded once, with or without FEC, for any number of Sessions."""
+
+    def __init__(self, image: bytes, fec: bool = False):
+        self.image = bytes(image)       # the frames are encoded from it, sessions read it for sparse skipping
+        self.fec = fec
+        self.length = len(self.image)
+        self.storage = ctypes.create_string_buffer(lib.blh_image_storage_size(self.length))
+        self.state = ctypes.create_string_buffer(lib.blh_image_size())
+        self.valid = lib.blh_image_init(self.state, self.image, self.length, BLH_OPTION_FEC if fec else 0, self.storage)
+
+
+class Session:
+    """The native update state machine; feed it received bytes, write out what it returns."""
+
+    def __init__(self, image: Image, now_ms: int, dense: bool = False, enter: bool = False, target: int | None = None):
+        self.image = image              # the session points into it
+        self.state = ctypes.create_string_buffer(lib.blh_session_size())
+        self.tx = (ctypes.c_uint8 * TX_BUFFER_SIZE)()
+        options = (BLH_OPTION_DENSE if dense else 0) | (BLH_OPTION_ENTER if enter else 0)
+        lib.blh_session_init(self.state, image.state, options, now_ms & 0xFFFFFFFF)
+        if target is not None:
+            lib.blh_session_set_target(self.state, target)
+
+    def update(self, rx: bytes, now_ms: int) -> bytes:
+        length = lib.blh_session_update(self.state, rx, len(rx), now_ms & 0xFFFFFFFF, self.tx, TX_BUFFER_SIZE)
+        return bytes(self.tx[:length])
+
+    def status(self) -> Status:
+        status = Status()
+        lib.blh_session_status(self.state, ctypes.byref(status))
+        return status
+
+
+class Broadcast:
+    """The native broadcast state machine; times are in microseconds, call update() about every millisecond."""
+
+    def __init__(self, image: bytes, nodes: list[int], baud_rate: int, now_us: int):
+        self.image = bytes(image)
+        self.state = ctypes.create_string_buffer(lib.blh_bcast_size())
+        self.tx = (ctypes.c_uint8 * TX_BUFFER_SIZE)()
+        addresses = (ctypes.c_uint16 * len(nodes))(*nodes)
+        self.valid = lib.blh_bcast_init(self.state, self.image, len(self.image), addresses, len(nodes), baud_rate,
+                                        now_us & 0xFFFFFFFF)
+        self.node_count = len(nodes)
+
+    def update(self, rx: bytes, now_us: int) -> bytes:
+        length = lib.blh_bcast_update(self.state, rx, len(rx), now_us & 0xFFFFFFFF, self.tx, TX_BUFFER_SIZE)
+        return bytes(self.tx[:length])
+
+    def status(self) -> BroadcastStatus:
+        status = BroadcastStatus()
+        lib.blh_bcast_status(self.state, ctypes.byref(status))
+        return status
+
+    def nodes(self) -> list[BroadcastNode]:
+        nodes = []
+        for index in range(self.node_count):
+            node = BroadcastNode()
+            lib.blh_bcast_node(self.state, index, ctypes.byref(node))
+            nodes.append(node)
+        return nodes
+
+
+def status_name(status: int) -> str:
+    return lib.blh_bcast_status_name(status).decode()
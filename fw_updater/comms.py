@@ -1,222 +1,354 @@
 import asyncio
-import serial_asyncio
-from enum import Enum
+from enum import IntEnum
+import argparse
+import os
 import sys
+import time
+import zlib
+
+import blhost
+import fw_image
+try:
+    import serial_raw
+except ImportError:     # no termios (Windows), pyserial only
+    serial_raw = None
+try:
+    import serial_asyncio
+except ImportError:     # the termios backend does not need pyserial
+    serial_asyncio = None
+
+# The protocol itself (frame codec, update and broadcast state machines) is host/libblhost.so,
+# built from the bootloader's own sources; this file only moves bytes and reports.
+
+DEFAULT_PORT                      = "/dev/ttyUSB0"
+DEFAULT_BAUD_RATE                 = 115200
+DEFAULT_BACKEND                   = "termios" if serial_raw else "pyserial"
+SERIAL_RX_BUFFER_SIZE             = 4096
+SESSION_POLL_INTERVAL             = 0.01    # s, how often an update session checks its timeouts
+BROADCAST_POLL_INTERVAL           = 0.001   # s, broadcast frames are paced in the library, it needs a fine clock
+DEFAULT_SIGNING_KEY               = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "keys", "signing-key.bin")
+QUIET_STATES                      = (b"SendFrame", b"WaitFrameReady")     # not logged, they alternate per frame
+
+
+class DeviceResult(IntEnum):
+    """Per-device exit code, the process exits with the highest one."""
+    Success     = 0
+    Failed      = 1
+    Timeout     = 2
+    PortError   = 3
+
+
+def open_serial(loop, protocol_factory, port: str, baud_rate: int, rtscts: bool, backend: str):
+    module = serial_raw if backend == "termios" else serial_asyncio
+    if module is None:
+        raise RuntimeError(f"the {backend} backend is not available here")
+    return module.create_serial_connection(loop, protocol_factory, port, baudrate=baud_rate, rtscts=rtscts)
+
+
+class SerialProtocol(asyncio.BufferedProtocol):
+    """Hands every chunk the port delivers to the session; the library finds the packets in them."""
+
+    def __init__(self, session: "DeviceSession | BroadcastSession"):
+        self.session = session
+        self.buffer = bytearray(SERIAL_RX_BUFFER_SIZE)
+        self.view = memoryview(self.buffer)
 
-# Coms Packets
-COMMS_PACKET_DATALEN_LEN           = 1
-COMMS_PACKET_PAYLOAD_LEN           = 16
-COMMS_PACKET_CRC_LEN               = 1
-COMMS_PACKET_FULL_LEN              = COMMS_PACKET_DATALEN_LEN + COMMS_PACKET_PAYLOAD_LEN + COMMS_PACKET_CRC_LEN
-
-COMMS_RETX_PACKET_DATA0            = 0x15
-COMMS_ACK_PACKET_DATA0             = 0x19
-
-# BL Packets
-DEVICE_ID                         = 0x52
-DEFAULT_TIMEOUT                   = 5000
-SYNC_SEQ_B0                       = 0xAA
-SYNC_SEQ_B1                       = 0xBB
-SYNC_SEQ_B2                       = 0xCC
-SYNC_SEQ_B3                       = 0xDD
-SYNC_SEQ_BYTES                    = [SYNC_SEQ_B0, SYNC_SEQ_B1, SYNC_SEQ_B2, SYNC_SEQ_B3]
-
-BL_PACKET_SEQ_OBSERVED_DATA0      = 0x23
-BL_PACKET_FW_UPDATE_REQ_DATA0     = 0x25
-BL_PACKET_FW_UPDATE_RES_DATA0     = 0x26
-BL_PACKET_DEVICE_ID_REQ_DATA0     = 0x31
-BL_PACKET_DEVICE_ID_RES_DATA0     = 0x32
-BL_PACKET_FW_LENGTH_REQ_DATA0     = 0x35
-BL_PACKET_FW_LENGTH_RES_DATA0     = 0x36
-BL_PACKET_READY_FOR_DATA_DATA0    = 0x39
-BL_PACKET_FW_UPDATE_SUCCESS_DATA0 = 0x41
-
-DEBUG_BL = False
-
-def crc8(buffer: list[int]) -> int:
-    crc = 0
-    for byte in buffer:
-        crc ^= byte
-        for _ in range(8):
-            if crc & 0x80:
-                crc = ((crc << 1) ^ 0x07) & 0xFF
-            else:
-                crc = (crc << 1) & 0xFF
-    return crc
-
-def create_packet(payload: list[int]) -> bytes:
-    padded_payload = payload + [0xFF] * (16 - len(payload))   # pad 0xFF's for 16 bytes
-    data = [len(payload)] + padded_payload                    # data before CRC = [LEN] + payload(16)
-    crc = crc8(data)                                          # compute CRC
-    return bytes(data + [crc])                                # return full packet (18 bytes)
-
-
-# Special Packets
-ACK_PACKET = create_packet([COMMS_ACK_PACKET_DATA0])
-REQ_RETX_PACKET = create_packet([COMMS_RETX_PACKET_DATA0])
-recv_packets_buff: asyncio.Queue[bytes] = asyncio.Queue()
-last_transmit_packet: bytes = bytes([0x00] * 18)
-
-
-async def transmit_packet(transport: serial_asyncio.SerialTransport, packet: bytes):
-    global last_transmit_packet
-    transport.write(packet)
-    last_transmit_packet = packet
+    def connection_made(self, transport):
+        low_latency = transport.get_extra_info("low_latency") if hasattr(transport, "get_extra_info") else None
+        self.session.log("✅ Serial port opened" + (" (low latency)" if low_latency else ""))
 
-    while True:
-        pkt = await recv_packets_buff.get()   # wait for next received packet
-        if pkt == ACK_PACKET:
-            print("Ack Received")
-            break
-        elif pkt == REQ_RETX_PACKET:
-            print("Retransmit Requested")
-            transport.write(last_transmit_packet)
-        # ignore everything else
-
-
-class BL_STATE(Enum):
-    BL_State_Sync = 0
-    BL_State_SendUpdateReq = 1
-    BL_State_WaitForUpdateRes = 2
-    BL_State_DeviceIDReq = 3
-    BL_State_DeviceIDRes = 4
-    BL_State_FwLengthReq = 5
-    BL_State_FwLengthRes = 6
-    BL_State_EraseApplication = 7
-    BL_State_RecieveFirmware = 8
-    BL_State_UpdateSuccess = 9
-
-
-class SerialProtocol(asyncio.Protocol):
-    def __init__(self):
-        self.transport = None
-        self.cur_buff = bytes()
+    def get_buffer(self, sizehint: int) -> memoryview:
+        return self.view
 
-    def connection_made(self, transport):
-        self.transport = transport
-        print("✅ Serial port opened")
+    def buffer_updated(self, nbytes: int):
+        self.session.received.put_nowait(bytes(self.view[:nbytes]))
 
     def data_received(self, data):
-        self.cur_buff += data
-        while len(self.cur_buff) >= 18:
-            packet = self.cur_buff[:18]
-            recv_packets_buff.put_nowait(packet)
-            self.cur_buff = self.cur_buff[18:]
+        # pyserial-asyncio hands over bytes objects instead of filling get_buffer()
+        self.session.received.put_nowait(bytes(data))
 
     def connection_lost(self, exc):
-        print("❌ Serial port closed")
-
+        if exc is not None:
+            self.session.log(f"❌ Serial port lost: {exc}")
+
+
+async def receive(queue: asyncio.Queue, timeout: float) -> bytes:
+    """Everything received so far, waiting up to `timeout` for the first chunk."""
+    try:
+        chunks = [await asyncio.wait_for(queue.get(), timeout)]
+    except asyncio.TimeoutError:
+        return b""
+    while not queue.empty():
+        chunks.append(queue.get_nowait())
+    return b"".join(chunks)
+
+
+class DeviceSession:
+    """One bootloader on one serial port, driven by the C session of host/libblhost.so (the one blflash runs).
+    All state lives here so many can share an event loop."""
+
+    def __init__(self, port: str, baud_rate: int, image: blhost.Image, verbose: bool, rtscts: bool = False,
+                 sparse: bool = False, backend: str = DEFAULT_BACKEND, enter: bool = False, target: int | None = None):
+        self.port = port
+        self.baud_rate = baud_rate
+        self.rtscts = rtscts
+        self.backend = backend
+        self.sparse = sparse
+        self.enter = enter
+        self.target = target
+        self.image = image              # shared with the other sessions, FEC or not is its choice
+        self.fw_length = image.length
+        self.verbose = verbose
 
-async def bl_state_machine(transport: serial_asyncio.SerialTransport, protocol, fw_length, fw_bytes):
-    state = BL_STATE.BL_State_Sync
-    seq_byts = bytes([0xAA, 0xBB, 0xCC, 0xDD])
-    offset = 0
+        self.transport = None
+        self.received: asyncio.Queue[bytes] = asyncio.Queue()
+
+        self.offset = 0
+        self.bytes_sent = 0
+        self.status = "waiting"
+        self.result: DeviceResult | None = None
+
+    def log(self, message: str):
+        self.status = message
+        if self.verbose:
+            print(f"[{self.port}] {message}")
+
+    def finish(self, result: DeviceResult, message: str):
+        self.result = result
+        self.log(message)
+
+    async def run(self) -> DeviceResult:
+        loop = asyncio.get_running_loop()
+        try:
+            self.transport, _ = await open_serial(loop, lambda: SerialProtocol(self), self.port, self.baud_rate,
+                                                  self.rtscts, self.backend)
+        except Exception as e:
+            self.finish(DeviceResult.PortError, f"❌ cannot open port: {e}")
+            return self.result
+
+        try:
+            await self.bl_state_machine()
+        except OSError as e:
+            # SerialException included; only this device's result, the other sessions carry on
+            self.finish(DeviceResult.PortError, f"❌ serial port error: {e}")
+        except Exception as e:
+            self.finish(DeviceResult.Failed, f"❌ {type(e).__name__}: {e}")
+        finally:
+            self.transport.close()
+        return self.result
+
+    async def bl_state_machine(self):
+        now_ms = lambda: int(time.monotonic() * 1000)
+        native = blhost.Session(self.image, now_ms(), dense=not self.sparse, enter=self.enter, target=self.target)
+        started = time.monotonic()
+        state = None
+        node_address = blhost.BLH_NODE_ADDRESS_UNKNOWN
+        boot_us = 0
+        rx = b""
+        while True:
+            tx = native.update(rx, now_ms())
+            if tx:
+                self.transport.write(tx)
+            status = native.status()
+            self.offset, self.bytes_sent = status.offset, status.bytes_sent
+            if status.node_address != node_address:
+                node_address = status.node_address
+                self.log(f"Node address {node_address:04x} (for --broadcast --node)")
+            if status.boot_us != boot_us:
+                boot_us = status.boot_us
+                self.log(f"Application reached main() {boot_us} us after the bootloader's jump")
+            if status.state != state:
+                state = status.state
+                if state not in QUIET_STATES:
+                    self.log(state.decode())
+            if status.result != blhost.BLH_RESULT_PENDING:
+                break
+            rx = await receive(self.received, SESSION_POLL_INTERVAL)
+
+        rtt = status.rtt_total_ms / status.rtt_count if status.rtt_count else 0
+        timing = ""
+        if status.verify_ms != blhost.BLH_TIME_UNKNOWN:
+            timing = (f"; transfer: {status.transfer_ms} ms, "
+                      f"post-transfer verification (CRC + signature): {status.verify_ms} ms")
+        self.finish(DeviceResult(status.result),
+                    f"{'✅' if status.result == DeviceResult.Success else '❌'} {status.message.decode()} "
+                    f"({(time.monotonic() - started) * 1000:.0f} ms, rtt {rtt:.2f} ms avg, "
+                    f"{status.rtt_max_ms} max over {status.rtt_count} frames{timing})")
+
+
+class BroadcastSession:
+    """Every listed node on one shared bus programs the same frames, driven by the C broadcast of host/libblhost.so."""
+
+    def __init__(self, port: str, baud_rate: int, fw_bytes: bytes, nodes: list[int], verbose: bool,
+                 rtscts: bool = False, backend: str = DEFAULT_BACKEND):
+        self.port = port
+        self.baud_rate = baud_rate
+        self.rtscts = rtscts
+        self.backend = backend
+        self.fw_bytes = fw_bytes
+        self.nodes = nodes
+        self.verbose = verbose
 
+        self.transport = None
+        self.received: asyncio.Queue[bytes] = asyncio.Queue()
+        self.status = ""
+        self.frames_sent = 0
+        self.total_frames = 0
+        self.node_status: dict[int, str] = {node: "no answer" for node in nodes}
+
+    def log(self, message: str):
+        self.status = message
+        if self.verbose:
+            print(f"[{self.port}] {message}")
+
+    async def run(self) -> dict[int, DeviceResult]:
+        loop = asyncio.get_running_loop()
+        try:
+            self.transport, _ = await open_serial(loop, lambda: SerialProtocol(self), self.port, self.baud_rate,
+                                                  self.rtscts, self.backend)
+        except Exception as e:
+            self.log(f"❌ cannot open port: {e}")
+            return {node: DeviceResult.PortError for node in self.nodes}
+
+        try:
+            return await self.broadcast()
+        except OSError as e:
+            self.log(f"❌ serial port error: {e}")
+            return {node: DeviceResult.PortError for node in self.nodes}
+        finally:
+            self.transport.close()
+
+    async def broadcast(self) -> dict[int, DeviceResult]:
+        now_us = lambda: int(time.monotonic() * 1000000)
+        native = blhost.Broadcast(self.fw_bytes, self.nodes, self.baud_rate, now_us())
+        if not native.valid:
+            self.log(f"❌ {native.status().message.decode()}")
+            return {node: DeviceResult.Failed for node in self.nodes}
+        message = None
+        rx = b""
+        while True:
+            tx = native.update(rx, now_us())
+            if tx:
+                self.transport.write(tx)
+            status = native.status()
+            self.frames_sent, self.total_frames = status.frames_sent, status.total_frames
+            if status.message != message:
+                message = status.message
+                self.log(message.decode())
+            if status.result != blhost.BLH_RESULT_PENDING:
+                break
+            rx = await receive(self.received, BROADCAST_POLL_INTERVAL)
+
+        results = {}
+        for node in native.nodes():
+            self.node_status[node.address] = blhost.status_name(node.status)
+            results[node.address] = DeviceResult(node.result)
+        return results
+
+
+def render_table(sessions: list[DeviceSession], started: float) -> str:
+    elapsed = max(time.monotonic() - started, 1e-3)
+    total_sent = sum(s.bytes_sent for s in sessions)
+    lines = [f"{'PORT':<16} {'PROGRESS':>8}  STATUS"]
+    for s in sessions:
+        progress = 100 * min(s.offset, s.fw_length) // s.fw_length
+        lines.append(f"{s.port:<16} {progress:>7}%  {s.status}")
+    lines.append(f"{len(sessions)} device(s), {elapsed:.1f} s, aggregate {total_sent / elapsed / 1024:.1f} KiB/s")
+    return "\n".join(lines)
+
+
+async def show_progress(sessions: list[DeviceSession], started: float):
+    drawn = 0
     while True:
-        if state != BL_STATE.BL_State_RecieveFirmware: print(f"{state}")
-
-        match state:
-            case BL_STATE.BL_State_Sync:
-                transport.write(seq_byts)
-                pkt = await recv_packets_buff.get()
-                if pkt and pkt == create_packet([BL_PACKET_SEQ_OBSERVED_DATA0]):
-                    print("[RECV-SeqObserved]:", pkt.hex(' '))
-                    state = BL_STATE.BL_State_SendUpdateReq
-
-            case BL_STATE.BL_State_SendUpdateReq:
-                pkt = await recv_packets_buff.get()
-                if pkt == create_packet([BL_PACKET_FW_UPDATE_REQ_DATA0]):
-                    print("[RECV-UpdateReq]:", pkt.hex(' '))
-                    state = BL_STATE.BL_State_WaitForUpdateRes
-            
-            case BL_STATE.BL_State_WaitForUpdateRes:
-                pckt = create_packet([BL_PACKET_FW_UPDATE_RES_DATA0])
-                await transmit_packet(transport, pckt)
-                state = BL_STATE.BL_State_DeviceIDReq
-
-            case BL_STATE.BL_State_DeviceIDReq:
-                pkt = await recv_packets_buff.get()
-                if pkt == create_packet([BL_PACKET_DEVICE_ID_REQ_DATA0]):
-                    print("[RECV-DeviceIDReq]:", pkt.hex(' '))
-                    state = BL_STATE.BL_State_DeviceIDRes
-
-            case BL_STATE.BL_State_DeviceIDRes:
-                pckt = create_packet([BL_PACKET_DEVICE_ID_RES_DATA0, DEVICE_ID])
-                await transmit_packet(transport, pckt)
-                state = BL_STATE.BL_State_FwLengthReq
-            
-            case BL_STATE.BL_State_FwLengthReq:
-                pkt = await recv_packets_buff.get()
-                if pkt == create_packet([BL_PACKET_FW_LENGTH_REQ_DATA0]):
-                    print("[RECV-FwLengthReq]:", pkt.hex(' '))
-                    state = BL_STATE.BL_State_FwLengthRes
-
-            case BL_STATE.BL_State_FwLengthRes:
-                if DEBUG_BL: input(f"{state} Start?: ")
-                pckt = create_packet([
-                    BL_PACKET_FW_LENGTH_RES_DATA0, 
-                    (fw_length >> 24) & 0xFF, 
-                    (fw_length >> 16) & 0xFF, 
-                    (fw_length >> 8) & 0xFF, 
-                    fw_length & 0xFF
-                ])
-                await transmit_packet(transport, pckt)
-                state = BL_STATE.BL_State_EraseApplication
-                
-            case BL_STATE.BL_State_EraseApplication:
-                pkt = await recv_packets_buff.get()
-                if pkt == create_packet([BL_PACKET_READY_FOR_DATA_DATA0]):
-                    print("[RECV-FwReadyData]:", pkt.hex(' '))
-                    state = BL_STATE.BL_State_RecieveFirmware
-
-            case BL_STATE.BL_State_RecieveFirmware:
-                if DEBUG_BL:
-                    input(f"{state} Start?: ")
-
-                # Send firmware in 16-byte chunks
-                chunk = fw_bytes[offset:offset+16]
-                pckt = create_packet(list(chunk))
-                await transmit_packet(transport, pckt)
-                offset += 16
-
-                if offset < fw_length:
-                    # Get Ready for Next Packet
-                    recv_pkt = await recv_packets_buff.get()
-                    if recv_pkt == create_packet([BL_PACKET_READY_FOR_DATA_DATA0]):
-                        # print(f"[Recv-ReadyForData]: {recv_pkt.hex(' ')}")
-                        print("Bytes Remaining to Send: ", fw_length-offset)
-                    else:
-                        print("❌ Firmware update failed (unexpected response)")
-                        return
-                else:
-                    state = BL_STATE.BL_State_UpdateSuccess
-            
-            case BL_STATE.BL_State_UpdateSuccess:
-                recv_pkt = await recv_packets_buff.get()
-                if recv_pkt == create_packet([BL_PACKET_FW_UPDATE_SUCCESS_DATA0]):
-                    print("✅ Firmware update completed")
-                    return
-
+        table = render_table(sessions, started)
+        if sys.stdout.isatty():
+            sys.stdout.write(f"\x1b[{drawn}F\x1b[J" if drawn else "")
+            print(table, flush=True)
+            drawn = table.count("\n") + 1
+        await asyncio.sleep(0.5)
 
 
 async def main():
-    # Com Port, Baud Rate
-    COM_PORT = "/dev/ttyUSB0"
-    BAUD_RATE = 115200
-
-    # Firmware Bytes, Length
-    with open("../app/firmware.bin", "rb") as file:
-        FW_BYTES = file.read()
-    FW_LENGTH = len(FW_BYTES)
-
-    # Run Recieve machine
-    loop = asyncio.get_running_loop()
-    transport, protocol = await serial_asyncio.create_serial_connection(
-        loop, SerialProtocol, COM_PORT, baudrate=BAUD_RATE
-    )
-
-    # Run state machine
-    await bl_state_machine(transport, protocol, FW_LENGTH, FW_BYTES)
+    parser = argparse.ArgumentParser(description="Update firmware on one or more bootloaders concurrently")
+    parser.add_argument("image", nargs="?", default="../app/firmware.img",
+                        help="packed image, or an .elf/.hex/.srec build output that is packed on the fly")
+    parser.add_argument("-p", "--port", action="append", help=f"serial port, repeat for more devices (default {DEFAULT_PORT})")
+    parser.add_argument("-b", "--baud", type=int, default=DEFAULT_BAUD_RATE)
+    parser.add_argument("--rtscts", action="store_true", help="hardware flow control (bootloader built with FLOW_CONTROL=1)")
+    parser.add_argument("--backend", choices=["termios", "pyserial"], default=DEFAULT_BACKEND,
+                        help=f"serial I/O: raw termios with low-latency reads, or pyserial-asyncio (default {DEFAULT_BACKEND})")
+    parser.add_argument("--fec", action="store_true", help="add Reed-Solomon parity to every frame (noisy links)")
+    parser.add_argument("--enter", action="store_true",
+                        help="reset a running application into the bootloader and update there, instead of staging")
+    parser.add_argument("-v", "--verbose", action="store_true", help="log every state change per device")
+    parser.add_argument("--broadcast", action="store_true", help="update every node on one shared bus (first --port)")
+    parser.add_argument("-n", "--node", action="append", type=lambda x: int(x, 16), default=[],
+                        help="node address (hex, printed by a unicast update): a node to poll in a broadcast session, "
+                             "or without --broadcast the one node each --port updates, relayed by gateways on the way")
+    parser.add_argument("--version", default="0.0.0", help="image version when packing a build output")
+    parser.add_argument("--build-id", help="hex build id when packing a build output (default: payload CRC)")
+    parser.add_argument("--sign", metavar="KEY", default=DEFAULT_SIGNING_KEY, help="signing key when packing a build output")
+    parser.add_argument("--encrypt", metavar="KEY", help="AES-128 key when packing a build output")
+    parser.add_argument("-D", "--define", action="append", type=fw_image.parse_define, default=[], metavar="NAME=VALUE",
+                        help="memory-map.h override the build used, when packing a build output (e.g. STAGING_SIZE=0)")
+    args = parser.parse_args()
+    ports = args.port or [DEFAULT_PORT]
+    if not blhost.lib:
+        parser.error(f"needs {blhost.LIB_PATH}, build it with 'make -C host'")
+
+    # Firmware Image Bytes, Length
+    if os.path.splitext(args.image)[1].lower() in fw_image.SEGMENT_LOADERS:
+        # Only the loaded segments travel, not the 0xFF filler objcopy puts between them
+        try:
+            segments = fw_image.load_segments(args.image)
+            image = fw_image.pack(segments, fw_image.parse_version(args.version), 0, dict(args.define))
+            image.build_id = int(args.build_id, 16) & 0xFFFFFFFF if args.build_id else zlib.crc32(image.payload)
+            FW_BYTES = image.to_bytes(fw_image.read_key(args.sign),
+                                      fw_image.read_key(args.encrypt, fw_image.ENCRYPTION_KEY_LEN) if args.encrypt else None)
+        except (ValueError, OSError) as e:
+            print(f"{args.image}: {e}")
+            return int(DeviceResult.Failed)
+        flat_size = fw_image.flat_binary_size(segments)
+        print(f"{args.image}: {len(image.segments)} segment(s), {image.image_size} bytes instead of "
+              f"{flat_size} as a flat binary ({max(flat_size - image.image_size, 0)} saved)")
+    else:
+        with open(args.image, "rb") as file:
+            FW_BYTES = file.read()
+    image = fw_image.parse_image(FW_BYTES)
+    print(f"Image v{fw_image.format_version(image.fw_version)} build {image.build_id:08x}, {image.image_size} bytes")
+
+    if args.broadcast:
+        if not args.node:
+            parser.error("--broadcast needs at least one --node")
+        session = BroadcastSession(ports[0], args.baud, FW_BYTES, args.node, True, args.rtscts, args.backend)
+        started = time.monotonic()
+        results = await session.run()
+        print(f"{len(args.node)} node(s), {time.monotonic() - started:.1f} s, "
+              f"{session.frames_sent} frames for {session.total_frames} image frames")
+        for node, result in results.items():
+            print(f"node {node:04x}: exit {int(result)} ({result.name}, {session.node_status[node]})")
+        return max(int(r) for r in results.values())
+
+    if args.node and len(args.node) != len(ports):
+        parser.error("an addressed update needs one --node per --port")
+    targets = args.node or [None] * len(ports)
+    sparse = not image.flags & fw_image.IMAGE_FLAG_ENCRYPTED     # ciphertext of 0xFF padding is not 0xFF
+    # Encoded once for every port
+    frames = blhost.Image(FW_BYTES, args.fec)
+    sessions = [DeviceSession(port, args.baud, frames, args.verbose or len(ports) == 1, args.rtscts, sparse,
+                              args.backend, args.enter, target)
+                for port, target in zip(ports, targets)]
+
+    started = time.monotonic()
+    progress = asyncio.create_task(show_progress(sessions, started)) if len(sessions) > 1 else None
+    results = await asyncio.gather(*(s.run() for s in sessions))
+    if progress:
+        progress.cancel()
+
+    print(render_table(sessions, started))
+    for s, result in zip(sessions, results):
+        print(f"{s.port}: exit {int(result)} ({result.name})")
+    return max(int(r) for r in results)
 
 if __name__ == "__main__":
-    asyncio.run(main())
+    sys.exit(asyncio.run(main()))
@@ -0,0 +1,113 @@
+"""Minimal Ed25519 (RFC 8032, section 6 reference implementation) used to sign firmware images.
+
+Not constant time: only meant for signing on a trusted build host.
+"""
+import hashlib
+
+p = 2**255 - 19
+q = 2**252 + 27742317777372353535851937790883648493   # group order L
+d = -121665 * pow(121666, p - 2, p) % p
+modp_sqrt_m1 = pow(2, (p - 1) // 4, p)
+
+
+def sha512(s: bytes) -> bytes:
+    return hashlib.sha512(s).digest()
+
+
+def point_add(P, Q):
+    A, B = (P[1] - P[0]) * (Q[1] - Q[0]) % p, (P[1] + P[0]) * (Q[1] + Q[0]) % p
+    C, D = 2 * P[3] * Q[3] * d % p, 2 * P[2] * Q[2] % p
+    E, F, G, H = B - A, D - C, D + C, B + A
+    return (E * F, G * H, F * G, E * H)
+
+
+def point_mul(s: int, P):
+    Q = (0, 1, 1, 0)   # neutral element
+    while s > 0:
+        if s & 1:
+            Q = point_add(Q, P)
+        P = point_add(P, P)
+        s >>= 1
+    return Q
+
+
+def point_equal(P, Q) -> bool:
+    if (P[0] * Q[2] - Q[0] * P[2]) % p != 0:
+        return False
+    return (P[1] * Q[2] - Q[1] * P[2]) % p == 0
+
+
+def recover_x(y: int, sign: int):
+    if y >= p:
+        return None
+    x2 = (y * y - 1) * pow(d * y * y + 1, p - 2, p)
+    if x2 == 0:
+        return None if sign else 0
+    x = pow(x2, (p + 3) // 8, p)
+    if (x * x - x2) % p != 0:
+        x = x * modp_sqrt_m1 % p
+    if (x * x - x2) % p != 0:
+        return None
+    if (x & 1) != sign:
+        x = p - x
+    return x
+
+
+g_y = 4 * pow(5, p - 2, p) % p
+g_x = recover_x(g_y, 0)
+G = (g_x, g_y, 1, g_x * g_y % p)
+
+
+def point_compress(P) -> bytes:
+    zinv = pow(P[2], p - 2, p)
+    x, y = P[0] * zinv % p, P[1] * zinv % p
+    return int.to_bytes(y | ((x & 1) << 255), 32, "little")
+
+
+def point_decompress(s: bytes):
+    y = int.from_bytes(s, "little")
+    sign = y >> 255
+    y &= (1 << 255) - 1
+    x = recover_x(y, sign)
+    if x is None:
+        return None
+    return (x, y, 1, x * y % p)
+
+
+def secret_expand(secret: bytes):
+    if len(secret) != 32:
+        raise ValueError("bad secret key length")
+    h = sha512(secret)
+    a = int.from_bytes(h[:32], "little")
+    a &= (1 << 254) - 8
+    a |= (1 << 254)
+    return a, h[32:]
+
+
+def secret_to_public(secret: bytes) -> bytes:
+    a, _ = secret_expand(secret)
+    return point_compress(point_mul(a, G))
+
+
+def sign(secret: bytes, msg: bytes) -> bytes:
+    a, prefix = secret_expand(secret)
+    A = point_compress(point_mul(a, G))
+    r = int.from_bytes(sha512(prefix + msg), "little") % q
+    R = point_compress(point_mul(r, G))
+    h = int.from_bytes(sha512(R + A + msg), "little") % q
+    s = (r + h * a) % q
+    return R + int.to_bytes(s, 32, "little")
+
+
+def verify(public: bytes, msg: bytes, signature: bytes) -> bool:
+    if len(public) != 32 or len(signature) != 64:
+        return False
+    A = point_decompress(public)
+    R = point_decompress(signature[:32])
+    if not A or not R:
+        return False
+    s = int.from_bytes(signature[32:], "little")
+    if s >= q:
+        return False
+    h = int.from_bytes(sha512(signature[:32] + public + msg), "little") % q
+    return point_equal(point_mul(s, G), point_add(R, point_mul(h, A)))
@@ -0,0 +1,420 @@
+"""Packaged firmware image (firmware.img) format, shared by the app Makefile and the updater.
+
+Layout (little-endian), mirrors shared/inc/core/image.h:
+
+    [header (36 bytes)][segment table (12 bytes each)][0xFF padding]([AES-CTR nonce (16)])([Ed25519 signature (64)])
+    [segment 0 data][segment 1 data]...
+
+Signed images set IMAGE_FLAG_SIGNED and sign SHA-256(header[8:header_size-64] || segment data).
+Encrypted images set IMAGE_FLAG_ENCRYPTED and AES-128-CTR encrypt the segment data;
+CRCs and the signed digest always cover the plaintext.
+"""
+import argparse
+import hashlib
+import os
+import re
+import struct
+import sys
+import zlib
+from dataclasses import dataclass
+
+import aes
+import ed25519
+
+IMAGE_MAGIC           = 0x474D4946    # "FIMG"
+IMAGE_HEADER_VERSION  = 1
+IMAGE_HEADER_FMT      = "<IIHHHHIIIII"
+IMAGE_HEADER_LEN      = struct.calcsize(IMAGE_HEADER_FMT)
+IMAGE_SEGMENT_FMT     = "<III"
+IMAGE_SEGMENT_LEN     = struct.calcsize(IMAGE_SEGMENT_FMT)
+IMAGE_MAX_SEGMENTS    = 8
+IMAGE_ALIGN           = 16
+IMAGE_HEADER_CRC_OFFSET = 8
+IMAGE_SIGNATURE_LEN   = 64
+IMAGE_NONCE_LEN       = 16
+IMAGE_FLAG_SIGNED     = 1 << 0
+IMAGE_FLAG_ENCRYPTED  = 1 << 1
+
+MEMORY_MAP_HEADER = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "shared", "inc", "core", "memory-map.h")
+
+ELF_PT_LOAD     = 1
+ELF_SHT_NOBITS  = 8
+ELF_SHF_ALLOC   = 0x2
+
+SREC_ADDRESS_LEN = {"1": 2, "2": 3, "3": 4}     # data record type -> address bytes
+
+
+def read_memory_map(path: str = MEMORY_MAP_HEADER, overrides: dict[str, int] | None = None) -> dict[str, int]:
+    """Evaluate the integer #defines of memory-map.h; overrides act like the Makefiles' -D flags"""
+    defines: dict[str, int] = dict(overrides or {})
+    with open(path, "r") as f:
+        for name, expr in re.findall(r"^#define\s+(\w+)\s+(\(.*\))\s*$", f.read(), re.M):
+            if overrides and name in overrides:
+                continue
+            for known, value in defines.items():
+                expr = re.sub(rf"\b{known}\b", str(value), expr)
+            defines[name] = eval(expr, {"__builtins__": {}})
+    return defines
+
+
+def parse_define(define: str) -> tuple[str, int]:
+    name, value = define.split("=", 1)
+    return name, int(value, 0)
+
+
+def align_up(value: int, align: int = IMAGE_ALIGN) -> int:
+    return (value + align - 1) & ~(align - 1)
+
+
+def parse_version(version: str) -> int:
+    major, minor, patch = (int(part) for part in version.split("."))
+    return (major << 16) | (minor << 8) | patch
+
+
+def format_version(version: int) -> str:
+    return f"{(version >> 16) & 0xFFFF}.{(version >> 8) & 0xFF}.{version & 0xFF}"
+
+
+@dataclass
+class Segment:
+    address: int
+    data: bytes
+
+    @property
+    def end(self) -> int:
+        return self.address + len(self.data)
+
+
+@dataclass
+class Image:
+    fw_version: int
+    build_id: int
+    load_address: int
+    segments: list[Segment]
+    flags: int = 0
+
+    @property
+    def image_size(self) -> int:
+        return sum(len(s.data) for s in self.segments)
+
+    @property
+    def payload(self) -> bytes:
+        return b"".join(s.data for s in self.segments)
+
+    def header_bytes(self, signing_key: bytes | None = None, nonce: bytes = b"") -> bytes:
+        flags = self.flags | (IMAGE_FLAG_SIGNED if signing_key else 0) | (IMAGE_FLAG_ENCRYPTED if nonce else 0)
+        signature_len = IMAGE_SIGNATURE_LEN if signing_key else 0
+        table = b"".join(struct.pack(IMAGE_SEGMENT_FMT, s.address, len(s.data), zlib.crc32(s.data)) for s in self.segments)
+        header_size = align_up(IMAGE_HEADER_LEN + len(table)) + len(nonce) + signature_len
+        fields = struct.pack(IMAGE_HEADER_FMT, IMAGE_MAGIC, 0, IMAGE_HEADER_VERSION, header_size,
+                             len(self.segments), flags, self.fw_version, self.build_id,
+                             self.load_address, self.image_size, zlib.crc32(self.payload))
+        raw = bytearray(fields + table)
+        raw += bytes([0xFF] * (header_size - signature_len - len(nonce) - len(raw)))
+        raw += nonce
+        if signing_key:
+            raw += ed25519.sign(signing_key, signed_digest(raw, self.payload))
+        header_crc = zlib.crc32(raw[IMAGE_HEADER_CRC_OFFSET:])
+        struct.pack_into("<I", raw, 4, header_crc)
+        return bytes(raw)
+
+    def to_bytes(self, signing_key: bytes | None = None, encryption_key: bytes | None = None) -> bytes:
+        if not encryption_key:
+            return self.header_bytes(signing_key) + self.payload
+        nonce = os.urandom(12) + bytes(4)
+        return self.header_bytes(signing_key, nonce) + aes.ctr_crypt(encryption_key, nonce, self.payload)
+
+
+def signed_digest(signed_header: bytes, payload: bytes) -> bytes:
+    """SHA-256 the bootloader computes while the image streams in"""
+    return hashlib.sha256(bytes(signed_header[IMAGE_HEADER_CRC_OFFSET:]) + payload).digest()
+
+
+SIGNING_KEY_LEN    = 32      # Ed25519 seed
+ENCRYPTION_KEY_LEN = 16      # AES-128
+
+
+def read_key(path: str, length: int = SIGNING_KEY_LEN) -> bytes:
+    with open(path, "rb") as f:
+        key = f.read()
+    if len(key) != length:
+        raise ValueError(f"{path}: expected a {length}-byte key")
+    return key
+
+
+def key_c_header(name: str, key: bytes, source: str) -> str:
+    guard = f"INC_GENERATED_{name.upper()}_H"
+    key_bytes = ", ".join(f"0x{b:02x}" for b in key)
+    return (f"/* Generated by fw_image.py from {source}, do not edit */\n"
+            f"#ifndef {guard}\n"
+            f"#define {guard}\n\n"
+            f"static const uint8_t {name}[{len(key)}] = {{{key_bytes}}};\n\n"
+            "#endif\n")
+
+
+def normalise_segments(segments: list[Segment]) -> list[Segment]:
+    """Sort, merge and 0xFF-pad segments to IMAGE_ALIGN so no payload frame straddles two segments"""
+    merged: list[Segment] = []
+    for seg in sorted(segments, key=lambda s: s.address):
+        if merged and seg.address <= align_up(merged[-1].end):
+            prev = merged[-1]
+            if seg.address < prev.end:
+                raise ValueError(f"overlapping segments at 0x{seg.address:08X}")
+            gap = bytes([0xFF] * (seg.address - prev.end))
+            merged[-1] = Segment(prev.address, prev.data + gap + seg.data)
+        else:
+            # HEX/S-record runs may start anywhere, pad down to the alignment
+            start = seg.address & ~(IMAGE_ALIGN - 1)
+            merged.append(Segment(start, bytes([0xFF] * (seg.address - start)) + bytes(seg.data)))
+
+    padded = [Segment(s.address, s.data + bytes([0xFF] * (align_up(len(s.data)) - len(s.data)))) for s in merged]
+    if len(padded) > IMAGE_MAX_SEGMENTS:
+        raise ValueError(f"{len(padded)} segments, at most {IMAGE_MAX_SEGMENTS} supported")
+    return padded
+
+
+def load_elf_segments(path: str) -> list[Segment]:
+    """Allocated, non-empty ELF sections placed at their load (LMA) address, like objcopy -Obinary"""
+    with open(path, "rb") as f:
+        elf = f.read()
+    if elf[:4] != b"\x7fELF" or elf[4] != 1 or elf[5] != 1:
+        raise ValueError(f"{path}: not a 32-bit little-endian ELF")
+
+    e_phoff, e_shoff = struct.unpack_from("<II", elf, 0x1C)
+    e_phentsize, e_phnum, e_shentsize, e_shnum = struct.unpack_from("<HHHH", elf, 0x2A)
+
+    loads = []
+    for i in range(e_phnum):
+        p_type, p_offset, p_vaddr, p_paddr, p_filesz, _, _, _ = struct.unpack_from("<IIIIIIII", elf, e_phoff + i * e_phentsize)
+        if p_type == ELF_PT_LOAD:
+            loads.append((p_offset, p_filesz, p_vaddr, p_paddr))
+
+    segments = []
+    for i in range(e_shnum):
+        _, sh_type, sh_flags, sh_addr, sh_offset, sh_size = struct.unpack_from("<IIIIII", elf, e_shoff + i * e_shentsize)
+        if not (sh_flags & ELF_SHF_ALLOC) or sh_type == ELF_SHT_NOBITS or sh_size == 0:
+            continue
+        for p_offset, p_filesz, p_vaddr, p_paddr in loads:
+            if p_offset <= sh_offset < p_offset + p_filesz:
+                segments.append(Segment(p_paddr + (sh_addr - p_vaddr), elf[sh_offset:sh_offset + sh_size]))
+                break
+    return segments
+
+
+def join_records(records: list[tuple[int, bytes]]) -> list[Segment]:
+    """Contiguous (address, data) records of a HEX or S-record file as one segment each"""
+    runs: list[tuple[int, bytearray]] = []
+    for address, data in sorted(records, key=lambda r: r[0]):
+        if runs and address == runs[-1][0] + len(runs[-1][1]):
+            runs[-1][1].extend(data)
+        else:
+            runs.append((address, bytearray(data)))
+    return [Segment(address, bytes(data)) for address, data in runs]
+
+
+def load_hex_segments(path: str) -> list[Segment]:
+    """Data records of an Intel HEX file (objcopy -Oihex)"""
+    records = []
+    base = 0
+    with open(path, "r") as f:
+        for number, line in enumerate(f, 1):
+            line = line.strip()
+            if not line:
+                continue
+            if not line.startswith(":"):
+                raise ValueError(f"{path}:{number}: not an Intel HEX record")
+            record = bytes.fromhex(line[1:])
+            if len(record) < 5 or len(record) != record[0] + 5 or sum(record) & 0xFF:
+                raise ValueError(f"{path}:{number}: bad record length or checksum")
+            address, record_type, data = int.from_bytes(record[1:3], "big"), record[3], record[4:-1]
+            if record_type == 0x00:
+                records.append((base + address, data))
+            elif record_type == 0x01:
+                break
+            elif record_type == 0x02:
+                base = int.from_bytes(data, "big") << 4
+            elif record_type == 0x04:
+                base = int.from_bytes(data, "big") << 16
+            # 0x03/0x05 start addresses are not needed, the vector table holds the entry point
+    return join_records(records)
+
+
+def load_srec_segments(path: str) -> list[Segment]:
+    """S1/S2/S3 data records of a Motorola S-record file (objcopy -Osrec)"""
+    records = []
+    with open(path, "r") as f:
+        for number, line in enumerate(f, 1):
+            line = line.strip()
+            if not line:
+                continue
+            if not line.startswith("S") or len(line) < 4:
+                raise ValueError(f"{path}:{number}: not an S-record")
+            record_type, record = line[1], bytes.fromhex(line[2:])
+            if len(record) != record[0] + 1 or (sum(record) & 0xFF) != 0xFF:
+                raise ValueError(f"{path}:{number}: bad record length or checksum")
+            if record_type in SREC_ADDRESS_LEN:
+                address_len = SREC_ADDRESS_LEN[record_type]
+                records.append((int.from_bytes(record[1:1 + address_len], "big"), record[1 + address_len:-1]))
+            elif record_type in "789":
+                break
+    return join_records(records)
+
+
+SEGMENT_LOADERS = {
+    ".elf": load_elf_segments,
+    ".hex": load_hex_segments, ".ihex": load_hex_segments,
+    ".srec": load_srec_segments, ".s19": load_srec_segments, ".s28": load_srec_segments, ".s37": load_srec_segments,
+}
+
+
+def load_segments(path: str) -> list[Segment]:
+    """Loaded segments of a build output (ELF, Intel HEX or S-record, by extension)"""
+    loader = SEGMENT_LOADERS.get(os.path.splitext(path)[1].lower())
+    if loader is None:
+        raise ValueError(f"{path}: expected one of {', '.join(SEGMENT_LOADERS)}")
+    return loader(path)
+
+
+def flat_binary_size(segments: list[Segment]) -> int:
+    """Size of the same segments as objcopy -Obinary writes them, gaps filled"""
+    return max(s.end for s in segments) - min(s.address for s in segments) if segments else 0
+
+
+def check_app_region(segments: list[Segment], memory_map: dict[str, int]):
+    start = memory_map["APP_START_ADDRESS"]
+    end = start + memory_map["APP_MAX_SIZE"]
+    for seg in segments:
+        if seg.address < start or seg.end > end:
+            raise ValueError(f"segment 0x{seg.address:08X}-0x{seg.end:08X} outside application region "
+                             f"0x{start:08X}-0x{end:08X}")
+
+
+def pack(segments: list[Segment], fw_version: int, build_id: int, defines: dict[str, int] | None = None) -> Image:
+    memory_map = read_memory_map(overrides=defines)
+    segments = normalise_segments(segments)
+    check_app_region(segments, memory_map)
+    return Image(fw_version, build_id, memory_map["APP_START_ADDRESS"], segments)
+
+
+def parse_image(raw: bytes, public_key: bytes | None = None, encryption_key: bytes | None = None) -> Image:
+    """Validate an image. Encrypted payloads are only CRC/signature checked when the key is given."""
+    if len(raw) < IMAGE_HEADER_LEN:
+        raise ValueError("image too short")
+    (magic, header_crc, header_version, header_size, segment_count, flags,
+     fw_version, build_id, load_address, image_size, image_crc) = struct.unpack_from(IMAGE_HEADER_FMT, raw)
+    if magic != IMAGE_MAGIC:
+        raise ValueError("bad image magic")
+    if header_version != IMAGE_HEADER_VERSION:
+        raise ValueError(f"unsupported image header version {header_version}")
+    if zlib.crc32(raw[IMAGE_HEADER_CRC_OFFSET:header_size]) != header_crc:
+        raise ValueError("image header CRC mismatch")
+    if len(raw) != header_size + image_size:
+        raise ValueError("image length does not match header")
+
+    signed_end = header_size - (IMAGE_SIGNATURE_LEN if flags & IMAGE_FLAG_SIGNED else 0)
+    payload = raw[header_size:]
+    check_payload = True
+    if flags & IMAGE_FLAG_ENCRYPTED:
+        nonce = raw[signed_end - IMAGE_NONCE_LEN:signed_end]
+        if encryption_key:
+            payload = aes.ctr_crypt(encryption_key, nonce, payload)
+        else:
+            check_payload = False
+
+    segments = []
+    offset = 0
+    for i in range(segment_count):
+        address, length, crc = struct.unpack_from(IMAGE_SEGMENT_FMT, raw, IMAGE_HEADER_LEN + i * IMAGE_SEGMENT_LEN)
+        data = payload[offset:offset + length]
+        if check_payload and zlib.crc32(data) != crc:
+            raise ValueError(f"segment {i} CRC mismatch")
+        segments.append(Segment(address, data))
+        offset += length
+
+    image = Image(fw_version, build_id, load_address, segments, flags)
+    if check_payload and zlib.crc32(image.payload) != image_crc:
+        raise ValueError("image CRC mismatch")
+    if public_key is not None:
+        if not check_payload:
+            raise ValueError("encrypted image, the encryption key is needed to check the signature")
+        if not flags & IMAGE_FLAG_SIGNED:
+            raise ValueError("image is not signed")
+        signature = raw[signed_end:header_size]
+        if not ed25519.verify(public_key, signed_digest(raw[:signed_end], image.payload), signature):
+            raise ValueError("image signature invalid")
+    return image
+
+
+def load_image(path: str, public_key: bytes | None = None, encryption_key: bytes | None = None) -> Image:
+    with open(path, "rb") as f:
+        return parse_image(f.read(), public_key, encryption_key)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Firmware image packager")
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    pack_cmd = sub.add_parser("pack", help="package an ELF, Intel HEX or S-record file into a firmware image")
+    pack_cmd.add_argument("input")
+    pack_cmd.add_argument("-o", "--output", required=True)
+    pack_cmd.add_argument("--version", default="0.0.0", help="major.minor.patch")
+    pack_cmd.add_argument("--build-id", default="0", help="hex build identifier (e.g. git short hash)")
+    pack_cmd.add_argument("--sign", metavar="KEY", help="Ed25519 signing key (32-byte seed file)")
+    pack_cmd.add_argument("--encrypt", metavar="KEY", help="AES-128 encryption key (16-byte file)")
+    pack_cmd.add_argument("-D", "--define", action="append", type=parse_define, default=[], metavar="NAME=VALUE",
+                          help="memory-map.h override the firmware was built with (e.g. STAGING_SIZE=0)")
+
+    info_cmd = sub.add_parser("info", help="print an image header")
+    info_cmd.add_argument("image")
+    info_cmd.add_argument("--verify", metavar="KEY", help="check the signature against this signing key")
+    info_cmd.add_argument("--decrypt", metavar="KEY", help="decrypt with this AES-128 key before checking")
+
+    keygen_cmd = sub.add_parser("keygen", help="create a new Ed25519 signing key (or AES-128 key with --aes)")
+    keygen_cmd.add_argument("key")
+    keygen_cmd.add_argument("--aes", action="store_true")
+
+    pubkey_cmd = sub.add_parser("pubkey", help="export the public key as a C header for the bootloader")
+    pubkey_cmd.add_argument("key")
+    pubkey_cmd.add_argument("-o", "--output", required=True)
+
+    aeskey_cmd = sub.add_parser("aeskey", help="export the AES-128 key as a C header for the bootloader")
+    aeskey_cmd.add_argument("key")
+    aeskey_cmd.add_argument("-o", "--output", required=True)
+
+    args = parser.parse_args()
+    if args.command == "keygen":
+        os.makedirs(os.path.dirname(os.path.abspath(args.key)), exist_ok=True)
+        with open(os.open(args.key, os.O_WRONLY | os.O_CREAT | os.O_EXCL, 0o600), "wb") as f:
+            f.write(os.urandom(ENCRYPTION_KEY_LEN if args.aes else SIGNING_KEY_LEN))
+        print(f"{args.key}: new {'encryption' if args.aes else 'signing'} key, keep it private")
+        return
+    if args.command == "pubkey":
+        with open(args.output, "w") as f:
+            f.write(key_c_header("signing_public_key", ed25519.secret_to_public(read_key(args.key)), args.key))
+        return
+    if args.command == "aeskey":
+        with open(args.output, "w") as f:
+            f.write(key_c_header("encryption_key", read_key(args.key, ENCRYPTION_KEY_LEN), args.key))
+        return
+
+    if args.command == "pack":
+        image = pack(load_segments(args.input), parse_version(args.version), int(args.build_id, 16) & 0xFFFFFFFF,
+                     dict(args.define))
+        with open(args.output, "wb") as f:
+            f.write(image.to_bytes(read_key(args.sign) if args.sign else None,
+                                   read_key(args.encrypt, ENCRYPTION_KEY_LEN) if args.encrypt else None))
+    else:
+        public_key = ed25519.secret_to_public(read_key(args.verify)) if args.verify else None
+        image = load_image(args.image, public_key, read_key(args.decrypt, ENCRYPTION_KEY_LEN) if args.decrypt else None)
+
+    print(f"{args.output if args.command == 'pack' else args.image}: v{format_version(image.fw_version)} "
+          f"build {image.build_id:08x}, {image.image_size} bytes in {len(image.segments)} segment(s)")
+    for seg in image.segments:
+        print(f"  0x{seg.address:08X} - 0x{seg.end:08X} ({len(seg.data)} bytes)")
+
+
+if __name__ == "__main__":
+    try:
+        main()
+    except ValueError as e:
+        sys.exit(f"error: {e}")
@@ -0,0 +1,174 @@
+"""Shortened Reed-Solomon code over GF(2^8) for frames sent to the bootloader with --fec.
+
+Matches shared/src/core/reed-solomon.c: field polynomial 0x11D, generator roots
+alpha^0 .. alpha^(RS_PARITY_LEN-1), parity appended after the message. Four parity
+bytes correct any two corrupted bytes in a frame.
+
+Run as a script to compare goodput against bit error rate with and without FEC.
+"""
+import argparse
+import random
+
+RS_PARITY_LEN = 4
+
+GF_EXP = [0] * 512
+GF_LOG = [0] * 256
+
+
+def _init_tables():
+    x = 1
+    for i in range(255):
+        GF_EXP[i] = x
+        GF_LOG[x] = i
+        x <<= 1
+        if x & 0x100:
+            x ^= 0x11D
+    for i in range(255, 512):
+        GF_EXP[i] = GF_EXP[i - 255]
+
+
+_init_tables()
+
+
+def gf_mul(a: int, b: int) -> int:
+    if a == 0 or b == 0:
+        return 0
+    return GF_EXP[GF_LOG[a] + GF_LOG[b]]
+
+
+def gf_div(a: int, b: int) -> int:
+    if a == 0:
+        return 0
+    return GF_EXP[(GF_LOG[a] + 255 - GF_LOG[b]) % 255]
+
+
+def _generator() -> list[int]:
+    g = [1]
+    for j in range(RS_PARITY_LEN):
+        root = GF_EXP[j]
+        g = [a ^ gf_mul(b, root) for a, b in zip(g + [0], [0] + g)]
+    return g
+
+
+GENERATOR = _generator()
+
+
+def encode(message: bytes) -> bytes:
+    """Parity bytes for `message` (highest degree coefficient first)."""
+    remainder = [0] * RS_PARITY_LEN
+    for byte in message:
+        feedback = byte ^ remainder[0]
+        remainder = remainder[1:] + [0]
+        if feedback:
+            for i in range(RS_PARITY_LEN):
+                remainder[i] ^= gf_mul(GENERATOR[i + 1], feedback)
+    return bytes(remainder)
+
+
+def decode(codeword: bytes) -> bytes | None:
+    """Corrected codeword, or None when there are more errors than the parity can locate."""
+    n = len(codeword)
+    syndromes = []
+    for j in range(RS_PARITY_LEN):
+        s = 0
+        for byte in codeword:
+            s = gf_mul(s, GF_EXP[j]) ^ byte
+        syndromes.append(s)
+    if not any(syndromes):
+        return bytes(codeword)
+
+    # Berlekamp-Massey
+    locator = [1] + [0] * RS_PARITY_LEN
+    previous = [1] + [0] * RS_PARITY_LEN
+    errors, shift, last_discrepancy = 0, 1, 1
+    for r in range(RS_PARITY_LEN):
+        d = syndromes[r]
+        for i in range(1, errors + 1):
+            d ^= gf_mul(locator[i], syndromes[r - i])
+        if d == 0:
+            shift += 1
+            continue
+        scale = gf_div(d, last_discrepancy)
+        updated = locator[:]
+        for i in range(shift, RS_PARITY_LEN + 1):
+            updated[i] ^= gf_mul(scale, previous[i - shift])
+        if 2 * errors <= r:
+            previous, errors, last_discrepancy, shift = locator, r + 1 - errors, d, 1
+        else:
+            shift += 1
+        locator = updated
+    if 2 * errors > RS_PARITY_LEN:
+        return None
+
+    evaluator = [0] * RS_PARITY_LEN
+    for i in range(RS_PARITY_LEN):
+        for j in range(i + 1):
+            evaluator[i] ^= gf_mul(syndromes[j], locator[i - j])
+
+    # Chien search and Forney
+    corrected = bytearray(codeword)
+    found = 0
+    for position in range(n):
+        power = n - 1 - position
+        x_inv = GF_EXP[(255 - power) % 255]
+        value, x_pow = 0, 1
+        for coefficient in locator:
+            value ^= gf_mul(coefficient, x_pow)
+            x_pow = gf_mul(x_pow, x_inv)
+        if value:
+            continue
+        numerator, x_pow = 0, 1
+        for coefficient in evaluator:
+            numerator ^= gf_mul(coefficient, x_pow)
+            x_pow = gf_mul(x_pow, x_inv)
+        denominator, x_pow = 0, 1
+        for i in range(1, RS_PARITY_LEN + 1, 2):
+            denominator ^= gf_mul(locator[i], x_pow)
+            x_pow = gf_mul(x_pow, gf_mul(x_inv, x_inv))
+        if denominator == 0:
+            return None
+        corrected[position] ^= gf_mul(GF_EXP[power], gf_div(numerator, denominator))
+        found += 1
+    return bytes(corrected) if found == errors else None
+
+
+def _corrupt(frame: bytes, ber: float, rng: random.Random) -> bytes:
+    out = bytearray(frame)
+    for bit in range(len(out) * 8):
+        if rng.random() < ber:
+            out[bit // 8] ^= 1 << (bit % 8)
+    return bytes(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Goodput versus bit error rate, with and without FEC")
+    parser.add_argument("--payload", type=int, default=16, choices=[16, 32, 64], help="frame payload bytes")
+    parser.add_argument("--frames", type=int, default=2000, help="frames simulated per error rate")
+    parser.add_argument("--ber", type=float, nargs="+", default=[0, 1e-5, 1e-4, 3e-4, 1e-3, 3e-3, 1e-2])
+    args = parser.parse_args()
+
+    rng = random.Random(1)
+    frame_len = 1 + args.payload + 1                 # [len][payload][crc8]
+    ack_len = 18                                     # every attempt costs an ACK or RETX on the way back
+    print(f"{'BER':>8}  {'plain':>7}  {'fec':>7}   goodput as a fraction of the raw line rate")
+    for ber in args.ber:
+        goodput = []
+        for fec in (False, True):
+            wire_len = frame_len + (RS_PARITY_LEN if fec else 0)
+            sent = 0
+            for _ in range(args.frames):
+                frame = bytes(rng.randrange(256) for _ in range(frame_len))
+                codeword = frame + encode(frame) if fec else frame
+                while True:
+                    sent += wire_len + ack_len
+                    received = _corrupt(codeword, ber, rng)
+                    if fec:
+                        received = decode(received)
+                    if received is not None and received[:frame_len] == frame:
+                        break
+            goodput.append(args.frames * args.payload / sent)
+        print(f"{ber:>8.0e}  {goodput[0]:>7.3f}  {goodput[1]:>7.3f}")
+
+
+if __name__ == "__main__":
+    main()
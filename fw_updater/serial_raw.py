@@ -0,0 +1,161 @@
+"""Low-latency serial backend for comms.py: the port is opened with raw termios and read by the event loop directly.
+
+Drop-in for serial_asyncio.create_serial_connection(). Reads go straight into the protocol's
+buffer (asyncio.BufferedProtocol), so no intermediate bytes objects are made per chunk.
+USB-serial drivers that support it are switched to ASYNC_LOW_LATENCY, which stops them
+holding received bytes back for their poll interval. Works on any tty, including a pty.
+"""
+import asyncio
+import errno
+import fcntl
+import os
+import struct
+import termios
+
+# <linux/serial.h>: struct serial_struct starts with int type, line; unsigned port; int irq, flags
+TIOCGSERIAL                = getattr(termios, "TIOCGSERIAL", 0x541E)
+TIOCSSERIAL                = getattr(termios, "TIOCSSERIAL", 0x541F)
+SERIAL_STRUCT_FLAGS_OFFSET = 16
+SERIAL_STRUCT_MAX_LEN      = 128     # larger than sizeof(struct serial_struct) on every ABI
+ASYNC_LOW_LATENCY          = 1 << 13
+
+CRTSCTS = getattr(termios, "CRTSCTS", 0)
+CLOSE_DRAIN_TIMEOUT        = 1.0     # s close() waits for queued writes before it drops them
+
+
+def set_low_latency(fd: int) -> bool:
+    """Set ASYNC_LOW_LATENCY; False where the driver has no such setting (ptys, non-Linux)."""
+    info = bytearray(SERIAL_STRUCT_MAX_LEN)
+    try:
+        fcntl.ioctl(fd, TIOCGSERIAL, info)
+        flags, = struct.unpack_from("i", info, SERIAL_STRUCT_FLAGS_OFFSET)
+        struct.pack_into("i", info, SERIAL_STRUCT_FLAGS_OFFSET, flags | ASYNC_LOW_LATENCY)
+        fcntl.ioctl(fd, TIOCSSERIAL, info)
+    except OSError:
+        return False
+    return True
+
+
+def open_raw(port: str, baudrate: int, rtscts: bool = False) -> int:
+    """8N1, no echo, no line discipline, non-blocking reads that return whatever has arrived."""
+    speed = getattr(termios, f"B{baudrate}", None)
+    if speed is None:
+        raise ValueError(f"baud rate {baudrate} not supported by termios")
+
+    fd = os.open(port, os.O_RDWR | os.O_NOCTTY | os.O_NONBLOCK)
+    try:
+        cc = termios.tcgetattr(fd)[6]
+        cc[termios.VMIN] = 0
+        cc[termios.VTIME] = 0
+        cflag = termios.CS8 | termios.CREAD | termios.CLOCAL | (CRTSCTS if rtscts else 0)
+        termios.tcsetattr(fd, termios.TCSANOW, [0, 0, cflag, 0, speed, speed, cc])
+        termios.tcflush(fd, termios.TCIOFLUSH)
+    except (OSError, termios.error):
+        os.close(fd)
+        raise
+    return fd
+
+
+class RawSerialTransport(asyncio.Transport):
+    def __init__(self, loop: asyncio.AbstractEventLoop, protocol: asyncio.BaseProtocol, fd: int, low_latency: bool):
+        super().__init__()
+        self.loop = loop
+        self.protocol = protocol
+        self.fd = fd
+        self.low_latency = low_latency
+        self.pending = bytearray()      # what a full TX buffer did not take yet
+        self.closing = False            # close() waits for pending to drain
+        self.closed = False
+        self.drain_timer: asyncio.TimerHandle | None = None
+        loop.add_reader(fd, self.read_ready)
+
+    def get_extra_info(self, name, default=None):
+        return {"fd": self.fd, "low_latency": self.low_latency}.get(name, default)
+
+    def read_ready(self):
+        try:
+            if isinstance(self.protocol, asyncio.BufferedProtocol):
+                buffer = self.protocol.get_buffer(-1)
+                nbytes = os.readv(self.fd, [buffer])
+                if nbytes:
+                    self.protocol.buffer_updated(nbytes)
+            else:
+                data = os.read(self.fd, 4096)
+                nbytes = len(data)
+                if nbytes:
+                    self.protocol.data_received(data)
+        except BlockingIOError:
+            return
+        except OSError as e:
+            # EIO: the adapter was unplugged, or the other end of a pty went away
+            self.abort(e)
+            return
+        if nbytes == 0:
+            self.abort(ConnectionResetError(errno.ECONNRESET, "end of file on the port"))
+
+    def write(self, data):
+        if self.closing or self.closed:
+            return
+        if self.pending:
+            self.pending += data
+            return
+        try:
+            written = os.write(self.fd, data)
+        except BlockingIOError:
+            written = 0
+        if written < len(data):
+            self.pending += data[written:]
+            self.loop.add_writer(self.fd, self.write_ready)
+
+    def write_ready(self):
+        try:
+            written = os.write(self.fd, self.pending)
+        except BlockingIOError:
+            return
+        except OSError as e:
+            self.abort(e)
+            return
+        del self.pending[:written]
+        if not self.pending:
+            self.loop.remove_writer(self.fd)
+            if self.closing:
+                self.abort()
+
+    def is_closing(self) -> bool:
+        return self.closing or self.closed
+
+    def close(self):
+        """Stops reading, sends what is still queued and then closes; see CLOSE_DRAIN_TIMEOUT."""
+        if self.closing or self.closed:
+            return
+        self.closing = True
+        self.loop.remove_reader(self.fd)
+        if not self.pending:
+            self.abort()
+            return
+        self.drain_timer = self.loop.call_later(CLOSE_DRAIN_TIMEOUT, self.drain_expired)
+
+    def drain_expired(self):
+        # Flow control held or the adapter stalled; the protocol learns how much never went out
+        self.abort(TimeoutError(errno.ETIMEDOUT, f"port closed with {len(self.pending)} queued bytes unsent"))
+
+    def abort(self, exc: Exception | None = None):
+        """Closes at once; queued writes are dropped."""
+        if self.closed:
+            return
+        self.closed = True
+        if self.drain_timer:
+            self.drain_timer.cancel()
+        self.loop.remove_reader(self.fd)
+        self.loop.remove_writer(self.fd)
+        os.close(self.fd)
+        self.protocol.connection_lost(exc)
+
+
+async def create_serial_connection(loop: asyncio.AbstractEventLoop, protocol_factory, port: str,
+                                   baudrate: int = 115200, rtscts: bool = False):
+    fd = open_raw(port, baudrate, rtscts)
+    protocol = protocol_factory()
+    transport = RawSerialTransport(loop, protocol, fd, set_low_latency(fd))
+    protocol.connection_made(transport)
+    return transport, protocol
@@ -0,0 +1,52 @@
+"""shared/src/core/reed-solomon.c (through host/libblhost.so) against reed_solomon.py on random codewords.
+
+Run from fw_updater/ with 'python3 -m unittest test_reed_solomon' after 'make -C host'.
+"""
+import ctypes
+import random
+import unittest
+
+import blhost
+import reed_solomon
+
+CODEWORDS           = 3000
+CODEWORD_MAX_LEN    = 255
+
+
+@unittest.skipUnless(blhost.lib, f"needs {blhost.LIB_PATH}, build it with 'make -C host'")
+class ReedSolomonTest(unittest.TestCase):
+    @classmethod
+    def setUpClass(cls):
+        lib = blhost.lib
+        lib.rs_encode.argtypes = [ctypes.c_char_p, ctypes.c_uint32, ctypes.POINTER(ctypes.c_uint8)]
+        lib.rs_decode.argtypes = [ctypes.POINTER(ctypes.c_uint8), ctypes.c_uint32]
+        lib.rs_decode.restype = ctypes.c_int32
+        lib.rs_setup()
+
+    def test_parity_matches(self):
+        rng = random.Random(27)
+        for _ in range(CODEWORDS):
+            message = rng.randbytes(rng.randint(1, CODEWORD_MAX_LEN - reed_solomon.RS_PARITY_LEN))
+            parity = (ctypes.c_uint8 * reed_solomon.RS_PARITY_LEN)()
+            blhost.lib.rs_encode(message, len(message), parity)
+            self.assertEqual(bytes(parity), reed_solomon.encode(message), message.hex())
+
+    def test_decoder_corrects_python_codewords(self):
+        rng = random.Random(42)
+        for _ in range(CODEWORDS):
+            message = rng.randbytes(rng.randint(1, CODEWORD_MAX_LEN - reed_solomon.RS_PARITY_LEN))
+            codeword = message + reed_solomon.encode(message)
+            errors = rng.randint(0, reed_solomon.RS_PARITY_LEN // 2)
+            received = bytearray(codeword)
+            for position in rng.sample(range(len(codeword)), errors):
+                received[position] ^= rng.randint(1, 255)
+
+            buffer = (ctypes.c_uint8 * len(received)).from_buffer_copy(received)
+            corrected = blhost.lib.rs_decode(buffer, len(received))
+            self.assertEqual(corrected, errors, received.hex())
+            self.assertEqual(bytes(buffer), codeword, received.hex())
+            self.assertEqual(reed_solomon.decode(bytes(received)), codeword)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,185 @@
+"""serial_raw.py against a scripted bootloader on the other end of a pty.
+
+Run from fw_updater/ with 'python3 -m unittest test_serial_raw' after 'make -C host'.
+"""
+import asyncio
+import errno
+import os
+import pty
+import re
+import tty
+import unittest
+
+import blhost
+import comms
+import fw_image
+import serial_raw
+
+LATENCY           = 0.02        # s the scripted bootloader waits before each answer
+PAYLOAD_LEN       = 512
+SYNC              = bytes([0xAA, 0xBB, 0xCC, 0xDD])
+ACK               = [0x19, 0, 16]       # no credits, 16 byte frames: every frame is lock-step
+NODE_ADDRESS      = 0x1234
+
+
+def test_image() -> bytes:
+    start = fw_image.read_memory_map()["APP_START_ADDRESS"]
+    payload = bytes((i * 7 + 3) & 0xFF for i in range(PAYLOAD_LEN))
+    return fw_image.pack([fw_image.Segment(start, payload)], fw_image.parse_version("1.0.0"), 1).to_bytes()
+
+
+class ScriptedBootloader:
+    """The device side of a unicast update, enough of it to take an image and to answer with a delay."""
+
+    def __init__(self, loop: asyncio.AbstractEventLoop, fd: int, image: bytes):
+        self.loop = loop
+        self.fd = fd
+        self.header_size = len(image) - fw_image.parse_image(image).image_size
+        self.rx = bytearray()
+        self.synced = False
+        self.header = bytearray()
+        self.payload = bytearray(len(image) - self.header_size)
+        self.errors = 0
+        os.set_blocking(fd, False)
+        loop.add_reader(fd, self.read_ready)
+
+    def stop(self):
+        self.loop.remove_reader(self.fd)
+
+    def answer(self, *payloads: list[int]):
+        frames = b"".join(blhost.encode_packet(payload) for payload in payloads)
+        self.loop.call_later(LATENCY, os.write, self.fd, frames)
+
+    def read_ready(self):
+        try:
+            self.rx += os.read(self.fd, 4096)
+        except BlockingIOError:
+            return
+        if not self.synced:
+            if SYNC not in self.rx:
+                return
+            del self.rx[:self.rx.index(SYNC) + len(SYNC)]
+            self.synced = True
+            self.answer([0x23], [0x25])
+
+        # Frames must arrive back to back and whole: [0x5A][size][offset 24 bit][payload][crc] or [len][16][crc]
+        while self.rx:
+            addressed = self.rx[0] == 0x5A
+            frame_len = (5 + self.rx[1] + 1) if addressed and len(self.rx) > 1 else 18
+            if len(self.rx) < frame_len:
+                return
+            frame = bytes(self.rx[:frame_len])
+            del self.rx[:frame_len]
+            decoded = blhost.decode_frame(frame)
+            if decoded is None or decoded[2] != frame_len:
+                self.errors += 1
+                continue
+            length, data, _ = decoded
+            self.on_frame(frame, length, data, addressed)
+
+    def on_frame(self, frame: bytes, length: int, data: bytes, addressed: bool):
+        if addressed:
+            offset = int.from_bytes(frame[2:5], "big")
+            self.payload[offset:offset + length] = data
+            self.answer(ACK, [0x39])
+        elif length == 1 and data[0] == 0x26:
+            self.answer(ACK, [0x31, NODE_ADDRESS >> 8, NODE_ADDRESS & 0xFF, 0, 64, 4, 0, 0, 1, 0, 0])
+        elif length == 2 and data[0] == 0x32:
+            self.answer(ACK, [0x35])
+        elif length == 5 and data[0] == 0x36:
+            self.answer(ACK, [0x39])
+        elif length == 1 and data[0] == 0x49:
+            self.answer(ACK, [0x41])
+        else:
+            self.header += data[:length]
+            self.answer(ACK, [0x39])
+
+
+class Peer(asyncio.Protocol):
+    def __init__(self):
+        self.received = bytearray()
+        self.lost = asyncio.get_running_loop().create_future()
+
+    def data_received(self, data):
+        self.received += data
+
+    def connection_lost(self, exc):
+        self.lost.set_result(exc)
+
+
+@unittest.skipUnless(blhost.lib, f"needs {blhost.LIB_PATH}, build it with 'make -C host'")
+class RawSerialTest(unittest.IsolatedAsyncioTestCase):
+    def setUp(self):
+        self.master, self.slave = pty.openpty()
+        tty.setraw(self.master)
+        self.port = os.ttyname(self.slave)
+
+    def tearDown(self):
+        os.close(self.master)
+        os.close(self.slave)
+
+    async def test_update_over_pty(self):
+        image = test_image()
+        device = ScriptedBootloader(asyncio.get_running_loop(), self.master, image)
+        session = comms.DeviceSession(self.port, 115200, blhost.Image(image), False, backend="termios")
+        try:
+            result = await asyncio.wait_for(session.run(), 30)
+        finally:
+            device.stop()
+
+        self.assertEqual(result, comms.DeviceResult.Success, session.status)
+        self.assertEqual(device.errors, 0)
+        self.assertEqual(bytes(device.header), image[:device.header_size])
+        self.assertEqual(bytes(device.payload), image[device.header_size:])
+
+        # Every frame waits LATENCY for its ACK, and the report says so
+        rtt = re.search(r"rtt ([0-9.]+) ms avg, ([0-9]+) max over ([0-9]+) frames", session.status)
+        self.assertIsNotNone(rtt, session.status)
+        self.assertGreaterEqual(float(rtt.group(1)), LATENCY * 1000 - 1)
+        self.assertLess(float(rtt.group(1)), LATENCY * 1000 * 10)
+        # UPDATE_RES, DEVICE_ID_RES, LENGTH_RES, every 16 byte frame of the image, WRITE_DONE
+        self.assertEqual(int(rtt.group(3)), 3 + len(image) // 16 + 1)
+
+    async def test_pty_has_no_low_latency_flag(self):
+        transport, _ = await serial_raw.create_serial_connection(asyncio.get_running_loop(), Peer, self.port)
+        self.assertFalse(transport.get_extra_info("low_latency"))
+        transport.close()
+
+    async def test_close_drains_queued_writes(self):
+        transport, peer = await serial_raw.create_serial_connection(asyncio.get_running_loop(), Peer, self.port)
+        data = bytes(range(256)) * 256      # far more than the pty buffers, most of it ends up in pending
+        transport.write(data)
+        self.assertTrue(transport.pending)
+        transport.close()
+        self.assertTrue(transport.is_closing())
+
+        os.set_blocking(self.master, False)
+        received = bytearray()
+        while len(received) < len(data):
+            await asyncio.sleep(0.001)
+            try:
+                received += os.read(self.master, 65536)
+            except BlockingIOError:
+                pass
+        self.assertEqual(bytes(received), data)
+        self.assertIsNone(await asyncio.wait_for(peer.lost, 1))
+
+    async def test_close_reports_dropped_writes(self):
+        transport, peer = await serial_raw.create_serial_connection(asyncio.get_running_loop(), Peer, self.port)
+        transport.write(bytes(256) * 256)   # nobody reads the master
+        queued = len(transport.pending)
+        self.assertGreater(queued, 0)
+
+        timeout, serial_raw.CLOSE_DRAIN_TIMEOUT = serial_raw.CLOSE_DRAIN_TIMEOUT, 0.05
+        try:
+            transport.close()
+        finally:
+            serial_raw.CLOSE_DRAIN_TIMEOUT = timeout
+        exc = await asyncio.wait_for(peer.lost, 1)
+        self.assertIsInstance(exc, TimeoutError)
+        self.assertEqual(exc.errno, errno.ETIMEDOUT)
+        self.assertIn(f"{queued} queued bytes unsent", str(exc))
+
+
+if __name__ == "__main__":
+    unittest.main()
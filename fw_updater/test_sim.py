@@ -0,0 +1,139 @@
+"""Updates through comms.py against the real bootloader and gateway, built for the host by 'make -C host sim'.
+
+Run from fw_updater/ with 'python3 -m unittest test_sim' after 'make -C host && make -C host sim'.
+"""
+import asyncio
+import importlib.util
+import os
+import struct
+import tempfile
+import unittest
+import zlib
+from unittest import mock
+
+import blhost
+import comms
+import fw_image
+
+SIM_SRC_DIR       = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "host", "sim")
+SIM_DIR           = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "host", "build", "sim")
+PAYLOAD_LEN       = 3000
+SESSION_TIMEOUT   = 60      # s, a broadcast paces its frames for the baud rate
+
+
+def load_sim_transport():
+    # Loaded under its own name, so an installed pyserial-asyncio is neither shadowed nor used
+    spec = importlib.util.spec_from_file_location("sim_serial_asyncio", os.path.join(SIM_SRC_DIR, "serial_asyncio.py"))
+    module = importlib.util.module_from_spec(spec)
+    spec.loader.exec_module(module)
+    return module
+
+
+def app_payload(memory_map: dict[str, int]) -> bytes:
+    # The bootloader only starts an application whose stack pointer is in RAM
+    vectors = struct.pack("<II", memory_map["RAM_ORIGIN"] + memory_map["RAM_SIZE"], memory_map["APP_START_ADDRESS"] | 1)
+    return vectors + bytes((i * 7 + 3) & 0xFF for i in range(PAYLOAD_LEN))
+
+
+@unittest.skipUnless(blhost.lib, f"needs {blhost.LIB_PATH}, build it with 'make -C host'")
+@unittest.skipUnless(os.path.exists(os.path.join(SIM_DIR, "node")), "needs the simulator, build it with 'make -C host sim'")
+class SimulatorTest(unittest.IsolatedAsyncioTestCase):
+    def setUp(self):
+        self.memory_map = fw_image.read_memory_map()
+        self.payload = app_payload(self.memory_map)
+        self.image = fw_image.pack([fw_image.Segment(self.memory_map["APP_START_ADDRESS"], self.payload)],
+                                   fw_image.parse_version("1.2.3"), 0x27)
+        self.signing_key = fw_image.read_key(os.path.join(SIM_DIR, "signing-key.bin"))
+        self.flash_dir = tempfile.TemporaryDirectory()
+        self.addCleanup(self.flash_dir.cleanup)
+        environment = mock.patch.dict(os.environ, SIM_FLASH_DIR=self.flash_dir.name, SIM_LOSS="0")
+        environment.start()
+        self.addCleanup(environment.stop)
+        transport = mock.patch.object(comms, "serial_asyncio", load_sim_transport())
+        transport.start()
+        self.addCleanup(transport.stop)
+
+    def flash(self, uid: str) -> bytes:
+        with open(os.path.join(self.flash_dir.name, f"flash_{uid}.bin"), "rb") as file:
+            return file.read()
+
+    def assertUpdated(self, uid: str):
+        offset = self.memory_map["APP_START_ADDRESS"] - self.memory_map["FLASH_ORIGIN"]
+        self.assertEqual(self.flash(uid)[offset:offset + len(self.payload)], self.payload, f"node {uid}")
+
+    async def update(self, port: str, image: bytes, **options) -> comms.DeviceResult:
+        frames = blhost.Image(image, options.pop("fec", False))
+        session = comms.DeviceSession(port, 115200, frames, False, backend="pyserial", **options)
+        self.session = session
+        result = await asyncio.wait_for(session.run(), SESSION_TIMEOUT)
+        await session.transport.finished
+        return result
+
+    async def test_unicast(self):
+        result = await self.update("bus:11", self.image.to_bytes(self.signing_key), sparse=True)
+        self.assertEqual(result, comms.DeviceResult.Success)
+        self.assertUpdated("11")
+        self.assertIn("post-transfer verification (CRC + signature)", self.session.status)
+
+    async def test_shared_frames(self):
+        # One encoding of the image for every port, as comms.py runs them
+        frames = blhost.Image(self.image.to_bytes(self.signing_key), fec=True)
+        sessions = [comms.DeviceSession(port, 115200, frames, False, backend="pyserial") for port in ("bus:16", "bus:17")]
+        results = await asyncio.wait_for(asyncio.gather(*(s.run() for s in sessions)), SESSION_TIMEOUT)
+        for session in sessions:
+            await session.transport.finished
+        self.assertEqual(results, [comms.DeviceResult.Success] * 2)
+        self.assertUpdated("16")
+        self.assertUpdated("17")
+
+    async def test_encrypted_with_fec(self):
+        encryption_key = fw_image.read_key(os.path.join(SIM_DIR, "encryption-key.bin"), fw_image.ENCRYPTION_KEY_LEN)
+        result = await self.update("bus:12", self.image.to_bytes(self.signing_key, encryption_key), fec=True)
+        self.assertEqual(result, comms.DeviceResult.Success)
+        self.assertUpdated("12")
+
+    async def test_lossy_link_with_fec(self):
+        with mock.patch.dict(os.environ, SIM_LOSS="0.2"):
+            result = await self.update("bus:13", self.image.to_bytes(self.signing_key), fec=True)
+        self.assertEqual(result, comms.DeviceResult.Success)
+        self.assertUpdated("13")
+
+    async def test_spi_staging(self):
+        with mock.patch.dict(os.environ, SIM_NODE="spinode"):
+            result = await self.update("bus:14", self.image.to_bytes(self.signing_key))
+        self.assertEqual(result, comms.DeviceResult.Success)
+        self.assertUpdated("14")
+
+    async def test_enter_from_application(self):
+        result = await self.update("app:31", self.image.to_bytes(self.signing_key), enter=True)
+        self.assertEqual(result, comms.DeviceResult.Success)
+        self.assertUpdated("31")
+
+    async def test_behind_gateway(self):
+        result = await self.update("chain:21,22", self.image.to_bytes(self.signing_key), target=0x22)
+        self.assertEqual(result, comms.DeviceResult.Success)
+        self.assertUpdated("22")
+        offset = self.memory_map["APP_START_ADDRESS"] - self.memory_map["FLASH_ORIGIN"]
+        self.assertNotEqual(self.flash("21")[offset:offset + len(self.payload)], self.payload)
+
+    async def test_broadcast(self):
+        nodes = ["41", "42", "43"]
+        session = comms.BroadcastSession(f"bus:{','.join(nodes)}", 115200, self.image.to_bytes(self.signing_key),
+                                         [int(uid, 16) for uid in nodes], False, backend="pyserial")
+        results = await asyncio.wait_for(session.run(), SESSION_TIMEOUT)
+        await session.transport.finished
+        self.assertEqual(results, {int(uid, 16): comms.DeviceResult.Success for uid in nodes})
+        for uid in nodes:
+            self.assertUpdated(uid)
+
+    async def test_bad_signature(self):
+        raw = bytearray(self.image.to_bytes(self.signing_key))
+        header_size = len(raw) - self.image.image_size
+        raw[header_size - 1] ^= 0x01        # the last signature byte; the header CRC still has to hold
+        struct.pack_into("<I", raw, 4, zlib.crc32(raw[fw_image.IMAGE_HEADER_CRC_OFFSET:header_size]))
+        result = await self.update("bus:15", bytes(raw))
+        self.assertEqual(result, comms.DeviceResult.Failed)
+
+
+if __name__ == "__main__":
+    unittest.main()
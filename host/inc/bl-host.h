@@ -0,0 +1,264 @@
+#ifndef INC_BL_HOST_H
+#define INC_BL_HOST_H
+
+#include "common-defines.h"
+#include "comms.h"
+#include "bl-broadcast.h"
+
+/*
+ * Host side of the update protocol, built from the same headers and shared
+ * sources as the bootloader (comms-frame.c, crc8, reed-solomon, image).
+ *
+ * The sessions do no I/O: feed them whatever the port delivered and write out
+ * what they return. Used by the blflash CLI and, through ctypes, by
+ * fw_updater/blhost.py, which has no protocol code of its own.
+ */
+
+#define BLH_DEVICE_ID             (0x52U)
+#define BLH_SYNC_RETRY_MS         (500U)
+#define BLH_SYNC_WINDOW_MS        (10000U)
+#define BLH_TIMEOUT_MS            (5000U)
+#define BLH_VERIFY_TIMEOUT_MS     (10000U)
+
+#define BLH_NODE_ADDRESS_UNKNOWN  (-1)
+#define BLH_TIME_UNKNOWN          (0xFFFFFFFFU)   // transfer_ms and verify_ms of a session that did not get that far
+
+/* Bindings size their buffers from blh_frame_max_len() and blh_tx_buffer_size() */
+#define BLH_FRAME_MAX_LEN         (COMMS_FRAME_MAX_LEN)
+#define BLH_TX_BUFFER_SIZE        (4U * BLH_FRAME_MAX_LEN)
+
+#define BLH_OPTION_FEC            (1U << 0)     // Reed-Solomon parity on every frame
+#define BLH_OPTION_DENSE          (1U << 1)     // Send 0xFF chunks of plain images too
+#define BLH_OPTION_ENTER          (1U << 2)     // Sync with AA BB CC BE, which resets a running application into the bootloader
+                                                // (not with a target: applications do not relay addressed syncs)
+
+/* Same values as comms.py's DeviceResult, so they can be used as exit codes */
+typedef enum {
+    BLH_Result_Pending = -1,
+    BLH_Result_Success = 0,
+    BLH_Result_Failed = 1,
+    BLH_Result_Timeout = 2,
+} blh_result_t;
+
+typedef enum {
+    BLH_State_Sync,
+    BLH_State_WaitUpdateReq,
+    BLH_State_SendUpdateRes,
+    BLH_State_WaitDeviceIdReq,
+    BLH_State_SendDeviceIdRes,
+    BLH_State_WaitLengthReq,
+    BLH_State_SendLength,
+    BLH_State_WaitReady,
+    BLH_State_SendFrame,
+    BLH_State_WaitFrameReady,
+    BLH_State_SendWriteDone,
+    BLH_State_WaitResult,
+    BLH_State_Done,
+} blh_state_t;
+
+/*
+ * A firmware image with every frame a session can send of it encoded once:
+ * the header as 16 byte packets, the payload as addressed frames of each size
+ * the link can settle on, at every 16 byte offset. Sessions to any number of
+ * devices share one, so N ports do not encode (or add FEC to) the image N
+ * times. The storage is the caller's, blh_image_storage_size() bytes.
+ */
+
+#define BLH_IMAGE_FRAME_SIZES     (3U)          // COMMS_PACKET_PAYLOAD_LEN up to COMMS_PACKET_PAYLOAD_MAX_LEN, doubling
+
+typedef struct {
+    const uint8_t* data;
+    uint32_t length;
+    uint32_t header_size;
+    uint32_t image_span;        /* Flash from the load address to the end of the last segment */
+    bool encrypted;
+    bool valid;
+    uint32_t options;           /* BLH_OPTION_FEC: the frames carry parity, and so do the sessions' packets */
+    uint8_t* frames;            /* BLH_FRAME_MAX_LEN each, by 16 byte offset and then by size */
+    uint8_t* frame_lengths;
+} blh_image_t;
+
+typedef struct {
+    const blh_image_t* image;
+    uint32_t options;
+    bool sparse;
+    bool targeted;              /* Addressed sync, see blh_session_set_target() */
+    uint16_t target;
+
+    blh_state_t state;
+    blh_result_t result;
+    char message[64];
+    uint32_t offset;
+    uint32_t bytes_sent;
+    uint32_t deadline_ms;
+    uint32_t sync_deadline_ms;
+
+    comms_frame_parser_t parser;
+    uint8_t tx[BLH_TX_BUFFER_SIZE];
+    uint32_t tx_length;
+
+    /* Last frame waiting for its ACK, resent on RETX: a packet of ours in frame[], or one of the image's */
+    bool awaiting_ack;
+    uint8_t frame[BLH_FRAME_MAX_LEN];
+    const uint8_t* sent_frame;
+    uint32_t frame_length;
+    uint32_t frame_payload;
+    bool frame_retransmitted;
+    uint32_t frame_sent_ms;
+
+    int32_t node_address;       /* From the device ID request, for broadcast sessions */
+    uint32_t boot_us;           /* Bootloader jump to application main(), reported by a download agent; 0 unknown */
+    uint8_t credits;
+    uint8_t device_max_payload;
+    comms_link_t link;          /* Retransmits instead of CRC failures */
+
+    uint32_t rtt_count;
+    uint32_t rtt_total_ms;
+    uint32_t rtt_max_ms;
+
+    /* READY_FOR_DATA to the last data ACK, and from there to the device's verdict (CRC and signature check) */
+    uint32_t transfer_start_ms;
+    uint32_t transfer_end_ms;
+    uint32_t transfer_ms;
+    uint32_t verify_ms;
+} blh_session_t;
+
+/* What bindings need from a session without knowing its layout */
+typedef struct {
+    int32_t result;
+    uint32_t offset;
+    uint32_t bytes_sent;
+    uint32_t rtt_count;
+    uint32_t rtt_total_ms;
+    uint32_t rtt_max_ms;
+    int32_t node_address;
+    uint32_t boot_us;
+    uint32_t transfer_ms;
+    uint32_t verify_ms;
+    const char* state;
+    const char* message;
+} blh_status_t;
+
+/* Codec, all of it comms-frame.c */
+uint32_t blh_frame_max_len(void);
+uint32_t blh_tx_buffer_size(void);
+uint8_t blh_crc8(const uint8_t* data, uint32_t length);
+uint32_t blh_encode_packet(const uint8_t* payload, uint8_t length, uint8_t* frame);
+uint32_t blh_encode_addressed(uint32_t offset, const uint8_t* payload, uint8_t length, uint8_t* frame);
+uint32_t blh_encode_broadcast(uint16_t seq, const uint8_t* payload, uint8_t* frame);
+uint32_t blh_add_fec(uint8_t* frame, uint32_t length);
+/* First frame in `data` with a good CRC: its length byte (or size of an addressed frame) and payload;
+ * returns the bytes consumed through the end of that frame, 0 if there is none */
+uint32_t blh_decode_frame(const uint8_t* data, uint32_t length, uint8_t* payload, uint8_t* payload_length);
+/* One byte from a device: true once the parser holds a good packet (not a data frame) */
+bool blh_receive(comms_frame_parser_t* parser, uint8_t byte);
+
+/* Image */
+uint32_t blh_image_storage_size(uint32_t image_length);
+bool blh_image_init(blh_image_t* image, const uint8_t* data, uint32_t length, uint32_t options, uint8_t* storage);
+uint32_t blh_image_size(void);
+
+/* Session; the image and its storage must outlive it. FEC follows the image's options */
+bool blh_session_init(blh_session_t* session, const blh_image_t* image, uint32_t options, uint32_t now_ms);
+void blh_session_set_target(blh_session_t* session, uint16_t node_address);
+uint32_t blh_session_update(blh_session_t* session, const uint8_t* rx, uint32_t rx_length, uint32_t now_ms,
+                            uint8_t* tx, uint32_t tx_size);
+void blh_session_status(const blh_session_t* session, blh_status_t* status);
+uint32_t blh_session_size(void);
+
+
+/*
+ * Broadcast session: every listed node on one shared bus programs the same
+ * frames, gaps are repaired from NACK polls. Nothing is acknowledged, so frames
+ * are paced for the slowest node's flash; time is in microseconds here.
+ */
+
+#define BLH_BCAST_MAX_NODES         (64U)
+#define BLH_BCAST_MAX_FRAMES        (0x10000U)
+#define BLH_BCAST_FRAME_LEN         (COMMS_PACKET_DATALEN_LEN + COMMS_BCAST_SEQ_LEN + COMMS_PACKET_PAYLOAD_LEN + COMMS_PACKET_CRC_LEN)
+#define BLH_BCAST_SYNC_MS           (2000U)     // of AA BB CC EE, nodes must be waiting in the bootloader
+#define BLH_BCAST_SYNC_INTERVAL_MS  (100U)
+#define BLH_BCAST_MIN_FRAME_US      (600U)      // a node programming one frame
+#define BLH_BCAST_LEAD_US           (5000U)     // frames are handed out this far ahead of their slot
+#define BLH_BCAST_REPEAT            (3U)        // BEGIN, END and header frames; nodes take headers in order
+#define BLH_BCAST_ERASE_MS          (1700U)     // worst case erase of the application area after the header
+#define BLH_BCAST_ERASE_MS_PER_KIB  (42U)       // nodes erase up to the image end, large images need longer
+#define BLH_BCAST_POLL_TIMEOUT_MS   (300U)
+#define BLH_BCAST_POLL_ATTEMPTS     (3U)
+#define BLH_BCAST_REPAIR_ROUNDS     (8U)
+#define BLH_BCAST_VERIFY_MS         (1500U)     // CRC and signature check on every node after END
+#define BLH_BCAST_NO_ANSWER         (-1)
+
+typedef enum {
+    BLH_Bcast_Sync,
+    BLH_Bcast_Begin,
+    BLH_Bcast_Header,
+    BLH_Bcast_Erase,
+    BLH_Bcast_Payload,
+    BLH_Bcast_Poll,
+    BLH_Bcast_End,
+    BLH_Bcast_Verify,
+    BLH_Bcast_FinalPoll,
+    BLH_Bcast_Done,
+} blh_bcast_state_t;
+
+typedef struct {
+    uint16_t address;
+    int32_t status;             /* bl_broadcast_status_t of its last NACK, or BLH_BCAST_NO_ANSWER */
+    uint32_t missing;           /* Frames it reported missing in the last poll */
+    int32_t result;             /* blh_result_t */
+} blh_bcast_node_t;
+
+typedef struct {
+    const uint8_t* image;
+    uint32_t image_length;
+    uint32_t header_frames;
+    uint32_t total_frames;
+    uint32_t frame_us;
+    uint32_t erase_us;
+
+    blh_bcast_state_t state;
+    blh_result_t result;
+    char message[64];
+    uint32_t deadline_us;
+    uint32_t next_frame_us;     /* Pacing slot of the next frame */
+    uint32_t repeats;
+    uint32_t seq;
+    uint32_t header_sent;
+    uint32_t frames_sent;
+
+    /* Repair rounds send only the frames some node reported missing */
+    bool repairing;
+    uint32_t round;
+    uint32_t repair_count;
+    uint8_t repair[BLH_BCAST_MAX_FRAMES / 8U];
+
+    uint32_t node;              /* Being polled */
+    uint32_t from_seq;
+    uint32_t attempts;
+
+    blh_bcast_node_t nodes[BLH_BCAST_MAX_NODES];
+    uint32_t node_count;
+
+    comms_frame_parser_t parser;
+    uint8_t tx[BLH_TX_BUFFER_SIZE];
+    uint32_t tx_length;
+} blh_bcast_t;
+
+typedef struct {
+    int32_t result;
+    uint32_t frames_sent;
+    uint32_t total_frames;
+    const char* message;
+} blh_bcast_status_t;
+
+bool blh_bcast_init(blh_bcast_t* bcast, const uint8_t* image, uint32_t image_length, const uint16_t* nodes,
+                    uint32_t node_count, uint32_t baud_rate, uint32_t now_us);
+uint32_t blh_bcast_update(blh_bcast_t* bcast, const uint8_t* rx, uint32_t rx_length, uint32_t now_us,
+                          uint8_t* tx, uint32_t tx_size);
+void blh_bcast_status(const blh_bcast_t* bcast, blh_bcast_status_t* status);
+bool blh_bcast_node(const blh_bcast_t* bcast, uint32_t index, blh_bcast_node_t* node);
+const char* blh_bcast_status_name(int32_t status);
+uint32_t blh_bcast_size(void);
+
+#endif /* INC_BL_HOST_H */
@@ -0,0 +1,8 @@
+#ifndef INC_COMMON_DEFINES_H
+#define INC_COMMON_DEFINES_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#endif
\ No newline at end of file
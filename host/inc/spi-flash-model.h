@@ -0,0 +1,18 @@
+#ifndef INC_SPI_FLASH_MODEL_H
+#define INC_SPI_FLASH_MODEL_H
+
+#include "common-defines.h"
+
+/*
+ * W25Q-style SPI NOR chip behind the core/spi-bus.h functions, so the host
+ * simulator runs core/spi-flash.c and the SPI staging backend unchanged.
+ * Programs only clear bits and wrap within their page, erases set a sector to
+ * 0xFF, and both report busy for a few status polls like the real chip.
+ */
+
+#define SPI_FLASH_MODEL_BUSY_POLLS  (4U)
+
+/* `size` must be a power of two; the memory is the chip's content and stays the caller's */
+void spi_flash_model_attach(uint8_t* memory, uint32_t size);
+
+#endif /* INC_SPI_FLASH_MODEL_H */
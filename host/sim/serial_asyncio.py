@@ -0,0 +1,124 @@
+"""Stand-in for pyserial-asyncio that connects comms.py to simulated nodes instead of a serial port.
+
+Put this directory first on PYTHONPATH and use '--backend pyserial'. Port names pick the wiring:
+
+    bus:11,12,13    one node per hex unique ID, all on the same line (broadcast sessions)
+    chain:21,22     the host talks to 21, a gateway, which forwards to 22 on its downstream link
+    app:31          31 runs the application, which resets into the bootloader (--enter)
+
+Environment:
+    SIM_DIR         where 'make -C host sim' put the binaries (default host/build/sim)
+    SIM_FLASH_DIR   where flash_<uid>.bin and spi_<uid>.bin live between runs (default SIM_DIR)
+    SIM_NODE        binary for bus and app nodes, e.g. spinode (default node)
+    SIM_LOSS        fraction of 18 byte frames that reach each node with a corrupted byte
+"""
+import asyncio
+import os
+import random
+
+SIM_DIR = os.environ.get("SIM_DIR", os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "build", "sim"))
+CORRUPT_OFFSET = 5      # a payload byte of any frame kind
+
+
+def flash_path(uid: str, kind: str = "flash") -> str:
+    return os.path.join(os.environ.get("SIM_FLASH_DIR", SIM_DIR), f"{kind}_{uid}.bin")
+
+
+class SimTransport(asyncio.Transport):
+    def __init__(self, protocol: asyncio.Protocol, port: str):
+        super().__init__()
+        self.protocol = protocol
+        self.wiring, _, uids = port.partition(":")
+        self.uids = uids.split(",")
+        if self.wiring not in ("bus", "chain", "app") or not all(self.uids):
+            raise OSError(f"{port}: not a simulator port, expected bus:UID,... chain:UID,... or app:UID")
+        self.loss = float(os.environ.get("SIM_LOSS", "0"))
+        self.processes: list[asyncio.subprocess.Process] = []     # the ones on the host line
+        self.others: list[asyncio.subprocess.Process] = []        # further down a chain
+        self.tasks: list[asyncio.Task] = []
+        self.closing = False
+        self.finished: asyncio.Task | None = None     # done once every node has saved its flash
+
+    def environment(self, uid: str, **extra: str) -> dict[str, str]:
+        return dict(os.environ, NODE_UID=uid, NODE_FLASH=flash_path(uid), NODE_SPI=flash_path(uid, "spi"), **extra)
+
+    async def start(self):
+        node = os.path.join(SIM_DIR, os.environ.get("SIM_NODE", "node"))
+        if self.wiring == "bus":
+            for uid in self.uids:
+                self.processes.append(await asyncio.create_subprocess_exec(
+                    node, stdin=asyncio.subprocess.PIPE, stdout=asyncio.subprocess.PIPE, env=self.environment(uid)))
+        elif self.wiring == "app":
+            app = os.path.join(SIM_DIR, "app")
+            self.processes.append(await asyncio.create_subprocess_exec(
+                app, stdin=asyncio.subprocess.PIPE, stdout=asyncio.subprocess.PIPE,
+                env=self.environment(self.uids[0], NODE_BOOT=node, NODE_APP=app)))
+        else:
+            await self.start_chain(node)
+        self.tasks = [asyncio.get_running_loop().create_task(self.pump(p)) for p in self.processes]
+
+    async def start_chain(self, node: str):
+        # Every hop but the last is a gateway, its downstream link a pair of pipes to the next hop's stdin and stdout
+        stdin, stdout = asyncio.subprocess.PIPE, asyncio.subprocess.PIPE
+        for index, uid in enumerate(self.uids):
+            last = index == len(self.uids) - 1
+            own_fds = [fd for fd in (stdin, stdout) if isinstance(fd, int) and fd >= 0]
+            if last:
+                process = await asyncio.create_subprocess_exec(node, stdin=stdin, stdout=stdout, env=self.environment(uid))
+            else:
+                from_next, next_stdout = os.pipe()
+                next_stdin, to_next = os.pipe()
+                process = await asyncio.create_subprocess_exec(
+                    os.path.join(SIM_DIR, "gateway"), stdin=stdin, stdout=stdout, pass_fds=(from_next, to_next),
+                    env=self.environment(uid, NODE_DOWNSTREAM=f"{from_next},{to_next}"))
+                own_fds += [from_next, to_next]
+                stdin, stdout = next_stdin, next_stdout
+            (self.others if index else self.processes).append(process)
+            for fd in own_fds:
+                os.close(fd)
+
+    async def pump(self, process: asyncio.subprocess.Process):
+        while True:
+            data = await process.stdout.read(256)
+            if not data:
+                return
+            self.protocol.data_received(data)
+
+    def write(self, data: bytes):
+        for process in self.processes:
+            chunk = bytearray(data)
+            if self.loss and len(chunk) > CORRUPT_OFFSET and random.random() < self.loss * len(chunk) / 18:
+                chunk[CORRUPT_OFFSET] ^= 0x5A
+            if process.returncode is None:
+                process.stdin.write(bytes(chunk))
+
+    def is_closing(self) -> bool:
+        return self.closing
+
+    def close(self):
+        """Closes the line; every node powers off and saves its flash."""
+        if self.closing:
+            return
+        self.closing = True
+        for process in self.processes:
+            if process.stdin and not process.stdin.is_closing():
+                process.stdin.close()
+        self.finished = asyncio.get_running_loop().create_task(self.finish())
+
+    async def finish(self):
+        for process in self.processes:
+            await process.wait()
+        # Down the chain a closed pipe is seen too, one hop after the other
+        for process in self.others:
+            await process.wait()
+        for task in self.tasks:
+            task.cancel()
+        self.protocol.connection_lost(None)
+
+
+async def create_serial_connection(loop, protocol_factory, port, baudrate=115200, rtscts=False, **kwargs):
+    protocol = protocol_factory()
+    transport = SimTransport(protocol, port)
+    await transport.start()
+    protocol.connection_made(transport)
+    return transport, protocol
@@ -0,0 +1,9 @@
+/* The download agent alone, as the application: what it needs of app/src/firmware.c */
+#include "download-agent.h"
+
+int main(void) {
+    download_agent_setup();
+    for (;;) {
+        download_agent_update();
+    }
+}
@@ -0,0 +1,373 @@
+/*
+ * Host stand-ins for the hardware under the bootloader and the download
+ * agent, so both run as ordinary processes: flash is anonymous memory mapped
+ * at its real address, USART2 is stdin/stdout and USART3 (the downstream
+ * link of a gateway) a pair of file descriptors from NODE_DOWNSTREAM.
+ *
+ * Environment:
+ *   NODE_UID         hex unique ID, which is also where the node address comes from
+ *   NODE_FLASH       file the flash content is loaded from and saved to on exit
+ *   NODE_APP         executable system_jump() runs in place of the application
+ *   NODE_BOOT        executable scb_reset_system() runs in place of the bootloader
+ *   NODE_DOWNSTREAM  "rx,tx" file descriptors of the USART3 link, a gateway's next hop
+ */
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <libopencm3/stm32/desig.h>
+#include <libopencm3/stm32/dma.h>
+#include <libopencm3/stm32/flash.h>
+#include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/usart.h>
+#include <libopencm3/cm3/dwt.h>
+#include <libopencm3/cm3/scb.h>
+#include <libopencm3/cm3/systick.h>
+#include "core/handoff.h"
+#include "core/memory-map.h"
+#include "core/system.h"
+#include "core/uart.h"
+#include "sim.h"
+
+#define SIM_PAGE_SIZE       (0x1000U)
+#define SIM_FLASH_PAGE_SIZE (1024U)     // A 64 KiB medium density part
+#define SIM_HOST_POLL_MS    (1)         // How long an empty host link blocks, keeps an idle node off the CPU
+#define SIM_DELAY_DIVISOR   (50U)       // Only LED blinking waits on system_delay_ms(), nothing the protocol needs
+
+uint32_t rcc_ahb_frequency = 72000000U;
+
+static uint32_t node_uid = 1U;
+static const char* flash_file = NULL;
+
+/* Register pages the firmware touches: DMA1 and RCC, SCB/NVIC/SysTick, DWT, DBGMCU, and the handoff block */
+static const uintptr_t register_pages[] = {
+    0x40020000U,
+    0x40021000U,
+    0xE000E000U,
+    0xE0001000U,
+    0xE0042000U,
+    (RAM_ORIGIN + RAM_SIZE - 1U) & ~(SIM_PAGE_SIZE - 1U),
+};
+
+static const uint32_t clock_hz[System_Clock_Count] = {24000000U, 48000000U, 72000000U};
+
+
+static void map_fixed(uintptr_t address, size_t size) {
+    if (mmap((void*) address, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED) {
+        perror("sim: mmap");
+        exit(SIM_EXIT_SETUP);
+    }
+}
+
+
+/* sim-spi.c replaces this in SPI staging builds */
+__attribute__((weak)) void sim_spi_save(void) {}
+
+
+static void save_flash(void) {
+    sim_spi_save();
+    if (flash_file == NULL) {
+        return;
+    }
+    FILE* f = fopen(flash_file, "wb");
+    if (f == NULL) {
+        perror(flash_file);
+        return;
+    }
+    fwrite((const void*) FLASH_ORIGIN, 1, FLASH_SIZE, f);
+    fclose(f);
+}
+
+
+__attribute__((constructor)) static void sim_setup(void) {
+    map_fixed(FLASH_ORIGIN, FLASH_SIZE);
+    for (uint32_t i = 0; i < sizeof(register_pages) / sizeof(register_pages[0]); i++) {
+        map_fixed(register_pages[i], SIM_PAGE_SIZE);
+    }
+    memset((void*) FLASH_ORIGIN, 0xFF, FLASH_SIZE);
+
+    const char* uid = getenv("NODE_UID");
+    if (uid != NULL) {
+        node_uid = (uint32_t) strtoul(uid, NULL, 16);
+    }
+    flash_file = getenv("NODE_FLASH");
+    if (flash_file != NULL) {
+        FILE* f = fopen(flash_file, "rb");
+        if (f != NULL) {
+            if (fread((void*) FLASH_ORIGIN, 1, FLASH_SIZE, f) == 0U) {
+                fprintf(stderr, "sim: %s is empty, starting erased\n", flash_file);
+            }
+            fclose(f);
+        }
+    }
+
+    // What handoff_enter_bootloader() leaves behind its software reset, see scb_reset_system()
+    if (getenv("SIM_ENTER_BOOTLOADER") != NULL) {
+        *(volatile uint32_t*) (HANDOFF_ADDRESS + HANDOFF_SIZE - 4U) = HANDOFF_ENTER_BOOTLOADER;
+        RCC_CSR |= RCC_CSR_SFTRSTF;
+        unsetenv("SIM_ENTER_BOOTLOADER");
+    }
+}
+
+
+/* Flash */
+void flash_unlock(void) {}
+void flash_lock(void) {}
+void flash_unlock_upper(void) {}
+void flash_lock_upper(void) {}
+
+void flash_erase_page(uint32_t page_address) {
+    memset((void*) (uintptr_t) page_address, 0xFF, SIM_FLASH_PAGE_SIZE);
+}
+
+void flash_program_half_word(uint32_t address, uint16_t data) {
+    volatile uint16_t* half_word = (volatile uint16_t*) (uintptr_t) address;
+
+    // The controller only programs erased half words, or zeroes them
+    if ((*half_word != 0xFFFFU) && (data != 0U)) {
+        fprintf(stderr, "sim %x: PGERR at %08x\n", node_uid, address);
+        return;
+    }
+    *half_word = data;
+}
+
+uint16_t desig_get_flash_size(void) {
+    return (uint16_t) (FLASH_SIZE / 1024U);
+}
+
+void desig_get_unique_id(uint32_t* result) {
+    result[0] = node_uid;
+    result[1] = 0U;
+    result[2] = 0U;
+}
+
+
+/* Clocks, pins and the core */
+void rcc_periph_clock_enable(enum rcc_periph_clken clken) {
+    (void) clken;
+}
+
+void gpio_set_mode(uint32_t gpioport, uint8_t mode, uint8_t cnf, uint16_t gpios) {
+    (void) gpioport;
+    (void) mode;
+    (void) cnf;
+    (void) gpios;
+}
+
+void gpio_toggle(uint32_t gpioport, uint16_t gpios) {
+    (void) gpioport;
+    (void) gpios;
+}
+
+void dma_disable_channel(uint32_t dma, uint8_t channel) {
+    (void) dma;
+    (void) channel;
+}
+
+void systick_interrupt_disable(void) {}
+void systick_counter_disable(void) {}
+
+bool dwt_enable_cycle_counter(void) {
+    return true;
+}
+
+uint32_t dwt_read_cycle_counter(void) {
+    return (uint32_t) (system_get_us() * (rcc_ahb_frequency / 1000000U));
+}
+
+void system_setup(system_clock_t clock) {
+    system_set_clock(clock);
+}
+
+void system_set_clock(system_clock_t clock) {
+    rcc_ahb_frequency = clock_hz[clock];
+}
+
+bool system_on_clock_change(void (*listener)(system_clock_event_t event)) {
+    (void) listener;
+    return true;
+}
+
+uint64_t system_get_us(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t) now.tv_sec * 1000000U) + ((uint64_t) now.tv_nsec / 1000U);
+}
+
+uint64_t system_get_ticks(void) {
+    return system_get_us() / 1000U;
+}
+
+void system_delay_ms(uint64_t millis) {
+    usleep((useconds_t) ((millis * 1000U) / SIM_DELAY_DIVISOR));
+}
+
+/* The process ends here, or becomes NODE_APP, which maps the flash this one saved */
+void system_jump(uint32_t address) {
+    const handoff_t* handoff = (const handoff_t*) (uintptr_t) HANDOFF_ADDRESS;
+    const char* app = getenv("NODE_APP");
+
+    fprintf(stderr, "sim %x: jump to %08x, update result %u\n", node_uid, address, handoff->update_result);
+    save_flash();
+    if (app != NULL) {
+        execl(app, app, (char*) NULL);
+        perror(app);
+    }
+    exit(SIM_EXIT_JUMPED);
+}
+
+void scb_reset_system(void) {
+    const char* bootloader = getenv("NODE_BOOT");
+
+    fprintf(stderr, "sim %x: software reset\n", node_uid);
+    save_flash();
+    if (bootloader != NULL) {
+        // RAM does not survive exec, so the request to stay in the bootloader goes through the environment
+        if (*(volatile uint32_t*) (HANDOFF_ADDRESS + HANDOFF_SIZE - 4U) == HANDOFF_ENTER_BOOTLOADER) {
+            setenv("SIM_ENTER_BOOTLOADER", "1", 1);
+        }
+        execl(bootloader, bootloader, (char*) NULL);
+        perror(bootloader);
+    }
+    exit(SIM_EXIT_RESET);
+}
+
+
+/* UARTs: USART2 is the host link, USART3 the downstream link */
+typedef struct {
+    int rx_fd;
+    int tx_fd;
+    uint8_t data[4096];
+    uint32_t length;
+    uint32_t position;
+} sim_link_t;
+
+static uart_t uarts[2];
+static sim_link_t links[2] = {
+    {.rx_fd = STDIN_FILENO, .tx_fd = STDOUT_FILENO},
+    {.rx_fd = -1, .tx_fd = -1},     // Unconnected until NODE_DOWNSTREAM says otherwise
+};
+
+
+static sim_link_t* link_of(uart_t* uart) {
+    return &links[(uart == &uarts[1]) ? 1 : 0];
+}
+
+
+uart_t* uart_open(const uart_config_t* config) {
+    uart_t* uart = &uarts[(config->usart == USART3) ? 1 : 0];
+
+    uart->usart = config->usart;
+    uart->baud_rate = config->baud_rate;
+    uart->rx_mode = config->rx_mode;
+    uart->tx_mode = config->tx_mode;
+    uart->flow_control = config->flow_control;
+
+    sim_link_t* link = link_of(uart);
+    const char* downstream = getenv("NODE_DOWNSTREAM");
+    if ((uart == &uarts[1]) && (downstream != NULL) && (sscanf(downstream, "%d,%d", &link->rx_fd, &link->tx_fd) != 2)) {
+        link->rx_fd = -1;
+        link->tx_fd = -1;
+    }
+    if (link->rx_fd >= 0) {
+        fcntl(link->rx_fd, F_SETFL, O_NONBLOCK);
+    }
+    return uart;
+}
+
+void uart_set_baud_rate(uart_t* uart, uint32_t baud_rate) {
+    uart->baud_rate = baud_rate;
+}
+
+void uart_send(uart_t* uart, const uint8_t* data, uint32_t length) {
+    const sim_link_t* link = link_of(uart);
+
+    while ((link->tx_fd >= 0) && (length > 0U)) {
+        const ssize_t written = write(link->tx_fd, data, length);
+        if (written <= 0) {
+            return;
+        }
+        data += written;
+        length -= (uint32_t) written;
+    }
+}
+
+void uart_flush(uart_t* uart) {
+    (void) uart;
+}
+
+bool uart_available(uart_t* uart) {
+    sim_link_t* link = link_of(uart);
+    const bool host = (uart == &uarts[0]);
+
+    if (link->position < link->length) {
+        return true;
+    }
+    if (link->rx_fd < 0) {
+        return false;
+    }
+    struct pollfd pfd = {.fd = link->rx_fd, .events = POLLIN};
+    if (poll(&pfd, 1, host ? SIM_HOST_POLL_MS : 0) <= 0) {
+        return false;
+    }
+    const ssize_t received = read(link->rx_fd, link->data, sizeof(link->data));
+    if (received > 0) {
+        link->length = (uint32_t) received;
+        link->position = 0U;
+        return true;
+    }
+    if ((received == 0) && host) {
+        // The host closed the line: power off
+        save_flash();
+        exit(SIM_EXIT_HANGUP);
+    }
+    return false;
+}
+
+uint8_t uart_recv_byte(uart_t* uart) {
+    sim_link_t* link = link_of(uart);
+    return (link->position < link->length) ? link->data[link->position++] : 0U;
+}
+
+uint32_t uart_recv(uart_t* uart, uint8_t* data, uint32_t length) {
+    uint32_t received = 0;
+    while ((received < length) && uart_available(uart)) {
+        data[received++] = uart_recv_byte(uart);
+    }
+    return received;
+}
+
+bool uart_rx_overrun(uart_t* uart) {
+    (void) uart;
+    return false;
+}
+
+void uart_setup(bool flow_control, uint32_t baud_rate) {
+    const uart_config_t config = {.usart = USART2, .baud_rate = baud_rate, .flow_control = flow_control};
+    uart_open(&config);
+}
+
+void uart_write(uint8_t* data, uint32_t length) {
+    uart_send(&uarts[0], data, length);
+}
+
+void uart_write_byte(uint8_t data) {
+    uart_send(&uarts[0], &data, 1U);
+}
+
+bool uart_data_available(void) {
+    return uart_available(&uarts[0]);
+}
+
+uint8_t uart_read_byte(void) {
+    return uart_recv_byte(&uarts[0]);
+}
+
+uint32_t uart_read(uint8_t* data, uint32_t length) {
+    return uart_recv(&uarts[0], data, length);
+}
@@ -0,0 +1,43 @@
+/*
+ * The SPI staging chip of a simulated node: the W25Q model of
+ * libspiflash-model.a over a 1 MiB buffer, loaded from and saved to NODE_SPI.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "spi-flash-model.h"
+#include "sim.h"
+
+#define SIM_SPI_SIZE    (1024U * 1024U)
+
+static uint8_t chip[SIM_SPI_SIZE];
+static const char* spi_file = NULL;
+
+
+__attribute__((constructor)) static void sim_spi_setup(void) {
+    memset(chip, 0xFF, sizeof(chip));
+    spi_file = getenv("NODE_SPI");
+    if (spi_file != NULL) {
+        FILE* f = fopen(spi_file, "rb");
+        if (f != NULL) {
+            if (fread(chip, 1, sizeof(chip), f) == 0U) {
+                fprintf(stderr, "sim: %s is empty, starting erased\n", spi_file);
+            }
+            fclose(f);
+        }
+    }
+    spi_flash_model_attach(chip, sizeof(chip));
+}
+
+
+void sim_spi_save(void) {
+    if (spi_file == NULL) {
+        return;
+    }
+    FILE* f = fopen(spi_file, "wb");
+    if (f == NULL) {
+        perror(spi_file);
+        return;
+    }
+    fwrite(chip, 1, sizeof(chip), f);
+    fclose(f);
+}
@@ -0,0 +1,15 @@
+#ifndef INC_SIM_H
+#define INC_SIM_H
+
+#include "common-defines.h"
+
+/* Exit codes of a simulated node, for whoever runs it */
+#define SIM_EXIT_JUMPED     (0)     // Started the application, with no NODE_APP to run
+#define SIM_EXIT_SETUP      (2)     // Could not map memory
+#define SIM_EXIT_HANGUP     (3)     // The host closed stdin
+#define SIM_EXIT_RESET      (4)     // Software reset, with no NODE_BOOT to run
+
+/* Writes the SPI NOR back to NODE_SPI; does nothing in builds without SPI staging */
+void sim_spi_save(void);
+
+#endif /* INC_SIM_H */
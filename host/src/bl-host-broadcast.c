@@ -0,0 +1,443 @@
+#include <string.h>
+#include "bl-host.h"
+#include "core/image.h"
+
+#define US_PER_MS (1000U)
+
+static const char* const bcast_status_names[] = {
+    "NotTarget", "NoHeader", "Receiving", "UpToDate", "Success", "Failed",
+};
+
+
+static bool time_reached(uint32_t now_us, uint32_t deadline_us) {
+    return (int32_t) (now_us - deadline_us) >= 0;
+}
+
+
+static void bcast_log(blh_bcast_t* bcast, const char* message) {
+    snprintf(bcast->message, sizeof(bcast->message), "%s", message);
+}
+
+
+static bool tx_room(const blh_bcast_t* bcast, uint32_t length) {
+    return bcast->tx_length + length <= sizeof(bcast->tx);
+}
+
+
+static void queue_bytes(blh_bcast_t* bcast, const uint8_t* data, uint32_t length) {
+    memcpy(&bcast->tx[bcast->tx_length], data, length);
+    bcast->tx_length += length;
+}
+
+
+static void queue_packet(blh_bcast_t* bcast, const uint8_t* payload, uint8_t length) {
+    bcast->tx_length += blh_encode_packet(payload, length, &bcast->tx[bcast->tx_length]);
+}
+
+
+static bool in_repair(const blh_bcast_t* bcast, uint32_t seq) {
+    return !bcast->repairing || (bcast->repair[seq / 8U] & (1U << (seq % 8U)));
+}
+
+
+/* Starts a paced run of frames in `state` */
+static void start_frames(blh_bcast_t* bcast, blh_bcast_state_t state, uint32_t now_us) {
+    bcast->state = state;
+    bcast->repeats = 0U;
+    bcast->seq = (state == BLH_Bcast_Payload) ? bcast->header_frames : 0U;
+    bcast->next_frame_us = now_us;
+}
+
+
+/* Next frame of the current run into the tx queue; false once the run is exhausted */
+static bool next_frame(blh_bcast_t* bcast) {
+    switch (bcast->state) {
+        case BLH_Bcast_Begin: {
+            if (bcast->repeats == BLH_BCAST_REPEAT) {
+                return false;
+            }
+            const uint8_t begin[6] = {
+                BL_PACKET_BCAST_BEGIN_DATA0, BLH_DEVICE_ID,
+                (uint8_t) (bcast->image_length >> 24), (uint8_t) (bcast->image_length >> 16),
+                (uint8_t) (bcast->image_length >> 8), (uint8_t) (bcast->image_length & 0xFF),
+            };
+            queue_packet(bcast, begin, sizeof(begin));
+            bcast->repeats++;
+            return true;
+        }
+
+        case BLH_Bcast_End: {
+            if (bcast->repeats == BLH_BCAST_REPEAT) {
+                return false;
+            }
+            const uint8_t end = BL_PACKET_BCAST_END_DATA0;
+            queue_packet(bcast, &end, 1U);
+            bcast->repeats++;
+            return true;
+        }
+
+        case BLH_Bcast_Header: {
+            // The whole header run is repeated, nodes take its frames in order
+            while (bcast->repeats < BLH_BCAST_REPEAT) {
+                for (; bcast->seq < bcast->header_frames; bcast->seq++) {
+                    if (in_repair(bcast, bcast->seq)) {
+                        const uint32_t seq = bcast->seq++;
+                        bcast->tx_length += blh_encode_broadcast((uint16_t) seq, &bcast->image[seq * COMMS_PACKET_PAYLOAD_LEN],
+                                                                 &bcast->tx[bcast->tx_length]);
+                        bcast->header_sent++;
+                        return true;
+                    }
+                }
+                bcast->seq = 0U;
+                bcast->repeats++;
+            }
+            return false;
+        }
+
+        case BLH_Bcast_Payload: {
+            for (; bcast->seq < bcast->total_frames; bcast->seq++) {
+                if (in_repair(bcast, bcast->seq)) {
+                    const uint32_t seq = bcast->seq++;
+                    bcast->tx_length += blh_encode_broadcast((uint16_t) seq, &bcast->image[seq * COMMS_PACKET_PAYLOAD_LEN],
+                                                             &bcast->tx[bcast->tx_length]);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        default: {
+            return false;
+        }
+    }
+}
+
+
+/* No ACKs on a bus, so frames go out no faster than the slowest node programs them.
+ * Returns true once the run is sent and its last slot has come. */
+static bool send_paced(blh_bcast_t* bcast, uint32_t now_us) {
+    while ((int32_t) (bcast->next_frame_us - now_us) <= (int32_t) BLH_BCAST_LEAD_US) {
+        if (!tx_room(bcast, BLH_BCAST_FRAME_LEN)) {
+            return false;
+        }
+        if (!next_frame(bcast)) {
+            return true;
+        }
+        bcast->frames_sent++;
+        bcast->next_frame_us += bcast->frame_us;
+    }
+    return false;
+}
+
+
+static void send_poll(blh_bcast_t* bcast, uint32_t now_us) {
+    const uint16_t node = bcast->nodes[bcast->node].address;
+    const uint8_t poll[5] = {
+        BL_PACKET_BCAST_POLL_DATA0, (uint8_t) (node >> 8), (uint8_t) (node & 0xFF),
+        (uint8_t) (bcast->from_seq >> 8), (uint8_t) (bcast->from_seq & 0xFF),
+    };
+    // Whatever arrived before this poll is not its answer
+    comms_frame_parser_reset(&bcast->parser);
+    queue_packet(bcast, poll, sizeof(poll));
+    bcast->attempts++;
+    bcast->deadline_us = now_us + (BLH_BCAST_POLL_TIMEOUT_MS * US_PER_MS);
+}
+
+
+static void start_node_poll(blh_bcast_t* bcast, uint32_t now_us) {
+    bcast->from_seq = (bcast->state == BLH_Bcast_FinalPoll) ? BL_BROADCAST_NONE_MISSING : 0U;
+    bcast->attempts = 0U;
+    bcast->nodes[bcast->node].missing = 0U;
+    send_poll(bcast, now_us);
+}
+
+
+static void start_polls(blh_bcast_t* bcast, blh_bcast_state_t state, uint32_t now_us) {
+    bcast->state = state;
+    bcast->node = 0U;
+    bcast->repair_count = 0U;
+    memset(bcast->repair, 0, sizeof(bcast->repair));
+    start_node_poll(bcast, now_us);
+}
+
+
+static void finish(blh_bcast_t* bcast) {
+    bcast->state = BLH_Bcast_Done;
+    bcast->result = BLH_Result_Success;
+    for (uint32_t i = 0; i < bcast->node_count; i++) {
+        if (bcast->nodes[i].result > (int32_t) bcast->result) {
+            bcast->result = (blh_result_t) bcast->nodes[i].result;
+        }
+    }
+    bcast_log(bcast, (bcast->result == BLH_Result_Success) ? "every node updated" : "not every node updated");
+}
+
+
+/* All nodes polled: repair what any of them still misses, or close the session */
+static void polls_done(blh_bcast_t* bcast, uint32_t now_us) {
+    if (bcast->state == BLH_Bcast_FinalPoll) {
+        finish(bcast);
+        return;
+    }
+    if (bcast->repair_count == 0U) {
+        start_frames(bcast, BLH_Bcast_End, now_us);
+        return;
+    }
+
+    char message[sizeof(bcast->message)];
+    bcast->round++;
+    bcast->repairing = true;
+    bcast->header_sent = 0U;
+    snprintf(message, sizeof(message), "Repair round %u: %u frames", (unsigned) bcast->round, (unsigned) bcast->repair_count);
+    bcast_log(bcast, message);
+    start_frames(bcast, BLH_Bcast_Header, now_us);
+}
+
+
+static void next_node(blh_bcast_t* bcast, uint32_t now_us) {
+    bcast->node++;
+    if (bcast->node < bcast->node_count) {
+        start_node_poll(bcast, now_us);
+    }
+    else {
+        polls_done(bcast, now_us);
+    }
+}
+
+
+/* [NACK][addr hi][addr lo][status][first hi][first lo][bitmap], bit b of bitmap byte i is frame first + 8i + b */
+static void on_nack(blh_bcast_t* bcast, const uint8_t* nack, uint32_t now_us) {
+    blh_bcast_node_t* node = &bcast->nodes[bcast->node];
+    const uint32_t first = ((uint32_t) nack[4] << 8) | nack[5];
+
+    node->status = nack[3];
+    if (bcast->state == BLH_Bcast_FinalPoll) {
+        node->result = ((node->status == BL_Broadcast_Status_Success) || (node->status == BL_Broadcast_Status_UpToDate)) ?
+                       BLH_Result_Success : BLH_Result_Failed;
+        next_node(bcast, now_us);
+        return;
+    }
+
+    if (first != BL_BROADCAST_NONE_MISSING) {
+        const bool wants_repair = (node->status == BL_Broadcast_Status_NoHeader) || (node->status == BL_Broadcast_Status_Receiving);
+        for (uint32_t i = 0; i < BL_BROADCAST_NACK_FRAMES; i++) {
+            const uint32_t seq = first + i;
+            if (!(nack[6U + (i / 8U)] & (1U << (i % 8U))) || (seq >= bcast->total_frames)) {
+                continue;
+            }
+            node->missing++;
+            if (wants_repair && !(bcast->repair[seq / 8U] & (1U << (seq % 8U)))) {
+                bcast->repair[seq / 8U] |= (uint8_t) (1U << (seq % 8U));
+                bcast->repair_count++;
+            }
+        }
+        bcast->from_seq = first + BL_BROADCAST_NACK_FRAMES;
+        if (bcast->from_seq < bcast->total_frames) {
+            // Next bitmap window of the same node
+            bcast->attempts = 0U;
+            send_poll(bcast, now_us);
+            return;
+        }
+    }
+    next_node(bcast, now_us);
+}
+
+
+static void on_packet(blh_bcast_t* bcast, const comms_packet_t* packet, uint32_t now_us) {
+    const uint16_t node = bcast->nodes[bcast->node].address;
+
+    // Other packets on the bus include our own polls, echoed by half-duplex transceivers
+    if ((packet->length == BL_BROADCAST_NACK_BITMAP_LEN + 6U) && (packet->data[0] == BL_PACKET_BCAST_NACK_DATA0) &&
+        ((((uint16_t) packet->data[1] << 8) | packet->data[2]) == node)) {
+        on_nack(bcast, packet->data, now_us);
+    }
+}
+
+
+bool blh_bcast_init(blh_bcast_t* bcast, const uint8_t* image, uint32_t image_length, const uint16_t* nodes,
+                    uint32_t node_count, uint32_t baud_rate, uint32_t now_us) {
+    image_header_t header;
+    image_segment_t segments[IMAGE_MAX_SEGMENTS];
+
+    memset(bcast, 0, sizeof(*bcast));
+    bcast->state = BLH_Bcast_Done;
+    bcast->result = BLH_Result_Failed;
+    if ((image_parse(image, image_length, &header, segments) != Image_Status_Ok) ||
+        (header.header_size + header.image_size != image_length) ||
+        (image_length / COMMS_PACKET_PAYLOAD_LEN > BLH_BCAST_MAX_FRAMES)) {
+        bcast_log(bcast, "not a valid firmware image");
+        return false;
+    }
+    if ((node_count == 0U) || (node_count > BLH_BCAST_MAX_NODES) || (baud_rate == 0U)) {
+        bcast_log(bcast, "invalid node list or baud rate");
+        return false;
+    }
+
+    const uint32_t span = segments[header.segment_count - 1U].address + segments[header.segment_count - 1U].length - header.load_address;
+    const uint32_t erase_ms = BLH_BCAST_ERASE_MS_PER_KIB * ((span + 1023U) / 1024U);
+
+    comms_frame_parser_reset(&bcast->parser);
+    bcast->image = image;
+    bcast->image_length = image_length;
+    bcast->header_frames = header.header_size / COMMS_PACKET_PAYLOAD_LEN;
+    bcast->total_frames = image_length / COMMS_PACKET_PAYLOAD_LEN;
+    bcast->frame_us = (BLH_BCAST_FRAME_LEN * 10U * 1000000U) / baud_rate;
+    if (bcast->frame_us < BLH_BCAST_MIN_FRAME_US) {
+        bcast->frame_us = BLH_BCAST_MIN_FRAME_US;
+    }
+    bcast->erase_us = ((erase_ms > BLH_BCAST_ERASE_MS) ? erase_ms : BLH_BCAST_ERASE_MS) * US_PER_MS;
+    for (uint32_t i = 0; i < node_count; i++) {
+        bcast->nodes[i].address = nodes[i];
+        bcast->nodes[i].status = BLH_BCAST_NO_ANSWER;
+        bcast->nodes[i].missing = bcast->total_frames;
+        bcast->nodes[i].result = BLH_Result_Pending;
+    }
+    bcast->node_count = node_count;
+    bcast->result = BLH_Result_Pending;
+    bcast->state = BLH_Bcast_Sync;
+    bcast->deadline_us = now_us;
+    bcast_log(bcast, "Broadcast sync");
+    return true;
+}
+
+
+uint32_t blh_bcast_update(blh_bcast_t* bcast, const uint8_t* rx, uint32_t rx_length, uint32_t now_us,
+                          uint8_t* tx, uint32_t tx_size) {
+    const bool polling = (bcast->state == BLH_Bcast_Poll) || (bcast->state == BLH_Bcast_FinalPoll);
+
+    for (uint32_t i = 0; polling && (i < rx_length); i++) {
+        if (blh_receive(&bcast->parser, rx[i])) {
+            on_packet(bcast, &bcast->parser.packet, now_us);
+            if ((bcast->state != BLH_Bcast_Poll) && (bcast->state != BLH_Bcast_FinalPoll)) {
+                break;
+            }
+        }
+    }
+
+    switch (bcast->state) {
+        case BLH_Bcast_Sync: {
+            if (!time_reached(now_us, bcast->deadline_us)) {
+                break;
+            }
+            if (bcast->repeats == (BLH_BCAST_SYNC_MS / BLH_BCAST_SYNC_INTERVAL_MS)) {
+                start_frames(bcast, BLH_Bcast_Begin, now_us);
+                break;
+            }
+            const uint8_t sync[4] = {0xAAU, 0xBBU, 0xCCU, 0xEEU};
+            if (tx_room(bcast, sizeof(sync))) {
+                queue_bytes(bcast, sync, sizeof(sync));
+                bcast->repeats++;
+                bcast->deadline_us = now_us + (BLH_BCAST_SYNC_INTERVAL_MS * US_PER_MS);
+            }
+        } break;
+
+        case BLH_Bcast_Begin: {
+            if (send_paced(bcast, now_us)) {
+                char message[sizeof(bcast->message)];
+                snprintf(message, sizeof(message), "Broadcasting %u frames", (unsigned) bcast->total_frames);
+                bcast_log(bcast, message);
+                start_frames(bcast, BLH_Bcast_Header, now_us);
+            }
+        } break;
+
+        case BLH_Bcast_Header: {
+            if (!send_paced(bcast, now_us)) {
+                break;
+            }
+            if (bcast->header_sent > 0U) {
+                // Nodes that just completed the header erase the application now
+                bcast->state = BLH_Bcast_Erase;
+                bcast->deadline_us = now_us + bcast->erase_us + (bcast->header_sent * bcast->frame_us);
+            }
+            else {
+                start_frames(bcast, BLH_Bcast_Payload, now_us);
+            }
+        } break;
+
+        case BLH_Bcast_Erase: {
+            if (time_reached(now_us, bcast->deadline_us)) {
+                start_frames(bcast, BLH_Bcast_Payload, now_us);
+            }
+        } break;
+
+        case BLH_Bcast_Payload: {
+            if (!send_paced(bcast, now_us)) {
+                break;
+            }
+            if (bcast->round == BLH_BCAST_REPAIR_ROUNDS) {
+                start_frames(bcast, BLH_Bcast_End, now_us);
+            }
+            else {
+                start_polls(bcast, BLH_Bcast_Poll, now_us);
+            }
+        } break;
+
+        case BLH_Bcast_Poll:
+        case BLH_Bcast_FinalPoll: {
+            if (!time_reached(now_us, bcast->deadline_us)) {
+                break;
+            }
+            if (bcast->attempts < BLH_BCAST_POLL_ATTEMPTS) {
+                send_poll(bcast, now_us);
+                break;
+            }
+            bcast->nodes[bcast->node].status = BLH_BCAST_NO_ANSWER;
+            if (bcast->state == BLH_Bcast_FinalPoll) {
+                bcast->nodes[bcast->node].result = BLH_Result_Timeout;
+            }
+            next_node(bcast, now_us);
+        } break;
+
+        case BLH_Bcast_End: {
+            if (send_paced(bcast, now_us)) {
+                bcast->state = BLH_Bcast_Verify;
+                bcast->deadline_us = now_us + (BLH_BCAST_VERIFY_MS * US_PER_MS);
+            }
+        } break;
+
+        case BLH_Bcast_Verify: {
+            if (time_reached(now_us, bcast->deadline_us)) {
+                start_polls(bcast, BLH_Bcast_FinalPoll, now_us);
+            }
+        } break;
+
+        default: {
+        } break;
+    }
+
+    const uint32_t length_out = (bcast->tx_length < tx_size) ? bcast->tx_length : tx_size;
+    memcpy(tx, bcast->tx, length_out);
+    memmove(bcast->tx, &bcast->tx[length_out], bcast->tx_length - length_out);
+    bcast->tx_length -= length_out;
+    return length_out;
+}
+
+
+void blh_bcast_status(const blh_bcast_t* bcast, blh_bcast_status_t* status) {
+    status->result = bcast->result;
+    status->frames_sent = bcast->frames_sent;
+    status->total_frames = bcast->total_frames;
+    status->message = bcast->message;
+}
+
+
+bool blh_bcast_node(const blh_bcast_t* bcast, uint32_t index, blh_bcast_node_t* node) {
+    if (index >= bcast->node_count) {
+        return false;
+    }
+    *node = bcast->nodes[index];
+    return true;
+}
+
+
+const char* blh_bcast_status_name(int32_t status) {
+    if ((status < 0) || ((uint32_t) status >= sizeof(bcast_status_names) / sizeof(bcast_status_names[0]))) {
+        return "no answer";
+    }
+    return bcast_status_names[status];
+}
+
+
+uint32_t blh_bcast_size(void) {
+    return sizeof(blh_bcast_t);
+}
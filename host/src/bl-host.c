@@ -0,0 +1,524 @@
+#include <string.h>
+#include "bl-host.h"
+#include "core/crc8.h"
+#include "core/reed-solomon.h"
+#include "core/image.h"
+
+static bool rs_ready = false;
+
+static const char* const state_names[] = {
+    "Sync", "WaitUpdateReq", "SendUpdateRes", "WaitDeviceIdReq", "SendDeviceIdRes", "WaitLengthReq",
+    "SendLength", "WaitReady", "SendFrame", "WaitFrameReady", "SendWriteDone", "WaitResult", "Done",
+};
+
+
+/* Codec */
+
+static void codec_setup(void) {
+    if (!rs_ready) {
+        rs_setup();
+        rs_ready = true;
+    }
+}
+
+
+uint32_t blh_frame_max_len(void) {
+    return BLH_FRAME_MAX_LEN;
+}
+
+
+uint32_t blh_tx_buffer_size(void) {
+    return BLH_TX_BUFFER_SIZE;
+}
+
+
+uint8_t blh_crc8(const uint8_t* data, uint32_t length) {
+    return crc8((uint8_t *) data, length);
+}
+
+
+static uint32_t encode(comms_packet_t* packet, const uint8_t* payload, uint8_t length, uint8_t* frame) {
+    for (uint8_t i = 0; i < comms_packet_payload_len(packet); i++) {
+        packet->data[i] = (i < length) ? payload[i] : 0xFFU;
+    }
+    packet->crc = comms_packet_crc(packet);
+    return comms_frame_encode(packet, frame);
+}
+
+
+uint32_t blh_encode_packet(const uint8_t* payload, uint8_t length, uint8_t* frame) {
+    comms_packet_t packet = {.length = length};
+    return encode(&packet, payload, length, frame);
+}
+
+
+uint32_t blh_encode_addressed(uint32_t offset, const uint8_t* payload, uint8_t length, uint8_t* frame) {
+    comms_packet_t packet = {.length = length, .addressed = true, .offset = offset};
+    return encode(&packet, payload, length, frame);
+}
+
+
+uint32_t blh_encode_broadcast(uint16_t seq, const uint8_t* payload, uint8_t* frame) {
+    comms_packet_t packet = {.length = COMMS_BCAST_FRAME_TAG, .seq = seq};
+    return encode(&packet, payload, COMMS_PACKET_PAYLOAD_LEN, frame);
+}
+
+
+/* Turns an encoded frame into its FEC form in place, returns the new length */
+uint32_t blh_add_fec(uint8_t* frame, uint32_t length) {
+    codec_setup();
+    return comms_frame_add_fec(frame, length);
+}
+
+
+uint32_t blh_decode_frame(const uint8_t* data, uint32_t length, uint8_t* payload, uint8_t* payload_length) {
+    comms_frame_parser_t parser;
+
+    codec_setup();
+    comms_frame_parser_reset(&parser);
+    for (uint32_t i = 0; i < length; i++) {
+        if (comms_frame_parse(&parser, data[i]) && (parser.packet.crc == comms_packet_crc(&parser.packet))) {
+            *payload_length = parser.packet.length;
+            memcpy(payload, parser.packet.data, comms_packet_payload_len(&parser.packet));
+            return i + 1U;
+        }
+    }
+    return 0U;
+}
+
+
+/* Device packets; corrupted ones are dropped and timed out, the parser resynchronises on the next length byte */
+bool blh_receive(comms_frame_parser_t* parser, uint8_t byte) {
+    return comms_frame_parse(parser, byte) && !parser->packet.addressed &&
+           (parser->packet.length != COMMS_BCAST_FRAME_TAG) && (parser->packet.crc == comms_packet_crc(&parser->packet));
+}
+
+
+/* Image */
+
+static uint32_t frame_size_index(uint32_t size) {
+    uint32_t index = 0;
+
+    while ((COMMS_PACKET_PAYLOAD_LEN << index) < size) {
+        index++;
+    }
+    return index;
+}
+
+
+static uint32_t frame_index(uint32_t offset, uint32_t size) {
+    return ((offset / COMMS_PACKET_PAYLOAD_LEN) * BLH_IMAGE_FRAME_SIZES) + frame_size_index(size);
+}
+
+
+uint32_t blh_image_storage_size(uint32_t image_length) {
+    return (image_length / COMMS_PACKET_PAYLOAD_LEN) * BLH_IMAGE_FRAME_SIZES * (BLH_FRAME_MAX_LEN + 1U);
+}
+
+
+bool blh_image_init(blh_image_t* image, const uint8_t* data, uint32_t length, uint32_t options, uint8_t* storage) {
+    image_header_t header;
+    image_segment_t segments[IMAGE_MAX_SEGMENTS];
+
+    memset(image, 0, sizeof(*image));
+    codec_setup();
+    if ((image_parse(data, length, &header, segments) != Image_Status_Ok) ||
+        (header.header_size + header.image_size != length)) {
+        return false;
+    }
+
+    const uint32_t slots = length / COMMS_PACKET_PAYLOAD_LEN;
+    image->data = data;
+    image->length = length;
+    image->header_size = header.header_size;
+    image->image_span = segments[header.segment_count - 1U].address + segments[header.segment_count - 1U].length - header.load_address;
+    image->encrypted = (header.flags & IMAGE_FLAG_ENCRYPTED) != 0U;
+    image->options = options & BLH_OPTION_FEC;
+    image->frames = storage;
+    image->frame_lengths = &storage[slots * BLH_IMAGE_FRAME_SIZES * BLH_FRAME_MAX_LEN];
+
+    /* Header frames are sequential 16 byte packets; sizes that run past the end are never asked for */
+    for (uint32_t offset = 0; offset < length; offset += COMMS_PACKET_PAYLOAD_LEN) {
+        for (uint32_t size = COMMS_PACKET_PAYLOAD_LEN; size <= COMMS_PACKET_PAYLOAD_MAX_LEN; size *= 2U) {
+            const uint32_t index = frame_index(offset, size);
+            uint8_t* frame = &image->frames[index * BLH_FRAME_MAX_LEN];
+            uint32_t frame_length = 0U;
+
+            if (offset < image->header_size) {
+                frame_length = (size == COMMS_PACKET_PAYLOAD_LEN) ? blh_encode_packet(&data[offset], (uint8_t) size, frame) : 0U;
+            }
+            else if (offset + size <= length) {
+                frame_length = blh_encode_addressed(offset - image->header_size, &data[offset], (uint8_t) size, frame);
+            }
+            if ((frame_length > 0U) && (image->options & BLH_OPTION_FEC)) {
+                frame_length = blh_add_fec(frame, frame_length);
+            }
+            image->frame_lengths[index] = (uint8_t) frame_length;
+        }
+    }
+    image->valid = true;
+    return true;
+}
+
+
+uint32_t blh_image_size(void) {
+    return sizeof(blh_image_t);
+}
+
+
+/* Session */
+
+static bool is_single_byte(const uint8_t* payload, uint8_t length, uint8_t byte) {
+    return (length == 1U) && (payload[0] == byte);
+}
+
+
+static void finish(blh_session_t* session, blh_result_t result, const char* message) {
+    session->result = result;
+    session->state = BLH_State_Done;
+    snprintf(session->message, sizeof(session->message), "%s", message);
+}
+
+
+static void queue_bytes(blh_session_t* session, const uint8_t* data, uint32_t length) {
+    if (session->tx_length + length <= sizeof(session->tx)) {
+        memcpy(&session->tx[session->tx_length], data, length);
+        session->tx_length += length;
+    }
+}
+
+
+/* Send an encoded frame, FEC included, and wait for its ACK in `state` */
+static void transmit(blh_session_t* session, blh_state_t state, const uint8_t* frame, uint32_t length, uint32_t payload,
+                     uint32_t now_ms) {
+    session->sent_frame = frame;
+    session->frame_length = length;
+    session->frame_payload = payload;
+    session->frame_retransmitted = false;
+    session->frame_sent_ms = now_ms;
+    session->awaiting_ack = true;
+    session->state = state;
+    session->deadline_ms = now_ms + BLH_TIMEOUT_MS;
+    queue_bytes(session, frame, length);
+}
+
+
+static void transmit_packet(blh_session_t* session, blh_state_t state, const uint8_t* payload, uint8_t length, uint32_t now_ms) {
+    uint32_t frame_length = blh_encode_packet(payload, length, session->frame);
+
+    if (session->options & BLH_OPTION_FEC) {
+        frame_length = blh_add_fec(session->frame, frame_length);
+    }
+    transmit(session, state, session->frame, frame_length, 0U, now_ms);
+}
+
+
+/* The image's frame of `size` payload bytes at the current offset */
+static void transmit_image_frame(blh_session_t* session, uint32_t size, uint32_t now_ms) {
+    const uint32_t index = frame_index(session->offset, size);
+
+    transmit(session, BLH_State_SendFrame, &session->image->frames[index * BLH_FRAME_MAX_LEN],
+             session->image->frame_lengths[index], size, now_ms);
+}
+
+
+static void wait_for(blh_session_t* session, blh_state_t state, uint32_t timeout_ms, uint32_t now_ms) {
+    session->state = state;
+    session->deadline_ms = now_ms + timeout_ms;
+}
+
+
+static bool chunk_is_erased(const blh_session_t* session) {
+    for (uint32_t i = 0; i < COMMS_PACKET_PAYLOAD_LEN; i++) {
+        if (session->image->data[session->offset + i] != 0xFFU) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+static void send_next_frame(blh_session_t* session, uint32_t now_ms) {
+    /* The erased device already holds the 0xFF padding of plain images */
+    while (session->sparse && (session->offset >= session->image->header_size) &&
+           (session->offset < session->image->length) && chunk_is_erased(session)) {
+        session->offset += COMMS_PACKET_PAYLOAD_LEN;
+    }
+
+    if (session->offset >= session->image->length) {
+        const uint8_t write_done = BL_PACKET_FW_WRITE_DONE_DATA0;
+        session->transfer_end_ms = now_ms;
+        session->transfer_ms = now_ms - session->transfer_start_ms;
+        transmit_packet(session, BLH_State_SendWriteDone, &write_done, 1U, now_ms);
+        return;
+    }
+
+    /* Header frames are sequential 16 byte packets, the payload goes in addressed frames */
+    if (session->offset < session->image->header_size) {
+        transmit_image_frame(session, COMMS_PACKET_PAYLOAD_LEN, now_ms);
+        return;
+    }
+
+    uint32_t size = (session->link.max_payload < session->device_max_payload) ? session->link.max_payload : session->device_max_payload;
+    while ((size > COMMS_PACKET_PAYLOAD_LEN) && (session->offset + size > session->image->length)) {
+        size /= 2U;
+    }
+    transmit_image_frame(session, size, now_ms);
+}
+
+
+static void on_ack(blh_session_t* session, const uint8_t* payload, uint8_t length, uint32_t now_ms) {
+    const uint32_t rtt_ms = now_ms - session->frame_sent_ms;
+
+    session->awaiting_ack = false;
+    session->rtt_count++;
+    session->rtt_total_ms += rtt_ms;
+    if (rtt_ms > session->rtt_max_ms) {
+        session->rtt_max_ms = rtt_ms;
+    }
+    /* A single byte ACK is an old bootloader: no credits, 16 byte frames */
+    session->credits = (length == COMMS_ACK_PACKET_LEN) ? payload[COMMS_ACK_CREDITS_INDEX] : 0U;
+    session->device_max_payload = (length == COMMS_ACK_PACKET_LEN) ? payload[COMMS_ACK_MAX_PAYLOAD_INDEX] : COMMS_PACKET_PAYLOAD_LEN;
+    (void) comms_link_record(&session->link, session->frame_retransmitted);
+
+    switch (session->state) {
+        case BLH_State_SendUpdateRes: {
+            wait_for(session, BLH_State_WaitDeviceIdReq, BLH_TIMEOUT_MS, now_ms);
+        } break;
+
+        case BLH_State_SendDeviceIdRes: {
+            wait_for(session, BLH_State_WaitLengthReq, BLH_TIMEOUT_MS, now_ms);
+        } break;
+
+        case BLH_State_SendLength: {
+            wait_for(session, BLH_State_WaitReady, BLH_TIMEOUT_MS, now_ms);
+        } break;
+
+        case BLH_State_SendFrame: {
+            session->offset += session->frame_payload;
+            session->bytes_sent += session->frame_payload;
+            if ((session->offset > session->image->header_size) && (session->credits > 0U)) {
+                // Payload frames stream while the device has queue space
+                send_next_frame(session, now_ms);
+            }
+            else {
+                // Header frames and the erase after them stay lock-step
+                wait_for(session, BLH_State_WaitFrameReady, BLH_TIMEOUT_MS, now_ms);
+            }
+        } break;
+
+        case BLH_State_SendWriteDone: {
+            wait_for(session, BLH_State_WaitResult, BLH_VERIFY_TIMEOUT_MS, now_ms);
+        } break;
+
+        default: {
+        } break;
+    }
+}
+
+
+static void on_packet(blh_session_t* session, const uint8_t* payload, uint8_t length, uint32_t now_ms) {
+    if (session->awaiting_ack) {
+        if ((length == COMMS_ACK_PACKET_LEN || length == 1U) && (payload[0] == COMMS_ACK_PACKET_DATA0)) {
+            on_ack(session, payload, length, now_ms);
+        }
+        else if (is_single_byte(payload, length, COMMS_RETX_PACKET_DATA0)) {
+            session->frame_retransmitted = true;
+            queue_bytes(session, session->sent_frame, session->frame_length);
+        }
+        else if (is_single_byte(payload, length, BL_PACKET_FW_UPDATE_FAILED_DATA0)) {
+            // Streaming ahead, the rejection of an earlier frame arrives in place of this ACK
+            finish(session, BLH_Result_Failed, "frame rejected by bootloader");
+        }
+        // Anything else: READYs for frames the credits already accounted for
+        return;
+    }
+
+    switch (session->state) {
+        case BLH_State_Sync: {
+            if (is_single_byte(payload, length, BL_PACKET_SEQ_OBSERVED_DATA0)) {
+                wait_for(session, BLH_State_WaitUpdateReq, BLH_TIMEOUT_MS, now_ms);
+            }
+        } break;
+
+        case BLH_State_WaitUpdateReq: {
+            if (is_single_byte(payload, length, BL_PACKET_FW_UPDATE_REQ_DATA0)) {
+                const uint8_t response = BL_PACKET_FW_UPDATE_RES_DATA0;
+                transmit_packet(session, BLH_State_SendUpdateRes, &response, 1U, now_ms);
+            }
+        } break;
+
+        case BLH_State_WaitDeviceIdReq: {
+            // Bootloaders before BL_DEVICE_ID_REQ_LEN only sent their node address
+            if (((length == 3U) || (length == BL_DEVICE_ID_REQ_LEN) || (length == BL_DEVICE_ID_REQ_APP_LEN)) &&
+                (payload[0] == BL_PACKET_DEVICE_ID_REQ_DATA0))
+            {
+                session->node_address = (int32_t) (((uint32_t) payload[1] << 8) | payload[2]);
+                const uint32_t app_size = ((uint32_t) payload[7] << 24) | ((uint32_t) payload[8] << 16) |
+                                          ((uint32_t) payload[9] << 8) | payload[10];
+                if (length == BL_DEVICE_ID_REQ_APP_LEN) {
+                    const uint8_t* boot = &payload[BL_DEVICE_ID_REQ_LEN];
+                    session->boot_us = ((uint32_t) boot[0] << 24) | ((uint32_t) boot[1] << 16) |
+                                       ((uint32_t) boot[2] << 8) | boot[3];
+                }
+                if ((length != 3U) && (session->image->image_span > app_size)) {
+                    char message[sizeof(session->message)];
+                    snprintf(message, sizeof(message), "image needs %u bytes of flash, device has %u",
+                             (unsigned) session->image->image_span, (unsigned) app_size);
+                    finish(session, BLH_Result_Failed, message);
+                    break;
+                }
+                const uint8_t response[2] = {BL_PACKET_DEVICE_ID_RES_DATA0, BLH_DEVICE_ID};
+                transmit_packet(session, BLH_State_SendDeviceIdRes, response, sizeof(response), now_ms);
+            }
+        } break;
+
+        case BLH_State_WaitLengthReq: {
+            if (is_single_byte(payload, length, BL_PACKET_FW_LENGTH_REQ_DATA0)) {
+                const uint8_t response[5] = {
+                    BL_PACKET_FW_LENGTH_RES_DATA0,
+                    (uint8_t) (session->image->length >> 24), (uint8_t) (session->image->length >> 16),
+                    (uint8_t) (session->image->length >> 8), (uint8_t) (session->image->length & 0xFF),
+                };
+                transmit_packet(session, BLH_State_SendLength, response, sizeof(response), now_ms);
+            }
+        } break;
+
+        case BLH_State_WaitReady: {
+            if (is_single_byte(payload, length, BL_PACKET_READY_FOR_DATA_DATA0)) {
+                session->transfer_start_ms = now_ms;
+                send_next_frame(session, now_ms);
+            }
+        } break;
+
+        case BLH_State_WaitFrameReady: {
+            if (is_single_byte(payload, length, BL_PACKET_READY_FOR_DATA_DATA0)) {
+                send_next_frame(session, now_ms);
+            }
+            else if ((length == 5U) && (payload[0] == BL_PACKET_FW_RESUME_DATA0)) {
+                // Interrupted update of this image, skip the pages the device already has
+                session->offset = session->image->header_size + (((uint32_t) payload[1] << 24) | ((uint32_t) payload[2] << 16) |
+                                                          ((uint32_t) payload[3] << 8) | payload[4]);
+                send_next_frame(session, now_ms);
+            }
+            else if (is_single_byte(payload, length, BL_PACKET_FW_UP_TO_DATE_DATA0)) {
+                finish(session, BLH_Result_Success, "already up to date, update skipped");
+            }
+            else if (is_single_byte(payload, length, BL_PACKET_FW_UPDATE_FAILED_DATA0)) {
+                finish(session, BLH_Result_Failed, "image rejected by bootloader");
+            }
+            else {
+                finish(session, BLH_Result_Failed, "unexpected response");
+            }
+        } break;
+
+        case BLH_State_WaitResult: {
+            session->verify_ms = now_ms - session->transfer_end_ms;
+            if (is_single_byte(payload, length, BL_PACKET_FW_UPDATE_SUCCESS_DATA0)) {
+                finish(session, BLH_Result_Success, "updated");
+            }
+            else if (is_single_byte(payload, length, BL_PACKET_FW_STAGED_DATA0)) {
+                finish(session, BLH_Result_Success, "staged, installs at the next reset");
+            }
+            else if (is_single_byte(payload, length, BL_PACKET_FW_UPDATE_FAILED_DATA0)) {
+                finish(session, BLH_Result_Failed, "image verification failed");
+            }
+        } break;
+
+        default: {
+        } break;
+    }
+}
+
+
+bool blh_session_init(blh_session_t* session, const blh_image_t* image, uint32_t options, uint32_t now_ms) {
+    memset(session, 0, sizeof(*session));
+    codec_setup();
+    comms_frame_parser_reset(&session->parser);
+    comms_link_reset(&session->link);
+    session->node_address = BLH_NODE_ADDRESS_UNKNOWN;
+    session->transfer_ms = BLH_TIME_UNKNOWN;
+    session->verify_ms = BLH_TIME_UNKNOWN;
+    if (!image->valid) {
+        finish(session, BLH_Result_Failed, "not a valid firmware image");
+        return false;
+    }
+
+    session->image = image;
+    session->options = (options & ~BLH_OPTION_FEC) | image->options;
+    session->sparse = !image->encrypted && !(options & BLH_OPTION_DENSE);
+    session->result = BLH_Result_Pending;
+    session->state = BLH_State_Sync;
+    session->sync_deadline_ms = now_ms + BLH_SYNC_WINDOW_MS;
+    session->deadline_ms = now_ms;
+    session->device_max_payload = COMMS_PACKET_PAYLOAD_LEN;
+    return true;
+}
+
+
+/* Only the node with this address answers, gateways on the way relay the session to it */
+void blh_session_set_target(blh_session_t* session, uint16_t node_address) {
+    session->targeted = true;
+    session->target = node_address;
+}
+
+
+uint32_t blh_session_update(blh_session_t* session, const uint8_t* rx, uint32_t rx_length, uint32_t now_ms,
+                            uint8_t* tx, uint32_t tx_size) {
+    for (uint32_t i = 0; (i < rx_length) && (session->state != BLH_State_Done); i++) {
+        if (blh_receive(&session->parser, rx[i])) {
+            on_packet(session, session->parser.packet.data, session->parser.packet.length, now_ms);
+        }
+    }
+
+    if (session->state == BLH_State_Sync) {
+        if ((int32_t) (now_ms - session->sync_deadline_ms) >= 0) {
+            finish(session, BLH_Result_Timeout, "no response in Sync");
+        }
+        else if ((int32_t) (now_ms - session->deadline_ms) >= 0) {
+            const uint8_t sync[4] = {0xAAU, 0xBBU, 0xCCU, (session->options & BLH_OPTION_ENTER) ? 0xBEU : 0xDDU};
+            const uint8_t address_sync[6] = {
+                0xAAU, 0xBBU, 0xCCU, 0xEFU, (uint8_t) (session->target >> 8), (uint8_t) (session->target & 0xFF),
+            };
+            if (session->targeted) {
+                queue_bytes(session, address_sync, sizeof(address_sync));
+            }
+            else {
+                queue_bytes(session, sync, sizeof(sync));
+            }
+            session->deadline_ms = now_ms + BLH_SYNC_RETRY_MS;
+        }
+    }
+    else if ((session->state != BLH_State_Done) && ((int32_t) (now_ms - session->deadline_ms) >= 0)) {
+        char message[sizeof(session->message)];
+        snprintf(message, sizeof(message), "no response in %s", state_names[session->state]);
+        finish(session, BLH_Result_Timeout, message);
+    }
+
+    const uint32_t length_out = (session->tx_length < tx_size) ? session->tx_length : tx_size;
+    memcpy(tx, session->tx, length_out);
+    memmove(session->tx, &session->tx[length_out], session->tx_length - length_out);
+    session->tx_length -= length_out;
+    return length_out;
+}
+
+
+void blh_session_status(const blh_session_t* session, blh_status_t* status) {
+    status->result = session->result;
+    status->offset = session->offset;
+    status->bytes_sent = session->bytes_sent;
+    status->rtt_count = session->rtt_count;
+    status->rtt_total_ms = session->rtt_total_ms;
+    status->rtt_max_ms = session->rtt_max_ms;
+    status->node_address = session->node_address;
+    status->boot_us = session->boot_us;
+    status->transfer_ms = session->transfer_ms;
+    status->verify_ms = session->verify_ms;
+    status->state = state_names[session->state];
+    status->message = session->message;
+}
+
+
+uint32_t blh_session_size(void) {
+    return sizeof(blh_session_t);
+}
@@ -0,0 +1,259 @@
+/*
+ * blflash: flashes a packed firmware image (firmware.img) over a serial port
+ * without Python, for CI and production lines. Exit codes match comms.py:
+ * 0 success, 1 failed, 2 timeout, 3 port error.
+ */
+#define _DEFAULT_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#ifdef __linux__
+#include <linux/serial.h>
+#endif
+#include "bl-host.h"
+
+#define BLFLASH_PORT_ERROR  (3)
+#define BLFLASH_POLL_MS     (10)
+#define BLFLASH_IMAGE_MAX   (1024U * 1024U)
+
+
+static uint32_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t) ((ts.tv_sec * 1000U) + (ts.tv_nsec / 1000000));
+}
+
+
+static speed_t baud_to_speed(uint32_t baud_rate) {
+    switch (baud_rate) {
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 115200: return B115200;
+        case 230400: return B230400;
+#ifdef B460800
+        case 460800: return B460800;
+        case 921600: return B921600;
+#endif
+        default: return 0;
+    }
+}
+
+
+/* Raw 8N1, non-blocking; ASYNC_LOW_LATENCY where the driver supports it */
+static int open_port(const char* path, uint32_t baud_rate, bool rtscts) {
+    const speed_t speed = baud_to_speed(baud_rate);
+    struct termios tio;
+
+    if (speed == 0) {
+        fprintf(stderr, "unsupported baud rate %u\n", baud_rate);
+        return -1;
+    }
+    const int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (fd < 0) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    if (tcgetattr(fd, &tio) != 0) {
+        fprintf(stderr, "%s: not a tty\n", path);
+        close(fd);
+        return -1;
+    }
+
+    cfmakeraw(&tio);
+    tio.c_cflag |= CLOCAL | CREAD;
+#ifdef CRTSCTS
+    if (rtscts) {
+        tio.c_cflag |= CRTSCTS;
+    }
+#endif
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+    tcsetattr(fd, TCSANOW, &tio);
+    tcflush(fd, TCIOFLUSH);
+
+#ifdef __linux__
+    struct serial_struct serial;
+    if (ioctl(fd, TIOCGSERIAL, &serial) == 0) {
+        serial.flags |= ASYNC_LOW_LATENCY;
+        ioctl(fd, TIOCSSERIAL, &serial);
+    }
+#endif
+    return fd;
+}
+
+
+static bool write_all(int fd, const uint8_t* data, uint32_t length) {
+    while (length > 0U) {
+        const ssize_t written = write(fd, data, length);
+        if (written < 0) {
+            if (errno != EAGAIN) {
+                return false;
+            }
+            struct pollfd pfd = {.fd = fd, .events = POLLOUT};
+            poll(&pfd, 1, BLFLASH_POLL_MS);
+            continue;
+        }
+        data += written;
+        length -= (uint32_t) written;
+    }
+    return true;
+}
+
+
+static uint8_t* read_image(const char* path, uint32_t* length) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+    uint8_t* image = malloc(BLFLASH_IMAGE_MAX);
+    *length = (image != NULL) ? (uint32_t) fread(image, 1, BLFLASH_IMAGE_MAX, file) : 0U;
+    fclose(file);
+    return image;
+}
+
+
+static void usage(const char* name) {
+    fprintf(stderr, "usage: %s [-p PORT] [-b BAUD] [--fec] [--rtscts] [--dense] [--enter] [-n NODE] [-q] IMAGE\n", name);
+}
+
+
+int main(int argc, char** argv) {
+    const char* port = "/dev/ttyUSB0";
+    const char* image_path = NULL;
+    uint32_t baud_rate = 115200U;
+    uint32_t options = 0U;
+    bool rtscts = false;
+    bool quiet = false;
+    const char* target = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if ((strcmp(argv[i], "-p") == 0) && (i + 1 < argc)) {
+            port = argv[++i];
+        }
+        else if ((strcmp(argv[i], "-b") == 0) && (i + 1 < argc)) {
+            baud_rate = (uint32_t) strtoul(argv[++i], NULL, 10);
+        }
+        else if ((strcmp(argv[i], "-n") == 0) && (i + 1 < argc)) {
+            target = argv[++i];
+        }
+        else if (strcmp(argv[i], "--fec") == 0) {
+            options |= BLH_OPTION_FEC;
+        }
+        else if (strcmp(argv[i], "--dense") == 0) {
+            options |= BLH_OPTION_DENSE;
+        }
+        else if (strcmp(argv[i], "--enter") == 0) {
+            options |= BLH_OPTION_ENTER;
+        }
+        else if (strcmp(argv[i], "--rtscts") == 0) {
+            rtscts = true;
+        }
+        else if (strcmp(argv[i], "-q") == 0) {
+            quiet = true;
+        }
+        else if ((argv[i][0] != '-') && (image_path == NULL)) {
+            image_path = argv[i];
+        }
+        else {
+            usage(argv[0]);
+            return BLFLASH_PORT_ERROR;
+        }
+    }
+    if (image_path == NULL) {
+        usage(argv[0]);
+        return BLFLASH_PORT_ERROR;
+    }
+
+    uint32_t image_length = 0U;
+    uint8_t* image = read_image(image_path, &image_length);
+    if (image == NULL) {
+        return BLH_Result_Failed;
+    }
+
+    static blh_image_t encoded;
+    static blh_session_t session;
+    uint8_t* frames = malloc(blh_image_storage_size(image_length));
+    if ((frames == NULL) || !blh_image_init(&encoded, image, image_length, options, frames)) {
+        fprintf(stderr, "%s: not a valid firmware image\n", image_path);
+        free(frames);
+        free(image);
+        return BLH_Result_Failed;
+    }
+
+    const uint32_t started = now_ms();
+    (void) blh_session_init(&session, &encoded, options, started);
+    if (target != NULL) {
+        blh_session_set_target(&session, (uint16_t) strtoul(target, NULL, 16));
+    }
+
+    const int fd = open_port(port, baud_rate, rtscts);
+    if (fd < 0) {
+        free(frames);
+        free(image);
+        return BLFLASH_PORT_ERROR;
+    }
+
+    uint8_t rx[256];
+    uint8_t tx[BLH_TX_BUFFER_SIZE];
+    uint32_t rx_length = 0U;
+    uint32_t last_percent = 101U;
+
+    while (session.result == BLH_Result_Pending) {
+        const uint32_t tx_length = blh_session_update(&session, rx, rx_length, now_ms(), tx, sizeof(tx));
+        if ((tx_length > 0U) && !write_all(fd, tx, tx_length)) {
+            fprintf(stderr, "%s: %s\n", port, strerror(errno));
+            close(fd);
+            free(frames);
+            free(image);
+            return BLFLASH_PORT_ERROR;
+        }
+
+        const uint32_t percent = (uint32_t) ((100ULL * ((session.offset < image_length) ? session.offset : image_length)) / image_length);
+        if (!quiet && (percent != last_percent) && isatty(STDOUT_FILENO)) {
+            printf("\r%s: %3u%%", port, percent);
+            fflush(stdout);
+            last_percent = percent;
+        }
+
+        struct pollfd pfd = {.fd = fd, .events = POLLIN};
+        const ssize_t received = (poll(&pfd, 1, (tx_length > 0U) ? 0 : BLFLASH_POLL_MS) > 0) ? read(fd, rx, sizeof(rx)) : 0;
+        if ((received < 0) && (errno != EAGAIN)) {
+            fprintf(stderr, "\n%s: %s\n", port, strerror(errno));
+            close(fd);
+            free(frames);
+            free(image);
+            return BLFLASH_PORT_ERROR;
+        }
+        rx_length = (received > 0) ? (uint32_t) received : 0U;
+    }
+
+    const uint32_t elapsed_ms = now_ms() - started;
+    printf("%s%s: %s %s (%u bytes in %u ms, rtt %.2f ms avg / %u ms max over %u frames)\n",
+           (!quiet && isatty(STDOUT_FILENO)) ? "\r" : "", port,
+           (session.result == BLH_Result_Success) ? "ok:" : "error:", session.message, session.bytes_sent, elapsed_ms,
+           session.rtt_count ? ((double) session.rtt_total_ms / session.rtt_count) : 0.0, session.rtt_max_ms, session.rtt_count);
+
+    if (session.verify_ms != BLH_TIME_UNKNOWN) {
+        printf("%s: transfer: %u ms, post-transfer verification (CRC + signature): %u ms\n",
+               port, session.transfer_ms, session.verify_ms);
+    }
+    if (session.boot_us > 0U) {
+        printf("%s: application reached main() %u us after the bootloader's jump\n", port, session.boot_us);
+    }
+
+    close(fd);
+    free(frames);
+    free(image);
+    return session.result;
+}
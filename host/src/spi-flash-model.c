@@ -0,0 +1,137 @@
+#include "spi-flash-model.h"
+#include "core/spi-bus.h"
+#include "core/spi-flash.h"
+
+#define JEDEC_MANUFACTURER  (0xEFU)     // Winbond
+#define JEDEC_MEMORY_TYPE   (0x40U)
+
+static uint8_t* memory = 0;
+static uint32_t memory_size = 0;
+static uint8_t size_log2 = 0;
+
+static bool selected = false;
+static bool write_enabled = false;
+static uint32_t busy_polls = 0;         /* Status reads left before WIP clears */
+
+static uint8_t opcode = 0;
+static uint32_t byte_index = 0;         /* Bytes clocked since chip select */
+static uint32_t address = 0;
+
+static uint8_t page_data[SPI_FLASH_PAGE_SIZE];
+static bool page_loaded[SPI_FLASH_PAGE_SIZE];
+
+
+static bool accepts_writes(void) {
+    return (memory != 0) && write_enabled && (busy_polls == 0U);
+}
+
+
+static uint8_t clock_byte(uint8_t mosi) {
+    uint8_t miso = 0xFFU;
+
+    if (byte_index == 0U) {
+        opcode = mosi;
+        address = 0;
+    }
+    else if (opcode == SPI_FLASH_CMD_JEDEC_ID) {
+        const uint8_t id[3] = {JEDEC_MANUFACTURER, JEDEC_MEMORY_TYPE, size_log2};
+        miso = (byte_index <= 3U) ? id[byte_index - 1U] : 0xFFU;
+    }
+    else if (opcode == SPI_FLASH_CMD_READ_STATUS) {
+        miso = (uint8_t) (((busy_polls > 0U) ? SPI_FLASH_STATUS_BUSY : 0U) | (write_enabled ? SPI_FLASH_STATUS_WEL : 0U));
+        if (busy_polls > 0U) {
+            busy_polls--;
+        }
+    }
+    else if (byte_index <= 3U) {
+        address = (address << 8) | mosi;
+    }
+    else if ((opcode == SPI_FLASH_CMD_READ_DATA) && (memory != 0) && (busy_polls == 0U)) {
+        miso = memory[(address + byte_index - 4U) & (memory_size - 1U)];
+    }
+    else if (opcode == SPI_FLASH_CMD_PAGE_PROGRAM) {
+        // Data past the end of the page wraps to its start, like the real part
+        const uint32_t column = (address + byte_index - 4U) % SPI_FLASH_PAGE_SIZE;
+        page_data[column] = mosi;
+        page_loaded[column] = true;
+    }
+
+    byte_index++;
+    return miso;
+}
+
+
+/* Programs and erases start when chip select goes high */
+static void command_finished(void) {
+    if ((opcode == SPI_FLASH_CMD_WRITE_ENABLE) && (byte_index == 1U)) {
+        write_enabled = true;
+    }
+    else if ((opcode == SPI_FLASH_CMD_PAGE_PROGRAM) && (byte_index > 4U) && accepts_writes()) {
+        const uint32_t page = (address & (memory_size - 1U)) & ~(SPI_FLASH_PAGE_SIZE - 1U);
+        for (uint32_t i = 0; i < SPI_FLASH_PAGE_SIZE; i++) {
+            if (page_loaded[i]) {
+                memory[page + i] &= page_data[i];
+            }
+        }
+        write_enabled = false;
+        busy_polls = SPI_FLASH_MODEL_BUSY_POLLS;
+    }
+    else if ((opcode == SPI_FLASH_CMD_SECTOR_ERASE) && (byte_index == 4U) && accepts_writes()) {
+        const uint32_t sector = (address & (memory_size - 1U)) & ~(SPI_FLASH_SECTOR_SIZE - 1U);
+        for (uint32_t i = 0; i < SPI_FLASH_SECTOR_SIZE; i++) {
+            memory[sector + i] = 0xFFU;
+        }
+        write_enabled = false;
+        busy_polls = SPI_FLASH_MODEL_BUSY_POLLS;
+    }
+}
+
+
+void spi_flash_model_attach(uint8_t* chip_memory, uint32_t size) {
+    memory = chip_memory;
+    memory_size = size;
+    size_log2 = 0;
+    while ((1UL << size_log2) < size) {
+        size_log2++;
+    }
+    selected = false;
+    write_enabled = false;
+    busy_polls = 0;
+}
+
+
+void spi_bus_setup(void) {
+    selected = false;
+}
+
+
+void spi_bus_select(void) {
+    selected = true;
+    byte_index = 0;
+    for (uint32_t i = 0; i < SPI_FLASH_PAGE_SIZE; i++) {
+        page_loaded[i] = false;
+    }
+}
+
+
+void spi_bus_deselect(void) {
+    if (selected) {
+        command_finished();
+    }
+    selected = false;
+}
+
+
+void spi_bus_transfer(const uint8_t* tx, uint8_t* rx, uint32_t length) {
+    for (uint32_t i = 0; i < length; i++) {
+        const uint8_t miso = selected ? clock_byte(tx ? tx[i] : 0xFFU) : 0xFFU;
+        if (rx) {
+            rx[i] = miso;
+        }
+    }
+}
+
+
+bool spi_bus_busy(void) {
+    return false;
+}
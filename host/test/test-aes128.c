@@ -0,0 +1,76 @@
+/*
+ * core/aes128.c against FIPS-197 appendix C.1 and the CTR-AES128 example of
+ * NIST SP 800-38A F.5.1, including the block_index entry point the bootloader
+ * uses to decrypt frames at any 16 byte aligned offset.
+ */
+#include <string.h>
+#include "core/aes128.h"
+#include "test.h"
+
+#define CTR_KEY         "2b7e151628aed2a6abf7158809cf4f3c"
+#define CTR_COUNTER     "f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff"
+#define CTR_PLAINTEXT   "6bc1bee22e409f96e93d7e117393172aae2d8a571e03ac9c9eb76fac45af8e51" \
+                        "30c81c46a35ce411e5fbc1191a0a52eff69f2445df4f9b17ad2b417be66c3710"
+#define CTR_CIPHERTEXT  "874d6191b620e3261bef6864990db6ce9806f66b7970fdff8617187bb9fffdff" \
+                        "5ae4df3edbd5d35e5b4f09020db03eab1e031dda2fbe03d1792170a0f3009cee"
+#define CTR_LEN         (4U * AES128_BLOCK_LEN)
+
+
+static void test_block(void) {
+    uint8_t key[AES128_KEY_LEN];
+    uint8_t plaintext[AES128_BLOCK_LEN];
+    uint8_t ciphertext[AES128_BLOCK_LEN];
+    uint8_t expected[AES128_BLOCK_LEN];
+    aes128_t ctx;
+
+    test_from_hex("000102030405060708090a0b0c0d0e0f", key);
+    test_from_hex("00112233445566778899aabbccddeeff", plaintext);
+    test_from_hex("69c4e0d86a7b0430d8cdb78070b4c55a", expected);
+    aes128_setup(&ctx, key);
+    aes128_encrypt_block(&ctx, plaintext, ciphertext);
+    CHECK(memcmp(ciphertext, expected, sizeof(expected)) == 0);
+}
+
+
+static void test_ctr(void) {
+    uint8_t key[AES128_KEY_LEN];
+    uint8_t counter[AES128_BLOCK_LEN];
+    uint8_t plaintext[CTR_LEN];
+    uint8_t expected[CTR_LEN];
+    uint8_t data[CTR_LEN];
+    aes128_t ctx;
+
+    test_from_hex(CTR_KEY, key);
+    test_from_hex(CTR_COUNTER, counter);
+    test_from_hex(CTR_PLAINTEXT, plaintext);
+    test_from_hex(CTR_CIPHERTEXT, expected);
+    aes128_setup(&ctx, key);
+
+    memcpy(data, plaintext, sizeof(data));
+    aes128_ctr_crypt(&ctx, counter, 0, data, sizeof(data));
+    CHECK(memcmp(data, expected, sizeof(data)) == 0);
+
+    // Decrypting is the same operation
+    aes128_ctr_crypt(&ctx, counter, 0, data, sizeof(data));
+    CHECK(memcmp(data, plaintext, sizeof(data)) == 0);
+
+    // Block by block, in reverse order, as out of order addressed frames arrive
+    memcpy(data, plaintext, sizeof(data));
+    for (uint32_t block = 4; block-- > 0;) {
+        aes128_ctr_crypt(&ctx, counter, block, &data[block * AES128_BLOCK_LEN], AES128_BLOCK_LEN);
+    }
+    CHECK(memcmp(data, expected, sizeof(data)) == 0);
+
+    // A short tail only uses the start of its keystream block
+    memcpy(data, plaintext, sizeof(data));
+    aes128_ctr_crypt(&ctx, counter, 2, &data[2U * AES128_BLOCK_LEN], 7U);
+    CHECK(memcmp(&data[2U * AES128_BLOCK_LEN], &expected[2U * AES128_BLOCK_LEN], 7U) == 0);
+    CHECK(memcmp(&data[(2U * AES128_BLOCK_LEN) + 7U], &plaintext[(2U * AES128_BLOCK_LEN) + 7U], 9U) == 0);
+}
+
+
+int main(void) {
+    test_block();
+    test_ctr();
+    return TEST_RESULT("test-aes128");
+}
@@ -0,0 +1,215 @@
+/*
+ * bootloader/src/comms-frame.c round trips: every frame kind the bootloader
+ * and the host exchange (control packets, large data frames, addressed and
+ * broadcast frames), plain and with FEC, through comms_frame_encode() and
+ * back out of the byte-at-a-time parser, plus the link size adaption.
+ */
+#include <string.h>
+#include "comms-frame.h"
+#include "test.h"
+
+static comms_frame_parser_t parser;
+
+
+static void make_packet(comms_packet_t* packet, uint8_t length, uint8_t seed) {
+    memset(packet, 0, sizeof(*packet));
+    packet->length = length;
+    for (uint8_t i = 0; i < COMMS_PACKET_PAYLOAD_MAX_LEN; i++) {
+        packet->data[i] = (i < comms_packet_payload_len(packet)) ? (uint8_t) ((i * 13U) + seed) : 0U;
+    }
+    // Control packets pad a short payload with 0xFF
+    for (uint8_t i = length; i < COMMS_PACKET_PAYLOAD_LEN; i++) {
+        packet->data[i] = 0xFFU;
+    }
+}
+
+
+/* Feeds the bytes through the parser; returns how many packets came out, the last one in parser.packet */
+static uint32_t parse(const uint8_t* data, uint32_t length) {
+    uint32_t packets = 0;
+
+    for (uint32_t i = 0; i < length; i++) {
+        if (comms_frame_parse(&parser, data[i])) {
+            packets++;
+            // A packet only ever completes on the last byte of its frame
+            CHECK(i == length - 1U);
+        }
+    }
+    return packets;
+}
+
+
+static bool same_packet(const comms_packet_t* a, const comms_packet_t* b) {
+    return (a->length == b->length) && (a->crc == b->crc) && (a->seq == b->seq) && (a->addressed == b->addressed) &&
+           (a->offset == b->offset) && (memcmp(a->data, b->data, comms_packet_payload_len(a)) == 0);
+}
+
+
+/* Encodes the packet plain and, when the frame kind takes it, with FEC, parses both back, and checks
+ * the FEC form survives two bad bytes */
+static void round_trip(comms_packet_t* packet, uint32_t header_len, bool fec, uint32_t corrupt_header) {
+    uint8_t frame[COMMS_FRAME_MAX_LEN];
+    const uint32_t payload_len = comms_packet_payload_len(packet);
+
+    packet->crc = comms_packet_crc(packet);
+    const uint32_t length = comms_frame_encode(packet, frame);
+    CHECK(length == header_len + payload_len + COMMS_PACKET_CRC_LEN);
+
+    comms_frame_parser_reset(&parser);
+    CHECK(parse(frame, length) == 1U);
+    CHECK(same_packet(&parser.packet, packet));
+    CHECK(comms_packet_crc(&parser.packet) == parser.packet.crc);
+
+    // Without FEC a bad byte goes through the parser and is left for the CRC to catch
+    frame[header_len + 3U] ^= 0x40U;
+    CHECK(parse(frame, length) == 1U);
+    CHECK(comms_packet_crc(&parser.packet) != parser.packet.crc);
+    frame[header_len + 3U] ^= 0x40U;
+    if (!fec) {
+        return;
+    }
+
+    const uint32_t fec_length = comms_frame_add_fec(frame, length);
+    CHECK(fec_length == length + RS_PARITY_LEN);
+    CHECK(parse(frame, fec_length) == 1U);
+    CHECK(same_packet(&parser.packet, packet));
+
+    // One bad byte in the payload, one in the header (or the CRC when the header has nothing to spare)
+    frame[header_len + payload_len - 1U] ^= 0xFFU;
+    frame[(corrupt_header != 0U) ? corrupt_header : (header_len + payload_len)] ^= 0x21U;
+    CHECK(parse(frame, fec_length) == 1U);
+    CHECK(same_packet(&parser.packet, packet));
+    CHECK(comms_packet_crc(&parser.packet) == parser.packet.crc);
+}
+
+
+static void test_control_packets(void) {
+    comms_packet_t packet;
+
+    for (uint8_t length = 1; length <= COMMS_PACKET_PAYLOAD_LEN; length++) {
+        make_packet(&packet, length, length);
+        round_trip(&packet, COMMS_PACKET_DATALEN_LEN, true, 0U);
+    }
+
+    // The single byte helpers build the same packet as the generic encoder
+    comms_create_single_byte_packet(&packet, COMMS_ACK_PACKET_DATA0);
+    CHECK(packet.crc == comms_packet_crc(&packet));
+    CHECK(comms_is_single_byte_packet(&packet, COMMS_ACK_PACKET_DATA0));
+    CHECK(!comms_is_single_byte_packet(&packet, COMMS_RETX_PACKET_DATA0));
+
+    // Replies are built in the packet the last frame was read into; they must not inherit its frame kind
+    make_packet(&packet, 32, 7);
+    packet.addressed = true;
+    packet.offset = 0x1230;
+    comms_create_single_byte_packet(&packet, COMMS_ACK_PACKET_DATA0);
+    const uint8_t crc = packet.crc;
+    round_trip(&packet, COMMS_PACKET_DATALEN_LEN, false, 0U);
+    CHECK(packet.crc == crc);
+}
+
+
+static void test_large_frames(void) {
+    comms_packet_t packet;
+
+    make_packet(&packet, 2U * COMMS_PACKET_PAYLOAD_LEN, 3U);
+    round_trip(&packet, COMMS_PACKET_DATALEN_LEN, true, 0U);
+    make_packet(&packet, COMMS_PACKET_PAYLOAD_MAX_LEN, 5U);
+    round_trip(&packet, COMMS_PACKET_DATALEN_LEN, true, 0U);
+}
+
+
+static void test_addressed_frames(void) {
+    static const uint8_t sizes[] = {COMMS_PACKET_PAYLOAD_LEN, 2U * COMMS_PACKET_PAYLOAD_LEN, COMMS_PACKET_PAYLOAD_MAX_LEN};
+    static const uint32_t offsets[] = {0x000000U, 0x000040U, 0x123456U, 0xFFFFC0U};
+    comms_packet_t packet;
+
+    for (uint32_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        for (uint32_t o = 0; o < sizeof(offsets) / sizeof(offsets[0]); o++) {
+            make_packet(&packet, sizes[s], (uint8_t) (s + o));
+            packet.addressed = true;
+            packet.offset = offsets[o];
+            // FEC also repairs the offset
+            round_trip(&packet, COMMS_ADDR_HEADER_LEN, true, 3U);
+        }
+    }
+}
+
+
+static void test_broadcast_frames(void) {
+    static const uint16_t seqs[] = {0x0000U, 0x0001U, 0x1234U, 0xFFFFU};
+    comms_packet_t packet;
+
+    for (uint32_t i = 0; i < sizeof(seqs) / sizeof(seqs[0]); i++) {
+        make_packet(&packet, COMMS_BCAST_FRAME_TAG, (uint8_t) i);
+        packet.seq = seqs[i];
+        // The tag already has the FEC bit set, broadcast frames go without parity
+        round_trip(&packet, COMMS_PACKET_DATALEN_LEN + COMMS_BCAST_SEQ_LEN, false, 0U);
+    }
+}
+
+
+/* Bytes that cannot start a frame, such as the tail of a sync sequence, are skipped */
+static void test_resync(void) {
+    uint8_t stream[8 + (2U * COMMS_PACKET_FULL_LEN)] = {0x00, 0xFF, 0xAA, 0xBB, 0xCC, 0xDD, 0x7F, 0x00};
+    comms_packet_t first;
+    comms_packet_t second;
+
+    make_packet(&first, 1U, 0x26U);
+    first.crc = comms_packet_crc(&first);
+    make_packet(&second, 5U, 0x36U);
+    second.crc = comms_packet_crc(&second);
+    uint32_t length = 8U;
+    length += comms_frame_encode(&first, &stream[length]);
+    length += comms_frame_encode(&second, &stream[length]);
+
+    uint32_t packets = 0;
+    comms_frame_parser_reset(&parser);
+    for (uint32_t i = 0; i < length; i++) {
+        if (comms_frame_parse(&parser, stream[i])) {
+            packets++;
+            CHECK(same_packet(&parser.packet, (packets == 1U) ? &first : &second));
+        }
+    }
+    CHECK(packets == 2U);
+}
+
+
+static void test_link(void) {
+    comms_link_t link;
+
+    comms_link_reset(&link);
+    CHECK(link.max_payload == COMMS_PACKET_PAYLOAD_LEN);
+
+    // A clean window grows the frames, one step at a time
+    for (uint32_t i = 0; i < COMMS_LINK_WINDOW - 1U; i++) {
+        CHECK(!comms_link_record(&link, false));
+    }
+    CHECK(comms_link_record(&link, false));
+    CHECK(link.max_payload == (2U * COMMS_PACKET_PAYLOAD_LEN));
+    for (uint32_t i = 0; i < (2U * COMMS_LINK_WINDOW); i++) {
+        comms_link_record(&link, false);
+    }
+    CHECK(link.max_payload == COMMS_PACKET_PAYLOAD_MAX_LEN);
+    for (uint32_t i = 0; i < COMMS_LINK_WINDOW; i++) {
+        CHECK(!comms_link_record(&link, false));
+    }
+
+    // Enough failures in the window shrink them again
+    for (uint32_t i = 0; i < COMMS_LINK_SHRINK_FAILURES - 1U; i++) {
+        CHECK(!comms_link_record(&link, true));
+    }
+    CHECK(comms_link_record(&link, true));
+    CHECK(link.max_payload == (2U * COMMS_PACKET_PAYLOAD_LEN));
+}
+
+
+int main(void) {
+    rs_setup();
+    test_control_packets();
+    test_large_frames();
+    test_addressed_frames();
+    test_broadcast_frames();
+    test_resync();
+    test_link();
+    return TEST_RESULT("test-comms-frame");
+}
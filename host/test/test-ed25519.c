@@ -0,0 +1,93 @@
+/*
+ * core/ed25519.c against RFC 8032 section 7.1 tests 1 to 3, and the forgeries
+ * a verifier has to turn down: any flipped bit, a non-canonical S and a
+ * message longer than the digest the bootloader signs.
+ */
+#include <string.h>
+#include "core/ed25519.h"
+#include "test.h"
+
+typedef struct {
+    const char* public_key;
+    const char* message;
+    const char* signature;
+} ed25519_vector_t;
+
+static const ed25519_vector_t vectors[] = {
+    {
+        "d75a980182b10ab7d54bfed3c964073a0ee172f3daa62325af021a68f707511a",
+        "",
+        "e5564300c360ac729086e2cc806e828a84877f1eb8e5d974d873e065224901555fb8821590a33bacc61e39701cf9b46bd25bf5f0595bbe24655141438e7a100b",
+    },
+    {
+        "3d4017c3e843895a92b70aa74d1b7ebc9c982ccf2ec4968cc0cd55f12af4660c",
+        "72",
+        "92a009a9f0d4cab8720e820b5f642540a2b27b5416503f8fb3762223ebdb69da085ac1e43e15996e458f3613d0f11d8c387b2eaeb4302aeeb00d291612bb0c00",
+    },
+    {
+        "fc51cd8e6218a1a38da47ed00230f0580816ed13ba3303ac5deb911548908025",
+        "af82",
+        "6291d657deec24024827e69c3abe01a30ce548a284743a445e3680d7db5ac3ac18ff9b538d16f290ae67f760984dc6594a7c15e9716ed28dc027beceea1ec40a",
+    },
+};
+
+/* S of test 1 plus the group order L: the same signature, but not in canonical form */
+#define TEST1_S_PLUS_L  "4c8c7872aa064e049dbb3013fbf29380d25bf5f0595bbe24655141438e7a101b"
+
+
+static void test_vectors(void) {
+    for (uint32_t i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++) {
+        uint8_t public_key[ED25519_PUBLIC_KEY_LEN];
+        uint8_t signature[ED25519_SIGNATURE_LEN];
+        uint8_t message[64];
+        const uint32_t length = test_from_hex(vectors[i].message, message);
+
+        test_from_hex(vectors[i].public_key, public_key);
+        test_from_hex(vectors[i].signature, signature);
+        CHECK(ed25519_verify(signature, message, length, public_key));
+    }
+}
+
+
+static void test_forgeries(void) {
+    uint8_t public_key[ED25519_PUBLIC_KEY_LEN];
+    uint8_t signature[ED25519_SIGNATURE_LEN];
+    uint8_t message[65];
+    const uint32_t length = test_from_hex(vectors[2].message, message);
+
+    test_from_hex(vectors[2].public_key, public_key);
+    test_from_hex(vectors[2].signature, signature);
+
+    for (uint32_t bit = 0; bit < (8U * ED25519_SIGNATURE_LEN); bit += 37U) {
+        signature[bit / 8U] ^= (uint8_t) (1U << (bit % 8U));
+        CHECK(!ed25519_verify(signature, message, length, public_key));
+        signature[bit / 8U] ^= (uint8_t) (1U << (bit % 8U));
+    }
+    for (uint32_t bit = 0; bit < (8U * length); bit++) {
+        message[bit / 8U] ^= (uint8_t) (1U << (bit % 8U));
+        CHECK(!ed25519_verify(signature, message, length, public_key));
+        message[bit / 8U] ^= (uint8_t) (1U << (bit % 8U));
+    }
+    public_key[5] ^= 0x10U;
+    CHECK(!ed25519_verify(signature, message, length, public_key));
+    public_key[5] ^= 0x10U;
+    CHECK(ed25519_verify(signature, message, length, public_key));
+
+    // Over the limit the message is not even hashed
+    memset(message, 0, sizeof(message));
+    CHECK(!ed25519_verify(signature, message, sizeof(message), public_key));
+
+    // Malleated S = S + L
+    test_from_hex(vectors[0].public_key, public_key);
+    test_from_hex(vectors[0].signature, signature);
+    CHECK(ed25519_verify(signature, message, 0, public_key));
+    test_from_hex(TEST1_S_PLUS_L, &signature[32]);
+    CHECK(!ed25519_verify(signature, message, 0, public_key));
+}
+
+
+int main(void) {
+    test_vectors();
+    test_forgeries();
+    return TEST_RESULT("test-ed25519");
+}
@@ -0,0 +1,86 @@
+/*
+ * core/reed-solomon.c: parity against known answers from the separately
+ * written fw_updater/reed_solomon.py (same field and generator), and
+ * correction of every one and two byte error pattern the parity covers.
+ * fw_updater/test_reed_solomon.py runs the decoder on random codewords.
+ */
+#include <string.h>
+#include "core/reed-solomon.h"
+#include "test.h"
+
+#define RS_MAX_LEN  (255U)
+
+typedef struct {
+    uint32_t length;
+    uint8_t multiplier;
+    uint8_t increment;
+    const char* parity;
+} rs_vector_t;
+
+/* Message byte i is (i * multiplier + increment) & 0xFF */
+static const rs_vector_t vectors[] = {
+    {17, 1, 1, "3d05dfe6"},       // A control packet: [len][16 byte payload]
+    {70, 31, 7, "2beff316"},      // An addressed 64 byte frame: [tag][size][offset][payload][crc]
+    {251, 1, 0, "5bf06d3d"},      // The longest message a codeword takes
+};
+
+
+static uint32_t make_codeword(const rs_vector_t* vector, uint8_t* codeword) {
+    for (uint32_t i = 0; i < vector->length; i++) {
+        codeword[i] = (uint8_t) ((i * vector->multiplier) + vector->increment);
+    }
+    rs_encode(codeword, vector->length, &codeword[vector->length]);
+    return vector->length + RS_PARITY_LEN;
+}
+
+
+static void test_encode(void) {
+    uint8_t codeword[RS_MAX_LEN];
+    uint8_t expected[RS_PARITY_LEN];
+
+    for (uint32_t i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++) {
+        const uint32_t length = make_codeword(&vectors[i], codeword);
+        test_from_hex(vectors[i].parity, expected);
+        CHECK(memcmp(&codeword[vectors[i].length], expected, RS_PARITY_LEN) == 0);
+        CHECK(rs_decode(codeword, length) == 0);
+    }
+}
+
+
+static void test_correct(void) {
+    uint8_t original[RS_MAX_LEN];
+    uint8_t codeword[RS_MAX_LEN];
+
+    for (uint32_t v = 0; v < 2U; v++) {
+        const uint32_t length = make_codeword(&vectors[v], original);
+
+        // Every single byte error, parity bytes included, with a few error values
+        for (uint32_t position = 0; position < length; position++) {
+            for (uint32_t error = 1; error < 256U; error += 85U) {
+                memcpy(codeword, original, length);
+                codeword[position] ^= (uint8_t) error;
+                CHECK(rs_decode(codeword, length) == 1);
+                CHECK(memcmp(codeword, original, length) == 0);
+            }
+        }
+
+        // Every pair of positions
+        for (uint32_t first = 0; first < length; first++) {
+            for (uint32_t second = first + 1U; second < length; second++) {
+                memcpy(codeword, original, length);
+                codeword[first] ^= 0xA5U;
+                codeword[second] ^= (uint8_t) (second + 1U);
+                CHECK(rs_decode(codeword, length) == 2);
+                CHECK(memcmp(codeword, original, length) == 0);
+            }
+        }
+    }
+}
+
+
+int main(void) {
+    rs_setup();
+    test_encode();
+    test_correct();
+    return TEST_RESULT("test-reed-solomon");
+}
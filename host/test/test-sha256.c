@@ -0,0 +1,91 @@
+/*
+ * core/sha256.c against the FIPS 180-2 examples, and the streamed digest the
+ * bootloader builds frame by frame against the same data hashed in one go.
+ */
+#include <string.h>
+#include "core/sha256.h"
+#include "test.h"
+
+typedef struct {
+    const char* message;
+    const char* digest;
+} sha256_vector_t;
+
+static const sha256_vector_t vectors[] = {
+    {"", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"},
+    {"abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"},
+    {"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"},
+};
+
+
+static void sha256(const uint8_t* data, uint32_t length, uint8_t* digest) {
+    sha256_t ctx;
+    sha256_init(&ctx);
+    sha256_update(&ctx, data, length);
+    sha256_final(&ctx, digest);
+}
+
+
+static void test_vectors(void) {
+    uint8_t digest[SHA256_DIGEST_LEN];
+    uint8_t expected[SHA256_DIGEST_LEN];
+
+    for (uint32_t i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++) {
+        test_from_hex(vectors[i].digest, expected);
+        sha256((const uint8_t*) vectors[i].message, (uint32_t) strlen(vectors[i].message), digest);
+        CHECK(memcmp(digest, expected, sizeof(digest)) == 0);
+    }
+}
+
+
+static void test_million_a(void) {
+    uint8_t chunk[1000];
+    uint8_t digest[SHA256_DIGEST_LEN];
+    uint8_t expected[SHA256_DIGEST_LEN];
+    sha256_t ctx;
+
+    memset(chunk, 'a', sizeof(chunk));
+    sha256_init(&ctx);
+    for (uint32_t i = 0; i < 1000U; i++) {
+        sha256_update(&ctx, chunk, sizeof(chunk));
+    }
+    sha256_final(&ctx, digest);
+    test_from_hex("cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0", expected);
+    CHECK(memcmp(digest, expected, sizeof(digest)) == 0);
+}
+
+
+/* Frames of 16, 32 and 64 bytes, and odd sizes, must not change the digest at any block boundary */
+static void test_streamed(void) {
+    static const uint32_t lengths[] = {1, 55, 56, 63, 64, 65, 127, 128, 129, 1000};
+    static const uint32_t chunks[] = {1, 7, 16, 17, 32, 64, 100};
+    uint8_t data[1000];
+
+    for (uint32_t i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t) ((i * 7U) + 3U);
+    }
+    for (uint32_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+        uint8_t expected[SHA256_DIGEST_LEN];
+        sha256(data, lengths[l], expected);
+
+        for (uint32_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+            uint8_t digest[SHA256_DIGEST_LEN];
+            sha256_t ctx;
+            sha256_init(&ctx);
+            for (uint32_t offset = 0; offset < lengths[l]; offset += chunks[c]) {
+                const uint32_t left = lengths[l] - offset;
+                sha256_update(&ctx, &data[offset], (left < chunks[c]) ? left : chunks[c]);
+            }
+            sha256_final(&ctx, digest);
+            CHECK(memcmp(digest, expected, sizeof(digest)) == 0);
+        }
+    }
+}
+
+
+int main(void) {
+    test_vectors();
+    test_million_a();
+    test_streamed();
+    return TEST_RESULT("test-sha256");
+}
@@ -0,0 +1,134 @@
+/*
+ * core/spi-flash.c against the W25Q model in libspiflash-model.a: the JEDEC
+ * probe, sector erase, programs that cross a page boundary and read_start.
+ */
+#include <string.h>
+#include "core/spi-flash.h"
+#include "spi-flash-model.h"
+#include "test.h"
+
+#define CHIP_SIZE   (1024U * 1024U)
+
+static uint8_t chip[CHIP_SIZE];
+
+
+static bool all_bytes(const uint8_t* data, uint32_t length, uint8_t value) {
+    for (uint32_t i = 0; i < length; i++) {
+        if (data[i] != value) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+static void test_probe(void) {
+    // Nothing on the bus: the capacity byte reads 0
+    spi_flash_model_attach(0, 0);
+    CHECK(!spi_flash_setup());
+    CHECK(spi_flash_size() == 0U);
+
+    // Smaller than the driver takes
+    spi_flash_model_attach(chip, 32U * 1024U);
+    CHECK(!spi_flash_setup());
+    CHECK(spi_flash_size() == 0U);
+
+    spi_flash_model_attach(chip, CHIP_SIZE);
+    CHECK(spi_flash_setup());
+    CHECK(spi_flash_size() == CHIP_SIZE);
+}
+
+
+static void test_erase_sector(void) {
+    const uint32_t sector = 3U * SPI_FLASH_SECTOR_SIZE;
+
+    memset(chip, 0x00, sizeof(chip));
+    spi_flash_model_attach(chip, CHIP_SIZE);
+    CHECK(spi_flash_setup());
+
+    // Any address inside the sector erases all of it
+    spi_flash_erase_sector(sector + 0x123U);
+    CHECK(spi_flash_is_busy());
+    spi_flash_wait();
+    CHECK(!spi_flash_is_busy());
+
+    CHECK(all_bytes(&chip[sector], SPI_FLASH_SECTOR_SIZE, 0xFFU));
+    CHECK(all_bytes(&chip[sector - SPI_FLASH_SECTOR_SIZE], SPI_FLASH_SECTOR_SIZE, 0x00U));
+    CHECK(all_bytes(&chip[sector + SPI_FLASH_SECTOR_SIZE], SPI_FLASH_SECTOR_SIZE, 0x00U));
+}
+
+
+static void test_program_across_pages(void) {
+    // Starts 16 bytes before a page boundary and ends inside the page after the next
+    const uint32_t address = (5U * SPI_FLASH_PAGE_SIZE) - 16U;
+    const uint32_t length = SPI_FLASH_PAGE_SIZE + 48U;
+    uint8_t data[SPI_FLASH_PAGE_SIZE + 48U];
+    uint8_t readback[SPI_FLASH_PAGE_SIZE + 48U];
+
+    memset(chip, 0xFF, sizeof(chip));
+    spi_flash_model_attach(chip, CHIP_SIZE);
+    CHECK(spi_flash_setup());
+    for (uint32_t i = 0; i < length; i++) {
+        data[i] = (uint8_t) ((i * 7U) + 1U);
+    }
+
+    spi_flash_program(address, data, length);
+    spi_flash_wait();
+
+    CHECK(memcmp(&chip[address], data, length) == 0);
+    // A program the chip had wrapped would have landed at the start of the first page
+    CHECK(all_bytes(&chip[4U * SPI_FLASH_PAGE_SIZE], SPI_FLASH_PAGE_SIZE - 16U, 0xFFU));
+    CHECK(all_bytes(&chip[address + length], 64U, 0xFFU));
+
+    memset(readback, 0, sizeof(readback));
+    spi_flash_read(address, readback, length);
+    CHECK(memcmp(readback, data, length) == 0);
+
+    // Programs only clear bits
+    const uint8_t high = 0xF0U;
+    const uint8_t low = 0x0FU;
+    spi_flash_program(0x10000U, &high, 1U);
+    spi_flash_program(0x10000U, &low, 1U);
+    spi_flash_wait();
+    CHECK(chip[0x10000U] == 0x00U);
+}
+
+
+static void test_read_start(void) {
+    const uint32_t address = 0x20000U;
+    uint8_t data[100];
+    uint8_t readback[100];
+
+    memset(chip, 0xFF, sizeof(chip));
+    spi_flash_model_attach(chip, CHIP_SIZE);
+    CHECK(spi_flash_setup());
+    for (uint32_t i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t) (0xA5U ^ i);
+    }
+
+    // The chip is still programming; read_start has to wait it out instead of reading 0xFF
+    spi_flash_program(address, data, sizeof(data));
+    memset(readback, 0, sizeof(readback));
+    spi_flash_read_start(address, readback, sizeof(readback));
+    while (spi_flash_is_busy()) {}
+    CHECK(memcmp(readback, data, sizeof(data)) == 0);
+
+    // Nothing to read leaves no transfer open
+    spi_flash_read_start(address, readback, 0U);
+    CHECK(!spi_flash_is_busy());
+
+    // The chip takes the next command once the read is closed
+    spi_flash_erase_sector(address);
+    spi_flash_wait();
+    spi_flash_read(address, readback, sizeof(readback));
+    CHECK(all_bytes(readback, sizeof(readback), 0xFFU));
+}
+
+
+int main(void) {
+    test_probe();
+    test_erase_sector();
+    test_program_across_pages();
+    test_read_start();
+    return TEST_RESULT("test-spi-flash");
+}
@@ -0,0 +1,37 @@
+#ifndef TEST_TEST_H
+#define TEST_TEST_H
+
+#include "common-defines.h"
+
+/*
+ * Just enough of a test runner for the host tests: CHECK() reports a failed
+ * condition with its line and carries on, TEST_RESULT() is main()'s exit code.
+ */
+
+static uint32_t test_failures = 0;
+
+#define CHECK(condition) do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            test_failures++; \
+        } \
+    } while (0)
+
+#define TEST_RESULT(name) \
+    (fprintf(stderr, "%s: %s\n", (name), (test_failures == 0U) ? "ok" : "FAILED"), (test_failures == 0U) ? 0 : 1)
+
+/* Known-answer vectors are written as hex strings; returns the number of bytes */
+static inline uint32_t test_from_hex(const char* hex, uint8_t* data) {
+    uint32_t length = 0;
+
+    for (; (hex[0] != '\0') && (hex[1] != '\0'); hex += 2) {
+        unsigned int byte = 0;
+        if (sscanf(hex, "%2x", &byte) != 1) {
+            break;
+        }
+        data[length++] = (uint8_t) byte;
+    }
+    return length;
+}
+
+#endif /* TEST_TEST_H */
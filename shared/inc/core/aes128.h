@@ -0,0 +1,21 @@
+#ifndef INC_AES128_H
+#define INC_AES128_H
+
+#include "common-defines.h"
+
+#define AES128_KEY_LEN   (16U)
+#define AES128_BLOCK_LEN (16U)
+
+typedef struct {
+    uint32_t round_keys[44];
+} aes128_t;
+
+void aes128_setup(aes128_t* ctx, const uint8_t* key);
+void aes128_encrypt_block(const aes128_t* ctx, const uint8_t* input, uint8_t* output);
+
+/* CTR mode en/decryption in place. The last four bytes of `nonce` are a
+ * big-endian block counter; `block_index` is added to it so any 16-byte
+ * aligned offset of a stream can be processed independently. */
+void aes128_ctr_crypt(const aes128_t* ctx, const uint8_t* nonce, uint32_t block_index, uint8_t* data, uint32_t length);
+
+#endif /* INC_AES128_H */
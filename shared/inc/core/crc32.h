@@ -0,0 +1,13 @@
+#ifndef INC_CRC32_H
+#define INC_CRC32_H
+
+#include "common-defines.h"
+
+#define CRC32_INITIAL_VALUE (0x00000000U)
+
+/* CRC-32/ISO-HDLC (zlib.crc32 compatible). Pass the previous result as `crc`
+ * to continue a running checksum over several buffers. */
+uint32_t crc32_update(uint32_t crc, const uint8_t* data, uint32_t length);
+uint32_t crc32(const uint8_t* data, uint32_t length);
+
+#endif /* INC_CRC32_H */
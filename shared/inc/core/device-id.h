@@ -0,0 +1,23 @@
+#ifndef INC_DEVICE_ID_H
+#define INC_DEVICE_ID_H
+
+#include "common-defines.h"
+
+/*
+ * What a node reports about itself in DEVICE_ID_REQ, the same from the
+ * bootloader and from the application's download agent: the node address a
+ * broadcast or gateway session polls it by, and the flash geometry the host
+ * checks the image against. The fields follow the request's type byte, all
+ * big endian:
+ *
+ *   [node address, 16 bit][flash KiB, 16 bit][page size, 16 bit][application region bytes, 32 bit]
+ */
+
+#define DEVICE_ID_FIELDS_LEN    (10U)
+
+/* The 96 bit unique ID folded to 16 bits */
+uint16_t device_id_node_address(void);
+
+void device_id_encode(uint8_t* fields, uint32_t flash_size, uint32_t page_size, uint32_t app_size);
+
+#endif /* INC_DEVICE_ID_H */
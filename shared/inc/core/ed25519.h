@@ -0,0 +1,14 @@
+#ifndef INC_ED25519_H
+#define INC_ED25519_H
+
+#include "common-defines.h"
+
+#define ED25519_PUBLIC_KEY_LEN (32U)
+#define ED25519_SIGNATURE_LEN  (64U)
+
+/* Verify-only Ed25519 (RFC 8032). Returns true when `signature` is a valid
+ * signature of `message` under `public_key`. Not constant time; it only
+ * handles public data. */
+bool ed25519_verify(const uint8_t* signature, const uint8_t* message, uint32_t length, const uint8_t* public_key);
+
+#endif /* INC_ED25519_H */
@@ -0,0 +1,59 @@
+#ifndef INC_HANDOFF_H
+#define INC_HANDOFF_H
+
+#include "common-defines.h"
+
+/*
+ * Bootloader to application handoff block, at HANDOFF_ADDRESS in the top
+ * HANDOFF_SIZE bytes of RAM (core/memory-map.h). Neither image's linker
+ * region covers it, so the application's startup code leaves it alone. The
+ * bootloader publishes it right before the jump; the application takes it
+ * once at the start of main(). A block with the wrong magic or version or a
+ * bad crc reads as absent (cold boot, older bootloader).
+ */
+
+#define HANDOFF_MAGIC           (0x46464F48U)   /* "HOFF" */
+#define HANDOFF_VERSION         (1U)
+
+/* The other direction: the application sets this in the last word of the
+ * handoff area and resets, and the bootloader starts an update session at once
+ * instead of waiting out the sync window for a host */
+#define HANDOFF_ENTER_BOOTLOADER (0x544F4F42U)  /* "BOOT" */
+
+/* What the bootloader did with this reset before starting the application */
+typedef enum {
+    Handoff_Update_None,            // No update session, the installed image starts unchanged
+    Handoff_Update_Installed,       // Received and verified over the serial link or a broadcast
+    Handoff_Update_StagedInstalled, // Installed from the staging slot
+    Handoff_Update_Failed,          // A session failed, the previous image still runs
+} handoff_update_t;
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t length;            /* sizeof(handoff_t) of the writer, newer fields are appended */
+    uint32_t ahb_hz;            /* HCLK the bootloader left running */
+    uint32_t ticks;             /* system_get_ticks() at the jump */
+    uint32_t jump_cycles;       /* DWT_CYCCNT at the jump, the counter keeps running */
+    uint32_t baud_rate;         /* USART2 rate the update link used */
+    uint32_t reset_flags;       /* RCC_CSR reset flags, the bootloader clears them */
+    uint32_t update_result;     /* handoff_update_t */
+    uint32_t crc;               /* crc32 over everything before it */
+} handoff_t;
+
+/* Bootloader: fills in magic, version, length, ticks, jump_cycles and crc */
+void handoff_publish(handoff_t* handoff);
+
+/* Application: validates and copies the block, then invalidates it in RAM. NULL when there is none */
+const handoff_t* handoff_take(void);
+
+/* Microseconds from the bootloader's jump to handoff_take(), counted in CPU cycles at ahb_hz; 0 without a handoff */
+uint32_t handoff_boot_us(void);
+
+/* Application: leaves the request and resets the system */
+void handoff_enter_bootloader(void) __attribute__((noreturn));
+
+/* Bootloader: whether the request is there, clearing it either way */
+bool handoff_bootloader_requested(void);
+
+#endif /* INC_HANDOFF_H */
@@ -0,0 +1,90 @@
+#ifndef INC_IMAGE_H
+#define INC_IMAGE_H
+
+#include "common-defines.h"
+
+/*
+ * Packaged firmware image (firmware.img), produced by fw_updater/fw_image.py:
+ *
+ *   [header (IMAGE_HEADER_LEN)][segment table][0xFF padding to header_size]
+ *   [segment 0 data][segment 1 data]...
+ *
+ * All fields are little-endian. header_size and every segment length are
+ * multiples of IMAGE_ALIGN so a comms payload never straddles two segments.
+ */
+
+#define IMAGE_MAGIC             (0x474D4946U)   /* "FIMG" */
+#define IMAGE_HEADER_VERSION    (1U)
+#define IMAGE_HEADER_LEN        (36U)
+#define IMAGE_SEGMENT_LEN       (12U)
+#define IMAGE_MAX_SEGMENTS      (8U)
+#define IMAGE_ALIGN             (16U)
+#define IMAGE_SIGNATURE_LEN     (64U)
+#define IMAGE_NONCE_LEN         (16U)
+#define IMAGE_HEADER_MAX_SIZE   (224U)          /* header + 8 segments, aligned, + nonce + signature */
+
+#define IMAGE_HEADER_CRC_OFFSET (8U)            /* header_crc covers [8, header_size) */
+#define IMAGE_HEADER_SIZE_OFFSET (10U)
+
+/* Signed images carry an Ed25519 signature in the last IMAGE_SIGNATURE_LEN
+ * bytes of the header block, over the SHA-256 digest of
+ * [IMAGE_HEADER_CRC_OFFSET, header_size - IMAGE_SIGNATURE_LEN) followed by
+ * all segment data. */
+#define IMAGE_FLAG_SIGNED       (1U << 0)
+
+/* Encrypted images carry an AES-128-CTR nonce in the IMAGE_NONCE_LEN bytes
+ * before the signature. Segment data is encrypted; CRCs and the signed
+ * digest cover the plaintext. */
+#define IMAGE_FLAG_ENCRYPTED    (1U << 1)
+
+/* A/B updates: the application downloads firmware.img unchanged into the
+ * staging slot and, once it is complete, programs an image_staged_t in the
+ * last IMAGE_ALIGN bytes of the slot. The bootloader installs a READY image at
+ * the next reset and then zeroes state (0x0000 can be programmed over any
+ * half-word without an erase). */
+#define IMAGE_STAGED_READY      (0x47545353U)   /* "SSTG" */
+#define IMAGE_STAGED_DONE       (0x00000000U)
+#define IMAGE_STAGED_TRAILER_LEN (IMAGE_ALIGN)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t header_crc;
+    uint16_t header_version;
+    uint16_t header_size;
+    uint16_t segment_count;
+    uint16_t flags;
+    uint32_t fw_version;        /* major << 16 | minor << 8 | patch */
+    uint32_t build_id;
+    uint32_t load_address;      /* application vector table */
+    uint32_t image_size;        /* sum of segment lengths */
+    uint32_t image_crc;         /* crc32 over all segment data */
+} image_header_t;
+
+typedef struct {
+    uint32_t address;
+    uint32_t length;
+    uint32_t crc;
+} image_segment_t;
+
+typedef struct {
+    uint32_t state;             /* IMAGE_STAGED_READY or _DONE, erased when nothing was staged */
+    uint32_t length;            /* firmware.img bytes at the start of the slot */
+    uint32_t header_crc;        /* identifies the staged image */
+    uint32_t reserved;
+} image_staged_t;
+
+typedef enum {
+    Image_Status_Ok,
+    Image_Status_BadMagic,
+    Image_Status_BadVersion,
+    Image_Status_BadSize,
+    Image_Status_BadCRC,
+    Image_Status_BadSegment,
+} image_status_t;
+
+uint16_t image_peek_header_size(const uint8_t* raw);
+image_status_t image_parse(const uint8_t* raw, uint32_t length, image_header_t* header, image_segment_t* segments);
+uint32_t image_signed_header_end(const image_header_t* header);
+uint32_t image_nonce_offset(const image_header_t* header);
+
+#endif /* INC_IMAGE_H */
@@ -0,0 +1,56 @@
+#ifndef INC_MEMORY_MAP_H
+#define INC_MEMORY_MAP_H
+
+/*
+ * Single source of truth for the flash/RAM partitioning. This header is also
+ * run through the C preprocessor to generate the linker MEMORY regions
+ * (see shared/ld/memory-map.ld.S), so keep it to plain integer macros.
+ */
+
+/* Sized for the 64 KiB F103C8 by default; 'make FLASH_SIZE=... RAM_SIZE=...' lays it out
+ * for a bigger part. The bootloader reads the real flash and page size at runtime. */
+#define FLASH_ORIGIN        (0x08000000)
+#ifndef FLASH_SIZE
+#define FLASH_SIZE          (0x10000)
+#endif
+#define FLASH_BANK_SIZE     (0x80000)     // XL-density parts add a second bank above this
+#define RAM_ORIGIN          (0x20000000)
+#ifndef RAM_SIZE
+#define RAM_SIZE            (0x5000)
+#endif
+
+#define BOOTLOADER_SIZE     (0x6000)
+
+/* Last 4 KiB of the bootloader partition hold persistent bootloader records.
+ * Each record owns a 2 KiB slot so it is independently erasable on both
+ * 1 KiB and 2 KiB flash page parts. */
+#define BL_METADATA_SIZE    (0x1000)
+#define BL_METADATA_ADDRESS (FLASH_ORIGIN + BOOTLOADER_SIZE - BL_METADATA_SIZE)
+#define BL_SLOT_SIZE        (0x800)
+#define BL_IMAGE_INFO_ADDRESS (BL_METADATA_ADDRESS)
+#define BL_PROGRESS_ADDRESS (BL_METADATA_ADDRESS + BL_SLOT_SIZE)
+
+/* A/B updates: the running application downloads the next image into the
+ * staging slot at the top of flash, the bootloader installs it from there at
+ * the next reset. The slot holds firmware.img as sent plus a trailer (see
+ * core/image.h) and must be a whole number of 2 KiB pages. SPI_STAGING=1
+ * builds stage in external SPI NOR instead and pass STAGING_SIZE=0, giving
+ * the slot back to the application. */
+#ifndef STAGING_SIZE
+#define STAGING_SIZE        (0x5000)
+#endif
+#define STAGING_ADDRESS     (FLASH_ORIGIN + FLASH_SIZE - STAGING_SIZE)
+
+/* Staging slot in the external SPI NOR (chip addresses), whole 4 KiB sectors */
+#define SPI_STAGING_ADDRESS (0x000000)
+#define SPI_STAGING_SIZE    (0x10000)
+
+/* Top of RAM, outside both images' ram region: the bootloader to application
+ * handoff block (core/handoff.h). The stacks start below it. */
+#define HANDOFF_SIZE        (0x40)
+#define HANDOFF_ADDRESS     (RAM_ORIGIN + RAM_SIZE - HANDOFF_SIZE)
+
+#define APP_START_ADDRESS   (FLASH_ORIGIN + BOOTLOADER_SIZE)
+#define APP_MAX_SIZE        (FLASH_SIZE - BOOTLOADER_SIZE - STAGING_SIZE)
+
+#endif /* INC_MEMORY_MAP_H */
@@ -0,0 +1,21 @@
+#ifndef INC_REED_SOLOMON_H
+#define INC_REED_SOLOMON_H
+
+#include "common-defines.h"
+
+/* Parity bytes per codeword; corrects up to RS_PARITY_LEN / 2 corrupted bytes */
+#define RS_PARITY_LEN (4U)
+
+#define RS_UNCORRECTABLE (-1)
+
+/* Builds the GF(2^8) log/antilog tables in RAM, call once before rs_encode()/rs_decode() */
+void rs_setup(void);
+
+/* RS_PARITY_LEN parity bytes for `message` (at most 255 - RS_PARITY_LEN bytes), sent after it */
+void rs_encode(const uint8_t* message, uint32_t length, uint8_t* parity);
+
+/* Corrects `codeword` (message followed by its parity, at most 255 bytes) in place.
+ * Returns the number of bytes corrected, or RS_UNCORRECTABLE. */
+int32_t rs_decode(uint8_t* codeword, uint32_t length);
+
+#endif /* INC_REED_SOLOMON_H */
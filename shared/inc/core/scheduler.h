@@ -0,0 +1,27 @@
+#ifndef INC_SCHEDULER_H
+#define INC_SCHEDULER_H
+
+#include "common-defines.h"
+
+/*
+ * Run-to-completion cooperative scheduler. A task runs when its period has
+ * elapsed or when something posted it, interrupt handlers included; earlier
+ * added tasks go first. With nothing ready the core sleeps in WFI until the
+ * next interrupt, SysTick at the latest, so periods have 1 ms resolution.
+ */
+
+#define SCHEDULER_MAX_TASKS     (8U)
+#define SCHEDULER_NO_TASK       (0xFFU)
+
+typedef void (*scheduler_task_fn_t)(void);
+typedef uint8_t scheduler_task_id_t;
+
+/* period_ms 0 runs the task only when posted. SCHEDULER_NO_TASK once the table is full */
+scheduler_task_id_t scheduler_add(scheduler_task_fn_t run, uint32_t period_ms);
+
+/* Safe from interrupt handlers; posting a task that is already pending runs it once */
+void scheduler_post(scheduler_task_id_t task);
+
+void scheduler_run(void) __attribute__((noreturn));
+
+#endif /* INC_SCHEDULER_H */
@@ -0,0 +1,20 @@
+#ifndef INC_SHA256_H
+#define INC_SHA256_H
+
+#include "common-defines.h"
+
+#define SHA256_BLOCK_LEN  (64U)
+#define SHA256_DIGEST_LEN (32U)
+
+typedef struct {
+    uint32_t state[8];
+    uint64_t length;
+    uint8_t block[SHA256_BLOCK_LEN];
+    uint32_t block_len;
+} sha256_t;
+
+void sha256_init(sha256_t* ctx);
+void sha256_update(sha256_t* ctx, const uint8_t* data, uint32_t length);
+void sha256_final(sha256_t* ctx, uint8_t* digest);
+
+#endif /* INC_SHA256_H */
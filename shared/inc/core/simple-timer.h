@@ -3,6 +3,7 @@
 
 #include "common-defines.h"
 
+/* Kept in microseconds (system_get_us()); simple_timer_setup() takes milliseconds */
 typedef struct {
     uint64_t wait_time;
     uint64_t target_time;
@@ -10,6 +11,8 @@ typedef struct {
 } simple_timer_t;
 
 void simple_timer_setup(simple_timer_t *timer, uint64_t wait_time, bool auto_reset);
+void simple_timer_setup_us(simple_timer_t *timer, uint64_t wait_time_us, bool auto_reset);
+/* drift in microseconds */
 void simple_timer_reset(simple_timer_t *timer, uint64_t drift);
 bool simple_timer_has_elapsed(simple_timer_t *timer);
 
@@ -0,0 +1,20 @@
+#ifndef INC_SPI_BUS_H
+#define INC_SPI_BUS_H
+
+#include "common-defines.h"
+
+/*
+ * Full duplex SPI transfers for core/spi-flash.c. On target this is SPI1 with
+ * DMA (core/spi-bus.c); the host simulator links its flash chip model
+ * (host/src/spi-flash-model.c) in its place.
+ */
+
+void spi_bus_setup(void);
+void spi_bus_select(void);
+void spi_bus_deselect(void);
+
+/* Starts clocking `length` bytes and returns; tx NULL sends 0xFF, rx NULL discards */
+void spi_bus_transfer(const uint8_t* tx, uint8_t* rx, uint32_t length);
+bool spi_bus_busy(void);
+
+#endif /* INC_SPI_BUS_H */
@@ -0,0 +1,37 @@
+#ifndef INC_SPI_FLASH_H
+#define INC_SPI_FLASH_H
+
+#include "common-defines.h"
+
+/*
+ * W25Qxx-class SPI NOR over core/spi-bus.h. Programs and erases return as
+ * soon as the chip has the command; the next operation, or spi_flash_wait(),
+ * waits for it to finish. Data phases run on DMA.
+ */
+
+#define SPI_FLASH_PAGE_SIZE     (256U)      // Program granularity, a program never crosses one
+#define SPI_FLASH_SECTOR_SIZE   (4096U)     // Smallest erase
+
+#define SPI_FLASH_CMD_WRITE_ENABLE  (0x06U)
+#define SPI_FLASH_CMD_READ_STATUS   (0x05U)
+#define SPI_FLASH_CMD_READ_DATA     (0x03U)
+#define SPI_FLASH_CMD_PAGE_PROGRAM  (0x02U)
+#define SPI_FLASH_CMD_SECTOR_ERASE  (0x20U)
+#define SPI_FLASH_CMD_JEDEC_ID      (0x9FU)
+
+#define SPI_FLASH_STATUS_BUSY       (1U << 0)
+#define SPI_FLASH_STATUS_WEL        (1U << 1)
+
+/* Probes the JEDEC ID; false when no chip answers */
+bool spi_flash_setup(void);
+uint32_t spi_flash_size(void);
+
+bool spi_flash_is_busy(void);
+void spi_flash_wait(void);
+
+void spi_flash_read(uint32_t address, uint8_t* data, uint32_t length);
+void spi_flash_read_start(uint32_t address, uint8_t* data, uint32_t length);   // Done once !spi_flash_is_busy()
+void spi_flash_program(uint32_t address, const uint8_t* data, uint32_t length);
+void spi_flash_erase_sector(uint32_t address);
+
+#endif /* INC_SPI_FLASH_H */
@@ -3,11 +3,43 @@
 
 #include "common-defines.h"
 
-#define CPU_FREQ        (24000000)
 #define SYSTICK_FREQ    (1000)
 
-void system_setup(void);
+/* PLL profiles off the 8 MHz HSE; flash wait states, prefetch and SysTick follow a switch */
+typedef enum {
+    System_Clock_24MHz,
+    System_Clock_48MHz,
+    System_Clock_72MHz,
+    System_Clock_Count,
+} system_clock_t;
+
+/* Profile the application runs at; the bootloader switches to it before the jump */
+#ifndef SYSTEM_CLOCK_APP
+#define SYSTEM_CLOCK_APP System_Clock_24MHz
+#endif
+
+/* Listeners see every switch twice: before, to finish what runs off the old clock, and after, to retime */
+typedef enum {
+    System_Clock_Changing,
+    System_Clock_Changed,
+} system_clock_event_t;
+
+#define SYSTEM_CLOCK_LISTENERS_MAX (4U)
+
+void system_setup(system_clock_t clock);
+void system_set_clock(system_clock_t clock);
+system_clock_t system_get_clock(void);
+/* The profile running HCLK at ahb_hz, System_Clock_Count for none */
+system_clock_t system_clock_at(uint32_t ahb_hz);
+bool system_on_clock_change(void (*listener)(system_clock_event_t event));
+/* Milliseconds since system_setup(); both reads are atomic */
 uint64_t system_get_ticks(void);
+/* Microseconds since system_setup(), interpolated from the SysTick counter */
+uint64_t system_get_us(void);
+/* Busy waits on the DWT cycle counter, independent of SysTick; any uint32 micros, one second at a time */
+void system_delay_us(uint32_t micros);
 void system_delay_ms(uint64_t millis);
+/* Hands the core to the image whose vector table is at `address`; does not return */
+void system_jump(uint32_t address);
 
 #endif // INC_SYSTEM_H
\ No newline at end of file
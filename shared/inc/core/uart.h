@@ -2,12 +2,67 @@
 #define INC_UART_H
 
 #include "common-defines.h"
+#include "core/ring_buffer.h"
 
-void uart_setup(void);
+typedef enum {
+    UART_RX_Interrupt,      // RXNE interrupt copies each byte into the ring
+    UART_RX_DMA,            // circular DMA fills the ring, survives flash stalls
+} uart_rx_mode_t;
+
+typedef enum {
+    UART_TX_Blocking,       // uart_send() returns once the data is in the shift register
+    UART_TX_Interrupt,      // uart_send() queues, TXE interrupt drains (forwarding links)
+    UART_TX_DMA,            // uart_send() queues, DMA drains contiguous runs of the ring
+} uart_tx_mode_t;
+
+typedef struct {
+    uint32_t usart;         // USART1, USART2 or USART3
+    uint32_t baud_rate;
+    uart_rx_mode_t rx_mode;
+    uart_tx_mode_t tx_mode;
+    uint8_t* rx_data;       // Ring storage, size must be a power of two
+    uint32_t rx_size;
+    uint8_t* tx_data;       // Power of two as well, may be NULL with UART_TX_Blocking
+    uint32_t tx_size;
+    bool flow_control;      // RTS follows the RX ring watermarks, CTS gates TX
+    void (*rx_callback)(void);  // UART_RX_Interrupt only: called from the interrupt after each byte, may be NULL
+} uart_config_t;
+
+typedef struct {
+    uint32_t usart;
+    uint8_t instance;       // Index into the USART/DMA channel table in uart.c
+    uint32_t baud_rate;     // Re-applied when the system clock changes
+    uart_rx_mode_t rx_mode;
+    uart_tx_mode_t tx_mode;
+    bool flow_control;
+    void (*rx_callback)(void);
+    ring_buffer_t rx_buffer;
+    ring_buffer_t tx_buffer;
+    volatile uint32_t tx_dma_length;
+    volatile bool rx_overrun;   // Received bytes were lost, see uart_rx_overrun()
+} uart_t;
+
+/* Instances, one per USART; TX/RX pin setup is left to the caller. NULL on an unknown USART or bad ring storage */
+uart_t* uart_open(const uart_config_t* config);
+void uart_set_baud_rate(uart_t* uart, uint32_t baud_rate);
+void uart_send(uart_t* uart, const uint8_t* data, uint32_t length);
+void uart_flush(uart_t* uart);
+uint32_t uart_recv(uart_t* uart, uint8_t* data, uint32_t length);
+uint8_t uart_recv_byte(uart_t* uart);
+bool uart_available(uart_t* uart);
+/* True once since bytes were lost to a full ring or a USART overrun; a lapped DMA ring is emptied */
+bool uart_rx_overrun(uart_t* uart);
+
+/* Default link on USART2 */
+#define UART_DEFAULT_BAUD_RATE (115200U)
+
+/* flow_control takes PA1 (RTS) and PA0 (CTS) */
+void uart_setup(bool flow_control, uint32_t baud_rate);
 void uart_write(uint8_t *data, uint32_t length);
 void uart_write_byte(uint8_t data);
 uint32_t uart_read(uint8_t *data, uint32_t length);
 uint8_t uart_read_byte(void);
 bool uart_data_available(void);
+void uart_set_rx_callback(void (*callback)(void));
 
-#endif
\ No newline at end of file
+#endif
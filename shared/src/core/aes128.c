@@ -0,0 +1,146 @@
+#include "core/aes128.h"
+
+/*
+ * Encrypt-only AES-128 (CTR mode never needs the inverse cipher) using a
+ * single 1 KiB T-table. The other three tables are byte rotations of te0,
+ * which the Cortex-M3 barrel shifter applies for free, and the final round
+ * takes the S-box from byte 1 of each entry.
+ *
+ * Columns are held as little-endian words: row 0 in bits 0..7.
+ * te0[x] = {2*S[x], S[x], S[x], 3*S[x]}
+ */
+
+#define ROTL32(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+#define SBOX(x)      ((te0[(x)] >> 8) & 0xFFU)
+
+static const uint32_t te0[256] = {
+    0xa56363c6U, 0x847c7cf8U, 0x997777eeU, 0x8d7b7bf6U, 0x0df2f2ffU, 0xbd6b6bd6U,
+    0xb16f6fdeU, 0x54c5c591U, 0x50303060U, 0x03010102U, 0xa96767ceU, 0x7d2b2b56U,
+    0x19fefee7U, 0x62d7d7b5U, 0xe6abab4dU, 0x9a7676ecU, 0x45caca8fU, 0x9d82821fU,
+    0x40c9c989U, 0x877d7dfaU, 0x15fafaefU, 0xeb5959b2U, 0xc947478eU, 0x0bf0f0fbU,
+    0xecadad41U, 0x67d4d4b3U, 0xfda2a25fU, 0xeaafaf45U, 0xbf9c9c23U, 0xf7a4a453U,
+    0x967272e4U, 0x5bc0c09bU, 0xc2b7b775U, 0x1cfdfde1U, 0xae93933dU, 0x6a26264cU,
+    0x5a36366cU, 0x413f3f7eU, 0x02f7f7f5U, 0x4fcccc83U, 0x5c343468U, 0xf4a5a551U,
+    0x34e5e5d1U, 0x08f1f1f9U, 0x937171e2U, 0x73d8d8abU, 0x53313162U, 0x3f15152aU,
+    0x0c040408U, 0x52c7c795U, 0x65232346U, 0x5ec3c39dU, 0x28181830U, 0xa1969637U,
+    0x0f05050aU, 0xb59a9a2fU, 0x0907070eU, 0x36121224U, 0x9b80801bU, 0x3de2e2dfU,
+    0x26ebebcdU, 0x6927274eU, 0xcdb2b27fU, 0x9f7575eaU, 0x1b090912U, 0x9e83831dU,
+    0x742c2c58U, 0x2e1a1a34U, 0x2d1b1b36U, 0xb26e6edcU, 0xee5a5ab4U, 0xfba0a05bU,
+    0xf65252a4U, 0x4d3b3b76U, 0x61d6d6b7U, 0xceb3b37dU, 0x7b292952U, 0x3ee3e3ddU,
+    0x712f2f5eU, 0x97848413U, 0xf55353a6U, 0x68d1d1b9U, 0x00000000U, 0x2cededc1U,
+    0x60202040U, 0x1ffcfce3U, 0xc8b1b179U, 0xed5b5bb6U, 0xbe6a6ad4U, 0x46cbcb8dU,
+    0xd9bebe67U, 0x4b393972U, 0xde4a4a94U, 0xd44c4c98U, 0xe85858b0U, 0x4acfcf85U,
+    0x6bd0d0bbU, 0x2aefefc5U, 0xe5aaaa4fU, 0x16fbfbedU, 0xc5434386U, 0xd74d4d9aU,
+    0x55333366U, 0x94858511U, 0xcf45458aU, 0x10f9f9e9U, 0x06020204U, 0x817f7ffeU,
+    0xf05050a0U, 0x443c3c78U, 0xba9f9f25U, 0xe3a8a84bU, 0xf35151a2U, 0xfea3a35dU,
+    0xc0404080U, 0x8a8f8f05U, 0xad92923fU, 0xbc9d9d21U, 0x48383870U, 0x04f5f5f1U,
+    0xdfbcbc63U, 0xc1b6b677U, 0x75dadaafU, 0x63212142U, 0x30101020U, 0x1affffe5U,
+    0x0ef3f3fdU, 0x6dd2d2bfU, 0x4ccdcd81U, 0x140c0c18U, 0x35131326U, 0x2fececc3U,
+    0xe15f5fbeU, 0xa2979735U, 0xcc444488U, 0x3917172eU, 0x57c4c493U, 0xf2a7a755U,
+    0x827e7efcU, 0x473d3d7aU, 0xac6464c8U, 0xe75d5dbaU, 0x2b191932U, 0x957373e6U,
+    0xa06060c0U, 0x98818119U, 0xd14f4f9eU, 0x7fdcdca3U, 0x66222244U, 0x7e2a2a54U,
+    0xab90903bU, 0x8388880bU, 0xca46468cU, 0x29eeeec7U, 0xd3b8b86bU, 0x3c141428U,
+    0x79dedea7U, 0xe25e5ebcU, 0x1d0b0b16U, 0x76dbdbadU, 0x3be0e0dbU, 0x56323264U,
+    0x4e3a3a74U, 0x1e0a0a14U, 0xdb494992U, 0x0a06060cU, 0x6c242448U, 0xe45c5cb8U,
+    0x5dc2c29fU, 0x6ed3d3bdU, 0xefacac43U, 0xa66262c4U, 0xa8919139U, 0xa4959531U,
+    0x37e4e4d3U, 0x8b7979f2U, 0x32e7e7d5U, 0x43c8c88bU, 0x5937376eU, 0xb76d6ddaU,
+    0x8c8d8d01U, 0x64d5d5b1U, 0xd24e4e9cU, 0xe0a9a949U, 0xb46c6cd8U, 0xfa5656acU,
+    0x07f4f4f3U, 0x25eaeacfU, 0xaf6565caU, 0x8e7a7af4U, 0xe9aeae47U, 0x18080810U,
+    0xd5baba6fU, 0x887878f0U, 0x6f25254aU, 0x722e2e5cU, 0x241c1c38U, 0xf1a6a657U,
+    0xc7b4b473U, 0x51c6c697U, 0x23e8e8cbU, 0x7cdddda1U, 0x9c7474e8U, 0x211f1f3eU,
+    0xdd4b4b96U, 0xdcbdbd61U, 0x868b8b0dU, 0x858a8a0fU, 0x907070e0U, 0x423e3e7cU,
+    0xc4b5b571U, 0xaa6666ccU, 0xd8484890U, 0x05030306U, 0x01f6f6f7U, 0x120e0e1cU,
+    0xa36161c2U, 0x5f35356aU, 0xf95757aeU, 0xd0b9b969U, 0x91868617U, 0x58c1c199U,
+    0x271d1d3aU, 0xb99e9e27U, 0x38e1e1d9U, 0x13f8f8ebU, 0xb398982bU, 0x33111122U,
+    0xbb6969d2U, 0x70d9d9a9U, 0x898e8e07U, 0xa7949433U, 0xb69b9b2dU, 0x221e1e3cU,
+    0x92878715U, 0x20e9e9c9U, 0x49cece87U, 0xff5555aaU, 0x78282850U, 0x7adfdfa5U,
+    0x8f8c8c03U, 0xf8a1a159U, 0x80898909U, 0x170d0d1aU, 0xdabfbf65U, 0x31e6e6d7U,
+    0xc6424284U, 0xb86868d0U, 0xc3414182U, 0xb0999929U, 0x772d2d5aU, 0x110f0f1eU,
+    0xcbb0b07bU, 0xfc5454a8U, 0xd6bbbb6dU, 0x3a16162cU,
+};
+
+static uint32_t load_le32(const uint8_t* data) {
+    return ((uint32_t)data[0]) | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+static void store_le32(uint8_t* data, uint32_t value) {
+    data[0] = (uint8_t)(value);
+    data[1] = (uint8_t)(value >> 8);
+    data[2] = (uint8_t)(value >> 16);
+    data[3] = (uint8_t)(value >> 24);
+}
+
+static uint32_t sub_word(uint32_t w) {
+    return SBOX(w & 0xFFU) | (SBOX((w >> 8) & 0xFFU) << 8) | (SBOX((w >> 16) & 0xFFU) << 16) | (SBOX(w >> 24) << 24);
+}
+
+void aes128_setup(aes128_t* ctx, const uint8_t* key) {
+    uint32_t rcon = 0x01;
+
+    for (uint32_t i = 0; i < 4; i++) {
+        ctx->round_keys[i] = load_le32(&key[4*i]);
+    }
+    for (uint32_t i = 4; i < 44; i++) {
+        uint32_t t = ctx->round_keys[i - 1];
+        if ((i % 4) == 0) {
+            t = sub_word(ROTL32(t, 24)) ^ rcon;
+            rcon = (rcon << 1) ^ ((rcon & 0x80) ? 0x11B : 0x00);
+        }
+        ctx->round_keys[i] = ctx->round_keys[i - 4] ^ t;
+    }
+}
+
+void aes128_encrypt_block(const aes128_t* ctx, const uint8_t* input, uint8_t* output) {
+    const uint32_t* rk = ctx->round_keys;
+    uint32_t s0 = load_le32(&input[0])  ^ rk[0];
+    uint32_t s1 = load_le32(&input[4])  ^ rk[1];
+    uint32_t s2 = load_le32(&input[8])  ^ rk[2];
+    uint32_t s3 = load_le32(&input[12]) ^ rk[3];
+    uint32_t t0, t1, t2, t3;
+
+    /* SubBytes + ShiftRows + MixColumns: output column c takes row r from column c+r */
+    for (uint32_t round = 1; round < 10; round++) {
+        rk += 4;
+        t0 = te0[s0 & 0xFF] ^ ROTL32(te0[(s1 >> 8) & 0xFF], 8) ^ ROTL32(te0[(s2 >> 16) & 0xFF], 16) ^ ROTL32(te0[s3 >> 24], 24) ^ rk[0];
+        t1 = te0[s1 & 0xFF] ^ ROTL32(te0[(s2 >> 8) & 0xFF], 8) ^ ROTL32(te0[(s3 >> 16) & 0xFF], 16) ^ ROTL32(te0[s0 >> 24], 24) ^ rk[1];
+        t2 = te0[s2 & 0xFF] ^ ROTL32(te0[(s3 >> 8) & 0xFF], 8) ^ ROTL32(te0[(s0 >> 16) & 0xFF], 16) ^ ROTL32(te0[s1 >> 24], 24) ^ rk[2];
+        t3 = te0[s3 & 0xFF] ^ ROTL32(te0[(s0 >> 8) & 0xFF], 8) ^ ROTL32(te0[(s1 >> 16) & 0xFF], 16) ^ ROTL32(te0[s2 >> 24], 24) ^ rk[3];
+        s0 = t0; s1 = t1; s2 = t2; s3 = t3;
+    }
+
+    /* Final round has no MixColumns */
+    rk += 4;
+    t0 = SBOX(s0 & 0xFF) | (SBOX((s1 >> 8) & 0xFF) << 8) | (SBOX((s2 >> 16) & 0xFF) << 16) | (SBOX(s3 >> 24) << 24);
+    t1 = SBOX(s1 & 0xFF) | (SBOX((s2 >> 8) & 0xFF) << 8) | (SBOX((s3 >> 16) & 0xFF) << 16) | (SBOX(s0 >> 24) << 24);
+    t2 = SBOX(s2 & 0xFF) | (SBOX((s3 >> 8) & 0xFF) << 8) | (SBOX((s0 >> 16) & 0xFF) << 16) | (SBOX(s1 >> 24) << 24);
+    t3 = SBOX(s3 & 0xFF) | (SBOX((s0 >> 8) & 0xFF) << 8) | (SBOX((s1 >> 16) & 0xFF) << 16) | (SBOX(s2 >> 24) << 24);
+
+    store_le32(&output[0],  t0 ^ rk[0]);
+    store_le32(&output[4],  t1 ^ rk[1]);
+    store_le32(&output[8],  t2 ^ rk[2]);
+    store_le32(&output[12], t3 ^ rk[3]);
+}
+
+void aes128_ctr_crypt(const aes128_t* ctx, const uint8_t* nonce, uint32_t block_index, uint8_t* data, uint32_t length) {
+    uint8_t counter_block[AES128_BLOCK_LEN];
+    uint8_t keystream[AES128_BLOCK_LEN];
+    uint32_t counter = ((uint32_t)nonce[12] << 24) | ((uint32_t)nonce[13] << 16) | ((uint32_t)nonce[14] << 8) | nonce[15];
+
+    counter += block_index;
+    for (uint32_t i = 0; i < 12; i++) {
+        counter_block[i] = nonce[i];
+    }
+
+    for (uint32_t offset = 0; offset < length; offset += AES128_BLOCK_LEN) {
+        counter_block[12] = (uint8_t)(counter >> 24);
+        counter_block[13] = (uint8_t)(counter >> 16);
+        counter_block[14] = (uint8_t)(counter >> 8);
+        counter_block[15] = (uint8_t)(counter);
+        aes128_encrypt_block(ctx, counter_block, keystream);
+
+        for (uint32_t i = 0; (i < AES128_BLOCK_LEN) && (offset + i < length); i++) {
+            data[offset + i] ^= keystream[i];
+        }
+        counter++;
+    }
+}
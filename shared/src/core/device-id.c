@@ -0,0 +1,28 @@
+#include "core/device-id.h"
+
+#include <libopencm3/stm32/desig.h>
+
+
+uint16_t device_id_node_address(void) {
+    uint32_t uid[3];
+    desig_get_unique_id(uid);
+
+    const uint32_t folded = uid[0] ^ uid[1] ^ uid[2];
+    return (uint16_t) ((folded >> 16) ^ (folded & 0xFFFF));
+}
+
+void device_id_encode(uint8_t* fields, uint32_t flash_size, uint32_t page_size, uint32_t app_size) {
+    const uint16_t node_address = device_id_node_address();
+    const uint16_t flash_kib = (uint16_t) (flash_size / 1024U);
+
+    fields[0] = (node_address >> 8) & 0xFF;
+    fields[1] = node_address & 0xFF;
+    fields[2] = (flash_kib >> 8) & 0xFF;
+    fields[3] = flash_kib & 0xFF;
+    fields[4] = (page_size >> 8) & 0xFF;
+    fields[5] = page_size & 0xFF;
+    fields[6] = (app_size >> 24) & 0xFF;
+    fields[7] = (app_size >> 16) & 0xFF;
+    fields[8] = (app_size >> 8) & 0xFF;
+    fields[9] = app_size & 0xFF;
+}
@@ -0,0 +1,459 @@
+#include "core/ed25519.h"
+
+/*
+ * Compact Ed25519 verification derived from the public domain TweetNaCl.
+ * Field elements are 16 limbs of 16 bits held in int64_t, which keeps every
+ * product in a single UMULL/MLA sequence on the Cortex-M3.
+ */
+
+#define ED25519_MAX_MESSAGE_LEN (64U)
+
+typedef int64_t gf_t[16];
+
+static const gf_t gf0 = {0};
+static const gf_t gf1 = {1};
+static const gf_t D = {0x78a3, 0x1359, 0x4dca, 0x75eb, 0xd8ab, 0x4141, 0x0a4d, 0x0070, 0xe898, 0x7779, 0x4079, 0x8cc7, 0xfe73, 0x2b6f, 0x6cee, 0x5203};
+static const gf_t D2 = {0xf159, 0x26b2, 0x9b94, 0xebd6, 0xb156, 0x8283, 0x149a, 0x00e0, 0xd130, 0xeef3, 0x80f2, 0x198e, 0xfce7, 0x56df, 0xd9dc, 0x2406};
+static const gf_t X = {0xd51a, 0x8f25, 0x2d60, 0xc956, 0xa7b2, 0x9525, 0xc760, 0x692c, 0xdc5c, 0xfdd6, 0xe231, 0xc0a4, 0x53fe, 0xcd6e, 0x36d3, 0x2169};
+static const gf_t Y = {0x6658, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666};
+static const gf_t I = {0xa0b0, 0x4a0e, 0x1b27, 0xc4ee, 0xe478, 0xad2f, 0x1806, 0x2f43, 0xd7a7, 0x3dfb, 0x0099, 0x2b4d, 0xdf0b, 0x4fc1, 0x2480, 0x2b83};
+
+/* Group order L, little-endian */
+static const int64_t L[32] = {
+    0xed, 0xd3, 0xf5, 0x5c, 0x1a, 0x63, 0x12, 0x58, 0xd6, 0x9c, 0xf7, 0xa2, 0xde, 0xf9, 0xde, 0x14,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x10,
+};
+
+
+/* SHA-512, only needed for the Ed25519 challenge hash */
+
+static const uint64_t sha512_k[80] = {
+    0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL, 0xe9b5dba58189dbbcULL, 0x3956c25bf348b538ULL,
+    0x59f111f1b605d019ULL, 0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL, 0xd807aa98a3030242ULL, 0x12835b0145706fbeULL,
+    0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL, 0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL,
+    0xc19bf174cf692694ULL, 0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL, 0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL,
+    0x2de92c6f592b0275ULL, 0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL, 0x983e5152ee66dfabULL,
+    0xa831c66d2db43210ULL, 0xb00327c898fb213fULL, 0xbf597fc7beef0ee4ULL, 0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL,
+    0x06ca6351e003826fULL, 0x142929670a0e6e70ULL, 0x27b70a8546d22ffcULL, 0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL,
+    0x53380d139d95b3dfULL, 0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL, 0x92722c851482353bULL,
+    0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL, 0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL, 0xd192e819d6ef5218ULL,
+    0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL, 0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL,
+    0x2748774cdf8eeb99ULL, 0x34b0bcb5e19b48a8ULL, 0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL, 0x5b9cca4f7763e373ULL,
+    0x682e6ff3d6b2b8a3ULL, 0x748f82ee5defb2fcULL, 0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+    0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL, 0xc67178f2e372532bULL, 0xca273eceea26619cULL,
+    0xd186b8c721c0c207ULL, 0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL, 0x06f067aa72176fbaULL, 0x0a637dc5a2c898a6ULL,
+    0x113f9804bef90daeULL, 0x1b710b35131c471bULL, 0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL,
+    0x431d67c49c100d4cULL, 0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL, 0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL,
+};
+
+#define ROTR64(x, n) (((x) >> (n)) | ((x) << (64 - (n))))
+
+static void sha512_transform(uint64_t* state, const uint8_t* block) {
+    uint64_t w[16];
+    uint64_t v[8];
+
+    for (uint32_t i = 0; i < 8; i++) {
+        v[i] = state[i];
+    }
+    for (uint32_t i = 0; i < 16; i++) {
+        w[i] = 0;
+        for (uint32_t j = 0; j < 8; j++) {
+            w[i] = (w[i] << 8) | block[8*i + j];
+        }
+    }
+
+    for (uint32_t i = 0; i < 80; i++) {
+        if (i >= 16) {
+            const uint64_t w15 = w[(i - 15) & 15];
+            const uint64_t w2 = w[(i - 2) & 15];
+            w[i & 15] += (ROTR64(w15, 1) ^ ROTR64(w15, 8) ^ (w15 >> 7)) + w[(i - 7) & 15] +
+                         (ROTR64(w2, 19) ^ ROTR64(w2, 61) ^ (w2 >> 6));
+        }
+
+        const uint64_t t1 = v[7] + (ROTR64(v[4], 14) ^ ROTR64(v[4], 18) ^ ROTR64(v[4], 41)) +
+                            ((v[4] & v[5]) ^ (~v[4] & v[6])) + sha512_k[i] + w[i & 15];
+        const uint64_t t2 = (ROTR64(v[0], 28) ^ ROTR64(v[0], 34) ^ ROTR64(v[0], 39)) +
+                            ((v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]));
+        for (uint32_t j = 7; j > 0; j--) {
+            v[j] = v[j - 1];
+        }
+        v[4] += t1;
+        v[0] = t1 + t2;
+    }
+
+    for (uint32_t i = 0; i < 8; i++) {
+        state[i] += v[i];
+    }
+}
+
+static void sha512(uint8_t* digest, const uint8_t* data, uint32_t length) {
+    uint64_t state[8] = {
+        0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+        0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL, 0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL,
+    };
+    uint8_t block[128];
+    uint32_t offset = 0;
+
+    while (length - offset >= 128) {
+        sha512_transform(state, &data[offset]);
+        offset += 128;
+    }
+
+    /* Final one or two blocks with padding and the 128-bit big-endian bit length */
+    const uint32_t remaining = length - offset;
+    const uint32_t pad_blocks = (remaining < 112) ? 1 : 2;
+    for (uint32_t i = 0; i < 128 * pad_blocks; i++) {
+        uint8_t byte = 0;
+        if (i < remaining) {
+            byte = data[offset + i];
+        }
+        else if (i == remaining) {
+            byte = 0x80;
+        }
+        else if (i >= (128 * pad_blocks) - 8) {
+            byte = (uint8_t)(((uint64_t)length * 8) >> (8 * ((128 * pad_blocks) - 1 - i)));
+        }
+        block[i & 127] = byte;
+        if ((i & 127) == 127) {
+            sha512_transform(state, block);
+        }
+    }
+
+    for (uint32_t i = 0; i < 64; i++) {
+        digest[i] = (uint8_t)(state[i / 8] >> (8 * (7 - (i % 8))));
+    }
+}
+
+
+/* GF(2^255 - 19) arithmetic */
+
+static void gf_copy(gf_t o, const gf_t a) {
+    for (uint32_t i = 0; i < 16; i++) {
+        o[i] = a[i];
+    }
+}
+
+static void gf_carry(gf_t o) {
+    for (uint32_t i = 0; i < 16; i++) {
+        o[i] += (1LL << 16);
+        const int64_t c = o[i] >> 16;
+        if (i < 15) {
+            o[i + 1] += c - 1;
+        }
+        else {
+            o[0] += 38 * (c - 1);
+        }
+        o[i] -= c << 16;
+    }
+}
+
+static void gf_select(gf_t p, gf_t q, int64_t b) {
+    const int64_t mask = ~(b - 1);
+    for (uint32_t i = 0; i < 16; i++) {
+        const int64_t t = mask & (p[i] ^ q[i]);
+        p[i] ^= t;
+        q[i] ^= t;
+    }
+}
+
+static void gf_pack(uint8_t* o, const gf_t n) {
+    gf_t m, t;
+
+    gf_copy(t, n);
+    gf_carry(t);
+    gf_carry(t);
+    gf_carry(t);
+    for (uint32_t j = 0; j < 2; j++) {
+        m[0] = t[0] - 0xffed;
+        for (uint32_t i = 1; i < 15; i++) {
+            m[i] = t[i] - 0xffff - ((m[i - 1] >> 16) & 1);
+            m[i - 1] &= 0xffff;
+        }
+        m[15] = t[15] - 0x7fff - ((m[14] >> 16) & 1);
+        const int64_t b = (m[15] >> 16) & 1;
+        m[14] &= 0xffff;
+        gf_select(t, m, 1 - b);
+    }
+    for (uint32_t i = 0; i < 16; i++) {
+        o[2*i] = (uint8_t)(t[i] & 0xff);
+        o[2*i + 1] = (uint8_t)(t[i] >> 8);
+    }
+}
+
+static void gf_unpack(gf_t o, const uint8_t* n) {
+    for (uint32_t i = 0; i < 16; i++) {
+        o[i] = n[2*i] + ((int64_t)n[2*i + 1] << 8);
+    }
+    o[15] &= 0x7fff;
+}
+
+static bool bytes_equal(const uint8_t* a, const uint8_t* b, uint32_t length) {
+    uint8_t diff = 0;
+    for (uint32_t i = 0; i < length; i++) {
+        diff |= a[i] ^ b[i];
+    }
+    return (diff == 0);
+}
+
+static bool gf_equal(const gf_t a, const gf_t b) {
+    uint8_t c[32], d[32];
+    gf_pack(c, a);
+    gf_pack(d, b);
+    return bytes_equal(c, d, 32);
+}
+
+static uint8_t gf_parity(const gf_t a) {
+    uint8_t d[32];
+    gf_pack(d, a);
+    return d[0] & 1;
+}
+
+static void gf_add(gf_t o, const gf_t a, const gf_t b) {
+    for (uint32_t i = 0; i < 16; i++) {
+        o[i] = a[i] + b[i];
+    }
+}
+
+static void gf_sub(gf_t o, const gf_t a, const gf_t b) {
+    for (uint32_t i = 0; i < 16; i++) {
+        o[i] = a[i] - b[i];
+    }
+}
+
+static void gf_mul(gf_t o, const gf_t a, const gf_t b) {
+    int64_t t[31] = {0};
+
+    for (uint32_t i = 0; i < 16; i++) {
+        for (uint32_t j = 0; j < 16; j++) {
+            t[i + j] += a[i] * b[j];
+        }
+    }
+    for (uint32_t i = 0; i < 15; i++) {
+        t[i] += 38 * t[i + 16];
+    }
+    for (uint32_t i = 0; i < 16; i++) {
+        o[i] = t[i];
+    }
+    gf_carry(o);
+    gf_carry(o);
+}
+
+static void gf_square(gf_t o, const gf_t a) {
+    gf_mul(o, a, a);
+}
+
+static void gf_pow2523(gf_t o, const gf_t i) {
+    gf_t c;
+    gf_copy(c, i);
+    for (int32_t a = 250; a >= 0; a--) {
+        gf_square(c, c);
+        if (a != 1) {
+            gf_mul(c, c, i);
+        }
+    }
+    gf_copy(o, c);
+}
+
+static void gf_invert(gf_t o, const gf_t i) {
+    gf_t c;
+    gf_copy(c, i);
+    for (int32_t a = 253; a >= 0; a--) {
+        gf_square(c, c);
+        if ((a != 2) && (a != 4)) {
+            gf_mul(c, c, i);
+        }
+    }
+    gf_copy(o, c);
+}
+
+
+/* Extended twisted Edwards points (X, Y, Z, T) */
+
+static void point_add(gf_t p[4], gf_t q[4]) {
+    gf_t a, b, c, d, t, e, f, g, h;
+
+    gf_sub(a, p[1], p[0]);
+    gf_sub(t, q[1], q[0]);
+    gf_mul(a, a, t);
+    gf_add(b, p[0], p[1]);
+    gf_add(t, q[0], q[1]);
+    gf_mul(b, b, t);
+    gf_mul(c, p[3], q[3]);
+    gf_mul(c, c, D2);
+    gf_mul(d, p[2], q[2]);
+    gf_add(d, d, d);
+    gf_sub(e, b, a);
+    gf_sub(f, d, c);
+    gf_add(g, d, c);
+    gf_add(h, b, a);
+
+    gf_mul(p[0], e, f);
+    gf_mul(p[1], h, g);
+    gf_mul(p[2], g, f);
+    gf_mul(p[3], e, h);
+}
+
+static void point_swap(gf_t p[4], gf_t q[4], uint8_t b) {
+    for (uint32_t i = 0; i < 4; i++) {
+        gf_select(p[i], q[i], b);
+    }
+}
+
+static void point_pack(uint8_t* r, gf_t p[4]) {
+    gf_t tx, ty, zi;
+    gf_invert(zi, p[2]);
+    gf_mul(tx, p[0], zi);
+    gf_mul(ty, p[1], zi);
+    gf_pack(r, ty);
+    r[31] ^= gf_parity(tx) << 7;
+}
+
+static void point_scalarmult(gf_t p[4], gf_t q[4], const uint8_t* s) {
+    gf_copy(p[0], gf0);
+    gf_copy(p[1], gf1);
+    gf_copy(p[2], gf1);
+    gf_copy(p[3], gf0);
+    for (int32_t i = 255; i >= 0; i--) {
+        const uint8_t b = (s[i / 8] >> (i & 7)) & 1;
+        point_swap(p, q, b);
+        point_add(q, p);
+        point_add(p, p);
+        point_swap(p, q, b);
+    }
+}
+
+static void point_scalarbase(gf_t p[4], const uint8_t* s) {
+    gf_t q[4];
+    gf_copy(q[0], X);
+    gf_copy(q[1], Y);
+    gf_copy(q[2], gf1);
+    gf_mul(q[3], X, Y);
+    point_scalarmult(p, q, s);
+}
+
+/* Decode a point and negate it, so verification can compute s*B - h*A */
+static bool point_unpack_negate(gf_t r[4], const uint8_t* p) {
+    gf_t t, chk, num, den, den2, den4, den6;
+
+    gf_copy(r[2], gf1);
+    gf_unpack(r[1], p);
+    gf_square(num, r[1]);
+    gf_mul(den, num, D);
+    gf_sub(num, num, r[2]);
+    gf_add(den, r[2], den);
+
+    gf_square(den2, den);
+    gf_square(den4, den2);
+    gf_mul(den6, den4, den2);
+    gf_mul(t, den6, num);
+    gf_mul(t, t, den);
+
+    gf_pow2523(t, t);
+    gf_mul(t, t, num);
+    gf_mul(t, t, den);
+    gf_mul(t, t, den);
+    gf_mul(r[0], t, den);
+
+    gf_square(chk, r[0]);
+    gf_mul(chk, chk, den);
+    if (!gf_equal(chk, num)) {
+        gf_mul(r[0], r[0], I);
+    }
+
+    gf_square(chk, r[0]);
+    gf_mul(chk, chk, den);
+    if (!gf_equal(chk, num)) {
+        return false;
+    }
+
+    if (gf_parity(r[0]) == (p[31] >> 7)) {
+        gf_sub(r[0], gf0, r[0]);
+    }
+    gf_mul(r[3], r[0], r[1]);
+    return true;
+}
+
+
+/* Scalars modulo L */
+
+static void scalar_mod_l(uint8_t* r, int64_t* x) {
+    int64_t carry;
+    int32_t j;
+
+    for (int32_t i = 63; i >= 32; i--) {
+        carry = 0;
+        for (j = i - 32; j < i - 12; j++) {
+            x[j] += carry - 16 * x[i] * L[j - (i - 32)];
+            carry = (x[j] + 128) >> 8;
+            x[j] -= carry * 256;
+        }
+        x[j] += carry;
+        x[i] = 0;
+    }
+
+    carry = 0;
+    for (j = 0; j < 32; j++) {
+        x[j] += carry - (x[31] >> 4) * L[j];
+        carry = x[j] >> 8;
+        x[j] &= 255;
+    }
+    for (j = 0; j < 32; j++) {
+        x[j] -= carry * L[j];
+    }
+    for (j = 0; j < 32; j++) {
+        x[j + 1] += x[j] >> 8;
+        r[j] = (uint8_t)(x[j] & 255);
+    }
+}
+
+static void scalar_reduce(uint8_t* r) {
+    int64_t x[64];
+    for (uint32_t i = 0; i < 64; i++) {
+        x[i] = r[i];
+    }
+    scalar_mod_l(r, x);
+}
+
+static bool scalar_is_canonical(const uint8_t* s) {
+    /* Reject s >= L (signature malleability) */
+    for (int32_t i = 31; i >= 0; i--) {
+        if (s[i] != L[i]) {
+            return (s[i] < L[i]);
+        }
+    }
+    return false;
+}
+
+
+bool ed25519_verify(const uint8_t* signature, const uint8_t* message, uint32_t length, const uint8_t* public_key) {
+    uint8_t hash_input[ED25519_SIGNATURE_LEN / 2 + ED25519_PUBLIC_KEY_LEN + ED25519_MAX_MESSAGE_LEN];
+    uint8_t h[64];
+    uint8_t check[32];
+    gf_t p[4], q[4];
+
+    if ((length > ED25519_MAX_MESSAGE_LEN) || !scalar_is_canonical(&signature[32])) {
+        return false;
+    }
+    if (!point_unpack_negate(q, public_key)) {
+        return false;
+    }
+
+    /* h = SHA-512(R || A || M) mod L */
+    for (uint32_t i = 0; i < 32; i++) {
+        hash_input[i] = signature[i];
+        hash_input[32 + i] = public_key[i];
+    }
+    for (uint32_t i = 0; i < length; i++) {
+        hash_input[64 + i] = message[i];
+    }
+    sha512(h, hash_input, 64 + length);
+    scalar_reduce(h);
+
+    /* R' = s*B - h*A must encode to R */
+    point_scalarmult(p, q, h);
+    point_scalarbase(q, &signature[32]);
+    point_add(p, q);
+    point_pack(check, p);
+
+    return bytes_equal(signature, check, 32);
+}
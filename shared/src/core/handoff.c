@@ -0,0 +1,68 @@
+#include "core/handoff.h"
+#include "core/crc32.h"
+#include "core/memory-map.h"
+#include "core/system.h"
+
+#include <libopencm3/cm3/dwt.h>
+#include <libopencm3/cm3/scb.h>
+
+#define HANDOFF_BLOCK   ((handoff_t*) HANDOFF_ADDRESS)
+#define HANDOFF_REQUEST (*(volatile uint32_t*) (HANDOFF_ADDRESS + HANDOFF_SIZE - sizeof(uint32_t)))
+#define HANDOFF_CRC_LEN (sizeof(handoff_t) - sizeof(uint32_t))    // crc is the last field
+
+static handoff_t handoff = {0};
+static bool handoff_valid = false;
+static uint32_t boot_cycles = 0;
+
+
+void handoff_publish(handoff_t* block) {
+    // Enabled here so the application can measure from the jump without a debugger attached
+    dwt_enable_cycle_counter();
+
+    block->magic = HANDOFF_MAGIC;
+    block->version = HANDOFF_VERSION;
+    block->length = sizeof(handoff_t);
+    block->ticks = (uint32_t) system_get_ticks();
+    block->jump_cycles = dwt_read_cycle_counter();
+    block->crc = crc32((const uint8_t *) block, HANDOFF_CRC_LEN);
+    *HANDOFF_BLOCK = *block;
+}
+
+
+const handoff_t* handoff_take(void) {
+    const uint32_t now = dwt_read_cycle_counter();
+    const handoff_t* block = HANDOFF_BLOCK;
+
+    handoff_valid = (block->magic == HANDOFF_MAGIC) && (block->version == HANDOFF_VERSION) &&
+                    (block->length == sizeof(handoff_t)) &&
+                    (block->crc == crc32((const uint8_t *) block, HANDOFF_CRC_LEN));
+    if (!handoff_valid) {
+        return NULL;
+    }
+
+    handoff = *block;
+    boot_cycles = now - handoff.jump_cycles;
+    HANDOFF_BLOCK->magic = 0;
+    return &handoff;
+}
+
+
+uint32_t handoff_boot_us(void) {
+    const uint32_t cycles_per_us = handoff.ahb_hz / 1000000U;
+
+    return (handoff_valid && (cycles_per_us > 0U)) ? (boot_cycles / cycles_per_us) : 0;
+}
+
+
+void handoff_enter_bootloader(void) {
+    HANDOFF_REQUEST = HANDOFF_ENTER_BOOTLOADER;
+    scb_reset_system();
+}
+
+
+bool handoff_bootloader_requested(void) {
+    const bool requested = (HANDOFF_REQUEST == HANDOFF_ENTER_BOOTLOADER);
+
+    HANDOFF_REQUEST = 0;
+    return requested;
+}
@@ -0,0 +1,112 @@
+#include "core/image.h"
+#include "core/crc32.h"
+#include "core/memory-map.h"
+
+static uint16_t read_u16(const uint8_t* raw) {
+    return (uint16_t)(raw[0] | (raw[1] << 8));
+}
+
+static uint32_t read_u32(const uint8_t* raw) {
+    return ((uint32_t)raw[0]) | ((uint32_t)raw[1] << 8) | ((uint32_t)raw[2] << 16) | ((uint32_t)raw[3] << 24);
+}
+
+static bool segment_in_app_region(const image_segment_t* segment) {
+    const uint32_t app_end = APP_START_ADDRESS + APP_MAX_SIZE;
+    return (segment->address >= APP_START_ADDRESS) &&
+           (segment->length <= APP_MAX_SIZE) &&
+           (segment->address + segment->length <= app_end);
+}
+
+uint32_t image_signed_header_end(const image_header_t* header) {
+    if (header->flags & IMAGE_FLAG_SIGNED) {
+        return header->header_size - IMAGE_SIGNATURE_LEN;
+    }
+    return header->header_size;
+}
+
+uint32_t image_nonce_offset(const image_header_t* header) {
+    if (header->flags & IMAGE_FLAG_ENCRYPTED) {
+        return image_signed_header_end(header) - IMAGE_NONCE_LEN;
+    }
+    return image_signed_header_end(header);
+}
+
+static uint32_t image_min_header_size(const image_header_t* header) {
+    uint32_t min_size = IMAGE_HEADER_LEN + (header->segment_count * IMAGE_SEGMENT_LEN);
+    if (header->flags & IMAGE_FLAG_SIGNED) {
+        min_size += IMAGE_SIGNATURE_LEN;
+    }
+    if (header->flags & IMAGE_FLAG_ENCRYPTED) {
+        min_size += IMAGE_NONCE_LEN;
+    }
+    return min_size;
+}
+
+uint16_t image_peek_header_size(const uint8_t* raw) {
+    if (read_u32(&raw[0]) != IMAGE_MAGIC) {
+        return 0;
+    }
+    return read_u16(&raw[IMAGE_HEADER_SIZE_OFFSET]);
+}
+
+image_status_t image_parse(const uint8_t* raw, uint32_t length, image_header_t* header, image_segment_t* segments) {
+    if (length < IMAGE_HEADER_LEN) {
+        return Image_Status_BadSize;
+    }
+
+    header->magic          = read_u32(&raw[0]);
+    header->header_crc     = read_u32(&raw[4]);
+    header->header_version = read_u16(&raw[8]);
+    header->header_size    = read_u16(&raw[10]);
+    header->segment_count  = read_u16(&raw[12]);
+    header->flags          = read_u16(&raw[14]);
+    header->fw_version     = read_u32(&raw[16]);
+    header->build_id       = read_u32(&raw[20]);
+    header->load_address   = read_u32(&raw[24]);
+    header->image_size     = read_u32(&raw[28]);
+    header->image_crc      = read_u32(&raw[32]);
+
+    if (header->magic != IMAGE_MAGIC) {
+        return Image_Status_BadMagic;
+    }
+    if (header->header_version != IMAGE_HEADER_VERSION) {
+        return Image_Status_BadVersion;
+    }
+    if ((header->header_size > length) || 
+        (header->header_size > IMAGE_HEADER_MAX_SIZE) ||
+        (header->header_size % IMAGE_ALIGN) != 0 ||
+        (header->segment_count == 0) ||
+        (header->segment_count > IMAGE_MAX_SEGMENTS) ||
+        (image_min_header_size(header) > header->header_size)) 
+    {
+        return Image_Status_BadSize;
+    }
+    if (crc32(&raw[IMAGE_HEADER_CRC_OFFSET], header->header_size - IMAGE_HEADER_CRC_OFFSET) != header->header_crc) {
+        return Image_Status_BadCRC;
+    }
+
+    uint32_t total_length = 0;
+    uint32_t previous_end = APP_START_ADDRESS;
+    for (uint16_t i = 0; i < header->segment_count; i++) {
+        const uint8_t* entry = &raw[IMAGE_HEADER_LEN + (i * IMAGE_SEGMENT_LEN)];
+        segments[i].address = read_u32(&entry[0]);
+        segments[i].length  = read_u32(&entry[4]);
+        segments[i].crc     = read_u32(&entry[8]);
+
+        /* Segments must be ascending and non-overlapping */
+        if (((segments[i].length % IMAGE_ALIGN) != 0) || 
+            !segment_in_app_region(&segments[i]) ||
+            (segments[i].address < previous_end)) 
+        {
+            return Image_Status_BadSegment;
+        }
+        previous_end = segments[i].address + segments[i].length;
+        total_length += segments[i].length;
+    }
+
+    if ((total_length != header->image_size) || (header->load_address != APP_START_ADDRESS)) {
+        return Image_Status_BadSegment;
+    }
+
+    return Image_Status_Ok;
+}
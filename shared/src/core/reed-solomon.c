@@ -0,0 +1,187 @@
+#include "core/reed-solomon.h"
+
+/*
+ * Shortened Reed-Solomon code shared with fw_updater/reed_solomon.py (the bootloader only
+ * decodes, the native host library also encodes): field polynomial x^8 + x^4 + x^3 + x^2 + 1 (0x11D), generator roots alpha^0 ..
+ * alpha^(RS_PARITY_LEN-1), codeword[0] is the highest degree coefficient.
+ *
+ * Syndromes -> Berlekamp-Massey error locator -> Chien search -> Forney magnitudes.
+ * The exp table is doubled so products never need a modulo.
+ */
+
+#define GF_FIELD_POLY (0x11DU)
+#define GF_ORDER      (255U)
+
+static uint8_t gf_exp[2U * GF_ORDER];
+static uint8_t gf_log[256];
+
+
+static uint8_t gf_mul(uint8_t a, uint8_t b) {
+    if ((a == 0U) || (b == 0U)) {
+        return 0U;
+    }
+    return gf_exp[gf_log[a] + gf_log[b]];
+}
+
+
+static uint8_t gf_div(uint8_t a, uint8_t b) {
+    if (a == 0U) {
+        return 0U;
+    }
+    return gf_exp[gf_log[a] + GF_ORDER - gf_log[b]];
+}
+
+
+/* p(x) at x, coefficients lowest degree first */
+static uint8_t poly_eval(const uint8_t* poly, uint32_t terms, uint8_t x) {
+    uint8_t value = 0U;
+    for (uint32_t i = terms; i > 0U; i--) {
+        value = gf_mul(value, x) ^ poly[i - 1U];
+    }
+    return value;
+}
+
+
+void rs_setup(void) {
+    uint32_t x = 1U;
+    for (uint32_t i = 0; i < GF_ORDER; i++) {
+        gf_exp[i] = (uint8_t) x;
+        gf_exp[i + GF_ORDER] = (uint8_t) x;
+        gf_log[x] = (uint8_t) i;
+        x <<= 1;
+        if (x & 0x100U) {
+            x ^= GF_FIELD_POLY;
+        }
+    }
+}
+
+
+void rs_encode(const uint8_t* message, uint32_t length, uint8_t* parity) {
+    /* Generator (x - alpha^0) ... (x - alpha^(RS_PARITY_LEN-1)), highest degree first */
+    uint8_t generator[RS_PARITY_LEN + 1U] = {1U};
+    for (uint32_t j = 0; j < RS_PARITY_LEN; j++) {
+        for (uint32_t i = j + 1U; i > 0U; i--) {
+            generator[i] ^= gf_mul(generator[i - 1U], gf_exp[j]);
+        }
+    }
+
+    /* Remainder of message(x) * x^RS_PARITY_LEN divided by the generator */
+    for (uint32_t i = 0; i < RS_PARITY_LEN; i++) {
+        parity[i] = 0U;
+    }
+    for (uint32_t n = 0; n < length; n++) {
+        const uint8_t feedback = message[n] ^ parity[0];
+        for (uint32_t i = 0; i < (RS_PARITY_LEN - 1U); i++) {
+            parity[i] = parity[i + 1U] ^ gf_mul(generator[i + 1U], feedback);
+        }
+        parity[RS_PARITY_LEN - 1U] = gf_mul(generator[RS_PARITY_LEN], feedback);
+    }
+}
+
+
+int32_t rs_decode(uint8_t* codeword, uint32_t length) {
+    uint8_t syndromes[RS_PARITY_LEN];
+    bool clean = true;
+
+    for (uint32_t j = 0; j < RS_PARITY_LEN; j++) {
+        uint8_t s = 0U;
+        for (uint32_t i = 0; i < length; i++) {
+            s = gf_mul(s, gf_exp[j]) ^ codeword[i];
+        }
+        syndromes[j] = s;
+        clean = clean && (s == 0U);
+    }
+    if (clean) {
+        return 0;
+    }
+
+    /* Berlekamp-Massey */
+    uint8_t locator[RS_PARITY_LEN + 1U] = {1U};
+    uint8_t previous[RS_PARITY_LEN + 1U] = {1U};
+    uint32_t errors = 0U;
+    uint32_t shift = 1U;
+    uint8_t last_discrepancy = 1U;
+
+    for (uint32_t r = 0; r < RS_PARITY_LEN; r++) {
+        uint8_t d = syndromes[r];
+        for (uint32_t i = 1; i <= errors; i++) {
+            d ^= gf_mul(locator[i], syndromes[r - i]);
+        }
+        if (d == 0U) {
+            shift++;
+            continue;
+        }
+
+        const uint8_t scale = gf_div(d, last_discrepancy);
+        uint8_t updated[RS_PARITY_LEN + 1U];
+        for (uint32_t i = 0; i <= RS_PARITY_LEN; i++) {
+            updated[i] = locator[i];
+            if (i >= shift) {
+                updated[i] ^= gf_mul(scale, previous[i - shift]);
+            }
+        }
+
+        if ((2U * errors) <= r) {
+            for (uint32_t i = 0; i <= RS_PARITY_LEN; i++) {
+                previous[i] = locator[i];
+            }
+            errors = r + 1U - errors;
+            last_discrepancy = d;
+            shift = 1U;
+        }
+        else {
+            shift++;
+        }
+
+        for (uint32_t i = 0; i <= RS_PARITY_LEN; i++) {
+            locator[i] = updated[i];
+        }
+    }
+    if ((2U * errors) > RS_PARITY_LEN) {
+        return RS_UNCORRECTABLE;
+    }
+
+    /* Error evaluator: S(x) * locator(x) mod x^RS_PARITY_LEN */
+    uint8_t evaluator[RS_PARITY_LEN] = {0U};
+    for (uint32_t i = 0; i < RS_PARITY_LEN; i++) {
+        for (uint32_t j = 0; j <= i; j++) {
+            evaluator[i] ^= gf_mul(syndromes[j], locator[i - j]);
+        }
+    }
+
+    /* Formal derivative of the locator, only the odd terms survive in GF(2^8) */
+    uint8_t derivative[RS_PARITY_LEN] = {0U};
+    for (uint32_t i = 1; i <= RS_PARITY_LEN; i += 2U) {
+        derivative[i - 1U] = locator[i];
+    }
+
+    /* Chien search: a root at X^-1 marks an error at the position of power X */
+    uint32_t found = 0U;
+    uint32_t positions[RS_PARITY_LEN / 2U];
+    uint8_t magnitudes[RS_PARITY_LEN / 2U];
+
+    for (uint32_t position = 0; position < length; position++) {
+        const uint32_t power = length - 1U - position;
+        const uint8_t x_inv = gf_exp[(GF_ORDER - power) % GF_ORDER];
+        if (poly_eval(locator, RS_PARITY_LEN + 1U, x_inv) != 0U) {
+            continue;
+        }
+
+        const uint8_t denominator = poly_eval(derivative, RS_PARITY_LEN, x_inv);
+        if ((denominator == 0U) || (found == errors)) {
+            return RS_UNCORRECTABLE;
+        }
+        positions[found] = position;
+        magnitudes[found] = gf_mul(gf_exp[power], gf_div(poly_eval(evaluator, RS_PARITY_LEN, x_inv), denominator));
+        found++;
+    }
+    if (found != errors) {
+        return RS_UNCORRECTABLE;
+    }
+
+    /* Only touch the codeword once the whole error pattern is known */
+    for (uint32_t i = 0; i < found; i++) {
+        codeword[positions[i]] ^= magnitudes[i];
+    }
+    return (int32_t) found;
+}
@@ -0,0 +1,83 @@
+#include "core/scheduler.h"
+#include "core/system.h"
+
+#include <libopencm3/cm3/cortex.h>
+
+typedef struct {
+    scheduler_task_fn_t run;
+    uint32_t period_ms;
+    uint64_t next_run;
+    volatile bool posted;       // Byte stores are atomic, so interrupt handlers need no lock
+} scheduler_task_t;
+
+static scheduler_task_t tasks[SCHEDULER_MAX_TASKS];
+static uint8_t task_count = 0;
+
+
+static bool task_is_due(const scheduler_task_t* task, uint64_t now) {
+    return (task->period_ms > 0U) && (now >= task->next_run);
+}
+
+
+static bool task_is_ready(uint64_t now) {
+    for (uint8_t i = 0; i < task_count; i++) {
+        if (tasks[i].posted || task_is_due(&tasks[i], now)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+scheduler_task_id_t scheduler_add(scheduler_task_fn_t run, uint32_t period_ms) {
+    if (task_count == SCHEDULER_MAX_TASKS) {
+        return SCHEDULER_NO_TASK;
+    }
+
+    scheduler_task_t* task = &tasks[task_count];
+    task->run = run;
+    task->period_ms = period_ms;
+    task->next_run = system_get_ticks() + period_ms;
+    task->posted = false;
+    return task_count++;
+}
+
+
+void scheduler_post(scheduler_task_id_t task) {
+    if (task < task_count) {
+        tasks[task].posted = true;
+    }
+}
+
+
+void scheduler_run(void) {
+    while (true) {
+        const uint64_t now = system_get_ticks();
+
+        for (uint8_t i = 0; i < task_count; i++) {
+            scheduler_task_t* task = &tasks[i];
+            const bool due = task_is_due(task, now);
+
+            if (!task->posted && !due) {
+                continue;
+            }
+            // Cleared before the run, so a post from inside it runs the task again
+            task->posted = false;
+            if (due) {
+                // Keep the phase, but after a stall resume from now instead of running a burst of catch-ups
+                task->next_run += task->period_ms;
+                if (task->next_run <= now) {
+                    task->next_run = now + task->period_ms;
+                }
+            }
+            task->run();
+        }
+
+        // An interrupt arriving while masked stays pending and ends the WFI right away, so no post is missed
+        cm_disable_interrupts();
+        if (!task_is_ready(system_get_ticks())) {
+            __asm__ volatile ("wfi");
+        }
+        cm_enable_interrupts();
+    }
+}
@@ -0,0 +1,90 @@
+#include "core/sha256.h"
+
+#define ROTR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static const uint32_t k[64] = {
+    0x428a2f98U, 0x71374491U, 0xb5c0fbcfU, 0xe9b5dba5U, 0x3956c25bU, 0x59f111f1U, 0x923f82a4U, 0xab1c5ed5U,
+    0xd807aa98U, 0x12835b01U, 0x243185beU, 0x550c7dc3U, 0x72be5d74U, 0x80deb1feU, 0x9bdc06a7U, 0xc19bf174U,
+    0xe49b69c1U, 0xefbe4786U, 0x0fc19dc6U, 0x240ca1ccU, 0x2de92c6fU, 0x4a7484aaU, 0x5cb0a9dcU, 0x76f988daU,
+    0x983e5152U, 0xa831c66dU, 0xb00327c8U, 0xbf597fc7U, 0xc6e00bf3U, 0xd5a79147U, 0x06ca6351U, 0x14292967U,
+    0x27b70a85U, 0x2e1b2138U, 0x4d2c6dfcU, 0x53380d13U, 0x650a7354U, 0x766a0abbU, 0x81c2c92eU, 0x92722c85U,
+    0xa2bfe8a1U, 0xa81a664bU, 0xc24b8b70U, 0xc76c51a3U, 0xd192e819U, 0xd6990624U, 0xf40e3585U, 0x106aa070U,
+    0x19a4c116U, 0x1e376c08U, 0x2748774cU, 0x34b0bcb5U, 0x391c0cb3U, 0x4ed8aa4aU, 0x5b9cca4fU, 0x682e6ff3U,
+    0x748f82eeU, 0x78a5636fU, 0x84c87814U, 0x8cc70208U, 0x90befffaU, 0xa4506cebU, 0xbef9a3f7U, 0xc67178f2U,
+};
+
+static void sha256_transform(sha256_t* ctx, const uint8_t* block) {
+    uint32_t w[16];
+    uint32_t a = ctx->state[0], b = ctx->state[1], c = ctx->state[2], d = ctx->state[3];
+    uint32_t e = ctx->state[4], f = ctx->state[5], g = ctx->state[6], h = ctx->state[7];
+
+    for (uint32_t i = 0; i < 16; i++) {
+        w[i] = ((uint32_t)block[4*i] << 24) | ((uint32_t)block[4*i + 1] << 16) | ((uint32_t)block[4*i + 2] << 8) | block[4*i + 3];
+    }
+
+    /* Message schedule kept as a rolling 16-word window to save RAM */
+    for (uint32_t i = 0; i < 64; i++) {
+        if (i >= 16) {
+            const uint32_t w15 = w[(i - 15) & 15];
+            const uint32_t w2 = w[(i - 2) & 15];
+            const uint32_t s0 = ROTR32(w15, 7) ^ ROTR32(w15, 18) ^ (w15 >> 3);
+            const uint32_t s1 = ROTR32(w2, 17) ^ ROTR32(w2, 19) ^ (w2 >> 10);
+            w[i & 15] += s0 + w[(i - 7) & 15] + s1;
+        }
+
+        const uint32_t t1 = h + (ROTR32(e, 6) ^ ROTR32(e, 11) ^ ROTR32(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i & 15];
+        const uint32_t t2 = (ROTR32(a, 2) ^ ROTR32(a, 13) ^ ROTR32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+
+    ctx->state[0] += a; ctx->state[1] += b; ctx->state[2] += c; ctx->state[3] += d;
+    ctx->state[4] += e; ctx->state[5] += f; ctx->state[6] += g; ctx->state[7] += h;
+}
+
+void sha256_init(sha256_t* ctx) {
+    ctx->state[0] = 0x6a09e667U;
+    ctx->state[1] = 0xbb67ae85U;
+    ctx->state[2] = 0x3c6ef372U;
+    ctx->state[3] = 0xa54ff53aU;
+    ctx->state[4] = 0x510e527fU;
+    ctx->state[5] = 0x9b05688cU;
+    ctx->state[6] = 0x1f83d9abU;
+    ctx->state[7] = 0x5be0cd19U;
+    ctx->length = 0;
+    ctx->block_len = 0;
+}
+
+void sha256_update(sha256_t* ctx, const uint8_t* data, uint32_t length) {
+    ctx->length += length;
+
+    for (uint32_t i = 0; i < length; i++) {
+        ctx->block[ctx->block_len++] = data[i];
+        if (ctx->block_len == SHA256_BLOCK_LEN) {
+            sha256_transform(ctx, ctx->block);
+            ctx->block_len = 0;
+        }
+    }
+}
+
+void sha256_final(sha256_t* ctx, uint8_t* digest) {
+    const uint64_t bit_length = ctx->length * 8;
+    const uint8_t pad_start = 0x80;
+    const uint8_t pad_zero = 0x00;
+
+    sha256_update(ctx, &pad_start, 1);
+    while (ctx->block_len != (SHA256_BLOCK_LEN - 8)) {
+        sha256_update(ctx, &pad_zero, 1);
+    }
+    for (int32_t i = 7; i >= 0; i--) {
+        ctx->block[ctx->block_len++] = (uint8_t)(bit_length >> (8 * i));
+    }
+    sha256_transform(ctx, ctx->block);
+
+    for (uint32_t i = 0; i < 8; i++) {
+        digest[4*i]     = (uint8_t)(ctx->state[i] >> 24);
+        digest[4*i + 1] = (uint8_t)(ctx->state[i] >> 16);
+        digest[4*i + 2] = (uint8_t)(ctx->state[i] >> 8);
+        digest[4*i + 3] = (uint8_t)(ctx->state[i]);
+    }
+}
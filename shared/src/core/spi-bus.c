@@ -0,0 +1,130 @@
+#include "core/spi-bus.h"
+#include "core/system.h"
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/spi.h>
+#include <libopencm3/stm32/dma.h>
+
+/* SPI1 on PA4 (chip select, driven as a GPIO) / PA5 / PA6 / PA7, DMA1 channels 2 (RX) and 3 (TX).
+ * Completion is polled: the interrupts of those channels belong to USART3 in uart.c. */
+#define SPI_BUS_PORT        (GPIOA)
+#define SPI_BUS_CS_PIN      (GPIO_SPI1_NSS)
+#define SPI_BUS_RX_CHANNEL  (DMA_CHANNEL2)
+#define SPI_BUS_TX_CHANNEL  (DMA_CHANNEL3)
+#define SPI_BUS_MAX_HZ      (18000000U)     // SPI1 limit in the F103 datasheet
+
+static const uint8_t dummy_tx = 0xFFU;
+static uint8_t dummy_rx = 0U;
+static bool clock_listener_added = false;
+
+
+static void dma_channel_setup(uint8_t channel, const uint8_t* buffer, uint32_t length, bool from_memory) {
+    dma_channel_reset(DMA1, channel);
+    dma_set_peripheral_address(DMA1, channel, (uint32_t) &SPI_DR(SPI1));
+    dma_set_peripheral_size(DMA1, channel, DMA_CCR_PSIZE_8BIT);
+    dma_set_memory_size(DMA1, channel, DMA_CCR_MSIZE_8BIT);
+    dma_set_priority(DMA1, channel, DMA_CCR_PL_VERY_HIGH);
+    dma_set_number_of_data(DMA1, channel, (uint16_t) length);
+
+    if (buffer != 0) {
+        dma_set_memory_address(DMA1, channel, (uint32_t) buffer);
+        dma_enable_memory_increment_mode(DMA1, channel);
+    }
+    else {
+        dma_set_memory_address(DMA1, channel, from_memory ? (uint32_t) &dummy_tx : (uint32_t) &dummy_rx);
+    }
+
+    if (from_memory) {
+        dma_set_read_from_memory(DMA1, channel);
+    }
+    else {
+        dma_set_read_from_peripheral(DMA1, channel);
+    }
+}
+
+
+/* Smallest PCLK2 divider (2^(n+1)) that keeps SCK within the part's limit: 12 MHz at 24 and 48 MHz, 18 MHz at 72 MHz */
+static uint8_t baudrate_prescaler(void) {
+    uint8_t prescaler = SPI_CR1_BR_FPCLK_DIV_2;
+
+    while (((rcc_apb2_frequency >> (prescaler + 1U)) > SPI_BUS_MAX_HZ) && (prescaler < SPI_CR1_BR_FPCLK_DIV_256)) {
+        prescaler++;
+    }
+    return prescaler;
+}
+
+
+/* Transfers are synchronous, so nothing is in flight when the clock changes */
+static void clock_changed(system_clock_event_t event) {
+    if (event == System_Clock_Changed) {
+        spi_disable(SPI1);
+        spi_set_baudrate_prescaler(SPI1, baudrate_prescaler());
+        spi_enable(SPI1);
+    }
+}
+
+
+void spi_bus_setup(void) {
+    rcc_periph_clock_enable(RCC_GPIOA);
+    rcc_periph_clock_enable(RCC_AFIO);
+    rcc_periph_clock_enable(RCC_SPI1);
+    rcc_periph_clock_enable(RCC_DMA1);
+
+    gpio_set(SPI_BUS_PORT, SPI_BUS_CS_PIN);
+    gpio_set_mode(SPI_BUS_PORT, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_PUSHPULL, SPI_BUS_CS_PIN);                    // PA4 -> CS
+    gpio_set_mode(SPI_BUS_PORT, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_ALTFN_PUSHPULL, GPIO_SPI1_SCK | GPIO_SPI1_MOSI); // PA5, PA7
+    gpio_set_mode(SPI_BUS_PORT, GPIO_MODE_INPUT, GPIO_CNF_INPUT_FLOAT, GPIO_SPI1_MISO);                               // PA6
+
+    // Mode 0, at most 18 MHz, well inside what W25Qxx parts take for plain reads
+    rcc_periph_reset_pulse(RST_SPI1);
+    spi_init_master(SPI1, (uint32_t) baudrate_prescaler() << 3, SPI_CR1_CPOL_CLK_TO_0_WHEN_IDLE,
+                    SPI_CR1_CPHA_CLK_TRANSITION_1, SPI_CR1_DFF_8BIT, SPI_CR1_MSBFIRST);
+    spi_enable_software_slave_management(SPI1);
+    spi_set_nss_high(SPI1);
+    spi_enable_rx_dma(SPI1);
+    spi_enable_tx_dma(SPI1);
+    spi_enable(SPI1);
+    if (!clock_listener_added) {
+        clock_listener_added = system_on_clock_change(clock_changed);
+    }
+}
+
+
+void spi_bus_select(void) {
+    gpio_clear(SPI_BUS_PORT, SPI_BUS_CS_PIN);
+}
+
+
+void spi_bus_deselect(void) {
+    gpio_set(SPI_BUS_PORT, SPI_BUS_CS_PIN);
+}
+
+
+void spi_bus_transfer(const uint8_t* tx, uint8_t* rx, uint32_t length) {
+    // Drop whatever a previous transfer left in the receive register
+    (void) SPI_DR(SPI1);
+
+    dma_channel_setup(SPI_BUS_RX_CHANNEL, rx, length, false);
+    dma_channel_setup(SPI_BUS_TX_CHANNEL, tx, length, true);
+
+    // RX first, so it is armed before the first byte is clocked
+    dma_enable_channel(DMA1, SPI_BUS_RX_CHANNEL);
+    dma_enable_channel(DMA1, SPI_BUS_TX_CHANNEL);
+}
+
+
+bool spi_bus_busy(void) {
+    // The last received byte completes the transfer, TX is done by then
+    if ((DMA_CCR(DMA1, SPI_BUS_RX_CHANNEL) & DMA_CCR_EN) == 0U) {
+        return false;
+    }
+    if (!dma_get_interrupt_flag(DMA1, SPI_BUS_RX_CHANNEL, DMA_TCIF)) {
+        return true;
+    }
+
+    dma_clear_interrupt_flags(DMA1, SPI_BUS_RX_CHANNEL, DMA_TCIF);
+    dma_clear_interrupt_flags(DMA1, SPI_BUS_TX_CHANNEL, DMA_TCIF);
+    dma_disable_channel(DMA1, SPI_BUS_RX_CHANNEL);
+    dma_disable_channel(DMA1, SPI_BUS_TX_CHANNEL);
+    return false;
+}
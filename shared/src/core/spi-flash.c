@@ -0,0 +1,140 @@
+#include "core/spi-flash.h"
+#include "core/spi-bus.h"
+
+#define SPI_FLASH_HEADER_LEN        (4U)    // Opcode and 24 bit address
+#define SPI_FLASH_MIN_SIZE_LOG2     (16U)
+#define SPI_FLASH_MAX_SIZE_LOG2     (24U)   // 3 byte addressing ends at 16 MiB
+
+static uint32_t flash_size = 0;
+static bool transfer_open = false;      /* A DMA data phase still holds chip select */
+static uint8_t page_buffer[SPI_FLASH_PAGE_SIZE];
+
+
+static void transfer_blocking(const uint8_t* tx, uint8_t* rx, uint32_t length) {
+    spi_bus_transfer(tx, rx, length);
+    while (spi_bus_busy()) {}
+}
+
+
+/* Selects the chip and sends the opcode, and the address when the command takes one */
+static void command(uint8_t opcode, uint32_t address, uint32_t header_len) {
+    const uint8_t header[SPI_FLASH_HEADER_LEN] = {
+        opcode,
+        (address >> 16) & 0xFF,
+        (address >> 8) & 0xFF,
+        address & 0xFF,
+    };
+    spi_bus_select();
+    transfer_blocking(header, 0, header_len);
+}
+
+
+static uint8_t read_status(void) {
+    const uint8_t tx[2] = {SPI_FLASH_CMD_READ_STATUS, 0xFFU};
+    uint8_t rx[2] = {0U};
+
+    spi_bus_select();
+    transfer_blocking(tx, rx, sizeof(tx));
+    spi_bus_deselect();
+    return rx[1];
+}
+
+
+static void write_enable(void) {
+    spi_flash_wait();
+    command(SPI_FLASH_CMD_WRITE_ENABLE, 0, 1U);
+    spi_bus_deselect();
+}
+
+
+bool spi_flash_setup(void) {
+    const uint8_t tx[4] = {SPI_FLASH_CMD_JEDEC_ID, 0xFFU, 0xFFU, 0xFFU};
+    uint8_t id[4] = {0U};
+
+    spi_bus_deselect();
+    transfer_open = false;
+
+    spi_bus_select();
+    transfer_blocking(tx, id, sizeof(tx));
+    spi_bus_deselect();
+
+    // [manufacturer][memory type][capacity, log2 of the size in bytes]; a floating bus reads 0x00 or 0xFF
+    if ((id[1] == 0x00U) || (id[1] == 0xFFU) || (id[3] < SPI_FLASH_MIN_SIZE_LOG2) || (id[3] > SPI_FLASH_MAX_SIZE_LOG2)) {
+        flash_size = 0;
+        return false;
+    }
+    flash_size = 1UL << id[3];
+    return true;
+}
+
+
+uint32_t spi_flash_size(void) {
+    return flash_size;
+}
+
+
+bool spi_flash_is_busy(void) {
+    if (transfer_open) {
+        if (spi_bus_busy()) {
+            return true;
+        }
+        // Raising chip select is what starts a program
+        spi_bus_deselect();
+        transfer_open = false;
+    }
+    return (read_status() & SPI_FLASH_STATUS_BUSY) != 0U;
+}
+
+
+void spi_flash_wait(void) {
+    while (spi_flash_is_busy()) {}
+}
+
+
+void spi_flash_read_start(uint32_t address, uint8_t* data, uint32_t length) {
+    spi_flash_wait();
+    if (length == 0U) {
+        return;
+    }
+    command(SPI_FLASH_CMD_READ_DATA, address, SPI_FLASH_HEADER_LEN);
+    spi_bus_transfer(0, data, length);
+    transfer_open = true;
+}
+
+
+void spi_flash_read(uint32_t address, uint8_t* data, uint32_t length) {
+    spi_flash_read_start(address, data, length);
+    if (transfer_open) {
+        while (spi_bus_busy()) {}
+        spi_bus_deselect();
+        transfer_open = false;
+    }
+}
+
+
+void spi_flash_program(uint32_t address, const uint8_t* data, uint32_t length) {
+    while (length > 0U) {
+        const uint32_t page_left = SPI_FLASH_PAGE_SIZE - (address % SPI_FLASH_PAGE_SIZE);
+        const uint32_t chunk = (length < page_left) ? length : page_left;
+
+        // Waits for the previous page, so page_buffer is free again
+        write_enable();
+        for (uint32_t i = 0; i < chunk; i++) {
+            page_buffer[i] = data[i];
+        }
+        command(SPI_FLASH_CMD_PAGE_PROGRAM, address, SPI_FLASH_HEADER_LEN);
+        spi_bus_transfer(page_buffer, 0, chunk);
+        transfer_open = true;
+
+        address += chunk;
+        data += chunk;
+        length -= chunk;
+    }
+}
+
+
+void spi_flash_erase_sector(uint32_t address) {
+    write_enable();
+    command(SPI_FLASH_CMD_SECTOR_ERASE, address, SPI_FLASH_HEADER_LEN);
+    spi_bus_deselect();
+}
@@ -1,35 +1,188 @@
 #include "core/system.h"
 
+#include <libopencm3/cm3/cortex.h>
+#include <libopencm3/cm3/dwt.h>
+#include <libopencm3/cm3/scb.h>
 #include <libopencm3/cm3/systick.h>
 #include <libopencm3/cm3/vector.h>
 #include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/flash.h>
 
 
+#define US_PER_MS       (1000U)
+#define US_PER_S        (1000000U)
+
 static volatile uint64_t ms_ticks = 0;
+static uint32_t cycles_per_us = 8U;     // HSI until system_setup()
 void sys_tick_handler(void) {
     ms_ticks++;
 }
 
-static void rcc_setup(void) {
-    rcc_clock_setup_pll(&rcc_hse_configs[RCC_CLOCK_HSE8_24MHZ]);
+/* libopencm3's F1 table has no 48 MHz entry: HSE8 x6, APB1 halved to stay under 36 MHz, USB straight off the PLL */
+static const struct rcc_clock_scale rcc_hse8_48mhz = {
+    .pll_mul = RCC_CFGR_PLLMUL_PLL_CLK_MUL6,
+    .pll_source = RCC_CFGR_PLLSRC_HSE_CLK,
+    .hpre = RCC_CFGR_HPRE_NODIV,
+    .ppre1 = RCC_CFGR_PPRE_DIV2,
+    .ppre2 = RCC_CFGR_PPRE_NODIV,
+    .adcpre = RCC_CFGR_ADCPRE_DIV4,
+    .flash_waitstates = 1,
+    .prediv1 = RCC_CFGR2_PREDIV_NODIV,
+    .usbpre = RCC_CFGR_USBPRE_PLL_CLK_NODIV,
+    .ahb_frequency = 48000000,
+    .apb1_frequency = 24000000,
+    .apb2_frequency = 48000000,
+};
+
+static const struct rcc_clock_scale* const clock_profiles[System_Clock_Count] = {
+    &rcc_hse_configs[RCC_CLOCK_HSE8_24MHZ],
+    &rcc_hse8_48mhz,
+    &rcc_hse_configs[RCC_CLOCK_HSE8_72MHZ],
+};
+
+static system_clock_t current_clock = System_Clock_Count;
+static void (*clock_listeners[SYSTEM_CLOCK_LISTENERS_MAX])(system_clock_event_t event);
+static uint8_t clock_listener_count = 0;
+
+#define RCC_CFGR_PLL_CONFIG (RCC_CFGR_PLLMUL | RCC_CFGR_PLLXTPRE | RCC_CFGR_PLLSRC | \
+                             RCC_CFGR_PPRE2 | RCC_CFGR_PPRE1 | RCC_CFGR_HPRE | RCC_CFGR_SWS)
+
+/* The bootloader already locked the PLL for `clock` and runs from it: nothing to wait for */
+static bool rcc_is_configured(const struct rcc_clock_scale* clock) {
+    const uint32_t expected = (clock->pll_mul << RCC_CFGR_PLLMUL_SHIFT) |
+                              ((clock->prediv1 & 1U) ? RCC_CFGR_PLLXTPRE : 0U) |
+                              ((clock->pll_source == RCC_CFGR_PLLSRC_HSE_CLK) ? RCC_CFGR_PLLSRC : 0U) |
+                              (clock->ppre2 << RCC_CFGR_PPRE2_SHIFT) |
+                              (clock->ppre1 << RCC_CFGR_PPRE1_SHIFT) |
+                              (clock->hpre << RCC_CFGR_HPRE_SHIFT) |
+                              (RCC_CFGR_SWS_SYSCLKSEL_PLLCLK << RCC_CFGR_SWS_SHIFT);
+
+    return (RCC_CR & RCC_CR_PLLRDY) && ((RCC_CFGR & RCC_CFGR_PLL_CONFIG) == expected);
 }
 
-static void systick_setup(void) {
-    systick_set_frequency(SYSTICK_FREQ, CPU_FREQ);
-    systick_counter_enable();
-    systick_interrupt_enable();
+/* Locks the PLL for `clock` unless it already runs that way, e.g. as the bootloader left it */
+static void rcc_setup(const struct rcc_clock_scale* clock) {
+    if (rcc_is_configured(clock)) {
+        rcc_ahb_frequency = clock->ahb_frequency;
+        rcc_apb1_frequency = clock->apb1_frequency;
+        rcc_apb2_frequency = clock->apb2_frequency;
+        return;
+    }
+
+    // PLL factors only take while it is off, so run from HSI in between. At 8 MHz any wait state count is safe,
+    // and prefetch may only be switched with SYSCLK under 24 MHz; it stays on for every profile
+    rcc_osc_on(RCC_HSI);
+    rcc_wait_for_osc_ready(RCC_HSI);
+    rcc_set_sysclk_source(RCC_CFGR_SW_SYSCLKSEL_HSICLK);
+    while (rcc_system_clock_source() != RCC_CFGR_SWS_SYSCLKSEL_HSICLK) {}
+    rcc_osc_off(RCC_PLL);
+    while (RCC_CR & RCC_CR_PLLRDY) {}
+    flash_prefetch_enable();
+
+    // Sets the new wait states while still on HSI, then switches SYSCLK over to the PLL
+    rcc_clock_setup_pll(clock);
+}
+
+static void notify_clock_listeners(system_clock_event_t event) {
+    for (uint8_t i = 0; i < clock_listener_count; i++) {
+        clock_listeners[i](event);
+    }
 }
 
+/* Two loads on the Cortex-M3: SysTick must not bump the high word in between */
 uint64_t system_get_ticks(void) {
-    return ms_ticks;
+    const uint32_t masked = cm_mask_interrupts(1);
+    const uint64_t ticks = ms_ticks;
+    cm_mask_interrupts(masked);
+    return ticks;
+}
+
+/* The milliseconds plus how far SysTick has counted down into the current one. With interrupts masked, a reload
+ * the handler has not counted yet shows as a pending SysTick exception; the counter is read again after it */
+uint64_t system_get_us(void) {
+    const uint32_t masked = cm_mask_interrupts(1);
+    uint64_t millis = ms_ticks;
+    uint32_t value = systick_get_value();
+
+    if (SCB_ICSR & SCB_ICSR_PENDSTSET) {
+        millis++;
+        value = systick_get_value();
+    }
+    const uint32_t elapsed = systick_get_reload() - value;
+    cm_mask_interrupts(masked);
+
+    return (millis * US_PER_MS) + (elapsed / cycles_per_us);
+}
+
+void system_set_clock(system_clock_t clock) {
+    if ((clock >= System_Clock_Count) || (clock == current_clock)) {
+        return;
+    }
+
+    notify_clock_listeners(System_Clock_Changing);
+    rcc_setup(clock_profiles[clock]);
+    systick_set_frequency(SYSTICK_FREQ, rcc_ahb_frequency);
+    cycles_per_us = rcc_ahb_frequency / 1000000U;
+    current_clock = clock;
+    notify_clock_listeners(System_Clock_Changed);
+}
+
+system_clock_t system_clock_at(uint32_t ahb_hz) {
+    system_clock_t clock = 0;
+
+    while ((clock < System_Clock_Count) && (clock_profiles[clock]->ahb_frequency != ahb_hz)) {
+        clock++;
+    }
+    return clock;
 }
 
-void system_setup(void) {
-    rcc_setup();
-    systick_setup();
+system_clock_t system_get_clock(void) {
+    return current_clock;
+}
+
+bool system_on_clock_change(void (*listener)(system_clock_event_t event)) {
+    if (clock_listener_count == SYSTEM_CLOCK_LISTENERS_MAX) {
+        return false;
+    }
+    clock_listeners[clock_listener_count++] = listener;
+    return true;
+}
+
+void system_setup(system_clock_t clock) {
+    dwt_enable_cycle_counter();
+    system_set_clock(clock);
+    systick_counter_enable();
+    systick_interrupt_enable();
+}
+
+/* Counts DWT cycles, so it also works with interrupts masked or SysTick stopped */
+void system_delay_us(uint32_t micros) {
+    // A second of cycles fits 32 bits at any profile, longer waits would wrap the product and end early
+    while (micros > 0U) {
+        const uint32_t chunk = (micros > US_PER_S) ? US_PER_S : micros;
+        const uint32_t start = dwt_read_cycle_counter();
+        const uint32_t cycles = chunk * cycles_per_us;
+
+        while ((dwt_read_cycle_counter() - start) < cycles) {}
+        micros -= chunk;
+    }
 }
 
 void system_delay_ms(uint64_t millis) {
-    uint64_t now = system_get_ticks();
-    while (system_get_ticks() < now + millis);
+    for (; millis > 0U; millis--) {
+        system_delay_us(US_PER_MS);
+    }
+}
+
+/* Loads the stack pointer and reset vector from the vector table at `address` and branches there */
+void system_jump(uint32_t address) {
+    const uint32_t stack = *(uint32_t *) address;
+    const uint32_t reset_vector = *(uint32_t *) (address + 4U);
+
+    SCB_VTOR = address;
+    __asm__ volatile (
+        "msr msp, %0\n"
+        "bx %1\n"
+        : : "r" (stack), "r" (reset_vector) : "memory"
+    );
 }
\ No newline at end of file
@@ -1,81 +1,475 @@
 #include <libopencm3/cm3/nvic.h>
+#include <libopencm3/stm32/dma.h>
+#include <libopencm3/stm32/gpio.h>
 #include <libopencm3/stm32/rcc.h>
 #include <libopencm3/stm32/usart.h>
 
 #include "core/uart.h"
 #include "core/ring_buffer.h"
+#include "core/system.h"
 
 
-#define BAUD_RATE        (115200U)
 #define RING_BUFFER_SIZE (128U)
 
-static ring_buffer_t rb;
-static uint8_t data_buffer[RING_BUFFER_SIZE] = {0U};
+typedef enum {
+    UART_Instance_USART1,
+    UART_Instance_USART2,
+    UART_Instance_USART3,
+    UART_Instance_Count,
+} uart_instance_t;
+
+typedef struct {
+    uint32_t usart;
+    enum rcc_periph_clken clock;
+    uint8_t irq;
+    uint8_t dma_rx_channel;
+    uint8_t dma_rx_irq;
+    uint8_t dma_tx_channel;
+    uint8_t dma_tx_irq;
+    uint32_t flow_port;
+    uint16_t rts_pin;
+    uint16_t cts_pin;
+} uart_hw_t;
+
+/* DMA1 request mapping from RM0008 table 78; RTS/CTS share the TX/RX pin bank */
+static const uart_hw_t uart_hw[UART_Instance_Count] = {
+    { USART1, RCC_USART1, NVIC_USART1_IRQ, DMA_CHANNEL5, NVIC_DMA1_CHANNEL5_IRQ, DMA_CHANNEL4, NVIC_DMA1_CHANNEL4_IRQ, GPIOA, GPIO_USART1_RTS, GPIO_USART1_CTS },
+    { USART2, RCC_USART2, NVIC_USART2_IRQ, DMA_CHANNEL6, NVIC_DMA1_CHANNEL6_IRQ, DMA_CHANNEL7, NVIC_DMA1_CHANNEL7_IRQ, GPIOA, GPIO_USART2_RTS, GPIO_USART2_CTS },
+    { USART3, RCC_USART3, NVIC_USART3_IRQ, DMA_CHANNEL3, NVIC_DMA1_CHANNEL3_IRQ, DMA_CHANNEL2, NVIC_DMA1_CHANNEL2_IRQ, GPIOB, GPIO_USART3_RTS, GPIO_USART3_CTS },
+};
+
+static uart_t instances[UART_Instance_Count];
+static uint8_t default_rx_data[RING_BUFFER_SIZE] = {0U};
+static uart_t* default_uart = 0;
+static bool clock_listener_added = false;
+
+
+static void tx_dma_start(uart_t* uart) {
+    const uart_hw_t* hw = &uart_hw[uart->instance];
+    const uint32_t read_index = uart->tx_buffer.read_index;
+    const uint32_t write_index = uart->tx_buffer.write_index;
+
+    if (read_index == write_index) {
+        return;
+    }
+
+    // One contiguous run per transfer, the wrapped part follows on completion
+    const uint32_t length = (write_index > read_index) ?
+        (write_index - read_index) : (uart->tx_buffer.mask + 1U - read_index);
+
+    uart->tx_dma_length = length;
+    dma_set_memory_address(DMA1, hw->dma_tx_channel, (uint32_t) &uart->tx_buffer.buffer[read_index]);
+    dma_set_number_of_data(DMA1, hw->dma_tx_channel, (uint16_t) length);
+    dma_enable_channel(DMA1, hw->dma_tx_channel);
+}
+
+
+/* RTS is driven by software so it tracks the ring, not just the single-byte data register */
+static void rx_flow_update(uart_t* uart) {
+    if (!uart->flow_control) {
+        return;
+    }
+
+    const uart_hw_t* hw = &uart_hw[uart->instance];
+    const uint32_t size = uart->rx_buffer.mask + 1U;
+    const uint32_t level = (uart->rx_buffer.write_index - uart->rx_buffer.read_index) & uart->rx_buffer.mask;
+    // DMA fills are only seen every half ring, so the sender is stopped while another half still fits
+    const uint32_t stop_level = (uart->rx_mode == UART_RX_DMA) ? (size / 4U) : ((size * 3U) / 4U);
+    const uint32_t resume_level = (uart->rx_mode == UART_RX_DMA) ? (size / 8U) : (size / 4U);
+
+    if (level >= stop_level) {
+        gpio_set(hw->flow_port, hw->rts_pin);
+    }
+    else if (level <= resume_level) {
+        gpio_clear(hw->flow_port, hw->rts_pin);
+    }
+}
+
+
+static void uart_isr(uart_t* uart) {
+    const bool overrun_occured = (usart_get_flag(uart->usart, USART_FLAG_ORE) == 1);
+    const bool received_data = (usart_get_flag(uart->usart, USART_FLAG_RXNE) == 1);
+
+    if ((uart->rx_mode == UART_RX_Interrupt) && (received_data || overrun_occured)) {
+        // ORE means the data register was overwritten before we got here, a full ring drops the new byte
+        if ((ring_buffer_write(&uart->rx_buffer, (uint8_t) usart_recv(uart->usart)) == false) || overrun_occured) {
+            uart->rx_overrun = true;
+        }
+        rx_flow_update(uart);
+        if (uart->rx_callback) {
+            uart->rx_callback();
+        }
+    }
+
+    if ((uart->tx_mode == UART_TX_Interrupt) && (usart_get_flag(uart->usart, USART_FLAG_TXE) == 1)) {
+        uint8_t byte;
+        if (ring_buffer_read(&uart->tx_buffer, &byte)) {
+            usart_send(uart->usart, byte);
+        }
+        else {
+            usart_disable_tx_interrupt(uart->usart);
+        }
+    }
+}
+
+
+/* Called from the half/full transfer interrupts and before every read, so the DMA can't lap the reader unnoticed */
+static void rx_dma_sync(uart_t* uart) {
+    if (uart->rx_mode == UART_RX_DMA) {
+        const uint32_t remaining = dma_get_number_of_data(DMA1, uart_hw[uart->instance].dma_rx_channel);
+        const uint32_t position = (uart->rx_buffer.mask + 1U - remaining) & uart->rx_buffer.mask;
+        const uint32_t level = (uart->rx_buffer.write_index - uart->rx_buffer.read_index) & uart->rx_buffer.mask;
+        const uint32_t received = (position - uart->rx_buffer.write_index) & uart->rx_buffer.mask;
+
+        if ((level + received) > uart->rx_buffer.mask) {
+            // Unread bytes were overwritten, what is left in the ring is no longer in order: drop it
+            uart->rx_buffer.read_index = position;
+            uart->rx_overrun = true;
+        }
+        uart->rx_buffer.write_index = position;
+    }
+    rx_flow_update(uart);
+}
+
+
+static void uart_dma_rx_isr(uart_t* uart) {
+    const uart_hw_t* hw = &uart_hw[uart->instance];
+
+    dma_clear_interrupt_flags(DMA1, hw->dma_rx_channel, DMA_HTIF | DMA_TCIF);
+    rx_dma_sync(uart);
+}
+
+
+static void uart_dma_tx_isr(uart_t* uart) {
+    const uart_hw_t* hw = &uart_hw[uart->instance];
+
+    if (!dma_get_interrupt_flag(DMA1, hw->dma_tx_channel, DMA_TCIF)) {
+        return;
+    }
+    dma_clear_interrupt_flags(DMA1, hw->dma_tx_channel, DMA_TCIF);
+    dma_disable_channel(DMA1, hw->dma_tx_channel);
+
+    // Release the bytes only now, uart_send() may overwrite them from here on
+    uart->tx_buffer.read_index = (uart->tx_buffer.read_index + uart->tx_dma_length) & uart->tx_buffer.mask;
+    uart->tx_dma_length = 0;
+    tx_dma_start(uart);
+}
+
+void usart1_isr(void) {
+    uart_isr(&instances[UART_Instance_USART1]);
+}
 
 void usart2_isr(void) {
-    const bool overrun_occured = (usart_get_flag(USART2, USART_FLAG_ORE) == 1);
-    const bool received_data = (usart_get_flag(USART2, USART_FLAG_RXNE) == 1);
+    uart_isr(&instances[UART_Instance_USART2]);
+}
+
+void usart3_isr(void) {
+    uart_isr(&instances[UART_Instance_USART3]);
+}
+
+void dma1_channel4_isr(void) {
+    uart_dma_tx_isr(&instances[UART_Instance_USART1]);
+}
+
+void dma1_channel7_isr(void) {
+    uart_dma_tx_isr(&instances[UART_Instance_USART2]);
+}
 
-    if (received_data || overrun_occured) {
-        if(ring_buffer_write(&rb, (uint8_t) usart_recv(USART2)) == false)  {
-            // Handler
+void dma1_channel2_isr(void) {
+    uart_dma_tx_isr(&instances[UART_Instance_USART3]);
+}
+
+void dma1_channel5_isr(void) {
+    uart_dma_rx_isr(&instances[UART_Instance_USART1]);
+}
+
+void dma1_channel6_isr(void) {
+    uart_dma_rx_isr(&instances[UART_Instance_USART2]);
+}
+
+void dma1_channel3_isr(void) {
+    uart_dma_rx_isr(&instances[UART_Instance_USART3]);
+}
+
+
+static void dma_channel_setup(uint32_t usart, uint8_t channel, bool from_memory) {
+    dma_channel_reset(DMA1, channel);
+    dma_set_peripheral_address(DMA1, channel, (uint32_t) &USART_DR(usart));
+    dma_set_peripheral_size(DMA1, channel, DMA_CCR_PSIZE_8BIT);
+    dma_set_memory_size(DMA1, channel, DMA_CCR_MSIZE_8BIT);
+    dma_enable_memory_increment_mode(DMA1, channel);
+    dma_set_priority(DMA1, channel, DMA_CCR_PL_HIGH);
+
+    if (from_memory) {
+        dma_set_read_from_memory(DMA1, channel);
+    }
+    else {
+        dma_set_read_from_peripheral(DMA1, channel);
+    }
+}
+
+
+/* The divider comes from PCLK: queued bytes go out at the old rate, then every open instance is retimed */
+static void clock_changed(system_clock_event_t event) {
+    for (uint8_t i = 0; i < UART_Instance_Count; i++) {
+        uart_t* uart = &instances[i];
+        if (uart->usart == 0) {
+            continue;
+        }
+        if (event == System_Clock_Changing) {
+            uart_flush(uart);
+        }
+        else {
+            uart_set_baud_rate(uart, uart->baud_rate);
         }
     }
 }
 
 
-void uart_setup(void) {
-    ring_buffer_setup(&rb, data_buffer, RING_BUFFER_SIZE);
-    rcc_periph_clock_enable(RCC_USART2);
+static bool ring_storage_valid(const uint8_t* data, uint32_t size) {
+    // The rings index with size - 1 as a mask
+    return (data != 0) && (size >= 2U) && ((size & (size - 1U)) == 0U);
+}
 
-    usart_set_flow_control(USART2, USART_FLOWCONTROL_NONE);
-    usart_set_baudrate(USART2, BAUD_RATE);
-    usart_set_databits(USART2, 8);
-    usart_set_parity(USART2, USART_PARITY_NONE);
-    usart_set_stopbits(USART2, USART_STOPBITS_1);
-    usart_set_mode(USART2, USART_MODE_TX_RX);
 
-    usart_enable_rx_interrupt(USART2);
-    nvic_enable_irq(NVIC_USART2_IRQ);
+uart_t* uart_open(const uart_config_t* config) {
+    uint8_t instance;
 
-    usart_enable(USART2);
+    if (!ring_storage_valid(config->rx_data, config->rx_size) ||
+        ((config->rx_mode == UART_RX_DMA) && (config->rx_size > 0xFFFFU)) ||
+        ((config->tx_mode != UART_TX_Blocking) && !ring_storage_valid(config->tx_data, config->tx_size)))
+    {
+        return 0;
+    }
+
+    for (instance = 0; instance < UART_Instance_Count; instance++) {
+        if (uart_hw[instance].usart == config->usart) {
+            break;
+        }
+    }
+    if (instance == UART_Instance_Count) {
+        return 0;
+    }
+
+    const uart_hw_t* hw = &uart_hw[instance];
+    uart_t* uart = &instances[instance];
+    uart->usart = config->usart;
+    uart->instance = instance;
+    uart->baud_rate = config->baud_rate;
+    uart->rx_mode = config->rx_mode;
+    uart->tx_mode = config->tx_mode;
+    uart->flow_control = config->flow_control;
+    uart->rx_callback = config->rx_callback;
+    uart->tx_dma_length = 0;
+    uart->rx_overrun = false;
+    ring_buffer_setup(&uart->rx_buffer, config->rx_data, config->rx_size);
+    if (config->tx_mode == UART_TX_Blocking) {
+        // Never queued into; mask 0 keeps it both empty and full
+        uart->tx_buffer = (ring_buffer_t) {0};
+    }
+    else {
+        ring_buffer_setup(&uart->tx_buffer, config->tx_data, config->tx_size);
+    }
+    if (!clock_listener_added) {
+        clock_listener_added = system_on_clock_change(clock_changed);
+    }
+
+    rcc_periph_clock_enable(hw->clock);
+    if (config->flow_control) {
+        // Asserted (low) while the ring has room, the CTS input stalls our TX in hardware
+        gpio_set_mode(hw->flow_port, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_PUSHPULL, hw->rts_pin);
+        gpio_set_mode(hw->flow_port, GPIO_MODE_INPUT, GPIO_CNF_INPUT_FLOAT, hw->cts_pin);
+        gpio_clear(hw->flow_port, hw->rts_pin);
+        usart_set_flow_control(config->usart, USART_FLOWCONTROL_CTS);
+    }
+    else {
+        usart_set_flow_control(config->usart, USART_FLOWCONTROL_NONE);
+    }
+    usart_set_baudrate(config->usart, config->baud_rate);
+    usart_set_databits(config->usart, 8);
+    usart_set_parity(config->usart, USART_PARITY_NONE);
+    usart_set_stopbits(config->usart, USART_STOPBITS_1);
+    usart_set_mode(config->usart, USART_MODE_TX_RX);
+
+    if ((config->rx_mode == UART_RX_DMA) || (config->tx_mode == UART_TX_DMA)) {
+        rcc_periph_clock_enable(RCC_DMA1);
+    }
+
+    if (config->rx_mode == UART_RX_DMA) {
+        // The ring is the DMA target, uart_available() derives the write index from CNDTR
+        dma_channel_setup(config->usart, hw->dma_rx_channel, false);
+        dma_set_memory_address(DMA1, hw->dma_rx_channel, (uint32_t) config->rx_data);
+        dma_set_number_of_data(DMA1, hw->dma_rx_channel, (uint16_t) config->rx_size);
+        dma_enable_circular_mode(DMA1, hw->dma_rx_channel);
+        dma_enable_half_transfer_interrupt(DMA1, hw->dma_rx_channel);
+        dma_enable_transfer_complete_interrupt(DMA1, hw->dma_rx_channel);
+        nvic_enable_irq(hw->dma_rx_irq);
+        dma_enable_channel(DMA1, hw->dma_rx_channel);
+        usart_enable_rx_dma(config->usart);
+    }
+    else {
+        usart_enable_rx_interrupt(config->usart);
+    }
+
+    if (config->tx_mode == UART_TX_DMA) {
+        dma_channel_setup(config->usart, hw->dma_tx_channel, true);
+        dma_enable_transfer_complete_interrupt(DMA1, hw->dma_tx_channel);
+        nvic_enable_irq(hw->dma_tx_irq);
+        usart_enable_tx_dma(config->usart);
+    }
+
+    nvic_enable_irq(hw->irq);
+    usart_enable(config->usart);
+    return uart;
 }
 
 
-void uart_write(uint8_t *data, uint32_t length) {
-    for(uint32_t i=0; i<length; i++) {
-        uart_write_byte(data[i]);
+void uart_set_baud_rate(uart_t* uart, uint32_t baud_rate) {
+    uart_flush(uart);
+    uart->baud_rate = baud_rate;
+    usart_disable(uart->usart);
+    usart_set_baudrate(uart->usart, baud_rate);
+    usart_enable(uart->usart);
+}
+
+
+static void tx_kick(uart_t* uart) {
+    if (uart->tx_mode == UART_TX_Interrupt) {
+        usart_enable_tx_interrupt(uart->usart);
+        return;
+    }
+
+    // The completion interrupt restarts the channel, only kick an idle one
+    const uint8_t dma_tx_irq = uart_hw[uart->instance].dma_tx_irq;
+    nvic_disable_irq(dma_tx_irq);
+    if (uart->tx_dma_length == 0) {
+        tx_dma_start(uart);
     }
+    nvic_enable_irq(dma_tx_irq);
 }
 
 
-void uart_write_byte(uint8_t data) {
-    usart_send_blocking(USART2, (uint16_t) data);
+void uart_send(uart_t* uart, const uint8_t* data, uint32_t length) {
+    if (uart->tx_mode == UART_TX_Blocking) {
+        for (uint32_t i = 0; i < length; i++) {
+            usart_send_blocking(uart->usart, (uint16_t) data[i]);
+        }
+        return;
+    }
+
+    for (uint32_t i = 0; i < length; i++) {
+        // Queue full: wait for the interrupt or DMA to make room
+        while (!ring_buffer_write(&uart->tx_buffer, data[i])) {
+            tx_kick(uart);
+        }
+    }
+    tx_kick(uart);
 }
 
 
+void uart_flush(uart_t* uart) {
+    if (uart->tx_mode != UART_TX_Blocking) {
+        while (!ring_buffer_empty(&uart->tx_buffer));
+    }
+    while (usart_get_flag(uart->usart, USART_FLAG_TC) == 0);
+}
 
-uint32_t uart_read(uint8_t *data, uint32_t length) {
+
+/* The DMA interrupts move the ring's indices too, keep them out while this side does */
+static void rx_lock(uart_t* uart) {
+    if (uart->rx_mode == UART_RX_DMA) {
+        nvic_disable_irq(uart_hw[uart->instance].dma_rx_irq);
+    }
+}
+
+static void rx_unlock(uart_t* uart) {
+    if (uart->rx_mode == UART_RX_DMA) {
+        nvic_enable_irq(uart_hw[uart->instance].dma_rx_irq);
+    }
+}
+
+
+uint32_t uart_recv(uart_t* uart, uint8_t* data, uint32_t length) {
     uint32_t bytes_read = 0;
 
+    rx_lock(uart);
+    rx_dma_sync(uart);
     for (bytes_read=0; bytes_read < length; bytes_read++) {
-        if(!ring_buffer_read(&rb, &data[bytes_read])) {
-            return bytes_read;
+        if(!ring_buffer_read(&uart->rx_buffer, &data[bytes_read])) {
+            break;
         }
     }
 
+    rx_flow_update(uart);
+    rx_unlock(uart);
     return bytes_read;
 }
 
 
-uint8_t uart_read_byte(void) {
+uint8_t uart_recv_byte(uart_t* uart) {
     uint8_t byte;
-    (void) uart_read(&byte, 1);
+    (void) uart_recv(uart, &byte, 1);
     return byte;
 }
 
 
+bool uart_available(uart_t* uart) {
+    rx_lock(uart);
+    rx_dma_sync(uart);
+    const bool available = !ring_buffer_empty(&uart->rx_buffer);
+    rx_unlock(uart);
+    return available;
+}
+
+
+bool uart_rx_overrun(uart_t* uart) {
+    rx_lock(uart);
+    const bool overrun = uart->rx_overrun;
+    uart->rx_overrun = false;
+    rx_unlock(uart);
+    return overrun;
+}
+
+
+void uart_setup(bool flow_control, uint32_t baud_rate) {
+    const uart_config_t config = {
+        .usart = USART2,
+        .baud_rate = baud_rate,
+        .rx_mode = UART_RX_Interrupt,
+        .tx_mode = UART_TX_Blocking,
+        .rx_data = default_rx_data,
+        .rx_size = RING_BUFFER_SIZE,
+        .flow_control = flow_control,
+    };
+    default_uart = uart_open(&config);
+}
+
+
+void uart_write(uint8_t *data, uint32_t length) {
+    uart_send(default_uart, data, length);
+}
+
+
+void uart_write_byte(uint8_t data) {
+    uart_send(default_uart, &data, 1);
+}
+
+
+uint32_t uart_read(uint8_t *data, uint32_t length) {
+    return uart_recv(default_uart, data, length);
+}
+
+
+uint8_t uart_read_byte(void) {
+    return uart_recv_byte(default_uart);
+}
+
+
 bool uart_data_available(void) {
-    return !ring_buffer_empty(&rb);
+    return uart_available(default_uart);
 }
 
+
+void uart_set_rx_callback(void (*callback)(void)) {
+    default_uart->rx_callback = callback;
+}